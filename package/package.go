@@ -42,8 +42,22 @@ func GetPackage() *denv.Package {
 	maintest.AddDependencies(cunittestpkg.GetTestLib())
 	maintest.AddDependency(testlib)
 
+	// benchmark application (source/bench/cpp)
+	benchapp := denv.SetupCppAppProject(mainpkg, name+"_bench", "bench")
+	benchapp.AddDependencies(cbasepkg.GetMainLib())
+	benchapp.AddDependencies(cfilepkg.GetMainLib())
+	benchapp.AddDependency(mainlib)
+
+	// layout tool (source/layout/cpp), orders an archive by recorded access logs
+	layoutapp := denv.SetupCppAppProject(mainpkg, name+"_layout", "layout")
+	layoutapp.AddDependencies(cbasepkg.GetMainLib())
+	layoutapp.AddDependencies(cfilepkg.GetMainLib())
+	layoutapp.AddDependency(mainlib)
+
 	mainpkg.AddMainLib(mainlib)
 	mainpkg.AddTestLib(testlib)
 	mainpkg.AddUnittest(maintest)
+	mainpkg.AddMainApp(benchapp)
+	mainpkg.AddMainApp(layoutapp)
 	return mainpkg
 }
@@ -0,0 +1,372 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_archive.h"
+#include "charon/c_gamedata.h"
+#include "charon/c_lz.h"
+
+#include "bench_bigfile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nbench
+        {
+            // ------------------------------------------------------------------------------------------------
+            // ------- Bigfile writer -------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            // The .gda is streamed to disk, only the per file offset, size and hash are kept in memory.
+            //
+            // Every table file (.toc/.fdb/.hdb) has a single section that is used for any archive index:
+            //   u32:       NumSections (1)
+            //   section_t: {ArchiveIndex, ArchiveOffset, ItemArrayCount, ItemArrayOffset (relative to the section)}
+            //   u32:       Padding, so that the item array is 8 byte aligned
+            //   Items
+            static const u32 s_section_offset = sizeof(u32);
+            static const u32 s_items_offset   = 24;
+
+            struct writer_t
+            {
+                alloc_t* mAllocator;
+                FILE*    mGda;
+                u64      mGdaSize;
+                u32      mNumFiles;
+                u32      mCount;
+                u32*     mOffsets;  // File offset / 64, bit 31 set when compressed
+                u32*     mSizes;
+                u64*     mHashes;
+                bool     mFailed;
+            };
+
+            static bool s_open(writer_t& w, alloc_t* allocator, const char* path, u32 numFiles)
+            {
+                char filename[512];
+                snprintf(filename, sizeof(filename), "%s.gda", path);
+                w.mAllocator = allocator;
+                w.mGda       = fopen(filename, "wb");
+                w.mGdaSize   = 0;
+                w.mNumFiles  = numFiles;
+                w.mCount     = 0;
+                w.mOffsets   = g_allocate_array_and_clear<u32>(allocator, numFiles);
+                w.mSizes     = g_allocate_array_and_clear<u32>(allocator, numFiles);
+                w.mHashes    = g_allocate_array_and_clear<u64>(allocator, numFiles);
+                w.mFailed    = w.mGda == nullptr;
+                return !w.mFailed;
+            }
+
+            // FNV-1a over the filename, the HDB holds one 64-bit hash per file
+            static u64 s_hash_name(const char* name)
+            {
+                u64 h = 0xCBF29CE484222325ull;
+                while (*name != 0)
+                {
+                    h ^= (u8)*name++;
+                    h *= 0x100000001B3ull;
+                }
+                return h;
+            }
+
+            static void s_name(char* name, u32 size, u32 archiveIndex, u32 index) { snprintf(name, size, "bench/%u/file_%06u.bin", archiveIndex, index); }
+
+            static void s_add(writer_t& w, byte const* data, u32 size, bool compressed, u64 hash)
+            {
+                static byte const s_zero[64] = {0};
+                u32 const         padding    = (u32)((64 - (w.mGdaSize & 63)) & 63);
+                if (padding > 0 && fwrite(s_zero, 1, padding, w.mGda) != padding)
+                    w.mFailed = true;
+                w.mGdaSize += padding;
+
+                w.mOffsets[w.mCount] = (u32)(w.mGdaSize >> 6) | (compressed ? 0x80000000 : 0);
+                w.mSizes[w.mCount]   = size;
+                w.mHashes[w.mCount]  = hash;
+                w.mCount += 1;
+
+                if (size > 0 && fwrite(data, 1, size, w.mGda) != size)
+                    w.mFailed = true;
+                w.mGdaSize += size;
+            }
+
+            static void s_put(FILE* f, void const* data, u32 size, bool& failed)
+            {
+                if (size > 0 && fwrite(data, 1, size, f) != size)
+                    failed = true;
+            }
+
+            static void s_put_header(FILE* f, u32 archiveIndex, u32 count, bool& failed)
+            {
+                u32 const header[6] = {1, archiveIndex, 0, count, s_items_offset - s_section_offset, 0};
+                s_put(f, header, sizeof(header), failed);
+            }
+
+            static s64 s_close(writer_t& w, const char* path, u32 archiveIndex)
+            {
+                char filename[512];
+                if (w.mGda != nullptr)
+                    fclose(w.mGda);
+
+                // TOC
+                snprintf(filename, sizeof(filename), "%s.toc", path);
+                FILE* f = fopen(filename, "wb");
+                if (f != nullptr)
+                {
+                    s_put_header(f, archiveIndex, w.mCount, w.mFailed);
+                    for (u32 i = 0; i < w.mCount; ++i)
+                    {
+                        u32 const item[2] = {w.mOffsets[i], w.mSizes[i]};
+                        s_put(f, item, sizeof(item), w.mFailed);
+                    }
+                    fclose(f);
+                }
+                else
+                {
+                    w.mFailed = true;
+                }
+
+                // FDB, the offset array is followed by {u32 bytes, u32 chars, char[] with terminator} entries
+                snprintf(filename, sizeof(filename), "%s.fdb", path);
+                f = fopen(filename, "wb");
+                if (f != nullptr)
+                {
+                    char name[128];
+                    s_put_header(f, archiveIndex, w.mCount, w.mFailed);
+                    u32 offset = s_items_offset + w.mCount * sizeof(u32);
+                    for (u32 i = 0; i < w.mCount; ++i)
+                    {
+                        s_name(name, sizeof(name), archiveIndex, i);
+                        u32 const length = (u32)strlen(name);
+                        s_put(f, &offset, sizeof(offset), w.mFailed);
+                        offset += (2 * sizeof(u32) + length + 1 + 3) & ~3;
+                    }
+                    for (u32 i = 0; i < w.mCount; ++i)
+                    {
+                        s_name(name, sizeof(name), archiveIndex, i);
+                        u32 const length  = (u32)strlen(name);
+                        u32 const entry   = (2 * sizeof(u32) + length + 1 + 3) & ~3;
+                        u32 const head[2] = {length, length};
+                        s_put(f, head, sizeof(head), w.mFailed);
+                        nmem::memset(name + length, 0, sizeof(name) - length);
+                        s_put(f, name, entry - sizeof(head), w.mFailed);
+                    }
+                    fclose(f);
+                }
+                else
+                {
+                    w.mFailed = true;
+                }
+
+                // HDB
+                snprintf(filename, sizeof(filename), "%s.hdb", path);
+                f = fopen(filename, "wb");
+                if (f != nullptr)
+                {
+                    s_put_header(f, archiveIndex, w.mCount, w.mFailed);
+                    s_put(f, w.mHashes, w.mCount * sizeof(u64), w.mFailed);
+                    fclose(f);
+                }
+                else
+                {
+                    w.mFailed = true;
+                }
+
+                g_deallocate(w.mAllocator, w.mOffsets);
+                g_deallocate(w.mAllocator, w.mSizes);
+                g_deallocate(w.mAllocator, w.mHashes);
+                return w.mFailed ? -1 : (s64)w.mGdaSize;
+            }
+
+            // Content with a small alphabet and runs, it compresses roughly like typical asset data
+            static void s_fill(byte* data, u32 size, random_t& random)
+            {
+                u32 i = 0;
+                while (i < size)
+                {
+                    u64 const r   = random.next();
+                    u32 const run = 1 + (u32)(r & 15);
+                    byte const b  = (byte)((r >> 8) & 0x1F);
+                    for (u32 j = 0; j < run && i < size; ++j)
+                        data[i++] = b;
+                }
+            }
+
+            static u32 s_size(datafiles_t const& desc, random_t& random)
+            {
+                u32 const minSize = desc.mMinSize > 0 ? desc.mMinSize : 1;
+                u32 const maxSize = desc.mMaxSize > minSize ? desc.mMaxSize : minSize;
+                if (desc.mDistribution == DistributionUniform)
+                    return minSize + random.range(maxSize - minSize + 1);
+
+                // Log-uniform, pick a power of two band first and then a size within the band
+                u32 bands = 0;
+                while ((minSize << bands) < maxSize && bands < 31)
+                    bands += 1;
+                u32 const band = random.range(bands + 1);
+                u64 lo         = (u64)minSize << band;
+                u64 hi         = lo * 2;
+                lo             = lo < maxSize ? lo : maxSize;
+                hi             = hi < maxSize ? hi : maxSize;
+                return (u32)(lo + (hi > lo ? random.range((u32)(hi - lo)) : 0));
+            }
+
+            u64 file_hash(u32 archiveIndex, u32 fileIndex)
+            {
+                char name[128];
+                s_name(name, sizeof(name), archiveIndex, fileIndex);
+                return s_hash_name(name);
+            }
+
+            s64 write_datafiles(alloc_t* allocator, const char* path, datafiles_t const& desc)
+            {
+                writer_t w;
+                if (!s_open(w, allocator, path, desc.mNumFiles))
+                    return s_close(w, path, desc.mArchiveIndex);
+
+                random_t  random(desc.mSeed);
+                u32 const maxSize    = desc.mMaxSize > desc.mMinSize ? desc.mMaxSize : desc.mMinSize;
+                byte*     data       = g_allocate_array<byte>(allocator, maxSize > 0 ? maxSize : 1);
+                u32 const bound      = nlz::compress_file_bound(maxSize);
+                byte*     compressed = desc.mCompressedPercent > 0 ? g_allocate_array<byte>(allocator, bound) : nullptr;
+                char      name[128];
+                for (u32 i = 0; i < desc.mNumFiles && !w.mFailed; ++i)
+                {
+                    u32 const size = s_size(desc, random);
+                    s_fill(data, size, random);
+                    s_name(name, sizeof(name), desc.mArchiveIndex, i);
+                    if (compressed != nullptr && random.range(100) < desc.mCompressedPercent)
+                    {
+                        s32 const n = nlz::compress_file(data, size, compressed, bound);
+                        s_add(w, compressed, (u32)n, true, s_hash_name(name));
+                    }
+                    else
+                    {
+                        s_add(w, data, size, false, s_hash_name(name));
+                    }
+                }
+                g_deallocate(allocator, compressed);
+                g_deallocate(allocator, data);
+                return s_close(w, path, desc.mArchiveIndex);
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Dataunits ------------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            // header | numPointers x {pointer record, 8 bytes payload} | numPointers x u32 targets | patch table
+            // Records point at random targets, so the patched pointers are scattered like in real data.
+            void* build_dataunit(alloc_t* allocator, u32 numPointers, bool flat, random_t& random, u32& size)
+            {
+                u32 const recordsOffset = sizeof(dataunit_header_t);
+                u32 const targetsOffset = recordsOffset + numPointers * 16;
+                u32 const tableOffset   = targetsOffset + numPointers * sizeof(u32);
+                u32 const tableSize     = flat ? numPointers * sizeof(u32) : sizeof(s32);
+                size                    = tableOffset + tableSize;
+                byte* data              = (byte*)g_allocate_array_and_clear<u64>(allocator, (size + 7) / 8);
+
+                dataunit_header_t* header = (dataunit_header_t*)data;
+                header->m_patch_offset    = tableOffset;
+                header->m_patch_count     = (s32)numPointers;
+                header->m_flags           = flat ? dataunit_header_t::FlagFlatPatchTable : 0;
+
+                u32* table = (u32*)(data + tableOffset);
+                for (u32 i = 0; i < numPointers; ++i)
+                {
+                    u32 const record = recordsOffset + i * 16;
+                    u32 const target = targetsOffset + random.range(numPointers) * sizeof(u32);
+                    s32       fields[2];
+                    fields[0] = (i + 1) < numPointers ? 16 : 0;
+                    fields[1] = (s32)target - (s32)record;
+                    nmem::memcpy(data + record, fields, sizeof(fields));
+                    if (flat)
+                        table[i] = record;
+                }
+                if (!flat)
+                    table[0] = numPointers > 0 ? recordsOffset : 0;
+                return data;
+            }
+
+            s64 write_dataunits(alloc_t* allocator, const char* path, dataunits_t const& desc)
+            {
+                writer_t w;
+                if (!s_open(w, allocator, path, desc.mNumUnits))
+                    return s_close(w, path, 0);
+
+                random_t random(desc.mSeed);
+                char     name[128];
+                for (u32 i = 0; i < desc.mNumUnits && !w.mFailed; ++i)
+                {
+                    u32         size = 0;
+                    bool const  flat = random.range(100) < desc.mFlatPercent;
+                    void* const unit = build_dataunit(allocator, desc.mNumPointers, flat, random, size);
+                    s_name(name, sizeof(name), 0, i);
+                    s_add(w, (byte const*)unit, size, false, s_hash_name(name));
+                    g_deallocate(allocator, unit);
+                }
+                return s_close(w, path, 0);
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Packed archive writer ------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            // Append a file at the next aligned offset of the pack, a missing file is an empty region
+            static void s_append(FILE* pack, const char* filename, archive_t::packheader_t::region_t& region, byte* buffer, u32 bufferSize, bool& failed)
+            {
+                static byte const s_zero[archive_t::packheader_t::Alignment] = {0};
+
+                u64 const end     = (u64)ftell(pack);
+                u64 const aligned = (end + archive_t::packheader_t::Alignment - 1) & ~(u64)(archive_t::packheader_t::Alignment - 1);
+                s_put(pack, s_zero, (u32)(aligned - end), failed);
+                region.mOffset = aligned;
+                region.mSize   = 0;
+
+                FILE* f = fopen(filename, "rb");
+                if (f == nullptr)
+                    return;
+                size_t n;
+                while ((n = fread(buffer, 1, bufferSize, f)) > 0)
+                {
+                    s_put(pack, buffer, (u32)n, failed);
+                    region.mSize += n;
+                }
+                fclose(f);
+            }
+
+            s64 write_pack(alloc_t* allocator, const char* path)
+            {
+                char filename[512];
+                snprintf(filename, sizeof(filename), "%s.gpk", path);
+                FILE* pack = fopen(filename, "wb");
+                if (pack == nullptr)
+                    return -1;
+
+                archive_t::packheader_t header;
+                nmem::memset(&header, 0, sizeof(header));
+                header.mMagic   = archive_t::packheader_t::Magic;
+                header.mVersion = archive_t::packheader_t::Version;
+
+                bool                               failed     = false;
+                u32 const                          bufferSize = 1 << 20;
+                byte*                              buffer     = g_allocate_array<byte>(allocator, bufferSize);
+                const char* const                  suffixes[] = {"gda", "toc", "fdb", "hdb"};
+                archive_t::packheader_t::region_t* regions[]  = {&header.mData, &header.mToc, &header.mFdb, &header.mHdb};
+                s_put(pack, &header, sizeof(header), failed);
+                for (s32 i = 0; i < 4; ++i)
+                {
+                    snprintf(filename, sizeof(filename), "%s.%s", path, suffixes[i]);
+                    s_append(pack, filename, *regions[i], buffer, bufferSize, failed);
+                }
+                g_deallocate(allocator, buffer);
+
+                u64 const size = (u64)ftell(pack);
+                if (fseek(pack, 0, SEEK_SET) != 0)
+                    failed = true;
+                s_put(pack, &header, sizeof(header), failed);
+                fclose(pack);
+                return failed || header.mToc.mSize == 0 ? -1 : (s64)size;
+            }
+
+        }  // namespace nbench
+    }  // namespace charon
+}  // namespace ncore
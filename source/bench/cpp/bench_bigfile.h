@@ -0,0 +1,79 @@
+#ifndef __CHARON_BENCH_BIGFILE_H__
+#define __CHARON_BENCH_BIGFILE_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace charon
+    {
+        namespace nbench
+        {
+            // Deterministic pseudo random numbers, so that runs are comparable
+            struct random_t
+            {
+                inline random_t(u64 seed)
+                    : mState(seed != 0 ? seed : 0x9E3779B97F4A7C15ull)
+                {
+                }
+                inline u64 next()
+                {
+                    mState ^= mState << 13;
+                    mState ^= mState >> 7;
+                    mState ^= mState << 17;
+                    return mState;
+                }
+                inline u32 range(u32 count) { return (u32)(next() % count); }
+
+                u64 mState;
+            };
+
+            enum EDistribution
+            {
+                DistributionUniform = 0,  // Sizes uniform between min and max
+                DistributionLog     = 1,  // Sizes log-uniform between min and max, many small and few large files
+            };
+
+            struct datafiles_t
+            {
+                u32           mNumFiles;
+                u32           mMinSize;
+                u32           mMaxSize;
+                EDistribution mDistribution;
+                u32           mCompressedPercent;  // Share of the files that are stored compressed
+                u32           mArchiveIndex;
+                u64           mSeed;
+            };
+
+            struct dataunits_t
+            {
+                u32 mNumUnits;
+                u32 mNumPointers;  // Pointers per dataunit
+                u32 mFlatPercent;  // Share of the units that have a flat patch table, the others have a chain
+                u64 mSeed;
+            };
+
+            // Write <path>.gda/.toc/.fdb/.hdb in the layout that archive_t::mount reads, returns the number of
+            // bytes in the .gda or -1 when a file could not be written. Dataunits always go in archive 0.
+            s64 write_datafiles(alloc_t* allocator, const char* path, datafiles_t const& desc);
+            s64 write_dataunits(alloc_t* allocator, const char* path, dataunits_t const& desc);
+
+            // Pack the <path>.gda/.toc/.fdb/.hdb written above into <path>.gpk (see archive_t::packheader_t),
+            // returns the size of the pack or -1 when it could not be written
+            s64 write_pack(alloc_t* allocator, const char* path);
+
+            // The HDB hash of a file written by write_datafiles
+            u64 file_hash(u32 archiveIndex, u32 fileIndex);
+
+            // A dataunit of numPointers pointer records in memory, for timing g_patch without I/O
+            void* build_dataunit(alloc_t* allocator, u32 numPointers, bool flat, random_t& random, u32& size);
+
+        }  // namespace nbench
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_BENCH_BIGFILE_H__
@@ -0,0 +1,555 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_base.h"
+#include "cbase/c_context.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_archive.h"
+#include "charon/c_gamedata.h"
+#include "charon/c_jobs.h"
+#include "charon/c_platform.h"
+
+#include "bench_bigfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Measures the archive load path on synthesized bigfiles:
+//   charon_bench [entries=N] [minsize=N] [maxsize=N] [dist=log|uniform] [compressed=PERCENT]
+//                [units=N] [pointers=N] [flat=PERCENT] [threads=N] [batch=N] [seed=N] [dir=PATH]
+//
+// 'cold' means the data is not resident in the loader, the OS file cache is warm since the files were
+// just written. Drop the OS cache between generating and running for truly cold numbers.
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nbench
+        {
+            // Counts live and peak bytes, so that the memory overhead of the loader can be reported
+            class trackalloc_t : public alloc_t
+            {
+            public:
+                trackalloc_t(alloc_t* allocator)
+                    : mAllocator(allocator)
+                    , mLive(0)
+                    , mPeak(0)
+                {
+                }
+
+                void reset_peak() { mPeak = mLive; }
+                u64  live() const { return (u64)nplatform::atomic_load(&mLive); }
+                u64  peak() const { return (u64)nplatform::atomic_load(&mPeak); }
+
+            protected:
+                virtual void* v_allocate(u32 size, u32 alignment)
+                {
+                    u32 const header = alignment > 16 ? alignment : 16;
+                    byte*     mem    = (byte*)mAllocator->allocate(size + header, header);
+                    *(u32*)mem       = size;
+                    *(u32*)(mem + 4) = header;
+                    s32 const live   = nplatform::atomic_add(&mLive, (s32)size);
+                    s32       peak   = nplatform::atomic_load(&mPeak);
+                    while (live > peak && !nplatform::atomic_cas(&mPeak, peak, live))
+                        peak = nplatform::atomic_load(&mPeak);
+                    return mem + header;
+                }
+
+                virtual void v_deallocate(void* ptr)
+                {
+                    if (ptr == nullptr)
+                        return;
+                    byte* mem = (byte*)ptr - 16;
+                    if (*(u32*)(mem + 4) != 16)
+                        mem = (byte*)ptr - *(u32*)(mem + 4);  // A larger alignment header, the size sits at its start
+                    nplatform::atomic_add(&mLive, -(s32) * (u32*)mem);
+                    mAllocator->deallocate(mem);
+                }
+
+                alloc_t*     mAllocator;
+                s32 volatile mLive;  // Bytes, the benchmark stays well below 2GB of loader memory
+                s32 volatile mPeak;
+            };
+
+            struct options_t
+            {
+                datafiles_t mFiles;
+                dataunits_t mUnits;
+                u32         mThreads;
+                u32         mBatch;
+                const char* mDir;
+            };
+
+            static void s_parse(options_t& o, int argc, char** argv)
+            {
+                o.mFiles.mNumFiles          = 4096;
+                o.mFiles.mMinSize           = 256;
+                o.mFiles.mMaxSize           = 256 * 1024;
+                o.mFiles.mDistribution      = DistributionLog;
+                o.mFiles.mCompressedPercent = 0;
+                o.mFiles.mArchiveIndex      = 1;
+                o.mFiles.mSeed              = 1;
+                o.mUnits.mNumUnits          = 8;
+                o.mUnits.mNumPointers       = 100000;
+                o.mUnits.mFlatPercent       = 50;
+                o.mUnits.mSeed              = 2;
+                o.mThreads                  = 4;
+                o.mBatch                    = 64;
+                o.mDir                      = ".";
+
+                for (int i = 1; i < argc; ++i)
+                {
+                    const char* arg   = argv[i];
+                    const char* value = strchr(arg, '=');
+                    if (value == nullptr)
+                    {
+                        printf("ignoring argument '%s', expected key=value\n", arg);
+                        continue;
+                    }
+                    value += 1;
+                    u32 const number = (u32)strtoul(value, nullptr, 10);
+                    if (strncmp(arg, "entries=", 8) == 0)
+                        o.mFiles.mNumFiles = number;
+                    else if (strncmp(arg, "minsize=", 8) == 0)
+                        o.mFiles.mMinSize = number;
+                    else if (strncmp(arg, "maxsize=", 8) == 0)
+                        o.mFiles.mMaxSize = number;
+                    else if (strncmp(arg, "dist=", 5) == 0)
+                        o.mFiles.mDistribution = strcmp(value, "uniform") == 0 ? DistributionUniform : DistributionLog;
+                    else if (strncmp(arg, "compressed=", 11) == 0)
+                        o.mFiles.mCompressedPercent = number;
+                    else if (strncmp(arg, "units=", 6) == 0)
+                        o.mUnits.mNumUnits = number;
+                    else if (strncmp(arg, "pointers=", 9) == 0)
+                        o.mUnits.mNumPointers = number;
+                    else if (strncmp(arg, "flat=", 5) == 0)
+                        o.mUnits.mFlatPercent = number;
+                    else if (strncmp(arg, "threads=", 8) == 0)
+                        o.mThreads = number;
+                    else if (strncmp(arg, "batch=", 6) == 0)
+                        o.mBatch = number > 0 ? number : 1;
+                    else if (strncmp(arg, "seed=", 5) == 0)
+                        o.mFiles.mSeed = o.mUnits.mSeed = number;
+                    else if (strncmp(arg, "dir=", 4) == 0)
+                        o.mDir = value;
+                    else
+                        printf("ignoring unknown argument '%s'\n", arg);
+                }
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Reporting ------------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            static const char* s_backend_name(archive_t::EBackend backend) { return backend == archive_t::BackendMemoryMapped ? "mapped" : "read"; }
+
+            static void s_report_ops(const char* group, const char* name, u64 ops, u64 ns)
+            {
+                double const perOp = ops > 0 ? (double)ns / (double)ops : 0.0;
+                printf("  %-7s %-22s %10llu ops  %12.1f ns/op\n", group, name, (unsigned long long)ops, perOp);
+            }
+
+            static void s_report_io(const char* group, const char* name, u64 files, u64 bytes, u64 ns)
+            {
+                double const seconds = (double)ns / 1e9;
+                double const mbps    = seconds > 0.0 ? ((double)bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+                double const perFile = files > 0 ? ((double)ns / 1000.0) / (double)files : 0.0;
+                printf("  %-7s %-22s %10llu files %9.1f MB/s %9.2f us/file\n", group, name, (unsigned long long)files, mbps, perFile);
+            }
+
+            // Mean and longest interval of every phase that the loader timed
+            static void s_report_phases(const char* group, telemetry_t::stats_t const& stats)
+            {
+                static const char* const names[telemetry_t::PhaseCount] = {"phase queue", "phase io", "phase decompress", "phase patch"};
+                for (s32 i = 0; i < telemetry_t::PhaseCount; ++i)
+                {
+                    if (stats.mPhaseCount[i] == 0)
+                        continue;
+                    double const mean = (double)stats.mPhaseNs[i] / (double)stats.mPhaseCount[i];
+                    printf("  %-7s %-22s %10llu ops  %12.1f ns/op %9.2f us max\n", group, names[i], (unsigned long long)stats.mPhaseCount[i], mean, (double)stats.mPhaseMaxNs[i] / 1000.0);
+                }
+            }
+
+            static void s_report_memory(const char* group, const char* name, u64 bytes)
+            {
+                printf("  %-7s %-22s %10.1f KB\n", group, name, (double)bytes / 1024.0);
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Datafiles ------------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            struct bigfile_t
+            {
+                char mGda[512];
+                char mToc[512];
+                char mFdb[512];
+                char mHdb[512];
+                char mPack[512];
+
+                void init(const char* path)
+                {
+                    snprintf(mPack, sizeof(mPack), "%s.gpk", path);
+                    snprintf(mGda, sizeof(mGda), "%s.gda", path);
+                    snprintf(mToc, sizeof(mToc), "%s.toc", path);
+                    snprintf(mFdb, sizeof(mFdb), "%s.fdb", path);
+                    snprintf(mHdb, sizeof(mHdb), "%s.hdb", path);
+                }
+            };
+
+            static u64 volatile s_sink = 0;  // Keeps measured loops from being optimized away
+
+            static void s_shuffle(fileid_t* ids, u32 count, random_t& random)
+            {
+                for (u32 i = count; i > 1; --i)
+                {
+                    u32 const      j = random.range(i);
+                    fileid_t const t = ids[i - 1];
+                    ids[i - 1]       = ids[j];
+                    ids[j]           = t;
+                }
+            }
+
+            static u64 s_load_all(archive_loader_t* loader, fileid_t const* ids, u32 count, void** data, u64& bytes)
+            {
+                archive_t* ar    = archive_t::s_instance;
+                u64 const  start = nplatform::clock_ns();
+                for (u32 i = 0; i < count; ++i)
+                {
+                    data[i] = loader->load_datafile(ids[i]);
+                    bytes += ar->fileitem(ids[i])->getFileSize();
+                }
+                return nplatform::clock_ns() - start;
+            }
+
+            static void s_unload_all(archive_loader_t* loader, fileid_t const* ids, u32 count, void** data)
+            {
+                for (u32 i = 0; i < count; ++i)
+                    loader->unload_datafile(ids[i], data[i]);
+            }
+
+            static void s_bench_datafiles(trackalloc_t* allocator, options_t const& o, bigfile_t const& bf, archive_t::EBackend backend)
+            {
+                const char* group = s_backend_name(backend);
+                u32 const   count = o.mFiles.mNumFiles;
+                u32 const   index = o.mFiles.mArchiveIndex;
+                random_t    random(o.mFiles.mSeed + 100);
+
+                fileid_t* ids  = g_allocate_array<fileid_t>(allocator, count);
+                void**    data = g_allocate_array_and_clear<void*>(allocator, count);
+                for (u32 i = 0; i < count; ++i)
+                    ids[i] = fileid_t(index, i);
+                s_shuffle(ids, count, random);
+                u64 const baseline = allocator->live();
+
+                archive_t::config_t config;
+                config.mBackend = backend;
+                archive_t::s_setup(allocator, 1, index + 2, config);
+                archive_t*        ar     = archive_t::s_instance;
+                archive_loader_t* loader = ar->loader();
+
+                u64 start = nplatform::clock_ns();
+                if (ar->mount(index, bf.mGda, bf.mToc, bf.mFdb, bf.mHdb) < 0)
+                {
+                    printf("  %-7s mount failed\n", group);
+                    archive_t::s_teardown();
+                    g_deallocate(allocator, data);
+                    g_deallocate(allocator, ids);
+                    return;
+                }
+                s_report_ops(group, "mount", 1, nplatform::clock_ns() - start);
+                s_report_memory(group, "memory after mount", allocator->live() - baseline);
+
+                // The same archive as one packed file, mounted at another index
+                {
+                    u64 const before = allocator->live();
+                    start            = nplatform::clock_ns();
+                    if (ar->mount(index + 1, bf.mPack) == 0)
+                    {
+                        s_report_ops(group, "mount, packed", 1, nplatform::clock_ns() - start);
+                        s_report_memory(group, "memory after mount, packed", allocator->live() - before);
+                        ar->unmount(index + 1);
+                    }
+                    else
+                    {
+                        printf("  %-7s mount of the pack failed\n", group);
+                    }
+                }
+
+                // TOC lookup latency, random ids
+                {
+                    u32 const lookups = 1 << 20;
+                    u64       sum     = 0;
+                    start             = nplatform::clock_ns();
+                    for (u32 i = 0; i < lookups; ++i)
+                        sum += ar->fileitem(ids[i % count])->getFileSize();
+                    u64 const ns = nplatform::clock_ns() - start;
+                    s_sink += sum;
+                    s_report_ops(group, "toc lookup", lookups, ns);
+                }
+
+                // Hash lookups through the HDB index, one at a time and batched
+                {
+                    u32 const lookups = 1 << 20;
+                    u64*      hashes  = g_allocate_array<u64>(allocator, count);
+                    fileid_t* found   = g_allocate_array<fileid_t>(allocator, count);
+                    for (u32 i = 0; i < count; ++i)
+                        hashes[i] = file_hash(index, ids[i].getFileIndex());
+
+                    u64 sum = 0;
+                    start   = nplatform::clock_ns();
+                    for (u32 i = 0; i < lookups; ++i)
+                        sum += ar->find(hashes[i % count]).getFileIndex();
+                    u64 ns = nplatform::clock_ns() - start;
+                    s_sink += sum;
+                    s_report_ops(group, "find by hash", lookups, ns);
+
+                    u32 done = 0;
+                    start    = nplatform::clock_ns();
+                    while (done < lookups)
+                    {
+                        done += (u32)ar->find(hashes, (s32)count, found);
+                    }
+                    ns = nplatform::clock_ns() - start;
+                    s_report_ops(group, "find by hash, batched", done, ns);
+
+                    g_deallocate(allocator, found);
+                    g_deallocate(allocator, hashes);
+                }
+
+                // Cold, every file read from the archive
+                {
+                    u64 const before = allocator->live();
+                    allocator->reset_peak();
+                    u64       bytes  = 0;
+                    u64 const ns     = s_load_all(loader, ids, count, data, bytes);
+                    s_report_io(group, "load cold", count, bytes, ns);
+                    s_report_memory(group, "resident after load", allocator->live() - before);
+                    s_report_memory(group, "peak during load", allocator->peak() - before);
+                    s_unload_all(loader, ids, count, data);
+                }
+
+                // Warm, everything stays resident under an unlimited budget
+                {
+                    u64 bytes = 0;
+                    ar->set_residency_budget((u64)-1);
+                    s_load_all(loader, ids, count, data, bytes);
+                    s_unload_all(loader, ids, count, data);
+                    bytes        = 0;
+                    u64 const ns = s_load_all(loader, ids, count, data, bytes);
+                    s_report_io(group, "load warm", count, bytes, ns);
+                    s_unload_all(loader, ids, count, data);
+                    ar->set_residency_budget(0);
+                }
+
+                // Batched, groups of random files go through one sorted and coalesced batch
+                {
+                    u64 const before = allocator->live();
+                    allocator->reset_peak();
+                    u64 bytes = 0;
+                    start     = nplatform::clock_ns();
+                    for (u32 i = 0; i < count; i += o.mBatch)
+                    {
+                        u32 const n = (count - i) < o.mBatch ? (count - i) : o.mBatch;
+                        loader->load_datafiles(ids + i, (s32)n, data + i);
+                        for (u32 j = 0; j < n; ++j)
+                            bytes += ar->fileitem(ids[i + j])->getFileSize();
+                    }
+                    u64 const ns = nplatform::clock_ns() - start;
+                    s_report_io(group, "load batched", count, bytes, ns);
+                    s_report_memory(group, "peak during batches", allocator->peak() - before);
+                    s_unload_all(loader, ids, count, data);
+                }
+
+                // Scope switch, everything of a scope released at once: evicting every file from the heap
+                // against releasing the arena that the files were loaded into
+                {
+                    u64 bytes = 0;
+                    ar->set_residency_budget((u64)-1);
+                    s_load_all(loader, ids, count, data, bytes);
+                    s_unload_all(loader, ids, count, data);
+                    start = nplatform::clock_ns();
+                    ar->set_residency_budget(0);
+                    s_report_ops(group, "release, heap", count, nplatform::clock_ns() - start);
+
+                    archive_t::arena_t* arena = ar->create_arena();
+                    bytes                     = 0;
+                    u64 const ns              = s_load_all(ar->loader(arena), ids, count, data, bytes);
+                    s_report_io(group, "load cold, arena", count, bytes, ns);
+                    s_unload_all(ar->loader(arena), ids, count, data);
+                    start = nplatform::clock_ns();
+                    ar->release_arena(arena);
+                    s_report_ops(group, "release, arena", count, nplatform::clock_ns() - start);
+                }
+
+                archive_t::s_teardown();
+
+                // Async, with I/O threads
+                if (o.mThreads > 0)
+                {
+                    config.mNumIoThreads  = (s32)o.mThreads;
+                    config.mMaxAsyncLoads = 1024;
+                    archive_t::s_setup(allocator, 1, index + 1, config);
+                    ar     = archive_t::s_instance;
+                    loader = ar->loader();
+                    ar->mount(index, bf.mGda, bf.mToc, bf.mFdb, bf.mHdb);
+                    ar->reset_stats();
+
+                    u32 const     window  = 256;
+                    loadhandle_t* handles = g_allocate_array<loadhandle_t>(allocator, window);
+                    u64           bytes   = 0;
+                    start                 = nplatform::clock_ns();
+                    for (u32 i = 0; i < count; i += window)
+                    {
+                        u32 const n = (count - i) < window ? (count - i) : window;
+                        for (u32 j = 0; j < n; ++j)
+                            handles[j] = loader->load_datafile_async(ids[i + j]);
+                        for (u32 j = 0; j < n; ++j)
+                        {
+                            data[i + j] = loader->wait(handles[j]);
+                            bytes += ar->fileitem(ids[i + j])->getFileSize();
+                        }
+                    }
+                    u64 const ns = nplatform::clock_ns() - start;
+                    char      name[64];
+                    snprintf(name, sizeof(name), "load async (%u thr)", o.mThreads);
+                    s_report_io(group, name, count, bytes, ns);
+
+                    telemetry_t::stats_t stats;
+                    ar->stats(stats);
+                    s_report_phases(group, stats);
+
+                    s_unload_all(loader, ids, count, data);
+                    g_deallocate(allocator, handles);
+                    archive_t::s_teardown();
+                }
+
+                g_deallocate(allocator, data);
+                g_deallocate(allocator, ids);
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Dataunits ------------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            static void s_bench_dataunits(trackalloc_t* allocator, options_t const& o, bigfile_t const& bf, archive_t::EBackend backend)
+            {
+                const char*         group = s_backend_name(backend);
+                archive_t::config_t config;
+                config.mBackend      = backend;
+                config.mNumIoThreads = (s32)o.mThreads;
+                archive_t::s_setup(allocator, (s32)o.mUnits.mNumUnits, 1, config);
+                archive_t*        ar     = archive_t::s_instance;
+                archive_loader_t* loader = ar->loader();
+                if (ar->mount(0, bf.mGda, bf.mToc, bf.mFdb, bf.mHdb) < 0)
+                {
+                    printf("  %-7s mount of the dataunits failed\n", group);
+                    archive_t::s_teardown();
+                    return;
+                }
+
+                u64 bytes = 0;
+                u64 ns    = 0;
+                for (u32 i = 0; i < o.mUnits.mNumUnits; ++i)
+                {
+                    u64 const start = nplatform::clock_ns();
+                    void*     unit  = loader->load_dataunit(i);
+                    ns += nplatform::clock_ns() - start;
+                    bytes += ar->fileitem(fileid_t(0, i))->getFileSize();
+                    loader->unload_dataunit(i, unit);
+                }
+                s_report_io(group, "load dataunit", o.mUnits.mNumUnits, bytes, ns);
+                archive_t::s_teardown();
+            }
+
+            // g_patch in memory, a pristine copy is restored before every run since patching is destructive
+            static void s_bench_patch(trackalloc_t* allocator, options_t const& o)
+            {
+                u32 const pointers = o.mUnits.mNumPointers;
+                s32 const runs     = 8;
+
+                jobs_t jobs;
+                jobs.setup(allocator, (s32)o.mThreads, 64);
+
+                for (s32 mode = 0; mode < 3; ++mode)
+                {
+                    bool const flat = mode > 0;
+                    random_t   random(o.mUnits.mSeed);
+                    u32        size     = 0;
+                    void*      pristine = build_dataunit(allocator, pointers, flat, random, size);
+                    void*      unit     = g_allocate_array<u64>(allocator, (size + 7) / 8);
+                    u64        ns       = 0;
+                    for (s32 r = 0; r < runs; ++r)
+                    {
+                        nmem::memcpy(unit, pristine, size);
+                        u64 const start = nplatform::clock_ns();
+                        g_patch((dataunit_header_t*)unit, mode == 2 ? &jobs : nullptr);
+                        ns += nplatform::clock_ns() - start;
+                    }
+
+                    const char* name = mode == 0 ? "g_patch chain" : (mode == 1 ? "g_patch flat" : "g_patch flat, jobs");
+                    s_report_ops("memory", name, (u64)pointers * runs, ns);
+                    g_deallocate(allocator, unit);
+                    g_deallocate(allocator, pristine);
+                }
+
+                jobs.teardown();
+            }
+
+            static int s_run(alloc_t* system, int argc, char** argv)
+            {
+                trackalloc_t allocator(system);
+                options_t    o;
+                s_parse(o, argc, argv);
+
+                char path[512];
+                snprintf(path, sizeof(path), "%s/charon_bench_files", o.mDir);
+                bigfile_t files;
+                files.init(path);
+                u64       start = nplatform::clock_ns();
+                s64 const size  = write_datafiles(&allocator, path, o.mFiles);
+                if (size < 0)
+                {
+                    printf("failed to write %s\n", files.mGda);
+                    return 1;
+                }
+                printf("datafiles: %u files, %.1f MB, %u%% compressed, generated in %.1f ms\n", o.mFiles.mNumFiles, (double)size / (1024.0 * 1024.0), o.mFiles.mCompressedPercent, (double)(nplatform::clock_ns() - start) / 1e6);
+                if (write_pack(&allocator, path) < 0)
+                {
+                    printf("failed to write %s\n", files.mPack);
+                    return 1;
+                }
+
+                snprintf(path, sizeof(path), "%s/charon_bench_units", o.mDir);
+                bigfile_t units;
+                units.init(path);
+                if (write_dataunits(&allocator, path, o.mUnits) < 0)
+                {
+                    printf("failed to write %s\n", units.mGda);
+                    return 1;
+                }
+                printf("dataunits: %u units of %u pointers, %u%% flat patch tables\n\n", o.mUnits.mNumUnits, o.mUnits.mNumPointers, o.mUnits.mFlatPercent);
+
+                archive_t::EBackend const backends[] = {archive_t::BackendFileRead, archive_t::BackendMemoryMapped};
+                for (s32 b = 0; b < 2; ++b)
+                {
+                    s_bench_datafiles(&allocator, o, files, backends[b]);
+                    s_bench_dataunits(&allocator, o, units, backends[b]);
+                }
+                s_bench_patch(&allocator, o);
+
+                if (allocator.live() != 0)
+                    printf("\nleaked %llu bytes\n", (unsigned long long)allocator.live());
+                return 0;
+            }
+
+        }  // namespace nbench
+    }  // namespace charon
+}  // namespace ncore
+
+int main(int argc, char** argv)
+{
+    cbase::init();
+    int const result = ncore::charon::nbench::s_run(ncore::context_t::system_alloc(), argc, argv);
+    cbase::exit();
+    return result;
+}
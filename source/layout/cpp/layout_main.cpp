@@ -0,0 +1,473 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_base.h"
+#include "cbase/c_context.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_archive.h"
+#include "charon/c_hashindex.h"
+#include "charon/c_telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lays out the data of an archive in load order, using access logs recorded with archive_t::start_access_log:
+//   charon_layout in=PATH out=PATH log=FILE [log=FILE ...] [archive=N]
+//
+// Reads PATH.gda/.toc and writes out.gda/.toc in which the files are stored in the order that the logs first
+// loaded them, one log after the other, followed by the files that no log loaded in their original order.
+// File indices do not change, the FDB and HDB (copied when they exist) stay valid and so do all file ids.
+// A TOC with a single section takes the log entries of archive N (default the archive index of the section),
+// a TOC with a section per archive index takes the entries of each section's archive.
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nlayout
+        {
+            struct options_t
+            {
+                const char* mIn;
+                const char* mOut;
+                const char* mLogs[64];
+                u32         mNumLogs;
+                s64         mArchive;  // -1 when not given
+            };
+
+            static bool s_parse(options_t& o, int argc, char** argv)
+            {
+                o.mIn      = nullptr;
+                o.mOut     = nullptr;
+                o.mNumLogs = 0;
+                o.mArchive = -1;
+
+                for (int i = 1; i < argc; ++i)
+                {
+                    const char* arg   = argv[i];
+                    const char* value = strchr(arg, '=');
+                    if (value == nullptr)
+                    {
+                        printf("ignoring argument '%s', expected key=value\n", arg);
+                        continue;
+                    }
+                    value += 1;
+                    if (strncmp(arg, "in=", 3) == 0)
+                        o.mIn = value;
+                    else if (strncmp(arg, "out=", 4) == 0)
+                        o.mOut = value;
+                    else if (strncmp(arg, "log=", 4) == 0 && o.mNumLogs < 64)
+                        o.mLogs[o.mNumLogs++] = value;
+                    else if (strncmp(arg, "archive=", 8) == 0)
+                        o.mArchive = (s64)strtoul(value, nullptr, 10);
+                    else
+                        printf("ignoring unknown argument '%s'\n", arg);
+                }
+
+                if (o.mIn == nullptr || o.mOut == nullptr || o.mNumLogs == 0)
+                {
+                    printf("usage: charon_layout in=PATH out=PATH log=FILE [log=FILE ...] [archive=N]\n");
+                    return false;
+                }
+                // The .gda is read while the new one is written, the same path would truncate it first
+                if (strcmp(o.mIn, o.mOut) == 0)
+                {
+                    printf("in and out must differ, the archive can not be laid out in place\n");
+                    return false;
+                }
+                return true;
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Files ----------------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            static byte* s_read_all(alloc_t* allocator, const char* filename, u64& size)
+            {
+                size    = 0;
+                FILE* f = fopen(filename, "rb");
+                if (f == nullptr)
+                    return nullptr;
+                fseek(f, 0, SEEK_END);
+                long const length = ftell(f);
+                fseek(f, 0, SEEK_SET);
+                byte* data = length > 0 ? g_allocate_array<byte>(allocator, (s64)length) : nullptr;
+                if (data != nullptr && fread(data, 1, (size_t)length, f) != (size_t)length)
+                {
+                    g_deallocate(allocator, data);
+                    data = nullptr;
+                }
+                fclose(f);
+                size = data != nullptr ? (u64)length : 0;
+                return data;
+            }
+
+            static bool s_write_all(const char* filename, void const* data, u64 size)
+            {
+                FILE* f = fopen(filename, "wb");
+                if (f == nullptr)
+                    return false;
+                bool const written = size == 0 || fwrite(data, 1, (size_t)size, f) == (size_t)size;
+                return (fclose(f) == 0) && written;
+            }
+
+            // Missing files are fine, an archive can be mounted without FDB or HDB
+            static bool s_copy(alloc_t* allocator, const char* from, const char* to)
+            {
+                u64   size = 0;
+                byte* data = s_read_all(allocator, from, size);
+                if (data == nullptr)
+                    return true;
+                bool const written = s_write_all(to, data, size);
+                g_deallocate(allocator, data);
+                return written;
+            }
+
+            // ------------------------------------------------------------------------------------------------
+            // ------- Layout ---------------------------------------------------------------------------------
+            // ------------------------------------------------------------------------------------------------
+            // A TOC entry, sorted into the order that it is written to the new .gda
+            struct entry_t
+            {
+                archive_t::file_t* mItem;
+                u32                mOrder;  // Position of the first load over all logs, ~0 when never loaded
+                u32                mIndex;  // Position in the TOC, orders the files that were never loaded
+            };
+
+            static bool s_less(entry_t const& a, entry_t const& b) { return a.mOrder != b.mOrder ? a.mOrder < b.mOrder : a.mIndex < b.mIndex; }
+
+            static void s_sort(entry_t* entries, s64 count)
+            {
+                // Insertion sort for small ranges, quicksort otherwise
+                while (count > 16)
+                {
+                    entry_t const pivot = entries[count / 2];
+                    s64           i     = 0;
+                    s64           j     = count - 1;
+                    while (i <= j)
+                    {
+                        while (s_less(entries[i], pivot))
+                            ++i;
+                        while (s_less(pivot, entries[j]))
+                            --j;
+                        if (i <= j)
+                        {
+                            entry_t const t = entries[i];
+                            entries[i++]    = entries[j];
+                            entries[j--]    = t;
+                        }
+                    }
+                    // Recurse on the smaller part, loop on the larger one
+                    if ((j + 1) < (count - i))
+                    {
+                        s_sort(entries, j + 1);
+                        entries += i;
+                        count -= i;
+                    }
+                    else
+                    {
+                        s_sort(entries + i, count - i);
+                        count = j + 1;
+                    }
+                }
+                for (s64 i = 1; i < count; ++i)
+                {
+                    entry_t const entry = entries[i];
+                    s64           j     = i - 1;
+                    while (j >= 0 && s_less(entry, entries[j]))
+                    {
+                        entries[j + 1] = entries[j];
+                        --j;
+                    }
+                    entries[j + 1] = entry;
+                }
+            }
+
+            static archive_t::file_t* s_items(archive_t::section_t* section) { return (archive_t::file_t*)((byte*)section + section->m_ItemArrayOffset); }
+
+            struct tocfile_t
+            {
+                byte*                 mData;
+                u64                   mSize;
+                u32                   mNumSections;
+                archive_t::section_t* mSections;
+                s64                   mArchive;  // Archive index of the log entries of a single section TOC
+            };
+
+            // The section table and every item array must lie within the file
+            static bool s_valid_toc(tocfile_t const& toc)
+            {
+                if (toc.mSize < sizeof(u32) || toc.mNumSections == 0)
+                    return false;
+                if ((u64)sizeof(u32) + (u64)toc.mNumSections * sizeof(archive_t::section_t) > toc.mSize)
+                    return false;
+                for (u32 s = 0; s < toc.mNumSections; ++s)
+                {
+                    archive_t::section_t const& section = toc.mSections[s];
+                    u64 const                   begin   = (u64)((byte const*)&section - toc.mData) + section.m_ItemArrayOffset;
+                    if (begin > toc.mSize || (u64)section.m_ItemArrayCount * sizeof(archive_t::file_t) > (toc.mSize - begin))
+                        return false;
+                }
+                return true;
+            }
+
+            // The entry of a logged load, nullptr when it is not a file of this archive. The section is picked
+            // like toc_t::getSection in the loader does.
+            static archive_t::file_t* s_item(tocfile_t const& toc, u32 archiveIndex, u32 fileIndex, u32& sectionIndex)
+            {
+                if (toc.mNumSections == 1 && archiveIndex != (u32)toc.mArchive)
+                    return nullptr;
+                sectionIndex = toc.mNumSections == 1 ? 0 : archiveIndex;
+                if (sectionIndex >= toc.mNumSections || fileIndex >= toc.mSections[sectionIndex].m_ItemArrayCount)
+                    return nullptr;
+                return &s_items(&toc.mSections[sectionIndex])[fileIndex];
+            }
+
+            static telemetry_t::accesslog_t const* s_read_log(alloc_t* allocator, const char* filename)
+            {
+                u64                             size = 0;
+                byte*                           data = s_read_all(allocator, filename, size);
+                telemetry_t::accesslog_t const* log  = (telemetry_t::accesslog_t const*)data;
+                if (data != nullptr && size >= sizeof(*log) && log->mMagic == telemetry_t::accesslog_t::Magic && log->mVersion == telemetry_t::accesslog_t::Version &&
+                    size >= sizeof(*log) + (u64)log->mCount * 2 * sizeof(u32))
+                    return log;
+                g_deallocate(allocator, data);
+                return nullptr;
+            }
+
+            // Each log contributes the files that earlier logs did not load, in the order of their first load
+            static u32 s_apply_logs(alloc_t* allocator, options_t const& o, tocfile_t const& toc, entry_t** entries, u32& numLogged)
+            {
+                u32 order = 0;
+                numLogged = 0;
+                for (u32 l = 0; l < o.mNumLogs; ++l)
+                {
+                    telemetry_t::accesslog_t const* log = s_read_log(allocator, o.mLogs[l]);
+                    if (log == nullptr)
+                    {
+                        printf("skipping %s, not an access log\n", o.mLogs[l]);
+                        continue;
+                    }
+                    if (log->mDropped > 0)
+                        printf("%s dropped %u loads, record with a larger log\n", o.mLogs[l], log->mDropped);
+
+                    u32 const* pairs = (u32 const*)(log + 1);
+                    for (u32 i = 0; i < log->mCount; ++i)
+                    {
+                        u32 section = 0;
+                        if (s_item(toc, pairs[i * 2 + 0], pairs[i * 2 + 1], section) == nullptr)
+                            continue;
+                        entry_t& entry = entries[section][pairs[i * 2 + 1]];
+                        numLogged += 1;
+                        if (entry.mOrder == ~0u)
+                            entry.mOrder = order++;
+                    }
+                    g_deallocate(allocator, (void*)log);
+                }
+                return order;
+            }
+
+            // Consecutive loads of the logs where the file starts where the previous one ended (aligned)
+            static u32 s_sequential(alloc_t* allocator, options_t const& o, tocfile_t const& toc, u32& transitions)
+            {
+                u32 sequential = 0;
+                transitions    = 0;
+                for (u32 l = 0; l < o.mNumLogs; ++l)
+                {
+                    telemetry_t::accesslog_t const* log = s_read_log(allocator, o.mLogs[l]);
+                    if (log == nullptr)
+                        continue;
+
+                    u32 const*               pairs    = (u32 const*)(log + 1);
+                    archive_t::file_t const* previous = nullptr;
+                    for (u32 i = 0; i < log->mCount; ++i)
+                    {
+                        u32                      section = 0;
+                        archive_t::file_t const* item    = s_item(toc, pairs[i * 2 + 0], pairs[i * 2 + 1], section);
+                        if (item == nullptr || !item->isValid())
+                            continue;
+                        if (previous != nullptr)
+                        {
+                            u64 const end = (previous->getFileOffset() + previous->getFileSize() + 63) & ~(u64)63;
+                            transitions += 1;
+                            sequential += item->getFileOffset() == end ? 1 : 0;
+                        }
+                        previous = item;
+                    }
+                    g_deallocate(allocator, (void*)log);
+                }
+                return sequential;
+            }
+
+            static bool s_seek(FILE* f, u64 offset)
+            {
+#if defined(_MSC_VER)
+                return _fseeki64(f, (__int64)offset, SEEK_SET) == 0;
+#else
+                return fseeko(f, (off_t)offset, SEEK_SET) == 0;
+#endif
+            }
+
+            static int s_run(alloc_t* allocator, int argc, char** argv)
+            {
+                options_t o;
+                if (!s_parse(o, argc, argv))
+                    return 1;
+
+                char  filename[512];
+                tocfile_t toc;
+                snprintf(filename, sizeof(filename), "%s.toc", o.mIn);
+                toc.mData = s_read_all(allocator, filename, toc.mSize);
+                if (toc.mData == nullptr || toc.mSize < sizeof(u32))
+                {
+                    printf("failed to read %s\n", filename);
+                    g_deallocate(allocator, toc.mData);
+                    return 1;
+                }
+                toc.mNumSections = *(u32*)toc.mData;
+                toc.mSections    = (archive_t::section_t*)(toc.mData + sizeof(u32));
+                if (!s_valid_toc(toc))
+                {
+                    printf("%s is not a valid TOC\n", filename);
+                    g_deallocate(allocator, toc.mData);
+                    return 1;
+                }
+                toc.mArchive = o.mArchive >= 0 ? o.mArchive : (s64)toc.mSections[0].m_ArchiveIndex;
+
+                snprintf(filename, sizeof(filename), "%s.gda", o.mIn);
+                FILE* gda = fopen(filename, "rb");
+                snprintf(filename, sizeof(filename), "%s.gda", o.mOut);
+                FILE* out = gda != nullptr ? fopen(filename, "wb") : nullptr;
+                if (out == nullptr)
+                {
+                    printf("failed to open %s.gda or %s\n", o.mIn, filename);
+                    if (gda != nullptr)
+                        fclose(gda);
+                    g_deallocate(allocator, toc.mData);
+                    return 1;
+                }
+
+                // Every TOC entry, per section, in TOC order
+                u32       total    = 0;
+                entry_t** sections = g_allocate_array_and_clear<entry_t*>(allocator, toc.mNumSections);
+                for (u32 s = 0; s < toc.mNumSections; ++s)
+                {
+                    archive_t::section_t* section = &toc.mSections[s];
+                    archive_t::file_t*    items   = s_items(section);
+                    sections[s]                   = g_allocate_array<entry_t>(allocator, section->m_ItemArrayCount);
+                    for (u32 i = 0; i < section->m_ItemArrayCount; ++i)
+                    {
+                        sections[s][i].mItem  = &items[i];
+                        sections[s][i].mOrder = ~0u;
+                        sections[s][i].mIndex = total++;
+                    }
+                }
+
+                u32       numLogged     = 0;
+                u32 const numPlaced     = s_apply_logs(allocator, o, toc, sections, numLogged);
+                u32       transitions   = 0;
+                u32 const sequentialOld = s_sequential(allocator, o, toc, transitions);
+
+                entry_t* entries = g_allocate_array<entry_t>(allocator, total);
+                u32      count   = 0;
+                for (u32 s = 0; s < toc.mNumSections; ++s)
+                {
+                    for (u32 i = 0; i < toc.mSections[s].m_ItemArrayCount; ++i)
+                        entries[count++] = sections[s][i];
+                    g_deallocate(allocator, sections[s]);
+                }
+                g_deallocate(allocator, sections);
+                s_sort(entries, count);
+
+                // Entries that share their data (same offset and size) keep sharing one copy
+                hashindex_t copied;
+                copied.setup(allocator, count);
+
+                static byte const s_zero[64] = {0};
+                u32 const         bufferSize = 1 << 20;
+                byte*             buffer     = g_allocate_array<byte>(allocator, bufferSize);
+                u64               position   = 0;
+                bool              failed     = false;
+                for (u32 i = 0; i < count && !failed; ++i)
+                {
+                    archive_t::file_t* item = entries[i].mItem;
+                    if (!item->isValid())
+                        continue;
+
+                    u64 const key        = (u64)(item->mFileOffset & 0x7FFFFFFF) | ((u64)item->mFileSize << 31);
+                    u32 const compressed = item->mFileOffset & 0x80000000;
+                    u32       offset     = 0;
+                    if (copied.find(key, offset))
+                    {
+                        item->mFileOffset = offset | compressed;
+                        continue;
+                    }
+
+                    u32 const padding = (u32)((64 - (position & 63)) & 63);
+                    if (padding > 0 && fwrite(s_zero, 1, padding, out) != padding)
+                        failed = true;
+                    position += padding;
+                    offset = (u32)(position >> 6);
+                    if ((position >> 6) > 0x7FFFFFFF)
+                        failed = true;
+
+                    if (!s_seek(gda, item->getFileOffset()))
+                        failed = true;
+                    u64 remaining = item->getFileSize();
+                    while (remaining > 0 && !failed)
+                    {
+                        u32 const chunk = remaining < bufferSize ? (u32)remaining : bufferSize;
+                        if (fread(buffer, 1, chunk, gda) != chunk || fwrite(buffer, 1, chunk, out) != chunk)
+                            failed = true;
+                        remaining -= chunk;
+                    }
+                    position += item->getFileSize();
+
+                    copied.insert(key, offset);
+                    item->mFileOffset = offset | compressed;
+                }
+                copied.teardown(allocator);
+                g_deallocate(allocator, buffer);
+                g_deallocate(allocator, entries);
+                fclose(gda);
+                if (fclose(out) != 0)
+                    failed = true;
+
+                snprintf(filename, sizeof(filename), "%s.toc", o.mOut);
+                failed = failed || !s_write_all(filename, toc.mData, toc.mSize);
+
+                const char* const suffixes[] = {"fdb", "hdb"};
+                for (s32 i = 0; i < 2 && !failed; ++i)
+                {
+                    char to[512];
+                    snprintf(filename, sizeof(filename), "%s.%s", o.mIn, suffixes[i]);
+                    snprintf(to, sizeof(to), "%s.%s", o.mOut, suffixes[i]);
+                    failed = !s_copy(allocator, filename, to);
+                }
+
+                if (!failed)
+                {
+                    u32       transitionsNew = 0;
+                    u32 const sequentialNew  = s_sequential(allocator, o, toc, transitionsNew);
+                    printf("%u of %u files placed in load order (%u loads in %u logs), %.1f MB\n", numPlaced, total, numLogged, o.mNumLogs, (double)position / (1024.0 * 1024.0));
+                    printf("sequential loads: %u of %u before, %u of %u after\n", sequentialOld, transitions, sequentialNew, transitionsNew);
+                }
+                else
+                {
+                    printf("failed to write %s\n", o.mOut);
+                }
+                g_deallocate(allocator, toc.mData);
+                return failed ? 1 : 0;
+            }
+
+        }  // namespace nlayout
+    }  // namespace charon
+}  // namespace ncore
+
+int main(int argc, char** argv)
+{
+    cbase::init();
+    int const result = ncore::charon::nlayout::s_run(ncore::context_t::system_alloc(), argc, argv);
+    cbase::exit();
+    return result;
+}
@@ -1,10 +1,17 @@
 #include "cbase/c_allocator.h"
 #include "cbase/c_log.h"
+#include "cbase/c_memory.h"
 #include "ccore/c_math.h"
 #include "cfile/c_file.h"
 
 #include "charon/c_gamedata.h"
 #include "charon/c_archive.h"
+#include "charon/c_hash.h"
+#include "charon/c_hashindex.h"
+#include "charon/c_jobs.h"
+#include "charon/c_lz.h"
+#include "charon/c_platform.h"
+#include "charon/c_telemetry.h"
 
 namespace ncore
 {
@@ -39,283 +46,2990 @@ namespace ncore
             return nullptr;
         }
 
+        // Read size bytes at offset of an open file, e.g. a region of a packed archive
+        static void* s_read_region(nplatform::fileio_t const& io, u64 offset, u64 size, alloc_t* allocator)
+        {
+            if (size == 0)
+                return nullptr;
+            void* data = g_allocate_array<byte>(allocator, size);
+            if (nplatform::fileio_pread(io, offset, data, size) != (s64)size)
+            {
+                g_deallocate(allocator, data);
+                return nullptr;
+            }
+            return data;
+        }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Map a File into Memory -----------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        static void* s_map_file(const char* filename, nplatform::filemap_t& map)
+        {
+            if (nplatform::filemap_open(filename, map))
+                return (void*)map.data();
+            return nullptr;
+        }
+
+        static void s_release_file(alloc_t* allocator, void* data, nplatform::filemap_t& map)
+        {
+            if (map.isValid())
+                nplatform::filemap_close(map);
+            else if (data != nullptr)
+                g_deallocate(allocator, data);
+        }
+
         // ------------------------------------------------------------------------------------------------
         // ------- Patching Pointers in a Datafile --------------------------------------------------------
         // ------------------------------------------------------------------------------------------------
-        u8* g_patch(dataunit_header_t* data)
+        // With relative pointers the records of the patch table are resolved on access, see relptr_t
+        static inline bool s_needs_patch(dataunit_header_t const* data)
+        {
+#if defined(CHARON_RELATIVE_POINTERS)
+            return false;
+#else
+            if ((data->m_flags & dataunit_header_t::FlagFlatPatchTable) != 0)
+                return data->m_patch_count > 0;
+            s32 const* head = (s32 const*)((u8 const*)data + data->m_patch_offset);
+            return head[0] > 0;
+#endif
+        }
+
+        static inline void s_patch_record(byte* record)
+        {
+            s32 dataOffset;
+            nmem::memcpy(&dataOffset, record + sizeof(s32), sizeof(dataOffset));
+            *(void**)record = (void*)(record + dataOffset);
+        }
+
+        // The flat table has no dependent loads, the records are independent read-modify-writes scattered
+        // over the dataunit so what matters is having their cache lines in flight well ahead of time.
+        static const s32 s_patch_prefetch_distance = 32;
+        static const s32 s_patch_parallel_min      = 64 * 1024;  // Fixups before a table is split across jobs
+        static const s32 s_patch_max_jobs          = 16;
+
+        static void s_patch_flat(byte* base, u32 const* offsets, s32 begin, s32 end)
         {
-            s32 count = data->m_patch_count;
-            s32* head = (s32*)((u8*)data + data->m_patch_offset);
-            if (head[0] > 0)
+            s32 i = begin;
+            for (; (i + 4) <= end; i += 4)
             {
-                s32* pointer = (s32*)((uptr_t)data + head[0]);
-                while (true)
+                s32 const ahead = i + s_patch_prefetch_distance;
+                if ((ahead + 4) <= end)
                 {
-                    s32 const nextOffset = pointer[0];
-                    s32 const dataOffset = pointer[1];
+                    nplatform::prefetch(base + offsets[ahead + 0]);
+                    nplatform::prefetch(base + offsets[ahead + 1]);
+                    nplatform::prefetch(base + offsets[ahead + 2]);
+                    nplatform::prefetch(base + offsets[ahead + 3]);
+                }
+                s_patch_record(base + offsets[i + 0]);
+                s_patch_record(base + offsets[i + 1]);
+                s_patch_record(base + offsets[i + 2]);
+                s_patch_record(base + offsets[i + 3]);
+            }
+            for (; i < end; ++i)
+                s_patch_record(base + offsets[i]);
+        }
 
-                    void** pointerToPatch = (void**)pointer;
-                    *pointerToPatch       = (void*)((uptr_t)pointer + dataOffset);
+        struct patchrange_t
+        {
+            byte*      mBase;
+            u32 const* mOffsets;
+            s32        mBegin;
+            s32        mEnd;
+        };
 
-                    if (nextOffset == 0)
-                        break;
-                    pointer = (s32*)((uptr_t)pointer + nextOffset);
+        static void s_patch_job(void* context, u64)
+        {
+            patchrange_t const* range = (patchrange_t const*)context;
+            s_patch_flat(range->mBase, range->mOffsets, range->mBegin, range->mEnd);
+        }
+
+        u8* g_patch(dataunit_header_t* data, jobs_t* jobs)
+        {
+            if (!s_needs_patch(data))
+                return (u8*)(data + 1);
+
+            if ((data->m_flags & dataunit_header_t::FlagFlatPatchTable) != 0)
+            {
+                byte*      base    = (byte*)data;
+                u32 const* offsets = (u32 const*)(base + data->m_patch_offset);
+                s32 const  count   = data->m_patch_count;
+
+                s32 numRanges = (jobs != nullptr && count >= s_patch_parallel_min) ? jobs->num_threads() + 1 : 1;
+                numRanges     = numRanges < s_patch_max_jobs ? numRanges : s_patch_max_jobs;
+                if (numRanges <= 1)
+                {
+                    s_patch_flat(base, offsets, 0, count);
+                    return (u8*)(data + 1);
+                }
+
+                // The first range is done by this thread while the workers do the others
+                patchrange_t ranges[s_patch_max_jobs];
+                jobhandle_t  handles[s_patch_max_jobs];
+                s32 const    perRange = (count + numRanges - 1) / numRanges;
+                for (s32 r = 0; r < numRanges; ++r)
+                {
+                    ranges[r].mBase    = base;
+                    ranges[r].mOffsets = offsets;
+                    ranges[r].mBegin   = r * perRange;
+                    ranges[r].mEnd     = (r + 1) * perRange < count ? (r + 1) * perRange : count;
                 }
+                for (s32 r = 1; r < numRanges; ++r)
+                    handles[r] = jobs->submit(s_patch_job, &ranges[r], 0);
+                s_patch_flat(base, offsets, ranges[0].mBegin, ranges[0].mEnd);
+                for (s32 r = 1; r < numRanges; ++r)
+                    jobs->wait(handles[r]);
+                return (u8*)(data + 1);
+            }
+
+            s32* head    = (s32*)((u8*)data + data->m_patch_offset);
+            s32* pointer = (s32*)((uptr_t)data + head[0]);
+            while (true)
+            {
+                s32 const nextOffset = pointer[0];
+                s_patch_record((byte*)pointer);
+                if (nextOffset == 0)
+                    break;
+                pointer = (s32*)((uptr_t)pointer + nextOffset);
             }
             return (u8*)(data + 1);
         }
 
+        // ------------------------------------------------------------------------------------------------
+        // ------- Once -----------------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Work that is done the first time something is needed, by the one thread that wins the CAS, threads
+        // that need it meanwhile wait for it. Once done this costs one atomic load.
+        static const s32 s_once_pending = 0;
+        static const s32 s_once_running = 1;
+        static const s32 s_once_done    = 2;
+
+        static bool s_once_begin(s32 volatile* state)
+        {
+            while (true)
+            {
+                s32 const current = nplatform::atomic_load(state);
+                if (current == s_once_done)
+                    return false;
+                if (current == s_once_pending && nplatform::atomic_cas(state, s_once_pending, s_once_running))
+                    return true;
+                nplatform::thread_yield();
+            }
+        }
+
+        static void s_once_end(s32 volatile* state) { nplatform::atomic_store(state, s_once_done); }
+
         // ------------------------------------------------------------------------------------------------
         // ------- A Single Datafile Archive --------------------------------------------------------------
         // ------------------------------------------------------------------------------------------------
+        // The FDB or HDB of an archive, loaded on first use. It is a separate file or a region of a packed
+        // archive, in a mapped packed archive it is used in-place and there is nothing to load.
+        struct lazydb_t
+        {
+            inline lazydb_t()
+                : mState(s_once_pending)
+                , mFilename(nullptr)
+                , mOffset(0)
+                , mSize(0)
+                , mData(nullptr)
+            {
+            }
+
+            s32 volatile         mState;     // s_once_*
+            char*                mFilename;  // Separate file, nullptr for a region of a packed archive
+            u64                  mOffset;    // Region in a packed archive, absent when mSize == 0
+            u64                  mSize;      //
+            void*                mData;      // Valid once mState == s_once_done, nullptr when absent
+            nplatform::filemap_t mMap;       // Mapping of a separate file (mapped backend only)
+        };
+
         class archivefile_t
         {
         public:
             archivefile_t();
 
-            s32  open(alloc_t* allocator, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            s32  open(alloc_t* allocator, archive_t::EBackend backend, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            s32  openPacked(alloc_t* allocator, archive_t::EBackend backend, const char* packFilename);
             void close(alloc_t* allocator);
 
-            bool                     exists(fileid_t id) const;                                             // Return True if file exists in Archive
-            archive_t::file_t const* file(fileid_t id) const;                                               // Return FileEntry associated with file id
-            string_t                 filename(fileid_t id) const;                                           // Return Filename associated with file id
-            s64                      fileRead(fileid_t id, s32 offset, s32 size, void* destination) const;  // Read part of file in destination
-
-            void*  mBasePtr;  // The TOC of the datafile in memory
-            s32    mIndex;    // Index of the datafile in the datafile manager
-            gda_t* mGDA;      // The .gda file
-            toc_t* mTOC;      // The TOC of the datafile
-            fdb_t* mFDB;      // In DEBUG mode if you want to know the filename of a fileid_t
-            hdb_t* mHDB;      // In DEBUG mode if you want to know the hash of a fileid_t
+            archive_t::section_t const* section(u32 archiveIndex) const;                                   // Return the TOC section of an archive index
+            bool                        exists(fileid_t id) const;                                             // Return True if file exists in Archive
+            archive_t::file_t const*    file(fileid_t id) const;                                               // Return FileEntry associated with file id
+            string_t                    filename(fileid_t id) const;                                           // Return Filename associated with file id
+            s64                         fileRead(fileid_t id, s32 offset, s32 size, void* destination) const;  // Read part of file in destination
+            s64                         read(u64 offset, u64 size, void* destination) const;                   // Read a range of the archive in destination
+            void                        willneed(u64 offset, u64 size) const;                                  // Hint that a range of the archive is about to be read
+            byte const*                 mapped(u64 offset, u64 size) const;                                    // Return a range of the archive in-place when mapped
+            void const*                 fileData(fileid_t id) const;                                           // Return file in-place when mapped and uncompressed
+            bool                        isMapped() const;                                                      // Return True if the archive is mapped
+            bool                        isMapped(void const* ptr) const;                                       // Return True if ptr points into the mapped archive
+            fdb_t const*                fdb() const;                                                           // Return the FDB, loaded on first use
+            hdb_t const*                hdb() const;                                                           // Return the HDB, loaded on first use
+            hashindex_t const&          index() const;                                                         // Return the hash index, built from the HDB on first use
+            bool                        find(u64 hash, fileid_t& id) const;                                    // Return the file that has this hash in the HDB
+            u64                         hash(fileid_t id) const;                                               // Return the HDB hash of a file, 0 when unknown
+            u64                         stamp() const;                                                         // Return the file stamps of the archive files combined
+
+            void*                mBasePtr;      // The TOC of the datafile in memory
+            s32                  mIndex;        // Index of the datafile in the datafile manager
+            s32                  mBase;         // Index of the archive that this one overlays, -1 when it is not an overlay
+            alloc_t*             mAllocator;    // For the databases that are loaded on first use
+            archive_t::EBackend  mBackend;      //
+            gda_t*               mGDA;          // The .gda file
+            toc_t*               mTOC;          // The TOC of the datafile
+            nplatform::filemap_t mTocMap;       // Mapping backing mTOC (mapped backend only)
+            mutable lazydb_t     mFDB;          // Filenames, only used for logging and tools (not in _SUBMISSION builds)
+            mutable lazydb_t     mHDB;          // The hash of every fileid_t, for find()
+            mutable s32 volatile mIndexState;   // s_once_*
+            mutable hashindex_t  mHashIndex;    // HDB hash to file index
+            char*                mFilename;     // The .gda file or the packed archive, to open it again on reload
+            char*                mTocFilename;  // nullptr for a packed archive
+            u64                  mStamp;        // stamp() when the archive was opened
+
+        private:
+            void  setupDb(lazydb_t& db, const char* filename);
+            void* loadDb(lazydb_t& db) const;
+            void  closeDb(lazydb_t& db);
+        };
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Residency ------------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Every datafile and dataunit has a slot, its state holds both the load state and the number of
+        // owners so that claiming, referencing and evicting are all single CAS transitions:
+        //   s_slot_empty        Not loaded
+        //   s_slot_loading      Claimed by the one thread that is loading it
+        //   s_slot_evicting     The data is being released
+        //   s_slot_cached + N   Resident with N owners, with 0 owners the slot is in the LRU list
+        static const s32 s_slot_empty    = 0;
+        static const s32 s_slot_loading  = 1;
+        static const s32 s_slot_evicting = 2;
+        static const s32 s_slot_cached   = 3;
+
+        struct slot_t
+        {
+            s32 volatile        mState;
+            u32                 mSize;       // Heap bytes owned by the slot, 0 when the data lives in the mapping, an arena or is shared
+            void*               mData;       // Only valid while mState >= s_slot_cached
+            slot_t*             mPrev;       // LRU links, nullptr when not in the list
+            slot_t*             mNext;
+            slot_t*             mShared;     // Slot of the identical file whose data this one uses, it holds one ownership of it
+            archive_t::arena_t* mArena;      // Arena that holds the data, nullptr otherwise
+            slot_t*             mArenaPrev;  // Links in the list of slots of mArena
+            slot_t*             mArenaNext;
+        };
+
+        // The slots of an archive are allocated in pages on first touch, archives can hold a few hundred
+        // thousand entries of which only a small part is loaded during a session. A page that exists is
+        // never released before the table is, so slot pointers stay valid while mounted.
+        static const u32 s_slot_page_size = 4096;
+        static const u32 s_slots_per_page = s_slot_page_size / sizeof(slot_t);
+
+        struct slottable_t
+        {
+            void* volatile* mPages;     // slot_t[s_slots_per_page] or nullptr
+            u32             mNumSlots;  //
+            u32             mNumPages;  //
+
+            void setup(alloc_t* allocator, u32 numSlots)
+            {
+                mNumSlots = numSlots;
+                mNumPages = (numSlots + s_slots_per_page - 1) / s_slots_per_page;
+                mPages    = mNumPages > 0 ? (void* volatile*)g_allocate_array_and_clear<void*>(allocator, mNumPages) : nullptr;
+            }
+
+            void teardown(alloc_t* allocator)
+            {
+                for (u32 p = 0; p < mNumPages; ++p)
+                    g_deallocate(allocator, (void*)mPages[p]);
+                g_deallocate(allocator, (void**)mPages);
+                mPages    = nullptr;
+                mNumSlots = 0;
+                mNumPages = 0;
+            }
+
+            // Only while nothing loads from the table, the pages that exist are kept
+            void grow(alloc_t* allocator, u32 numSlots)
+            {
+                u32 const numPages = (numSlots + s_slots_per_page - 1) / s_slots_per_page;
+                if (numPages > mNumPages)
+                {
+                    void* volatile* pages = (void* volatile*)g_allocate_array_and_clear<void*>(allocator, numPages);
+                    for (u32 p = 0; p < mNumPages; ++p)
+                        pages[p] = mPages[p];
+                    g_deallocate(allocator, (void**)mPages);
+                    mPages    = pages;
+                    mNumPages = numPages;
+                }
+                if (numSlots > mNumSlots)
+                    mNumSlots = numSlots;
+            }
+
+            inline slot_t* page(u32 p) const { return (slot_t*)nplatform::atomic_load(&mPages[p]); }
+
+            // Return the index of a slot of this table, or mNumSlots when the slot is not part of it
+            u32 indexOf(slot_t const* slot) const
+            {
+                for (u32 p = 0; p < mNumPages; ++p)
+                {
+                    slot_t const* slots = page(p);
+                    if (slots != nullptr && slot >= slots && slot < (slots + s_slots_per_page))
+                        return p * s_slots_per_page + (u32)(slot - slots);
+                }
+                return mNumSlots;
+            }
+
+            bool contains(slot_t const* slot) const { return indexOf(slot) < mNumSlots; }
+
+            // Return the slot or nullptr when its page has not been touched yet
+            slot_t* find(u32 index) const
+            {
+                if (index >= mNumSlots)
+                    return nullptr;
+                slot_t* slots = page(index / s_slots_per_page);
+                return slots != nullptr ? &slots[index % s_slots_per_page] : nullptr;
+            }
+
+            // Return the slot, allocating its page when this is the first touch
+            slot_t* get(alloc_t* allocator, u32 index)
+            {
+                if (index >= mNumSlots)
+                    return nullptr;
+                u32 const p     = index / s_slots_per_page;
+                slot_t*   slots = page(p);
+                if (slots == nullptr)
+                {
+                    slot_t* fresh = g_allocate_array_and_clear<slot_t>(allocator, s_slots_per_page);
+                    if (nplatform::atomic_cas(&mPages[p], nullptr, fresh))
+                    {
+                        slots = fresh;
+                    }
+                    else
+                    {
+                        // Another thread touched the page first
+                        g_deallocate(allocator, fresh);
+                        slots = page(p);
+                    }
+                }
+                return &slots[index % s_slots_per_page];
+            }
+        };
+
+        enum EClaim
+        {
+            ClaimWon      = 0,  // Caller must load and publish
+            ClaimResident = 1,  // Data is loaded and the caller is now one of its owners
+            ClaimBusy     = 2,  // Another thread is loading or evicting it
+        };
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Streaming requests ---------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Async loads are queued as requests in a binary heap, ordered by priority, then by deadline (no
+        // deadline goes last) and then by submission. A request is queued while mHeapIndex >= 0, it is
+        // loading when it is allocated but no longer queued. Completing or cancelling a request bumps its
+        // generation, which is what load handles compare against.
+        struct group_t;
+
+        struct request_t
+        {
+            u64          mDeadline;    // nplatform::clock_ns() time, 0 = none
+            u64          mSequence;    // Submission order
+            u64          mQueued;      // nplatform::clock_ns() time of the submission
+            u64          mOffset;      // In the archive, for merging the reads of neighbours
+            u64          mSize;        // 0 when the request is never merged (dataunits and compressed files)
+            group_t*     mGroup;       // Load the dataunit with its dependencies
+            void*        mArena;       // archive_t::arena_t that the data is allocated from, nullptr for the heap
+            fileid_t     mFileId;      //
+            s32          mDataUnit;    // -1 for a datafile
+            s32          mPriority;    // EPriority
+            s32          mHeapIndex;   // -1 when not queued
+            s32 volatile mGeneration;  //
+            s32          mNext;        // Free list
+        };
+
+        struct streamqueue_t
+        {
+            request_t* mRequests;
+            s32*       mHeap;  // Request indices, the most urgent first
+            s32        mCount;
+            s32        mMax;
+            s32        mFree;
+            u64        mSequence;
+
+            void setup(alloc_t* allocator, s32 maxRequests)
+            {
+                mRequests = g_allocate_array_and_clear<request_t>(allocator, maxRequests);
+                mHeap     = g_allocate_array<s32>(allocator, maxRequests);
+                mCount    = 0;
+                mMax      = maxRequests;
+                mFree     = -1;
+                mSequence = 0;
+                for (s32 i = maxRequests - 1; i >= 0; --i)
+                {
+                    mRequests[i].mHeapIndex = -1;
+                    mRequests[i].mNext      = mFree;
+                    mFree                   = i;
+                }
+            }
+
+            void teardown(alloc_t* allocator)
+            {
+                g_deallocate(allocator, mHeap);
+                g_deallocate(allocator, mRequests);
+                mRequests = nullptr;
+                mHeap     = nullptr;
+                mCount    = 0;
+                mMax      = 0;
+                mFree     = -1;
+            }
+
+            s32 allocate()
+            {
+                s32 const index = mFree;
+                if (index >= 0)
+                    mFree = mRequests[index].mNext;
+                return index;
+            }
+
+            void release(s32 index)
+            {
+                request_t& r = mRequests[index];
+                nplatform::atomic_store(&r.mGeneration, r.mGeneration + 1);
+                r.mHeapIndex = -1;
+                r.mNext      = mFree;
+                mFree        = index;
+            }
+
+            // The deadline of 0 wraps around to the largest value, so it sorts after every real deadline
+            inline bool before(s32 a, s32 b) const
+            {
+                request_t const& ra = mRequests[a];
+                request_t const& rb = mRequests[b];
+                if (ra.mPriority != rb.mPriority)
+                    return ra.mPriority < rb.mPriority;
+                if (ra.mDeadline != rb.mDeadline)
+                    return (ra.mDeadline - 1) < (rb.mDeadline - 1);
+                return ra.mSequence < rb.mSequence;
+            }
+
+            inline void place(s32 pos, s32 index)
+            {
+                mHeap[pos]                  = index;
+                mRequests[index].mHeapIndex = pos;
+            }
+
+            void up(s32 pos)
+            {
+                s32 const index = mHeap[pos];
+                while (pos > 0)
+                {
+                    s32 const parent = (pos - 1) / 2;
+                    if (!before(index, mHeap[parent]))
+                        break;
+                    place(pos, mHeap[parent]);
+                    pos = parent;
+                }
+                place(pos, index);
+            }
+
+            void down(s32 pos)
+            {
+                s32 const index = mHeap[pos];
+                while (true)
+                {
+                    s32 child = pos * 2 + 1;
+                    if (child >= mCount)
+                        break;
+                    if ((child + 1) < mCount && before(mHeap[child + 1], mHeap[child]))
+                        child += 1;
+                    if (!before(mHeap[child], index))
+                        break;
+                    place(pos, mHeap[child]);
+                    pos = child;
+                }
+                place(pos, index);
+            }
+
+            void push(s32 index)
+            {
+                mRequests[index].mSequence = mSequence++;
+                place(mCount++, index);
+                up(mCount - 1);
+            }
+
+            inline s32 top() const { return mCount > 0 ? mHeap[0] : -1; }
+
+            void remove(s32 index)
+            {
+                s32 const pos               = mRequests[index].mHeapIndex;
+                mRequests[index].mHeapIndex = -1;
+                mCount -= 1;
+                if (pos < mCount)
+                {
+                    place(pos, mHeap[mCount]);
+                    update(mHeap[pos]);
+                }
+            }
+
+            // Restore the heap order after the priority or deadline of a queued request changed
+            void update(s32 index)
+            {
+                s32 const pos = mRequests[index].mHeapIndex;
+                if (pos > 0 && before(index, mHeap[(pos - 1) / 2]))
+                    up(pos);
+                else
+                    down(pos);
+            }
+        };
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Overlays -------------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // The layers of a base archive, layer 0 is the base itself and later layers are newer. The redirect
+        // table holds the newest layer that has a file, so resolving a file id is one lookup.
+        static const s32 s_max_layers = 256;
+
+        struct overlay_t
+        {
+            u8* mRedirect;              // Per file index, the layer that the file is loaded from
+            u32 mCount;                 // Entries in mRedirect, the largest file count of the layers
+            s32 mNumLayers;             //
+            s32 mLayers[s_max_layers];  // Archive index of every layer
+        };
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Arenas ---------------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Loads through the loader of an arena allocate their data linearly from large blocks, which are only
+        // freed when the arena is destroyed. Slots with data in an arena are linked in its list, releasing the
+        // arena drops them with one walk of that list and frees the blocks at once. Slots that still have
+        // owners keep a released arena alive, it is destroyed when the last of them loses its last owner.
+        static const u64 s_arena_alignment = 16;
+
+        struct arenablock_t
+        {
+            arenablock_t* mNext;
+            u64           mSize;  // Bytes that follow the header
+            u64           mUsed;  //
+            u64           mPadding;
+        };
+
+        // Blocks come from an alloc_t, which takes the size as a u32
+        static const u64 s_arena_max_block = 0xFFFFFFFFull - sizeof(arenablock_t);
+
+        class archive_imp_t;
+
+        class archive_t::arena_t : public archive_loader_t
+        {
+        public:
+            void  setup(archive_imp_t* imp, u64 blockSize);
+            void  teardown();
+            void* allocate(u64 size);
+
+            void* v_get_datafile_ptr(fileid_t fileid) override;
+            void* v_get_dataunit_ptr(u32 dataunit_index) override;
+            void* v_load_datafile(fileid_t fileid) override;
+            void* v_load_dataunit(u32 dataunit_index) override;
+            void  v_load_datafiles(fileid_t const* fileids, s32 count, void** outData) override;
+            void  v_unload_datafile(fileid_t fileid, void*& data) override;
+            void  v_unload_dataunit(u32 dataunit_index, void*& data) override;
+
+            loadhandle_t v_load_datafile_async(fileid_t fileid, EPriority priority, u64 deadline) override;
+            loadhandle_t v_load_dataunit_async(u32 dataunit_index, EPriority priority, u64 deadline) override;
+            bool         v_is_done(loadhandle_t const& handle) override;
+            void*        v_wait(loadhandle_t const& handle) override;
+            bool         v_reprioritize(loadhandle_t const& handle, EPriority priority, u64 deadline) override;
+            bool         v_cancel(loadhandle_t const& handle) override;
+
+            loadgroup_t v_load_dataunit_group(u32 dataunit_index, EPriority priority, u64 deadline) override;
+            void        v_unload_group(loadgroup_t& group) override;
+
+            archive_imp_t*     mImp;
+            u64                mBlockSize;  //
+            arenablock_t*      mBlocks;     // The block that is allocated from, followed by full and oversized blocks
+            nplatform::mutex_t mMutex;      // Guards mBlocks
+            slot_t             mSlots;      // Sentinel of the slots with data in this arena, guarded by the cache mutex
+            arena_t*           mNextArena;  // Arenas of the archive that are not destroyed yet
+            bool               mReleased;   // Destroyed as soon as no slot has data in it anymore
+        };
+
+        // The arena that loads on this thread allocate from, nullptr for the heap
+        static thread_local archive_t::arena_t* s_arena = nullptr;
+
+        struct arenascope_t
+        {
+            inline arenascope_t(archive_t::arena_t* arena)
+                : mPrevious(s_arena)
+            {
+                s_arena = arena;
+            }
+            inline ~arenascope_t() { s_arena = mPrevious; }
+
+            archive_t::arena_t* mPrevious;
         };
 
+        static inline void s_arena_link(slot_t* head, slot_t* slot)
+        {
+            slot->mArenaPrev             = head->mArenaPrev;
+            slot->mArenaNext             = head;
+            head->mArenaPrev->mArenaNext = slot;
+            head->mArenaPrev             = slot;
+        }
+
+        static inline void s_arena_unlink(slot_t* slot)
+        {
+            slot->mArenaPrev->mArenaNext = slot->mArenaNext;
+            slot->mArenaNext->mArenaPrev = slot->mArenaPrev;
+            slot->mArenaPrev             = nullptr;
+            slot->mArenaNext             = nullptr;
+        }
+
         // ------------------------------------------------------------------------------------------------
         // ------- Data Archive, implementation -----------------------------------------------------------
         // ------------------------------------------------------------------------------------------------
         class archive_imp_t : public archive_loader_t
         {
         public:
-            void                     setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataFileArchives);
+            void                     setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataFileArchives, archive_t::config_t const& config);
             void                     teardown();
+            s32                      mount(s32 archiveIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            archivefile_t*           openArchive(s32 archiveIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            void                     attach(s32 archiveIndex, archivefile_t* archive);
+            void                     unmount(s32 archiveIndex);
+            s32                      mountOverlay(s32 archiveIndex, s32 baseIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            void                     buildRedirect(s32 baseIndex);
+            void                     rebuildRedirect(s32 archiveIndex);
+            bool                     changed(s32 archiveIndex) const;
+            s32                      reload(s32 archiveIndex, archive_t::reload_fn callback, void* context);
+            fileid_t                 resolve(fileid_t id) const;
+            slot_t*                  heldSlot(fileid_t id, void const* data);
             bool                     exists(fileid_t id) const;
             archive_t::file_t const* fileitem(fileid_t id) const;
             string_t                 filename(fileid_t id) const;
+            fileid_t                 find(u64 hash) const;
+            s32                      find(u64 const* hashes, s32 count, fileid_t* outIds) const;
+
+            slot_t* datafileSlot(fileid_t fileid, bool touch);
+            slot_t* dataunitSlot(u32 dataunit_index, bool touch);
+            EClaim  acquire(slot_t* slot, void*& data, bool wait);
+            void    publish(slot_t* slot, void* data, u32 size);
+            void    release(slot_t* slot);
+            void    settle(slot_t* slot);
+            void    evict(u64 budget);
+            void    drop(slot_t* slot);
+            void    discard(slot_t* slot);
+            void    discard(slottable_t& table);
+            void    unshare(slot_t* slot);
+            void    unshare(slottable_t& table, slottable_t const& from);
+            bool    sharedWith(fileid_t fileid, fileid_t& canonical) const;
+            void*   readShared(fileid_t fileid, slot_t* slot);
+            void    setResidencyBudget(u64 bytes);
+            u64     residentBytes();
+            u64     residentBytes(s32 archiveIndex);
+            s64     read(archivefile_t* dataArchive, u64 offset, u64 size, void* destination, u32 fileIndex);
+            void*   readFile(fileid_t fileid, u32& size);
+            void*   readCompressed(fileid_t fileid, u32& size);
+            void*   readUnit(fileid_t fileid, u32 dataunit_index, u32& size);
+            void*   inPlace(fileid_t fileid, bool& corrupt);
+            bool    verified(fileid_t fileid, void const* data, u64 size);
+            bool    matches(fileid_t fileid, u64 hash);
+            s32     verify(s32 archiveIndex, fileid_t* outCorrupt, s32 maxCorrupt, s32 numThreads);
+            void*   allocData(u64 size);
+            void    freeData(void* data);
+
+            archive_t::arena_t* createArena(u64 blockSize);
+            void                releaseArena(archive_t::arena_t* arena);
+            void                destroyArena(archive_t::arena_t* arena);
+            void                leaveArena(slot_t* slot);
 
             void* v_get_datafile_ptr(fileid_t fileid) override;
             void* v_get_dataunit_ptr(u32 dataunit_index) override;
             void* v_load_datafile(fileid_t fileid) override;
             void* v_load_dataunit(u32 dataunit_index) override;
+            void  v_load_datafiles(fileid_t const* fileids, s32 count, void** outData) override;
             void  v_unload_datafile(fileid_t fileid, void*& data) override;
             void  v_unload_dataunit(u32 dataunit_index, void*& data) override;
 
+            loadhandle_t v_load_datafile_async(fileid_t fileid, EPriority priority, u64 deadline) override;
+            loadhandle_t v_load_dataunit_async(u32 dataunit_index, EPriority priority, u64 deadline) override;
+            bool         v_is_done(loadhandle_t const& handle) override;
+            void*        v_wait(loadhandle_t const& handle) override;
+            bool         v_reprioritize(loadhandle_t const& handle, EPriority priority, u64 deadline) override;
+            bool         v_cancel(loadhandle_t const& handle) override;
+
+            loadgroup_t  v_load_dataunit_group(u32 dataunit_index, EPriority priority, u64 deadline) override;
+            void         v_unload_group(loadgroup_t& group) override;
+
+            loadhandle_t enqueue(fileid_t fileid, s32 dataunit_index, group_t* group, EPriority priority, u64 deadline);
+            s32          gather(s32 index, s32* batch);
+            void         serve(s32 const* batch, s32 count);
+            bool         queued(loadhandle_t const& handle) const;
+            void         loadGroup(group_t* group);
+
+            static void s_stream_job(void* context, u64);
+
             alloc_t*               mAllocator;
+            archive_t::EBackend    mBackend;
             s32                    mNumDataUnits;
             s32                    mNumArchives;
             archivefile_t**        mArchives;
             archive_t::section_t** mArchiveSections;
-            void***                mDataFilePtrs;
-            dataunit_header_t**    mDataUnitPtrs;
+            overlay_t**            mOverlays;         // Per archive, the layers on top of it or nullptr
+            slottable_t*           mDataFileSlots;    // Per archive, per file
+            slottable_t            mDataUnitSlots;    // Per dataunit, the data points to the dataunit_header_t
+            jobs_t                 mJobs;             // Background I/O threads serving the async loads
+            streamqueue_t          mStream;           // Async loads that have not started yet
+            nplatform::mutex_t     mStreamMutex;      // Guards mStream
+            nplatform::cond_t      mStreamDone;       // Broadcast when a request completed
+            nplatform::mutex_t     mCacheMutex;       // Guards the LRU list and the residency accounting
+            slot_t                 mLru;              // Sentinel of the list of resident slots without owners, oldest first
+            u64                    mResidentBytes;    // Heap bytes held by resident slots
+            u64                    mResidencyBudget;  // Unreferenced slots are evicted while mResidentBytes exceeds this
+            bool                   mDeduplicate;      // Identical datafiles share the data of their canonical slot
+            bool                   mVerify;           // Files that are read are checked against their HDB hash
+            archive_t::arena_t*    mArenas;           // Arenas that are not destroyed yet, guarded by the cache mutex
+            telemetry_t            mTelemetry;        // Counters, timing and trace of the loads
         };
 
-        void archive_imp_t::setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataFileArchives)
+        void archive_imp_t::setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataFileArchives, archive_t::config_t const& config)
         {
             mAllocator       = allocator;
+            mBackend         = config.mBackend;
             mNumDataUnits    = maxNumDataUnits;
             mNumArchives     = maxNumDataFileArchives;
             mArchives        = g_allocate_array_and_clear<archivefile_t*>(allocator, maxNumDataFileArchives);
             mArchiveSections = g_allocate_array_and_clear<archive_t::section_t*>(allocator, maxNumDataFileArchives);
-            mDataFilePtrs    = g_allocate_array_and_clear<void**>(allocator, maxNumDataFileArchives);
-            mDataUnitPtrs    = g_allocate_array_and_clear<dataunit_header_t*>(allocator, maxNumDataUnits);
+            mOverlays        = g_allocate_array_and_clear<overlay_t*>(allocator, maxNumDataFileArchives);
+            mDataFileSlots   = g_allocate_array_and_clear<slottable_t>(allocator, maxNumDataFileArchives);
+            mDataUnitSlots.setup(allocator, maxNumDataUnits);
+            mJobs.setup(allocator, config.mNumIoThreads, config.mMaxAsyncLoads);
+            mStream.setup(allocator, config.mMaxAsyncLoads);
+            nplatform::mutex_init(mStreamMutex);
+            nplatform::cond_init(mStreamDone);
+
+            nplatform::mutex_init(mCacheMutex);
+            mLru.mPrev       = &mLru;
+            mLru.mNext       = &mLru;
+            mResidentBytes   = 0;
+            mResidencyBudget = config.mResidencyBudget;
+            mDeduplicate     = config.mDeduplicate;
+            mVerify          = config.mVerify;
+            mArenas          = nullptr;
+            mTelemetry.setup(allocator);
+        }
+
+        void archive_imp_t::teardown()
+        {
+            // Finish any async load that is still queued or in flight before releasing memory
+            mJobs.teardown();
+            mStream.teardown(mAllocator);
+            nplatform::cond_destroy(mStreamDone);
+            nplatform::mutex_destroy(mStreamMutex);
+
+            discard(mDataUnitSlots);
+
+            for (s32 i = 0; i < mNumArchives; ++i)
+            {
+                unmount(i);
+            }
+
+            g_deallocate(mAllocator, mArchives);
+            g_deallocate(mAllocator, mArchiveSections);
+            g_deallocate(mAllocator, mOverlays);
+            g_deallocate(mAllocator, mDataFileSlots);
+
+            // Every slot is gone, what is left are arenas that were never released
+            nplatform::mutex_lock(mCacheMutex);
+            while (mArenas != nullptr)
+                destroyArena(mArenas);
+            nplatform::mutex_unlock(mCacheMutex);
+            nplatform::mutex_destroy(mCacheMutex);
+            mTelemetry.teardown();
+        }
+
+        s32 archive_imp_t::mount(s32 archiveIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename)
+        {
+            if (archiveIndex < 0 || archiveIndex >= mNumArchives)
+                return -1;
+
+            unmount(archiveIndex);
+
+            archivefile_t* archive = openArchive(archiveIndex, archiveFilename, tocFilename, filenameDbFilename, hashDbFilename);
+            if (archive == nullptr)
+                return -1;
+            attach(archiveIndex, archive);
+            return 0;
+        }
+
+        // Open the files of an archive without touching what is mounted, nullptr when they can not be opened.
+        // Without a TOC filename the archive is a packed archive.
+        archivefile_t* archive_imp_t::openArchive(s32 archiveIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename)
+        {
+            archivefile_t* archive = g_allocate<archivefile_t>(mAllocator);
+            s32 const      result  = tocFilename != nullptr ? archive->open(mAllocator, mBackend, archiveFilename, tocFilename, filenameDbFilename, hashDbFilename) : archive->openPacked(mAllocator, mBackend, archiveFilename);
+            if (result < 0)
+            {
+                archive->close(mAllocator);
+                g_deallocate(mAllocator, archive);
+                return nullptr;
+            }
+            archive->mIndex = archiveIndex;
+            return archive;
+        }
+
+        // Make an opened archive the one at archiveIndex, which must be unmounted
+        void archive_imp_t::attach(s32 archiveIndex, archivefile_t* archive)
+        {
+            archive_t::section_t const* section = archive->section(archiveIndex);
+            mArchives[archiveIndex]             = archive;
+            mArchiveSections[archiveIndex]      = (archive_t::section_t*)section;
+            mDataFileSlots[archiveIndex].setup(mAllocator, section->m_ItemArrayCount);
+
+            if (mOverlays[archiveIndex] != nullptr)
+                buildRedirect(archiveIndex);
+        }
+
+        void archive_imp_t::unmount(s32 archiveIndex)
+        {
+            archivefile_t* archive = mArchives[archiveIndex];
+            if (archive == nullptr)
+                return;
+
+            // An overlay first stops shadowing the files of its base
+            if (archive->mBase >= 0)
+            {
+                overlay_t* overlay = mOverlays[archive->mBase];
+                s32        layer   = 1;
+                while (overlay->mLayers[layer] != archiveIndex)
+                    layer += 1;
+                for (; layer < (overlay->mNumLayers - 1); ++layer)
+                    overlay->mLayers[layer] = overlay->mLayers[layer + 1];
+                overlay->mNumLayers -= 1;
+
+                if (overlay->mNumLayers == 1)
+                {
+                    g_deallocate(mAllocator, overlay->mRedirect);
+                    g_deallocate(mAllocator, overlay);
+                    mOverlays[archive->mBase] = nullptr;
+                }
+                else
+                {
+                    buildRedirect(archive->mBase);
+                }
+            }
+
+            // Files that share data of this archive lose it as well, this archive included so that no
+            // slot of it is still owned by a duplicate when it is discarded
+            if (mDeduplicate)
+            {
+                for (s32 i = 0; i < mNumArchives; ++i)
+                {
+                    if (mArchives[i] != nullptr)
+                        unshare(mDataFileSlots[i], mDataFileSlots[archiveIndex]);
+                }
+            }
+            discard(mDataFileSlots[archiveIndex]);
+
+            archive->close(mAllocator);
+            g_deallocate(mAllocator, archive);
+
+            mArchives[archiveIndex]        = nullptr;
+            mArchiveSections[archiveIndex] = nullptr;
+
+            // Overlays stay on top of an unmounted base, they still serve the files that they have
+            if (mOverlays[archiveIndex] != nullptr)
+                buildRedirect(archiveIndex);
+        }
+
+        s32 archive_imp_t::mountOverlay(s32 archiveIndex, s32 baseIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename)
+        {
+            if (archiveIndex < 0 || archiveIndex >= mNumArchives || baseIndex < 0 || baseIndex >= mNumArchives)
+                return -1;
+
+            // Layers all stack on the bottom archive, an archive that has layers can not be a layer itself
+            if (mArchives[baseIndex] != nullptr && mArchives[baseIndex]->mBase >= 0)
+                baseIndex = mArchives[baseIndex]->mBase;
+            if (baseIndex == archiveIndex || mOverlays[archiveIndex] != nullptr)
+                return -1;
+
+            // A layer of this base that is replaced frees its place, whatever is mounted at archiveIndex stays
+            // mounted until the new layer is open
+            archivefile_t const* current  = mArchives[archiveIndex];
+            s32 const            replaced = (current != nullptr && current->mBase == baseIndex) ? 1 : 0;
+            if (mOverlays[baseIndex] != nullptr && (mOverlays[baseIndex]->mNumLayers - replaced) >= s_max_layers)
+                return -1;
+            archivefile_t* archive = openArchive(archiveIndex, archiveFilename, tocFilename, filenameDbFilename, hashDbFilename);
+            if (archive == nullptr)
+                return -1;
+
+            unmount(archiveIndex);
+            attach(archiveIndex, archive);
+
+            // Unmounting the last layer of the base removed its overlay
+            overlay_t* overlay = mOverlays[baseIndex];
+            if (overlay == nullptr)
+            {
+                overlay             = g_allocate<overlay_t>(mAllocator);
+                overlay->mRedirect  = nullptr;
+                overlay->mCount     = 0;
+                overlay->mNumLayers = 1;
+                overlay->mLayers[0] = baseIndex;
+                mOverlays[baseIndex] = overlay;
+            }
+            overlay->mLayers[overlay->mNumLayers++] = archiveIndex;
+            mArchives[archiveIndex]->mBase          = baseIndex;
+            buildRedirect(baseIndex);
+            return 0;
+        }
+
+        // The table covers the largest file count of the layers, files that a layer adds beyond the end of
+        // the base are found through the base archive index as well
+        void archive_imp_t::buildRedirect(s32 baseIndex)
+        {
+            overlay_t* overlay = mOverlays[baseIndex];
+            g_deallocate(mAllocator, overlay->mRedirect);
+
+            u32 count = 0;
+            for (s32 l = 0; l < overlay->mNumLayers; ++l)
+            {
+                archive_t::section_t const* section = mArchiveSections[overlay->mLayers[l]];
+                if (section != nullptr && section->m_ItemArrayCount > count)
+                    count = section->m_ItemArrayCount;
+            }
+
+            overlay->mRedirect = count > 0 ? g_allocate_array_and_clear<u8>(mAllocator, count) : nullptr;
+            overlay->mCount    = count;
+            for (s32 l = 1; l < overlay->mNumLayers; ++l)
+            {
+                s32 const                   layerIndex = overlay->mLayers[l];
+                archivefile_t const*        layer      = mArchives[layerIndex];
+                archive_t::section_t const* section    = mArchiveSections[layerIndex];
+                for (u32 f = 0; f < section->m_ItemArrayCount; ++f)
+                {
+                    if (layer->file(fileid_t((u32)layerIndex, f))->isValid())
+                        overlay->mRedirect[f] = (u8)l;
+                }
+            }
+        }
+
+        // Map a file id to the archive of the newest layer that has the file
+        fileid_t archive_imp_t::resolve(fileid_t id) const
+        {
+            if (id.getArchiveIndex() < (u32)mNumArchives)
+            {
+                overlay_t const* overlay = mOverlays[id.getArchiveIndex()];
+                if (overlay != nullptr && id.getFileIndex() < overlay->mCount)
+                {
+                    u8 const layer = overlay->mRedirect[id.getFileIndex()];
+                    if (layer != 0)
+                        return fileid_t((u32)overlay->mLayers[layer], id.getFileIndex());
+                }
+            }
+            return id;
+        }
+
+        bool archive_imp_t::exists(fileid_t fileid) const
+        {
+            fileid_t const id = resolve(fileid);
+            if (id.getArchiveIndex() < mNumArchives)
+            {
+                archivefile_t* datafile = mArchives[id.getArchiveIndex()];
+                return datafile != nullptr && datafile->exists(id);
+            }
+            return false;
+        }
+
+        archive_t::file_t const* archive_imp_t::fileitem(fileid_t fileid) const
+        {
+            fileid_t const id = resolve(fileid);
+            if (id.getArchiveIndex() < mNumArchives)
+            {
+                archivefile_t* datafile = mArchives[id.getArchiveIndex()];
+                return datafile != nullptr ? datafile->file(id) : nullptr;
+            }
+            return nullptr;
+        }
+
+        fileid_t archive_imp_t::find(u64 hash) const
+        {
+            fileid_t id;
+            for (s32 i = 0; i < mNumArchives; ++i)
+            {
+                if (mArchives[i] != nullptr && mArchives[i]->find(hash, id))
+                    return id;
+            }
+            return INVALID_FILEID;
+        }
+
+        // The groups of the hashes a few lookups ahead are prefetched, so that resolving many hashes is
+        // bound by memory bandwidth instead of by the latency of every miss.
+        static const s32 s_find_prefetch_distance = 8;
+
+        s32 archive_imp_t::find(u64 const* hashes, s32 count, fileid_t* outIds) const
+        {
+            s32 found = 0;
+            for (s32 i = 0; i < count; ++i)
+            {
+                if ((i + s_find_prefetch_distance) < count)
+                {
+                    for (s32 a = 0; a < mNumArchives; ++a)
+                    {
+                        if (mArchives[a] != nullptr)
+                            mArchives[a]->index().prefetch(hashes[i + s_find_prefetch_distance]);
+                    }
+                }
+                outIds[i] = find(hashes[i]);
+                if (outIds[i].getArchiveIndex() != INVALID_FILEID.getArchiveIndex())
+                    found += 1;
+            }
+            return found;
+        }
+
+        string_t archive_imp_t::filename(fileid_t fileid) const
+        {
+            fileid_t const id = resolve(fileid);
+            if (id.getArchiveIndex() < mNumArchives)
+            {
+                archivefile_t* datafile = mArchives[id.getArchiveIndex()];
+                return datafile != nullptr ? datafile->filename(id) : string_t();
+            }
+            return string_t();
+        }
+
+        // Lookups that only read a slot do not touch it, an untouched page holds no loaded data
+        slot_t* archive_imp_t::datafileSlot(fileid_t fileid, bool touch)
+        {
+            if (fileid.getArchiveIndex() < (u32)mNumArchives && mArchives[fileid.getArchiveIndex()] != nullptr)
+            {
+                slottable_t& table = mDataFileSlots[fileid.getArchiveIndex()];
+                return touch ? table.get(mAllocator, fileid.getFileIndex()) : table.find(fileid.getFileIndex());
+            }
+            return nullptr;
+        }
+
+        slot_t* archive_imp_t::dataunitSlot(u32 dataunit_index, bool touch)
+        {
+            // Dataunits all live in archive 0
+            fileid_t fileid(0, dataunit_index);
+            if (fileid.getArchiveIndex() < (u32)mNumArchives)
+            {
+                archive_t::section_t const* section = mArchiveSections[fileid.getArchiveIndex()];
+                if (section != nullptr && fileid.getFileIndex() < section->m_ItemArrayCount)
+                {
+                    return touch ? mDataUnitSlots.get(mAllocator, dataunit_index) : mDataUnitSlots.find(dataunit_index);
+                }
+            }
+            return nullptr;
+        }
+
+        static inline void s_lru_link(slot_t* head, slot_t* slot)
+        {
+            slot->mPrev        = head->mPrev;
+            slot->mNext        = head;
+            head->mPrev->mNext = slot;
+            head->mPrev        = slot;
+        }
+
+        static inline void s_lru_unlink(slot_t* slot)
+        {
+            slot->mPrev->mNext = slot->mNext;
+            slot->mNext->mPrev = slot->mPrev;
+            slot->mPrev        = nullptr;
+            slot->mNext        = nullptr;
+        }
+
+        static void* s_resident(slot_t const* slot)
+        {
+            return nplatform::atomic_load(&slot->mState) >= s_slot_cached ? slot->mData : nullptr;
+        }
+
+        // Take ownership of a resident slot or claim an empty one for loading. With wait == false this does
+        // not wait for a load or an eviction by another thread to finish and returns ClaimBusy instead.
+        EClaim archive_imp_t::acquire(slot_t* slot, void*& data, bool wait)
+        {
+            data = nullptr;
+            while (true)
+            {
+                s32 const state = nplatform::atomic_load(&slot->mState);
+                if (state >= s_slot_cached)
+                {
+                    if (nplatform::atomic_cas(&slot->mState, state, state + 1))
+                    {
+                        if (state == s_slot_cached)
+                        {
+                            // Owned again, it is no longer a candidate for eviction
+                            nplatform::scoped_lock_t lock(mCacheMutex);
+                            if (slot->mNext != nullptr)
+                                s_lru_unlink(slot);
+                        }
+                        data = slot->mData;
+                        return ClaimResident;
+                    }
+                }
+                else if (state == s_slot_empty)
+                {
+                    if (nplatform::atomic_cas(&slot->mState, s_slot_empty, s_slot_loading))
+                        return ClaimWon;
+                }
+                else if (!wait)
+                {
+                    return ClaimBusy;
+                }
+                else
+                {
+                    nplatform::thread_yield();
+                }
+            }
+        }
+
+        // Finish a won claim, the loading thread becomes the first owner. On failure (data == nullptr)
+        // the slot is released again so that a later load can retry.
+        void archive_imp_t::publish(slot_t* slot, void* data, u32 size)
+        {
+            if (data == nullptr)
+            {
+                nplatform::atomic_store(&slot->mState, s_slot_empty);
+                return;
+            }
+
+            // Data in an arena, also when shared from a slot in an arena, is released with the arena
+            archive_t::arena_t* arena = slot->mShared != nullptr ? slot->mShared->mArena : (size > 0 ? s_arena : nullptr);
+            slot->mData               = data;
+            slot->mSize               = arena != nullptr ? 0 : size;
+            if (arena != nullptr)
+            {
+                nplatform::scoped_lock_t lock(mCacheMutex);
+                slot->mArena = arena;
+                s_arena_link(&arena->mSlots, slot);
+            }
+            else if (size > 0)
+            {
+                nplatform::scoped_lock_t lock(mCacheMutex);
+                mResidentBytes += size;
+                evict(mResidencyBudget);
+            }
+            nplatform::atomic_store(&slot->mState, s_slot_cached + 1);
+        }
+
+        void archive_imp_t::release(slot_t* slot)
+        {
+            s32 const state = nplatform::atomic_add(&slot->mState, -1);
+            ASSERT(state >= s_slot_cached);
+            if (state == s_slot_cached)
+            {
+                nplatform::scoped_lock_t lock(mCacheMutex);
+                if (nplatform::atomic_load(&slot->mState) == s_slot_cached)
+                    settle(slot);
+                evict(mResidencyBudget);
+            }
+        }
+
+        // Cache mutex must be held. The last owner of the slot is gone, keep it around as the most recently
+        // used entry, unless its arena was released.
+        void archive_imp_t::settle(slot_t* slot)
+        {
+            if (slot->mArena != nullptr && slot->mArena->mReleased)
+            {
+                if (nplatform::atomic_cas(&slot->mState, s_slot_cached, s_slot_evicting))
+                    drop(slot);
+            }
+            else if (slot->mNext == nullptr)
+            {
+                s_lru_link(&mLru, slot);
+            }
+        }
+
+        // Cache mutex must be held. Slots that got an owner after they entered the list fail the CAS
+        // and are skipped, the new owner takes them out of the list.
+        void archive_imp_t::evict(u64 budget)
+        {
+            slot_t* slot = mLru.mNext;
+            while (slot != &mLru && mResidentBytes > budget)
+            {
+                slot_t* next = slot->mNext;
+                if (nplatform::atomic_cas(&slot->mState, s_slot_cached, s_slot_evicting))
+                {
+                    mTelemetry.count(telemetry_t::CounterEvictions);
+                    s_lru_unlink(slot);
+                    mResidentBytes -= slot->mSize;
+                    if (slot->mSize > 0)
+                        g_deallocate(mAllocator, slot->mData);
+                    slot->mData = nullptr;
+                    slot->mSize = 0;
+                    if (slot->mArena != nullptr)
+                        leaveArena(slot);
+                    if (slot->mShared != nullptr)
+                    {
+                        // The canonical slot can now be at the end of the list, visit it as well
+                        unshare(slot);
+                        if (next == &mLru)
+                            next = mLru.mPrev;
+                    }
+                    nplatform::atomic_store(&slot->mState, s_slot_empty);
+                }
+                slot = next;
+            }
+        }
+
+        // Cache mutex must be held. Release the data of a slot regardless of its owners, mSize is only
+        // non-zero while the slot is resident.
+        void archive_imp_t::drop(slot_t* slot)
+        {
+            if (slot->mNext != nullptr)
+                s_lru_unlink(slot);
+            mResidentBytes -= slot->mSize;
+            if (slot->mSize > 0)
+                g_deallocate(mAllocator, slot->mData);
+            if (slot->mShared != nullptr)
+                unshare(slot);
+            if (slot->mArena != nullptr)
+                leaveArena(slot);
+            slot->mData = nullptr;
+            slot->mSize = 0;
+            nplatform::atomic_store(&slot->mState, s_slot_empty);
+        }
+
+        // Only used when unmounting and at teardown
+        void archive_imp_t::discard(slot_t* slot)
+        {
+            nplatform::scoped_lock_t lock(mCacheMutex);
+            drop(slot);
+        }
+
+        void archive_imp_t::discard(slottable_t& table)
+        {
+            for (u32 p = 0; p < table.mNumPages; ++p)
+            {
+                slot_t* slots = table.page(p);
+                if (slots != nullptr)
+                {
+                    for (u32 i = 0; i < s_slots_per_page; ++i)
+                        discard(&slots[i]);
+                }
+            }
+            table.teardown(mAllocator);
+        }
+
+        // Cache mutex must be held. Drop the ownership that a slot holds of the slot it shares data with, when
+        // that was the last owner the canonical slot is cached like any other.
+        void archive_imp_t::unshare(slot_t* slot)
+        {
+            slot_t* canonical = slot->mShared;
+            slot->mShared     = nullptr;
+            s32 const state   = nplatform::atomic_add(&canonical->mState, -1);
+            ASSERT(state >= s_slot_cached);
+            if (state == s_slot_cached)
+                settle(canonical);
+        }
+
+        // Discard the slots of a table that share data of the slots in another table
+        void archive_imp_t::unshare(slottable_t& table, slottable_t const& from)
+        {
+            for (u32 p = 0; p < table.mNumPages; ++p)
+            {
+                slot_t* slots = table.page(p);
+                if (slots != nullptr)
+                {
+                    for (u32 i = 0; i < s_slots_per_page; ++i)
+                    {
+                        if (slots[i].mShared != nullptr && from.contains(slots[i].mShared))
+                            discard(&slots[i]);
+                    }
+                }
+            }
+        }
+
+        // A file shares the data of the first file in mount order that has the same hash, size and
+        // compression. Return false when the file is that file itself or deduplication is off.
+        bool archive_imp_t::sharedWith(fileid_t fileid, fileid_t& canonical) const
+        {
+            if (!mDeduplicate)
+                return false;
+
+            archivefile_t const* archive = mArchives[fileid.getArchiveIndex()];
+            u64 const            hash    = archive->hash(fileid);
+            if (hash == 0)
+                return false;
+
+            archive_t::file_t const* entry = archive->file(fileid);
+            for (s32 i = 0; i < mNumArchives; ++i)
+            {
+                if (mArchives[i] == nullptr || !mArchives[i]->find(hash, canonical) || (mOverlays[i] != nullptr && resolve(canonical).getArchiveIndex() != (u32)i))
+                    continue;
+                if (canonical.getArchiveIndex() == fileid.getArchiveIndex() && canonical.getFileIndex() == fileid.getFileIndex())
+                    return false;
+                archive_t::file_t const* other = mArchives[i]->file(canonical);
+                if (other->getFileSize() == entry->getFileSize() && other->isCompressed() == entry->isCompressed())
+                    return true;
+            }
+            return false;
+        }
+
+        // Load the data of a duplicate file through its canonical file, the claimed slot of the duplicate
+        // keeps the ownership of the canonical slot that this takes
+        void* archive_imp_t::readShared(fileid_t fileid, slot_t* slot)
+        {
+            fileid_t canonical;
+            if (!sharedWith(fileid, canonical))
+                return nullptr;
+
+            void* data = v_load_datafile(canonical);
+            if (data == nullptr)
+                return nullptr;
+
+            // Only share within one arena (or the heap), data of another arena can be released before this
+            slot_t* canonicalSlot = datafileSlot(canonical, false);
+            if (canonicalSlot->mArena != s_arena)
+            {
+                release(canonicalSlot);
+                return nullptr;
+            }
+            slot->mShared = canonicalSlot;
+            return data;
+        }
+
+        void archive_imp_t::setResidencyBudget(u64 bytes)
+        {
+            nplatform::scoped_lock_t lock(mCacheMutex);
+            mResidencyBudget = bytes;
+            evict(mResidencyBudget);
+        }
+
+        u64 archive_imp_t::residentBytes()
+        {
+            nplatform::scoped_lock_t lock(mCacheMutex);
+            return mResidentBytes;
+        }
+
+        static u64 s_resident_bytes(slottable_t const& table)
+        {
+            u64 bytes = 0;
+            for (u32 p = 0; p < table.mNumPages; ++p)
+            {
+                slot_t const* slots = table.page(p);
+                if (slots != nullptr)
+                {
+                    for (u32 i = 0; i < s_slots_per_page; ++i)
+                        bytes += slots[i].mSize;
+                }
+            }
+            return bytes;
+        }
+
+        // Walks the slots of the archive, for reporting only. Dataunits all live in archive 0.
+        u64 archive_imp_t::residentBytes(s32 archiveIndex)
+        {
+            if (archiveIndex < 0 || archiveIndex >= mNumArchives)
+                return 0;
+            nplatform::scoped_lock_t lock(mCacheMutex);
+            u64                      bytes = s_resident_bytes(mDataFileSlots[archiveIndex]);
+            if (archiveIndex == 0)
+                bytes += s_resident_bytes(mDataUnitSlots);
+            return bytes;
+        }
+
+        // Datafiles are allocated from the arena that the calling thread loads into, or from the heap. Returns
+        // nullptr when the allocation fails, the allocator takes the size as a u32.
+        void* archive_imp_t::allocData(u64 size)
+        {
+            archive_t::arena_t* arena = s_arena;
+            if (arena != nullptr)
+                return arena->allocate(size);
+            return size <= 0xFFFFFFFFull ? g_allocate_array<byte>(mAllocator, size) : nullptr;
+        }
+
+        // Arena memory is only returned when the arena is destroyed
+        void archive_imp_t::freeData(void* data)
+        {
+            if (s_arena == nullptr)
+                g_deallocate(mAllocator, data);
+        }
+
+        archive_t::arena_t* archive_imp_t::createArena(u64 blockSize)
+        {
+            archive_t::arena_t* arena = g_allocate<archive_t::arena_t>(mAllocator);
+            arena->setup(this, blockSize);
+
+            nplatform::scoped_lock_t lock(mCacheMutex);
+            arena->mNextArena = mArenas;
+            mArenas           = arena;
+            return arena;
+        }
+
+        // Drop every slot of the arena that has no owners, duplicates first since they hold an ownership of
+        // the slot that they share
+        void archive_imp_t::releaseArena(archive_t::arena_t* arena)
+        {
+            nplatform::scoped_lock_t lock(mCacheMutex);
+            for (s32 pass = 0; pass < 2; ++pass)
+            {
+                slot_t* slot = arena->mSlots.mArenaNext;
+                while (slot != &arena->mSlots)
+                {
+                    slot_t* next = slot->mArenaNext;
+                    if ((slot->mShared != nullptr) == (pass == 0) && nplatform::atomic_cas(&slot->mState, s_slot_cached, s_slot_evicting))
+                        drop(slot);
+                    slot = next;
+                }
+            }
+
+            // From now on a slot of the arena is dropped when it loses its last owner
+            arena->mReleased = true;
+            if (arena->mSlots.mArenaNext == &arena->mSlots)
+                destroyArena(arena);
+        }
+
+        // Cache mutex must be held
+        void archive_imp_t::destroyArena(archive_t::arena_t* arena)
+        {
+            archive_t::arena_t** link = &mArenas;
+            while (*link != arena)
+                link = &(*link)->mNextArena;
+            *link = arena->mNextArena;
+
+            arena->teardown();
+            g_deallocate(mAllocator, arena);
+        }
+
+        // Cache mutex must be held
+        void archive_imp_t::leaveArena(slot_t* slot)
+        {
+            archive_t::arena_t* arena = slot->mArena;
+            s_arena_unlink(slot);
+            slot->mArena = nullptr;
+            if (arena->mReleased && arena->mSlots.mArenaNext == &arena->mSlots)
+                destroyArena(arena);
+        }
+
+        void archive_t::arena_t::setup(archive_imp_t* imp, u64 blockSize)
+        {
+            mImp              = imp;
+            mBlockSize        = blockSize < s_arena_max_block ? blockSize : s_arena_max_block;
+            mBlocks           = nullptr;
+            mSlots.mArenaPrev = &mSlots;
+            mSlots.mArenaNext = &mSlots;
+            mNextArena        = nullptr;
+            mReleased         = false;
+            nplatform::mutex_init(mMutex);
+        }
+
+        void archive_t::arena_t::teardown()
+        {
+            while (mBlocks != nullptr)
+            {
+                arenablock_t* next = mBlocks->mNext;
+                mImp->mAllocator->deallocate(mBlocks);
+                mBlocks = next;
+            }
+            nplatform::mutex_destroy(mMutex);
+        }
+
+        // Return nullptr when the data does not fit in a block or the allocator fails, the load then fails
+        void* archive_t::arena_t::allocate(u64 size)
+        {
+            if (size > s_arena_max_block)
+                return nullptr;
+            u64 const                aligned = (size + s_arena_alignment - 1) & ~(s_arena_alignment - 1);
+            nplatform::scoped_lock_t lock(mMutex);
+
+            arenablock_t* block = mBlocks;
+            if (block == nullptr || (block->mSize - block->mUsed) < aligned)
+            {
+                // Data that is larger than a block gets a block of its own, the current block stays in front
+                bool const oversized = aligned > mBlockSize;
+                u64 const  blockSize = oversized ? aligned : mBlockSize;
+                if (blockSize > s_arena_max_block)
+                    return nullptr;
+                arenablock_t* fresh = (arenablock_t*)mImp->mAllocator->allocate((u32)(sizeof(arenablock_t) + blockSize), (u32)s_arena_alignment);
+                if (fresh == nullptr)
+                    return nullptr;
+                fresh->mSize = blockSize;
+                fresh->mUsed = 0;
+                if (block != nullptr && oversized)
+                {
+                    fresh->mNext = block->mNext;
+                    block->mNext = fresh;
+                }
+                else
+                {
+                    fresh->mNext = block;
+                    mBlocks      = fresh;
+                }
+                block = fresh;
+            }
+
+            void* data = (byte*)(block + 1) + block->mUsed;
+            block->mUsed += aligned;
+            return data;
+        }
+
+        // Loads allocate from this arena, everything else is the same as with the loader of the archive
+        void* archive_t::arena_t::v_get_datafile_ptr(fileid_t fileid) { return mImp->v_get_datafile_ptr(fileid); }
+        void* archive_t::arena_t::v_get_dataunit_ptr(u32 dataunit_index) { return mImp->v_get_dataunit_ptr(dataunit_index); }
+        void  archive_t::arena_t::v_unload_datafile(fileid_t fileid, void*& data) { mImp->v_unload_datafile(fileid, data); }
+        void  archive_t::arena_t::v_unload_dataunit(u32 dataunit_index, void*& data) { mImp->v_unload_dataunit(dataunit_index, data); }
+        bool  archive_t::arena_t::v_is_done(loadhandle_t const& handle) { return mImp->v_is_done(handle); }
+        void* archive_t::arena_t::v_wait(loadhandle_t const& handle) { return mImp->v_wait(handle); }
+        bool  archive_t::arena_t::v_reprioritize(loadhandle_t const& handle, EPriority priority, u64 deadline) { return mImp->v_reprioritize(handle, priority, deadline); }
+        bool  archive_t::arena_t::v_cancel(loadhandle_t const& handle) { return mImp->v_cancel(handle); }
+        void  archive_t::arena_t::v_unload_group(loadgroup_t& group) { mImp->v_unload_group(group); }
+
+        void* archive_t::arena_t::v_load_datafile(fileid_t fileid)
+        {
+            arenascope_t const scope(this);
+            return mImp->v_load_datafile(fileid);
+        }
+
+        void* archive_t::arena_t::v_load_dataunit(u32 dataunit_index)
+        {
+            arenascope_t const scope(this);
+            return mImp->v_load_dataunit(dataunit_index);
+        }
+
+        void archive_t::arena_t::v_load_datafiles(fileid_t const* fileids, s32 count, void** outData)
+        {
+            arenascope_t const scope(this);
+            mImp->v_load_datafiles(fileids, count, outData);
+        }
+
+        loadhandle_t archive_t::arena_t::v_load_datafile_async(fileid_t fileid, EPriority priority, u64 deadline)
+        {
+            arenascope_t const scope(this);
+            return mImp->v_load_datafile_async(fileid, priority, deadline);
+        }
+
+        loadhandle_t archive_t::arena_t::v_load_dataunit_async(u32 dataunit_index, EPriority priority, u64 deadline)
+        {
+            arenascope_t const scope(this);
+            return mImp->v_load_dataunit_async(dataunit_index, priority, deadline);
+        }
+
+        loadgroup_t archive_t::arena_t::v_load_dataunit_group(u32 dataunit_index, EPriority priority, u64 deadline)
+        {
+            arenascope_t const scope(this);
+            return mImp->v_load_dataunit_group(dataunit_index, priority, deadline);
+        }
+
+        // Every read from an archive goes through here, for the telemetry. A read of many files passes ~0 as
+        // the file index.
+        s64 archive_imp_t::read(archivefile_t* dataArchive, u64 offset, u64 size, void* destination, u32 fileIndex)
+        {
+            u64 const begin  = nplatform::clock_ns();
+            s64 const result = dataArchive->read(offset, size, destination);
+            mTelemetry.record(telemetry_t::PhaseIo, begin, nplatform::clock_ns(), (u32)dataArchive->mIndex, fileIndex);
+            mTelemetry.count(telemetry_t::CounterReads);
+            mTelemetry.count(telemetry_t::CounterBytesRead, result > 0 ? (u64)result : 0);
+            return result;
+        }
+
+        // Read a datafile into a heap or arena allocation, size receives the number of bytes allocated
+        void* archive_imp_t::readFile(fileid_t fileid, u32& size)
+        {
+            size                                 = 0;
+            archivefile_t*           dataArchive = mArchives[fileid.getArchiveIndex()];
+            archive_t::file_t const* entry       = dataArchive->file(fileid);
+            if (!entry->isValid())
+                return nullptr;
+            if (entry->isCompressed())
+                return readCompressed(fileid, size);
+
+            u8* data = (u8*)allocData(entry->getFileSize());
+            if (data == nullptr)
+                return nullptr;
+            if (read(dataArchive, entry->getFileOffset(), entry->getFileSize(), data, fileid.getFileIndex()) != (s64)entry->getFileSize() || !verified(fileid, data, entry->getFileSize()))
+            {
+                freeData(data);
+                return nullptr;
+            }
+            size = (u32)entry->getFileSize();
+            return data;
+        }
+
+        // A file used in-place from a mapped archive, corrupt is set when it fails verification
+        void* archive_imp_t::inPlace(fileid_t fileid, bool& corrupt)
+        {
+            archivefile_t* dataArchive = mArchives[fileid.getArchiveIndex()];
+            void const*    data        = dataArchive->fileData(fileid);
+            corrupt                    = data != nullptr && !verified(fileid, data, dataArchive->file(fileid)->getFileSize());
+            return corrupt ? nullptr : (void*)data;
+        }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Verification ---------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // The HDB holds nhash::hash64 of the bytes as stored in the archive, compressed files are verified
+        // before they are decompressed. Files with a hash of 0 are not verified.
+        bool archive_imp_t::verified(fileid_t fileid, void const* data, u64 size) { return !mVerify || matches(fileid, nhash::hash64(data, size)); }
+
+        bool archive_imp_t::matches(fileid_t fileid, u64 hash)
+        {
+            u64 const expected = mArchives[fileid.getArchiveIndex()]->hash(fileid);
+            if (expected == 0 || expected == hash)
+                return true;
+            mTelemetry.count(telemetry_t::CounterCorrupt);
+            return false;
+        }
+
+        // Workers claim runs of files in TOC order, which is mostly the order of the data, so each worker reads
+        // long stretches of the archive. Mapped archives are hashed in-place.
+        static const u32 s_verify_run    = 64;
+        static const u32 s_verify_buffer = 1024 * 1024;
+
+        struct verify_t
+        {
+            archivefile_t* mArchive;
+            alloc_t*       mAllocator;
+            u32            mArchiveIndex;
+            u32            mNumFiles;
+            s32 volatile   mNext;  // First file of the next run
+            s32 volatile   mNumCorrupt;
+            fileid_t*      mCorrupt;
+            s32            mMaxCorrupt;
+        };
+
+        static bool s_verify_file(verify_t* verify, fileid_t fileid, byte* buffer)
+        {
+            archivefile_t*           archive = verify->mArchive;
+            archive_t::file_t const* entry   = archive->file(fileid);
+            u64 const                hash    = archive->hash(fileid);
+            if (!entry->isValid() || hash == 0)
+                return true;
+
+            byte const* mapped = archive->mapped(entry->getFileOffset(), entry->getFileSize());
+            if (mapped != nullptr)
+                return nhash::hash64(mapped, entry->getFileSize()) == hash;
+
+            nhash::state_t state;
+            state.reset();
+            for (u64 offset = 0; offset < entry->getFileSize(); offset += s_verify_buffer)
+            {
+                u64 const size = (entry->getFileSize() - offset) < s_verify_buffer ? (entry->getFileSize() - offset) : s_verify_buffer;
+                if (archive->read(entry->getFileOffset() + offset, size, buffer) != (s64)size)
+                    return false;
+                state.update(buffer, size);
+            }
+            return state.digest() == hash;
+        }
+
+        static void s_verify_job(void* context, u64)
+        {
+            verify_t* verify = (verify_t*)context;
+            byte*     buffer = g_allocate_array<byte>(verify->mAllocator, s_verify_buffer);
+            for (;;)
+            {
+                u32 const first = (u32)(nplatform::atomic_add(&verify->mNext, (s32)s_verify_run) - (s32)s_verify_run);
+                if (first >= verify->mNumFiles)
+                    break;
+                u32 const end = (first + s_verify_run) < verify->mNumFiles ? (first + s_verify_run) : verify->mNumFiles;
+                for (u32 f = first; f < end; ++f)
+                {
+                    fileid_t const fileid(verify->mArchiveIndex, f);
+                    if (s_verify_file(verify, fileid, buffer))
+                        continue;
+                    s32 const n = nplatform::atomic_add(&verify->mNumCorrupt, 1);
+                    if (n <= verify->mMaxCorrupt)
+                        verify->mCorrupt[n - 1] = fileid;
+                }
+            }
+            g_deallocate(verify->mAllocator, buffer);
+        }
+
+        s32 archive_imp_t::verify(s32 archiveIndex, fileid_t* outCorrupt, s32 maxCorrupt, s32 numThreads)
+        {
+            if (archiveIndex < 0 || archiveIndex >= mNumArchives || mArchives[archiveIndex] == nullptr || mArchives[archiveIndex]->hdb() == nullptr)
+                return -1;
+
+            verify_t verify;
+            verify.mArchive      = mArchives[archiveIndex];
+            verify.mAllocator    = mAllocator;
+            verify.mArchiveIndex = (u32)archiveIndex;
+            verify.mNumFiles     = mArchiveSections[archiveIndex]->m_ItemArrayCount;
+            verify.mNext         = 0;
+            verify.mNumCorrupt   = 0;
+            verify.mCorrupt      = outCorrupt;
+            verify.mMaxCorrupt   = outCorrupt != nullptr ? maxCorrupt : 0;
+
+            // A pool of its own so that the async loads keep their I/O threads, this thread is one of the workers
+            if (numThreads <= 0)
+                numThreads = nplatform::thread_hardware_concurrency();
+            numThreads = numThreads > 0 ? numThreads : 1;
+
+            jobs_t pool;
+            pool.setup(mAllocator, numThreads - 1, numThreads);
+            jobhandle_t* jobs = g_allocate_array<jobhandle_t>(mAllocator, numThreads);
+            for (s32 i = 0; i < numThreads; ++i)
+                jobs[i] = pool.submit(s_verify_job, &verify, (u64)i);
+            for (s32 i = 0; i < numThreads; ++i)
+                pool.wait(jobs[i]);
+            g_deallocate(mAllocator, jobs);
+            pool.teardown();
+
+            return nplatform::atomic_load(&verify.mNumCorrupt);
+        }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Decompression --------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // A compressed datafile is streamed in chunks of whole blocks through a small ring of staging
+        // buffers, so peak memory is the uncompressed size plus the staging ring and never the compressed
+        // plus uncompressed size. Each chunk is decoded as a job, so while the worker threads decode one
+        // chunk this thread is already reading the next. With the mapped backend the blocks are decoded
+        // straight from the mapping.
+        static const u32 s_decode_chunk_size = 256 * 1024;
+        static const s32 s_decode_ring_size  = 4;
+
+        struct decodechunk_t
+        {
+            nlz::header_t const* mHeader;
+            byte const*          mSource;  // Compressed data of mFirstBlock
+            byte*                mDestination;
+            u32                  mFirstBlock;
+            u32                  mEndBlock;
+            s32 volatile*        mFailed;
+            telemetry_t*         mTelemetry;
+            fileid_t             mFileId;
+        };
+
+        static void s_decode_chunk_job(void* context, u64)
+        {
+            decodechunk_t const* chunk  = (decodechunk_t const*)context;
+            nlz::header_t const* header = chunk->mHeader;
+            byte const*          ip     = chunk->mSource;
+            u64 const            begin  = nplatform::clock_ns();
+            for (u32 b = chunk->mFirstBlock; b < chunk->mEndBlock; ++b)
+            {
+                u32 const size       = header->blockCompressedSize(b);
+                u32 const outputSize = header->blockUncompressedSize(b);
+                byte*     out        = chunk->mDestination + (u64)b * header->mBlockSize;
+                if (header->blockIsStored(b))
+                {
+                    if (size != outputSize)
+                        nplatform::atomic_store(chunk->mFailed, 1);
+                    else
+                        nmem::memcpy(out, ip, size);
+                }
+                else if (nlz::decompress_block(ip, size, out, outputSize) != (s32)outputSize)
+                {
+                    nplatform::atomic_store(chunk->mFailed, 1);
+                }
+                ip += size;
+            }
+            chunk->mTelemetry->record(telemetry_t::PhaseDecompress, begin, nplatform::clock_ns(), chunk->mFileId.getArchiveIndex(), chunk->mFileId.getFileIndex());
+        }
+
+        void* archive_imp_t::readCompressed(fileid_t fileid, u32& size)
+        {
+            archivefile_t*           dataArchive = mArchives[fileid.getArchiveIndex()];
+            archive_t::file_t const* entry       = dataArchive->file(fileid);
+            u64 const                fileOffset  = entry->getFileOffset();
+            u64 const                fileSize    = entry->getFileSize();
+            u32 const                fileIndex   = fileid.getFileIndex();
+
+            nlz::header_t header;
+            if (fileSize < sizeof(header) || read(dataArchive, fileOffset, sizeof(header), &header, fileIndex) != (s64)sizeof(header) || !header.isValid() || header.headerSize() > fileSize)
+                return nullptr;
+
+            nlz::header_t* fullHeader = (nlz::header_t*)g_allocate_array<byte>(mAllocator, header.headerSize());
+            if (read(dataArchive, fileOffset, header.headerSize(), fullHeader, fileIndex) != (s64)header.headerSize())
+            {
+                g_deallocate(mAllocator, fullHeader);
+                return nullptr;
+            }
+
+            // Validate the block table and find the largest block, a chunk holds at least one block
+            u64 compressedSize = header.headerSize();
+            u32 largestBlock   = 0;
+            for (u32 b = 0; b < header.mNumBlocks; ++b)
+            {
+                u32 const size = fullHeader->blockCompressedSize(b);
+                compressedSize += size;
+                largestBlock = size > largestBlock ? size : largestBlock;
+            }
+            if (compressedSize > fileSize)
+            {
+                g_deallocate(mAllocator, fullHeader);
+                return nullptr;
+            }
+
+            u32 const dataSize = header.mUncompressedSize > 0 ? header.mUncompressedSize : 1;
+            byte*     data     = (byte*)allocData(dataSize);
+            if (data == nullptr)
+            {
+                g_deallocate(mAllocator, fullHeader);
+                return nullptr;
+            }
+
+            byte const* const mapping    = dataArchive->mapped(fileOffset, fileSize);
+            u32 const         chunkSize  = largestBlock > s_decode_chunk_size ? largestBlock : s_decode_chunk_size;
+            byte*             staging[s_decode_ring_size];
+            decodechunk_t     chunks[s_decode_ring_size];
+            jobhandle_t       jobs[s_decode_ring_size];
+            s32 volatile      failed = 0;
+            for (s32 i = 0; i < s_decode_ring_size; ++i)
+                staging[i] = nullptr;
+
+            // Verification hashes the stored bytes as they stream past, the header and then chunk by chunk
+            nhash::state_t stored;
+            stored.reset();
+            if (mVerify)
+                stored.update(fullHeader, header.headerSize());
+
+            u64 position = header.headerSize();
+            u32 block    = 0;
+            s32 ring     = 0;
+            while (block < header.mNumBlocks && failed == 0)
+            {
+                // Gather whole blocks into a chunk
+                u32 const firstBlock = block;
+                u64       size       = 0;
+                while (block < header.mNumBlocks && (block == firstBlock || (size + fullHeader->blockCompressedSize(block)) <= chunkSize))
+                    size += fullHeader->blockCompressedSize(block++);
+
+                // The ring entry may still be decoding a previous chunk
+                mJobs.wait(jobs[ring]);
+
+                byte const* source = nullptr;
+                if (mapping != nullptr)
+                {
+                    source = mapping + position;
+                }
+                else
+                {
+                    if (staging[ring] == nullptr)
+                        staging[ring] = g_allocate_array<byte>(mAllocator, chunkSize);
+                    if (read(dataArchive, fileOffset + position, size, staging[ring], fileIndex) != (s64)size)
+                    {
+                        failed = 1;
+                        break;
+                    }
+                    source = staging[ring];
+                }
+                if (mVerify)
+                    stored.update(source, size);
+
+                decodechunk_t& chunk = chunks[ring];
+                chunk.mHeader        = fullHeader;
+                chunk.mSource        = source;
+                chunk.mDestination   = data;
+                chunk.mFirstBlock    = firstBlock;
+                chunk.mEndBlock      = block;
+                chunk.mFailed        = &failed;
+                chunk.mTelemetry     = &mTelemetry;
+                chunk.mFileId        = fileid;
+                jobs[ring]           = mJobs.submit(s_decode_chunk_job, &chunk, 0);
+
+                position += size;
+                ring = (ring + 1) % s_decode_ring_size;
+            }
+
+            for (s32 i = 0; i < s_decode_ring_size; ++i)
+                mJobs.wait(jobs[i]);
+
+            // Bytes of the entry beyond the last block, if any, are part of what the hash covers
+            if (mVerify && failed == 0)
+            {
+                while (position < fileSize && failed == 0)
+                {
+                    u64 const size = (fileSize - position) < chunkSize ? (fileSize - position) : chunkSize;
+                    if (mapping == nullptr && staging[0] == nullptr)
+                        staging[0] = g_allocate_array<byte>(mAllocator, chunkSize);
+                    if (mapping != nullptr)
+                        stored.update(mapping + position, size);
+                    else if (read(dataArchive, fileOffset + position, size, staging[0], fileIndex) == (s64)size)
+                        stored.update(staging[0], size);
+                    else
+                        failed = 1;
+                    position += size;
+                }
+                if (failed == 0 && !matches(fileid, stored.digest()))
+                    failed = 1;
+            }
+
+            for (s32 i = 0; i < s_decode_ring_size; ++i)
+                g_deallocate(mAllocator, staging[i]);
+            g_deallocate(mAllocator, fullHeader);
+
+            if (nplatform::atomic_load(&failed) != 0)
+            {
+                freeData(data);
+                return nullptr;
+            }
+            size = dataSize;
+            return data;
+        }
+
+        void* archive_imp_t::v_get_datafile_ptr(fileid_t fileid)
+        {
+            slot_t* slot = datafileSlot(resolve(fileid), false);
+            return slot != nullptr ? s_resident(slot) : nullptr;
+        }
+
+        void* archive_imp_t::v_get_dataunit_ptr(u32 dataunit_index)
+        {
+            slot_t* slot = dataunitSlot(dataunit_index, false);
+            if (slot != nullptr)
+            {
+                dataunit_header_t* dataUnitPtr = (dataunit_header_t*)s_resident(slot);
+                if (dataUnitPtr != nullptr)
+                    return dataUnitPtr + 1;
+            }
+            return nullptr;
+        }
+
+        void* archive_imp_t::v_load_datafile(fileid_t fileid)
+        {
+            fileid       = resolve(fileid);
+            slot_t* slot = datafileSlot(fileid, true);
+            if (slot == nullptr)
+                return nullptr;
+
+            void*        data  = nullptr;
+            EClaim const claim = acquire(slot, data, true);
+            mTelemetry.count(telemetry_t::CounterLoads);
+            mTelemetry.count(claim == ClaimWon ? telemetry_t::CounterMisses : telemetry_t::CounterHits);
+            if (claim == ClaimWon)
+            {
+                mTelemetry.access(fileid.getArchiveIndex(), fileid.getFileIndex());
+
+                // Zero-copy when the archive is mapped, the datafile is then read-only
+                u32  size    = 0;
+                bool corrupt = false;
+                data         = inPlace(fileid, corrupt);
+                if (data == nullptr && !corrupt)
+                    data = readShared(fileid, slot);
+                if (data == nullptr && !corrupt)
+                    data = readFile(fileid, size);
+                publish(slot, data, size);
+            }
+            return data;
+        }
+
+        void* archive_imp_t::v_load_dataunit(u32 dataunit_index)
+        {
+            slot_t* slot = dataunitSlot(dataunit_index, true);
+            if (slot == nullptr)
+                return nullptr;
+
+            void*        data  = nullptr;
+            EClaim const claim = acquire(slot, data, true);
+            mTelemetry.count(telemetry_t::CounterLoads);
+            mTelemetry.count(claim == ClaimWon ? telemetry_t::CounterMisses : telemetry_t::CounterHits);
+            if (claim == ClaimWon)
+            {
+                fileid_t const fileid = resolve(fileid_t(0, dataunit_index));
+                u32            size   = 0;
+                mTelemetry.access(fileid.getArchiveIndex(), fileid.getFileIndex());
+
+                // Only publish once patched, other threads must never see unpatched pointers
+                data = readUnit(fileid, dataunit_index, size);
+                publish(slot, data, size);
+            }
+            dataunit_header_t* dataUnitPtr = (dataunit_header_t*)data;
+            return dataUnitPtr != nullptr ? dataUnitPtr + 1 : nullptr;
+        }
+
+        // A dataunit without fixups, which is always the case with relative pointers, is used in-place when
+        // the archive is mapped, otherwise it is read and patched
+        void* archive_imp_t::readUnit(fileid_t fileid, u32 dataunit_index, u32& size)
+        {
+            size          = 0;
+            bool  corrupt = false;
+            void* data    = inPlace(fileid, corrupt);
+            if (data != nullptr && s_needs_patch((dataunit_header_t const*)data))
+                data = nullptr;
+            if (data == nullptr && !corrupt)
+            {
+                data = readFile(fileid, size);
+                if (data != nullptr)
+                {
+                    u64 const begin = nplatform::clock_ns();
+                    g_patch((dataunit_header_t*)data, &mJobs);
+                    mTelemetry.record(telemetry_t::PhasePatch, begin, nplatform::clock_ns(), 0, dataunit_index);
+                }
+            }
+            return data;
+        }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Batched loading ------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Files in a batch are sorted by archive and offset, neighbours that are at most s_batch_max_gap
+        // apart are merged into one read of at most s_batch_max_read bytes, the read is then scattered
+        // into the individual datafile buffers.
+        static const u64 s_batch_max_gap  = 64 * 1024;
+        static const u64 s_batch_max_read = 2 * 1024 * 1024;
+
+        struct batchitem_t
+        {
+            u32             mArchive;
+            u32             mFile;
+            u64             mOffset;
+            u64             mSize;
+            slot_t*         mSlot;
+            s32             mIndex;  // Index into the caller's array
+            bool            mCompressed;
+        };
+
+        static inline bool s_batch_less(batchitem_t const& a, batchitem_t const& b)
+        {
+            if (a.mArchive != b.mArchive)
+                return a.mArchive < b.mArchive;
+            return a.mOffset < b.mOffset;
+        }
+
+        static void s_batch_sort(batchitem_t* items, s32 count)
+        {
+            // Insertion sort for small ranges, quicksort otherwise
+            while (count > 16)
+            {
+                batchitem_t const pivot = items[count / 2];
+                s32               i     = 0;
+                s32               j     = count - 1;
+                while (i <= j)
+                {
+                    while (s_batch_less(items[i], pivot))
+                        ++i;
+                    while (s_batch_less(pivot, items[j]))
+                        --j;
+                    if (i <= j)
+                    {
+                        batchitem_t const t = items[i];
+                        items[i++]          = items[j];
+                        items[j--]          = t;
+                    }
+                }
+                // Recurse on the smaller part, loop on the larger one
+                if ((j + 1) < (count - i))
+                {
+                    s_batch_sort(items, j + 1);
+                    items += i;
+                    count -= i;
+                }
+                else
+                {
+                    s_batch_sort(items + i, count - i);
+                    count = j + 1;
+                }
+            }
+            for (s32 i = 1; i < count; ++i)
+            {
+                batchitem_t const item = items[i];
+                s32               j    = i - 1;
+                while (j >= 0 && s_batch_less(item, items[j]))
+                {
+                    items[j + 1] = items[j];
+                    --j;
+                }
+                items[j + 1] = item;
+            }
+        }
+
+        void archive_imp_t::v_load_datafiles(fileid_t const* fileids, s32 count, void** outData)
+        {
+            if (count <= 0)
+                return;
+
+            batchitem_t* items     = g_allocate_array<batchitem_t>(mAllocator, count);
+            s32*         deferred  = g_allocate_array<s32>(mAllocator, count);
+            s32*         shared    = g_allocate_array<s32>(mAllocator, count);
+            s32          numItems  = 0;
+            s32          numBusy   = 0;
+            s32          numShared = 0;
+
+            // Claim every slot that is not loaded yet, the rest is either resident (now owned by us as well)
+            // or being loaded elsewhere
+            for (s32 i = 0; i < count; ++i)
+            {
+                fileid_t const fileid = resolve(fileids[i]);
+                void*          data   = nullptr;
+                slot_t*        slot   = datafileSlot(fileid, true);
+                if (slot != nullptr)
+                {
+                    EClaim const claim = acquire(slot, data, false);
+                    fileid_t     canonical;
+
+                    // Busy files are counted when they are loaded after the batch
+                    if (claim != ClaimBusy)
+                    {
+                        mTelemetry.count(telemetry_t::CounterLoads);
+                        mTelemetry.count(claim == ClaimWon ? telemetry_t::CounterMisses : telemetry_t::CounterHits);
+                    }
+                    if (claim == ClaimWon)
+                        mTelemetry.access(fileid.getArchiveIndex(), fileid.getFileIndex());
+                    if (claim == ClaimWon && sharedWith(fileid, canonical))
+                    {
+                        shared[numShared++] = i;
+                    }
+                    else if (claim == ClaimWon)
+                    {
+                        archive_t::file_t const* entry = mArchives[fileid.getArchiveIndex()]->file(fileid);
+                        batchitem_t&             item  = items[numItems++];
+                        item.mArchive                  = fileid.getArchiveIndex();
+                        item.mFile                     = fileid.getFileIndex();
+                        item.mOffset                   = entry->getFileOffset();
+                        item.mSize                     = entry->getFileSize();
+                        item.mSlot                     = slot;
+                        item.mIndex                    = i;
+                        item.mCompressed               = entry->isCompressed();
+                    }
+                    else if (claim == ClaimBusy)
+                    {
+                        deferred[numBusy++] = i;
+                    }
+                }
+                if (outData != nullptr)
+                    outData[i] = data;
+            }
+
+            s_batch_sort(items, numItems);
+
+            byte* staging = nullptr;
+            s32   begin   = 0;
+            while (begin < numItems)
+            {
+                // Grow the run while the next file is close and the total read stays bounded. A mapped archive
+                // serves uncompressed files in-place, every file is a run of its own that is neither read nor staged.
+                archivefile_t* dataArchive = mArchives[items[begin].mArchive];
+                bool const     mapped      = dataArchive->isMapped();
+                u64 const      runOffset   = items[begin].mOffset;
+                u64            runEnd      = runOffset + items[begin].mSize;
+                s32            end         = begin + 1;
+                while (!mapped && end < numItems && items[end].mArchive == items[begin].mArchive && !items[begin].mCompressed && !items[end].mCompressed)
+                {
+                    u64 const itemEnd = items[end].mOffset + items[end].mSize;
+                    if (items[end].mOffset > (runEnd + s_batch_max_gap) || (itemEnd - runOffset) > s_batch_max_read)
+                        break;
+                    if (itemEnd > runEnd)
+                        runEnd = itemEnd;
+                    end += 1;
+                }
+
+                dataArchive->willneed(runOffset, runEnd - runOffset);
+
+                // Compressed files are never merged, they stream through the decompressor
+                if (items[begin].mCompressed)
+                {
+                    u32   size = 0;
+                    void* data = readFile(fileid_t(items[begin].mArchive, items[begin].mFile), size);
+                    publish(items[begin].mSlot, data, size);
+                    if (outData != nullptr)
+                        outData[items[begin].mIndex] = data;
+                    begin = end;
+                    continue;
+                }
+
+                bool const single = (end - begin) == 1;
+                if (!single && staging == nullptr)
+                    staging = g_allocate_array<byte>(mAllocator, s_batch_max_read);
+                bool const runRead = single || (staging != nullptr && read(dataArchive, runOffset, runEnd - runOffset, staging, ~0u) == (s64)(runEnd - runOffset));
+
+                for (s32 i = begin; i < end; ++i)
+                {
+                    batchitem_t const& item = items[i];
+                    fileid_t const     fileid(item.mArchive, item.mFile);
+
+                    // Zero-copy when the archive is mapped
+                    u32   size    = 0;
+                    bool  corrupt = false;
+                    void* data    = inPlace(fileid, corrupt);
+                    if (data == nullptr && runRead && !corrupt)
+                    {
+                        size = (u32)item.mSize;
+                        data = allocData(item.mSize);
+                        if (data == nullptr)
+                            size = 0;
+                        else
+                        {
+                            if (single)
+                                corrupt = read(dataArchive, item.mOffset, item.mSize, data, item.mFile) != (s64)item.mSize;
+                            else
+                                nmem::memcpy(data, staging + (item.mOffset - runOffset), item.mSize);
+                            if (corrupt || !verified(fileid, data, item.mSize))
+                            {
+                                freeData(data);
+                                data = nullptr;
+                                size = 0;
+                            }
+                        }
+                    }
+
+                    publish(item.mSlot, data, size);
+                    if (outData != nullptr)
+                        outData[item.mIndex] = data;
+                }
+                begin = end;
+            }
+
+            // Duplicates go through their canonical file once every claim of this batch is published, the
+            // canonical file can be part of this batch
+            for (s32 i = 0; i < numShared; ++i)
+            {
+                fileid_t const fileid = resolve(fileids[shared[i]]);
+                slot_t*        slot   = datafileSlot(fileid, false);
+                u32            size   = 0;
+                void*          data   = readShared(fileid, slot);
+                if (data == nullptr)
+                    data = readFile(fileid, size);
+                publish(slot, data, size);
+                if (outData != nullptr)
+                    outData[shared[i]] = data;
+            }
+
+            // Files that another thread was loading, wait for them
+            for (s32 i = 0; i < numBusy; ++i)
+            {
+                void* data = v_load_datafile(fileids[deferred[i]]);
+                if (outData != nullptr)
+                    outData[deferred[i]] = data;
+            }
+
+            g_deallocate(mAllocator, staging);
+            g_deallocate(mAllocator, shared);
+            g_deallocate(mAllocator, deferred);
+            g_deallocate(mAllocator, items);
+        }
+
+        // The slot that holds data of a file, data that was loaded before the layers of its base archive
+        // changed is held by the slot of another layer than the one that the file resolves to now
+        slot_t* archive_imp_t::heldSlot(fileid_t id, void const* data)
+        {
+            slot_t* slot = datafileSlot(resolve(id), false);
+            if (slot != nullptr && s_resident(slot) == data)
+                return slot;
+
+            overlay_t const* overlay = id.getArchiveIndex() < (u32)mNumArchives ? mOverlays[id.getArchiveIndex()] : nullptr;
+            if (overlay != nullptr)
+            {
+                for (s32 l = 0; l < overlay->mNumLayers; ++l)
+                {
+                    slot_t* layerSlot = datafileSlot(fileid_t((u32)overlay->mLayers[l], id.getFileIndex()), false);
+                    if (layerSlot != nullptr && s_resident(layerSlot) == data)
+                        return layerSlot;
+                }
+            }
+            return slot;
+        }
+
+        // Drops the caller's ownership, the data stays cached until it has to make room for other data
+        void archive_imp_t::v_unload_datafile(fileid_t fileid, void*& data)
+        {
+            slot_t* slot = heldSlot(fileid, data);
+            if (slot != nullptr && data != nullptr)
+            {
+                void* archiveDataFilePtr = s_resident(slot);
+                ASSERT(archiveDataFilePtr == data);
+                if (archiveDataFilePtr == data)
+                    release(slot);
+                data = nullptr;
+            }
+        }
+
+        void archive_imp_t::v_unload_dataunit(u32 dataunit_index, void*& data)
+        {
+            slot_t* slot = dataunitSlot(dataunit_index, false);
+            if (slot != nullptr && data != nullptr)
+            {
+                // The caller holds the pointer past the header, as returned by load
+                dataunit_header_t* dataUnitPtr = (dataunit_header_t*)s_resident(slot);
+                ASSERT(dataUnitPtr != nullptr && (dataUnitPtr + 1) == data);
+                if (dataUnitPtr != nullptr && (dataUnitPtr + 1) == data)
+                    release(slot);
+                data = nullptr;
+            }
+        }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Async loading --------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Every request submits one job, a job serves whichever request is the most urgent when it runs, so
+        // that urgent requests overtake the ones queued before them. There are never fewer jobs left than
+        // queued requests, a job that finds the queue empty had its request served by an earlier job or by
+        // a thread waiting on it.
+        static const s32 s_stream_max_batch = 32;
+
+        void archive_imp_t::s_stream_job(void* context, u64)
+        {
+            archive_imp_t* imp = (archive_imp_t*)context;
+            s32            batch[s_stream_max_batch];
+
+            nplatform::mutex_lock(imp->mStreamMutex);
+            s32 const index = imp->mStream.top();
+            s32 const count = index >= 0 ? imp->gather(index, batch) : 0;
+            nplatform::mutex_unlock(imp->mStreamMutex);
+
+            imp->serve(batch, count);
+        }
+
+        // Mutex must be held. Takes the request out of the queue together with queued datafiles that are
+        // close to it in the same archive, of any priority since their reads are merged with this one.
+        s32 archive_imp_t::gather(s32 index, s32* batch)
+        {
+            mStream.remove(index);
+            batch[0] = index;
+
+            request_t const& first = mStream.mRequests[index];
+            s32              count = 1;
+            if (first.mSize == 0)
+                return count;
+
+            // Candidates are picked from the heap array as it is and removed once the batch is complete, removing
+            // reorders the heap. A request that joins widens the range, a pass that added any is followed by
+            // another one for the requests that were too far away before.
+            u64  begin = first.mOffset;
+            u64  end   = first.mOffset + first.mSize;
+            bool grown = true;
+            while (grown && count < s_stream_max_batch)
+            {
+                grown = false;
+                for (s32 i = 0; i < mStream.mCount && count < s_stream_max_batch; ++i)
+                {
+                    s32 const        candidate = mStream.mHeap[i];
+                    request_t const& r         = mStream.mRequests[candidate];
+                    u64 const        rEnd      = r.mOffset + r.mSize;
+                    u64 const        newBegin  = r.mOffset < begin ? r.mOffset : begin;
+                    u64 const        newEnd    = rEnd > end ? rEnd : end;
+                    bool const       near      = (r.mOffset <= end + s_batch_max_gap) && (rEnd + s_batch_max_gap >= begin);
+                    if (r.mSize == 0 || r.mArena != first.mArena || r.mFileId.getArchiveIndex() != first.mFileId.getArchiveIndex() || !near || (newEnd - newBegin) > s_batch_max_read)
+                        continue;
+                    s32 b = 1;
+                    while (b < count && batch[b] != candidate)
+                        b += 1;
+                    if (b < count)
+                        continue;
+                    batch[count++] = candidate;
+                    begin          = newBegin;
+                    end            = newEnd;
+                    grown          = true;
+                }
+            }
+            for (s32 b = 1; b < count; ++b)
+                mStream.remove(batch[b]);
+            return count;
+        }
+
+        void archive_imp_t::serve(s32 const* batch, s32 count)
+        {
+            if (count <= 0)
+                return;
+
+            u64 const now = nplatform::clock_ns();
+            for (s32 i = 0; i < count; ++i)
+            {
+                request_t const& r = mStream.mRequests[batch[i]];
+                if (r.mDataUnit >= 0)
+                    mTelemetry.record(telemetry_t::PhaseQueue, r.mQueued, now, 0, (u32)r.mDataUnit);
+                else
+                    mTelemetry.record(telemetry_t::PhaseQueue, r.mQueued, now, r.mFileId.getArchiveIndex(), r.mFileId.getFileIndex());
+            }
+
+            // Load into the arena that the requests were made through
+            request_t const&   first = mStream.mRequests[batch[0]];
+            arenascope_t const scope((archive_t::arena_t*)first.mArena);
+            if (count == 1)
+            {
+                if (first.mGroup != nullptr)
+                    loadGroup(first.mGroup);
+                else if (first.mDataUnit >= 0)
+                    v_load_dataunit((u32)first.mDataUnit);
+                else
+                    v_load_datafile(first.mFileId);
+            }
+            else
+            {
+                fileid_t fileids[s_stream_max_batch];
+                for (s32 i = 0; i < count; ++i)
+                    fileids[i] = mStream.mRequests[batch[i]].mFileId;
+                v_load_datafiles(fileids, count, nullptr);
+            }
+
+            nplatform::mutex_lock(mStreamMutex);
+            for (s32 i = 0; i < count; ++i)
+                mStream.release(batch[i]);
+            nplatform::cond_broadcast(mStreamDone);
+            nplatform::mutex_unlock(mStreamMutex);
+        }
+
+        // Mutex must be held
+        bool archive_imp_t::queued(loadhandle_t const& handle) const
+        {
+            if (handle.m_job < 0)
+                return false;
+            request_t const& r = mStream.mRequests[handle.m_job];
+            return r.mGeneration == handle.m_generation && r.mHeapIndex >= 0;
+        }
+
+        loadhandle_t archive_imp_t::enqueue(fileid_t fileid, s32 dataunit_index, group_t* group, EPriority priority, u64 deadline)
+        {
+            loadhandle_t handle;
+            handle.m_fileid         = fileid;
+            handle.m_dataunit_index = dataunit_index;
+
+            // Without I/O threads the load completes inline
+            s32 index = -1;
+            if (mJobs.num_threads() > 0)
+            {
+                nplatform::mutex_lock(mStreamMutex);
+                index = mStream.allocate();
+                if (index >= 0)
+                {
+                    request_t& r = mStream.mRequests[index];
+                    r.mDeadline  = deadline;
+                    r.mQueued    = nplatform::clock_ns();
+                    r.mOffset    = 0;
+                    r.mSize      = 0;
+                    r.mGroup     = group;
+                    r.mArena     = s_arena;
+                    r.mFileId    = fileid;
+                    r.mDataUnit  = dataunit_index;
+                    r.mPriority  = (s32)priority;
+                    if (dataunit_index < 0)
+                    {
+                        archive_t::file_t const* entry = mArchives[fileid.getArchiveIndex()]->file(fileid);
+                        r.mOffset                      = entry->getFileOffset();
+                        r.mSize                        = entry->isCompressed() ? 0 : entry->getFileSize();
+                    }
+                    mStream.push(index);
+                    handle.m_job        = index;
+                    handle.m_generation = r.mGeneration;
+                }
+                nplatform::mutex_unlock(mStreamMutex);
+            }
+
+            if (index >= 0)
+            {
+                mJobs.submit(s_stream_job, this, 0);
+            }
+            else if (group != nullptr)
+            {
+                loadGroup(group);
+            }
+            else if (dataunit_index >= 0)
+            {
+                v_load_dataunit((u32)dataunit_index);
+            }
+            else
+            {
+                v_load_datafile(fileid);
+            }
+            return handle;
+        }
+
+        loadhandle_t archive_imp_t::v_load_datafile_async(fileid_t fileid, EPriority priority, u64 deadline)
+        {
+            fileid = resolve(fileid);
+
+            // Unknown or already resident, no need to queue it
+            if (datafileSlot(fileid, true) == nullptr || v_get_datafile_ptr(fileid) != nullptr)
+            {
+                loadhandle_t handle;
+                handle.m_fileid = fileid;
+                v_load_datafile(fileid);
+                return handle;
+            }
+            return enqueue(fileid, -1, nullptr, priority, deadline);
         }
 
-        void archive_imp_t::teardown()
+        loadhandle_t archive_imp_t::v_load_dataunit_async(u32 dataunit_index, EPriority priority, u64 deadline)
         {
-            for (s32 i = 0; i < mNumDataUnits; ++i)
+            if (dataunitSlot(dataunit_index, true) == nullptr || v_get_dataunit_ptr(dataunit_index) != nullptr)
             {
-                if (mDataUnitPtrs[i] != nullptr)
-                {
-                    g_deallocate(mAllocator, mDataUnitPtrs[i]);
-                }
+                loadhandle_t handle;
+                handle.m_dataunit_index = (s32)dataunit_index;
+                v_load_dataunit(dataunit_index);
+                return handle;
             }
+            return enqueue(INVALID_FILEID, (s32)dataunit_index, nullptr, priority, deadline);
+        }
 
-            for (s32 i = 0; i < mNumArchives; ++i)
+        bool archive_imp_t::v_is_done(loadhandle_t const& handle)
+        {
+            if (handle.m_job < 0)
+                return true;
+            return nplatform::atomic_load(&mStream.mRequests[handle.m_job].mGeneration) != handle.m_generation;
+        }
+
+        void* archive_imp_t::v_wait(loadhandle_t const& handle)
+        {
+            if (handle.m_job >= 0)
             {
-                if (mArchives[i] != nullptr)
+                s32 batch[s_stream_max_batch];
+                s32 count = 0;
+
+                nplatform::mutex_lock(mStreamMutex);
+                if (queued(handle))
                 {
-                    mArchives[i]->close(mAllocator);
-                    g_deallocate(mAllocator, mArchives[i]);
+                    // Not started yet, rather than waiting for its turn load it here
+                    count = gather(handle.m_job, batch);
                 }
-
-                archive_t::section_t* section = mArchiveSections[i];
-                if (section != nullptr)
+                else
                 {
-                    for (s32 j = 0; j < section->m_ItemArrayCount; ++j)
-                    {
-                        if (mDataFilePtrs[i][j] != nullptr)
-                        {
-                            g_deallocate(mAllocator, mDataFilePtrs[i][j]);
-                        }
-                    }
-                    mArchiveSections[i] = nullptr;
+                    while (mStream.mRequests[handle.m_job].mGeneration == handle.m_generation)
+                        nplatform::cond_wait(mStreamDone, mStreamMutex);
                 }
+                nplatform::mutex_unlock(mStreamMutex);
+
+                serve(batch, count);
             }
 
-            g_deallocate(mAllocator, mArchives);
-            g_deallocate(mAllocator, mArchiveSections);
-            g_deallocate(mAllocator, mDataFilePtrs);
-            g_deallocate(mAllocator, mDataUnitPtrs);
+            if (handle.m_dataunit_index >= 0)
+                return v_get_dataunit_ptr((u32)handle.m_dataunit_index);
+            return v_get_datafile_ptr(handle.m_fileid);
         }
 
-        bool archive_imp_t::exists(fileid_t id) const
+        bool archive_imp_t::v_reprioritize(loadhandle_t const& handle, EPriority priority, u64 deadline)
         {
-            if (id.getArchiveIndex() < mNumArchives)
+            nplatform::mutex_lock(mStreamMutex);
+            bool const isQueued = queued(handle);
+            if (isQueued)
             {
-                archivefile_t* datafile = mArchives[id.getArchiveIndex()];
-                return datafile != nullptr && datafile->exists(id);
+                request_t& r = mStream.mRequests[handle.m_job];
+                r.mPriority  = (s32)priority;
+                r.mDeadline  = deadline;
+                mStream.update(handle.m_job);
             }
-            return false;
+            nplatform::mutex_unlock(mStreamMutex);
+            return isQueued;
         }
 
-        archive_t::file_t const* archive_imp_t::fileitem(fileid_t id) const
+        bool archive_imp_t::v_cancel(loadhandle_t const& handle)
         {
-            if (id.getArchiveIndex() < mNumArchives)
+            nplatform::mutex_lock(mStreamMutex);
+            bool const isQueued = queued(handle);
+            if (isQueued)
             {
-                archivefile_t* datafile = mArchives[id.getArchiveIndex()];
-                return datafile != nullptr ? datafile->file(id) : nullptr;
+                mStream.remove(handle.m_job);
+                mStream.release(handle.m_job);
+                nplatform::cond_broadcast(mStreamDone);
             }
-            return nullptr;
+            nplatform::mutex_unlock(mStreamMutex);
+            return isQueued;
         }
 
-        string_t archive_imp_t::filename(fileid_t id) const
+        // ------------------------------------------------------------------------------------------------
+        // ------- Dependency groups ----------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // A group records every load it made in an open addressing set, so that a dependency shared by
+        // several dataunits is loaded once per group and every load is matched by one unload. Keys are the
+        // packed file id of a datafile or the index of a dataunit with s_group_unit set, a load that failed
+        // gets s_group_failed set so that it is not unloaded.
+        static const u64 s_group_empty  = (u64)-1;
+        static const u64 s_group_unit   = (u64)1 << 63;
+        static const u64 s_group_failed = (u64)1 << 62;
+
+        struct group_t
+        {
+            u32  mRoot;
+            u64* mKeys;
+            u32  mCapacity;  // Power of two
+            u32  mCount;
+        };
+
+        static inline u64 s_group_key(fileid_t fileid) { return ((u64)fileid.getArchiveIndex() << 32) | (u64)fileid.getFileIndex(); }
+        static inline u32 s_group_bucket(group_t const* group, u64 key) { return (u32)((key * 0x9E3779B97F4A7C15ull) >> 32) & (group->mCapacity - 1); }
+
+        // Return false when the key is already in the set
+        static bool s_group_insert(alloc_t* allocator, group_t* group, u64 key)
         {
-            if (id.getArchiveIndex() < mNumArchives)
+            if ((group->mCount + 1) * 2 > group->mCapacity)
             {
-                archivefile_t* datafile = mArchives[id.getArchiveIndex()];
-                return datafile != nullptr ? datafile->filename(id) : string_t();
+                u64* keys        = group->mKeys;
+                u32  capacity    = group->mCapacity;
+                group->mCapacity = capacity > 0 ? capacity * 2 : 64;
+                group->mKeys     = g_allocate_array<u64>(allocator, group->mCapacity);
+                group->mCount    = 0;
+                nmem::memset(group->mKeys, 0xFF, group->mCapacity * sizeof(u64));
+                for (u32 i = 0; i < capacity; ++i)
+                {
+                    if (keys[i] != s_group_empty)
+                        s_group_insert(allocator, group, keys[i]);
+                }
+                g_deallocate(allocator, keys);
             }
-            return string_t();
+
+            u32 b = s_group_bucket(group, key);
+            while (group->mKeys[b] != s_group_empty)
+            {
+                if (group->mKeys[b] == key)
+                    return false;
+                b = (b + 1) & (group->mCapacity - 1);
+            }
+            group->mKeys[b] = key;
+            group->mCount += 1;
+            return true;
         }
 
-        void* archive_imp_t::v_get_datafile_ptr(fileid_t fileid)
+        // The key keeps its bucket, a failed key is simply never matched again
+        static void s_group_fail(group_t* group, u64 key)
+        {
+            u32 b = s_group_bucket(group, key);
+            while (group->mKeys[b] != key)
+                b = (b + 1) & (group->mCapacity - 1);
+            group->mKeys[b] = key | s_group_failed;
+        }
+
+        template <typename T>
+        static void s_reserve(alloc_t* allocator, T*& array, u32 count, u32& capacity, u32 needed)
+        {
+            if (needed <= capacity)
+                return;
+            u32 newCapacity = capacity > 0 ? capacity : 64;
+            while (newCapacity < needed)
+                newCapacity *= 2;
+            T* fresh = g_allocate_array<T>(allocator, newCapacity);
+            if (count > 0)
+                nmem::memcpy(fresh, array, count * sizeof(T));
+            g_deallocate(allocator, array);
+            array    = fresh;
+            capacity = newCapacity;
+        }
+
+        // Breadth first, the dataunits of a level are loaded first and then all the datafiles they list
+        // as one batch, after which the dataunits they list form the next level.
+        void archive_imp_t::loadGroup(group_t* group)
         {
-            if (fileid.getArchiveIndex() < mNumArchives)
+            u32*      units         = nullptr;
+            u32*      next          = nullptr;
+            fileid_t* files         = nullptr;
+            void**    data          = nullptr;
+            u32       unitsCapacity = 0;
+            u32       nextCapacity  = 0;
+            u32       filesCapacity = 0;
+            u32       dataCapacity  = 0;
+
+            s_reserve(mAllocator, units, 0, unitsCapacity, 1);
+            units[0]     = group->mRoot;
+            u32 numUnits = 1;
+            s_group_insert(mAllocator, group, s_group_unit | group->mRoot);
+
+            while (numUnits > 0)
             {
-                archive_t::section_t const* section = mArchiveSections[fileid.getArchiveIndex()];
-                if (section != nullptr && fileid.getFileIndex() < section->m_ItemArrayCount)
+                u32 numFiles = 0;
+                u32 numNext  = 0;
+                for (u32 i = 0; i < numUnits; ++i)
+                {
+                    void* unit = v_load_dataunit(units[i]);
+                    if (unit == nullptr)
+                    {
+                        s_group_fail(group, s_group_unit | units[i]);
+                        continue;
+                    }
+
+                    dataunit_header_t const* header = (dataunit_header_t const*)unit - 1;
+                    if (header->m_refs_offset == 0)
+                        continue;
+
+                    u32 const*      table       = (u32 const*)((byte const*)header + header->m_refs_offset);
+                    u32 const       numRefFiles = table[0];
+                    u32 const       numRefUnits = table[1];
+                    fileid_t const* refFiles    = (fileid_t const*)(table + 2);
+                    u32 const*      refUnits    = (u32 const*)(refFiles + numRefFiles);
+
+                    s_reserve(mAllocator, files, numFiles, filesCapacity, numFiles + numRefFiles);
+                    for (u32 f = 0; f < numRefFiles; ++f)
+                    {
+                        if (s_group_insert(mAllocator, group, s_group_key(refFiles[f])))
+                            files[numFiles++] = refFiles[f];
+                    }
+                    s_reserve(mAllocator, next, numNext, nextCapacity, numNext + numRefUnits);
+                    for (u32 u = 0; u < numRefUnits; ++u)
+                    {
+                        if (s_group_insert(mAllocator, group, s_group_unit | refUnits[u]))
+                            next[numNext++] = refUnits[u];
+                    }
+                }
+
+                if (numFiles > 0)
                 {
-                    void** archiveDataPtrs = mDataFilePtrs[fileid.getArchiveIndex()];
-                    if (archiveDataPtrs != nullptr)
+                    s_reserve(mAllocator, data, 0, dataCapacity, numFiles);
+                    v_load_datafiles(files, (s32)numFiles, data);
+                    for (u32 f = 0; f < numFiles; ++f)
                     {
-                        return archiveDataPtrs[fileid.getArchiveIndex()];
+                        if (data[f] == nullptr)
+                            s_group_fail(group, s_group_key(files[f]));
                     }
                 }
+
+                u32* const swap     = units;
+                u32 const  capacity = unitsCapacity;
+                units               = next;
+                unitsCapacity       = nextCapacity;
+                next                = swap;
+                nextCapacity        = capacity;
+                numUnits            = numNext;
             }
-            return nullptr;
+
+            g_deallocate(mAllocator, data);
+            g_deallocate(mAllocator, files);
+            g_deallocate(mAllocator, next);
+            g_deallocate(mAllocator, units);
         }
 
-        void* archive_imp_t::v_get_dataunit_ptr(u32 dataunit_index)
+        loadgroup_t archive_imp_t::v_load_dataunit_group(u32 dataunit_index, EPriority priority, u64 deadline)
+        {
+            group_t* group   = g_allocate<group_t>(mAllocator);
+            group->mRoot     = dataunit_index;
+            group->mKeys     = nullptr;
+            group->mCapacity = 0;
+            group->mCount    = 0;
+
+            loadgroup_t result;
+            result.m_group  = group;
+            result.m_handle = enqueue(INVALID_FILEID, (s32)dataunit_index, group, priority, deadline);
+            return result;
+        }
+
+        void archive_imp_t::v_unload_group(loadgroup_t& result)
         {
-            if (dataunit_index < mNumDataUnits)
+            group_t* group = (group_t*)result.m_group;
+            if (group == nullptr)
+                return;
+
+            // A group that did not start yet made no loads
+            if (!v_cancel(result.m_handle))
+                v_wait(result.m_handle);
+
+            for (u32 i = 0; i < group->mCapacity; ++i)
             {
-                return mDataUnitPtrs[dataunit_index] + 1;
+                u64 const key = group->mKeys[i];
+                if (key == s_group_empty || (key & s_group_failed) != 0)
+                    continue;
+                if ((key & s_group_unit) != 0)
+                {
+                    u32 const index = (u32)(key & 0xFFFFFFFF);
+                    void*     data  = v_get_dataunit_ptr(index);
+                    v_unload_dataunit(index, data);
+                }
+                else
+                {
+                    fileid_t const fileid((u32)(key >> 32), (u32)(key & 0xFFFFFFFF));
+                    void*          data = v_get_datafile_ptr(fileid);
+                    v_unload_datafile(fileid, data);
+                }
             }
-            return nullptr;
+
+            g_deallocate(mAllocator, group->mKeys);
+            g_deallocate(mAllocator, group);
+            result.m_group  = nullptr;
+            result.m_handle = loadhandle_t();
         }
 
-        void* archive_imp_t::v_load_datafile(fileid_t fileid)
+        // ------------------------------------------------------------------------------------------------
+        // ------- Hot reload -----------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // A resident slot of a reloaded archive moves to new data when its TOC entry or its HDB hash changed,
+        // when its data is in-place in the mapping of the old archive, or when it shares the data of a slot
+        // that moves. Slots without owners are dropped, a later load reads the new data.
+        struct reloaditem_t
+        {
+            slot_t*  mSlot;     //
+            fileid_t mId;       // The file that the slot holds, resolved
+            s32      mUnit;     // Dataunit index, -1 for a datafile
+            s32      mSharers;  // Moving slots that share the data of this one, they own it as well
+            void*    mData;     // New data, nullptr while not read
+            u32      mSize;     // Heap bytes of mData
+        };
+
+        static bool s_reload_moved(archivefile_t const* old, archivefile_t const* fresh, fileid_t id, bool hashes, void const* data)
+        {
+            if (old->isMapped(data))
+                return true;
+            archive_t::file_t const* before = old->file(id);
+            archive_t::file_t const* after  = fresh->file(id);
+            if (!after->isValid() || before->mFileOffset != after->mFileOffset || before->mFileSize != after->mFileSize)
+                return true;
+            return hashes && old->hash(id) != fresh->hash(id);
+        }
+
+        static inline bool s_reload_owned(reloaditem_t const& item) { return (nplatform::atomic_load(&item.mSlot->mState) - s_slot_cached - item.mSharers) > 0; }
+
+        bool archive_imp_t::changed(s32 archiveIndex) const
+        {
+            archivefile_t const* archive = (archiveIndex >= 0 && archiveIndex < mNumArchives) ? mArchives[archiveIndex] : nullptr;
+            return archive != nullptr && archive->stamp() != archive->mStamp;
+        }
+
+        void archive_imp_t::rebuildRedirect(s32 archiveIndex)
+        {
+            if (mArchives[archiveIndex]->mBase >= 0)
+                buildRedirect(mArchives[archiveIndex]->mBase);
+            else if (mOverlays[archiveIndex] != nullptr)
+                buildRedirect(archiveIndex);
+        }
+
+        // The new data of every owned slot is read before anything changes, when any of it fails to load the
+        // archive stays as it was. Old data is released once every callback returned.
+        s32 archive_imp_t::reload(s32 archiveIndex, archive_t::reload_fn callback, void* context)
         {
-            if (fileid.getArchiveIndex() < mNumArchives)
+            archivefile_t* old = (archiveIndex >= 0 && archiveIndex < mNumArchives) ? mArchives[archiveIndex] : nullptr;
+            if (old == nullptr)
+                return -1;
+
+            archivefile_t* fresh  = g_allocate<archivefile_t>(mAllocator);
+            s32 const      result = old->mTocFilename != nullptr ? fresh->open(mAllocator, mBackend, old->mFilename, old->mTocFilename, old->mFDB.mFilename, old->mHDB.mFilename) : fresh->openPacked(mAllocator, mBackend, old->mFilename);
+            if (result < 0)
             {
-                archive_t::section_t const* section = mArchiveSections[fileid.getArchiveIndex()];
-                if (section != nullptr && fileid.getFileIndex() < section->m_ItemArrayCount)
+                fresh->close(mAllocator);
+                g_deallocate(mAllocator, fresh);
+                return -1;
+            }
+            fresh->mIndex = archiveIndex;
+            fresh->mBase  = old->mBase;
+
+            // The HDB of the old archive can only be trusted when it is not read from the rebuilt files now
+            bool const hashes = old->mHDB.mState == s_once_done || old->mHDB.mFilename == nullptr;
+
+            reloaditem_t* items    = nullptr;
+            u32           count    = 0;
+            u32           capacity = 0;
+            slottable_t&  table    = mDataFileSlots[archiveIndex];
+            u32*          itemOf   = table.mNumSlots > 0 ? g_allocate_array_and_clear<u32>(mAllocator, table.mNumSlots) : nullptr;  // Item + 1 per file
+            for (u32 f = 0; f < table.mNumSlots; ++f)
+            {
+                slot_t* slot = table.find(f);
+                if (slot == nullptr || nplatform::atomic_load(&slot->mState) < s_slot_cached)
+                    continue;
+                fileid_t const id((u32)archiveIndex, f);
+                if (s_reload_moved(old, fresh, id, hashes, slot->mData))
                 {
-                    void** archiveDataPtrs = mDataFilePtrs[fileid.getArchiveIndex()];
-                    // TODO: the array of pointers might not exist yet
+                    s_reserve(mAllocator, items, count, capacity, count + 1);
+                    reloaditem_t const item = {slot, id, -1, 0, nullptr, 0};
+                    items[count++]          = item;
+                    itemOf[f]               = count;
+                }
+            }
 
-                    void*& archiveDataFilePtr = archiveDataPtrs[fileid.getFileIndex()];
-                    if (archiveDataFilePtr == nullptr)
+            // Dataunits are files of archive 0 or of its layers
+            if (archiveIndex == 0 || old->mBase == 0)
+            {
+                for (u32 u = 0; u < mDataUnitSlots.mNumSlots; ++u)
+                {
+                    slot_t* slot = mDataUnitSlots.find(u);
+                    if (slot == nullptr || nplatform::atomic_load(&slot->mState) < s_slot_cached)
+                        continue;
+                    fileid_t const id = resolve(fileid_t(0, u));
+                    if (id.getArchiveIndex() == (u32)archiveIndex && s_reload_moved(old, fresh, id, hashes, slot->mData))
                     {
-                        archive_t::file_t const* files = section->getItemArray<archive_t::file_t>();
-                        archive_t::file_t const* entry = &files[fileid.getFileIndex()];
-                        u8*                      data  = g_allocate_array<byte>(mAllocator, entry->getFileSize());
-
-                        archivefile_t* dataArchive = mArchives[fileid.getArchiveIndex()];
-                        dataArchive->fileRead(fileid, 0, entry->getFileSize(), data);
-
-                        archiveDataFilePtr = data;
+                        s_reserve(mAllocator, items, count, capacity, count + 1);
+                        reloaditem_t const item = {slot, id, (s32)u, 0, nullptr, 0};
+                        items[count++]          = item;
                     }
-                    return archiveDataFilePtr;
                 }
             }
-            return nullptr;
-        }
 
-        void* archive_imp_t::v_load_dataunit(u32 dataunit_index)
-        {
-            fileid_t fileid(0, dataunit_index);
-            if (fileid.getArchiveIndex() < mNumArchives)
+            // Duplicates of a moving datafile, in any archive, get data of their own
+            for (s32 a = 0; mDeduplicate && a < mNumArchives; ++a)
             {
-                archive_t::section_t const* section = mArchiveSections[fileid.getArchiveIndex()];
-                if (section != nullptr && fileid.getFileIndex() < section->m_ItemArrayCount)
+                slottable_t const& other = mDataFileSlots[a];
+                for (u32 f = 0; mArchives[a] != nullptr && f < other.mNumSlots; ++f)
                 {
-                    dataunit_header_t*& dataUnitPtr = mDataUnitPtrs[fileid.getFileIndex()];
-                    if (dataUnitPtr == nullptr)
+                    slot_t* slot = other.find(f);
+                    if (slot == nullptr || slot->mShared == nullptr || nplatform::atomic_load(&slot->mState) < s_slot_cached)
+                        continue;
+                    u32 const canonical = table.indexOf(slot->mShared);
+                    if (canonical >= table.mNumSlots || itemOf[canonical] == 0)
+                        continue;
+                    items[itemOf[canonical] - 1].mSharers += 1;
+                    if (a != archiveIndex || itemOf[f] == 0)
                     {
-                        archive_t::file_t const* files = (archive_t::file_t const*)section->getItemArray<archive_t::file_t>();
-                        archive_t::file_t const* entry = &files[fileid.getFileIndex()];
-                        u8*                      data  = g_allocate_array<byte>(mAllocator, entry->getFileSize());
+                        s_reserve(mAllocator, items, count, capacity, count + 1);
+                        reloaditem_t const item = {slot, fileid_t((u32)a, f), -1, 0, nullptr, 0};
+                        items[count++]          = item;
+                    }
+                }
+            }
+            g_deallocate(mAllocator, itemOf);
 
-                        archivefile_t* dataArchive = mArchives[fileid.getArchiveIndex()];
-                        dataArchive->fileRead(fileid, 0, entry->getFileSize(), data);
+            // Read the new data of the slots that have owners through the new archive, into the arena of the slot
+            mArchives[archiveIndex]        = fresh;
+            mArchiveSections[archiveIndex] = (archive_t::section_t*)fresh->section(archiveIndex);
+            rebuildRedirect(archiveIndex);
 
-                        dataUnitPtr = (dataunit_header_t*)data;
-                        return g_patch(dataUnitPtr);
-                    }
-                    return dataUnitPtr + 1;
+            u32 read = 0;
+            for (; read < count; ++read)
+            {
+                reloaditem_t& item = items[read];
+                if (!s_reload_owned(item))
+                    continue;
+                arenascope_t scope(item.mSlot->mArena);
+                if (item.mUnit >= 0)
+                {
+                    item.mData = readUnit(item.mId, (u32)item.mUnit, item.mSize);
                 }
+                else
+                {
+                    bool corrupt = false;
+                    item.mData   = inPlace(item.mId, corrupt);
+                    if (item.mData == nullptr && !corrupt)
+                        item.mData = readFile(item.mId, item.mSize);
+                }
+                if (item.mData == nullptr)
+                    break;
             }
-            return nullptr;
-        }
 
-        void archive_imp_t::v_unload_datafile(fileid_t fileid, void*& data)
-        {
-            if (fileid.getArchiveIndex() < mNumArchives)
+            if (read < count)
             {
-                archive_t::section_t const* section = mArchiveSections[fileid.getArchiveIndex()];
-                if (section != nullptr && fileid.getFileIndex() < section->m_ItemArrayCount)
+                for (u32 i = 0; i < read; ++i)
                 {
-                    void** archiveDataPtrs = mDataFilePtrs[fileid.getArchiveIndex()];
-                    if (archiveDataPtrs != nullptr)
-                    {
-                        void*& archiveDataFilePtr = archiveDataPtrs[fileid.getFileIndex()];
-                        if (archiveDataFilePtr != nullptr)
-                        {
-                            ASSERT(archiveDataFilePtr == data);
-                            g_deallocate(mAllocator, archiveDataFilePtr);
-                            data = nullptr;
-                        }
-                    }
+                    if (items[i].mSize > 0 && items[i].mSlot->mArena == nullptr)
+                        g_deallocate(mAllocator, items[i].mData);
                 }
+                g_deallocate(mAllocator, items);
+                mArchives[archiveIndex]        = old;
+                mArchiveSections[archiveIndex] = (archive_t::section_t*)old->section(archiveIndex);
+                rebuildRedirect(archiveIndex);
+                fresh->close(mAllocator);
+                g_deallocate(mAllocator, fresh);
+                return -1;
             }
-        }
+            mDataFileSlots[archiveIndex].grow(mAllocator, mArchiveSections[archiveIndex]->m_ItemArrayCount);
 
-        void archive_imp_t::v_unload_dataunit(u32 dataunit_index, void*& data)
-        {
-            fileid_t fileid(0, dataunit_index);
-            if (fileid.getArchiveIndex() < mNumArchives)
+            // Owners switch to the new data, dataunit owners hold the pointer past the header
+            s32 reloaded = 0;
+            for (u32 i = 0; i < count; ++i)
             {
-                archive_t::section_t const* section = mArchiveSections[fileid.getArchiveIndex()];
-                if (section != nullptr && fileid.getFileIndex() < section->m_ItemArrayCount)
+                reloaditem_t const& item = items[i];
+                if (item.mData == nullptr)
+                    continue;
+                reloaded += 1;
+                if (callback == nullptr)
+                    continue;
+                if (item.mUnit >= 0)
+                    callback(context, item.mId, item.mUnit, (dataunit_header_t*)item.mSlot->mData + 1, (dataunit_header_t*)item.mData + 1);
+                else
+                    callback(context, item.mId, -1, item.mSlot->mData, item.mData);
+            }
+
+            {
+                nplatform::scoped_lock_t lock(mCacheMutex);
+                for (u32 i = 0; i < count; ++i)
                 {
-                    dataunit_header_t*& dataUnitPtr = mDataUnitPtrs[fileid.getFileIndex()];
-                    if (dataUnitPtr != nullptr)
-                    {
-                        ASSERT(dataUnitPtr == (dataunit_header_t*)data);
-                        g_deallocate(mAllocator, dataUnitPtr);
-                        data = nullptr;
-                    }
+                    reloaditem_t const& item = items[i];
+                    slot_t*             slot = item.mSlot;
+                    if (item.mData == nullptr)
+                        continue;
+                    if (slot->mShared != nullptr)
+                        unshare(slot);
+                    mResidentBytes -= slot->mSize;
+                    if (slot->mSize > 0)
+                        g_deallocate(mAllocator, slot->mData);
+                    slot->mData = item.mData;
+                    slot->mSize = slot->mArena != nullptr ? 0 : item.mSize;
+                    mResidentBytes += slot->mSize;
                 }
+
+                // What is left has no owners (the duplicates that shared it have let go by now)
+                for (u32 i = 0; i < count; ++i)
+                {
+                    if (items[i].mData == nullptr && nplatform::atomic_cas(&items[i].mSlot->mState, s_slot_cached, s_slot_evicting))
+                        drop(items[i].mSlot);
+                }
+                evict(mResidencyBudget);
             }
+
+            g_deallocate(mAllocator, items);
+            old->close(mAllocator);
+            g_deallocate(mAllocator, old);
+            return reloaded;
         }
 
         // TOC
@@ -353,8 +3067,13 @@ namespace ncore
 
         struct gda_t
         {
-            bool                 isValid() const { return fd.isValid(); }
-            nfile::file_handle_t fd;
+            bool                 isValid() const { return io.isValid() || map.isValid(); }
+            bool                 isMapped() const { return map.isValid(); }
+            byte const*          data() const { return map.data() + mBase; }
+            nplatform::fileio_t  io;     // Positional reads, no shared file position between threads
+            nplatform::filemap_t map;    //
+            u64                  mBase;  // Offset of the file data in the file, 0 unless the archive is packed
+            u64                  mSize;  // Bytes of file data
         };
 
         // FDB is a file/db containing all the filenames of the files in the datafile
@@ -419,48 +3138,237 @@ namespace ncore
             if (id.getFileIndex() >= section->m_ItemArrayCount)
                 return 0;
 
-            u64 const* hashArray = section->getItemArray<u64>();
-            return hashArray[id.getFileIndex()];
+            // The item array is only 4 byte aligned in some files
+            u64 hash;
+            nmem::memcpy(&hash, section->getItemArray<u64>() + id.getFileIndex(), sizeof(hash));
+            return hash;
         }
 
         archivefile_t::archivefile_t()
         {
-            mTOC = nullptr;
-            mFDB = nullptr;
-            mGDA = nullptr;
+            mBasePtr     = nullptr;
+            mIndex       = -1;
+            mBase        = -1;
+            mAllocator   = nullptr;
+            mBackend     = archive_t::BackendFileRead;
+            mTOC         = nullptr;
+            mGDA         = nullptr;
+            mIndexState  = s_once_pending;
+            mFilename    = nullptr;
+            mTocFilename = nullptr;
+            mStamp       = 0;
+        }
+
+        static char* s_copy_string(alloc_t* allocator, const char* str)
+        {
+            if (str == nullptr)
+                return nullptr;
+            u32 length = 0;
+            while (str[length] != '\0')
+                length += 1;
+            char* copy = g_allocate_array<char>(allocator, length + 1);
+            nmem::memcpy(copy, str, length + 1);
+            return copy;
+        }
+
+        void archivefile_t::setupDb(lazydb_t& db, const char* filename)
+        {
+            db.mState    = s_once_pending;
+            db.mFilename = s_copy_string(mAllocator, filename);
+            db.mOffset   = 0;
+            db.mSize     = 0;
+            db.mData     = nullptr;
+        }
+
+        void* archivefile_t::loadDb(lazydb_t& db) const
+        {
+            if (s_once_begin(&db.mState))
+            {
+                if (db.mFilename != nullptr)
+                    db.mData = (mBackend == archive_t::BackendMemoryMapped) ? s_map_file(db.mFilename, db.mMap) : nullptr;
+                if (db.mFilename != nullptr && db.mData == nullptr)
+                    db.mData = s_read_file(db.mFilename, mAllocator, nullptr);
+                if (db.mFilename == nullptr && db.mSize > 0)
+                    db.mData = s_read_region(mGDA->io, db.mOffset, db.mSize, mAllocator);
+                s_once_end(&db.mState);
+            }
+            return db.mData;
+        }
+
+        void archivefile_t::closeDb(lazydb_t& db)
+        {
+            if (db.mMap.isValid())
+                nplatform::filemap_close(db.mMap);
+            else if (db.mData != nullptr && (mGDA == nullptr || !isMapped(db.mData)))
+                g_deallocate(mAllocator, db.mData);
+            g_deallocate(mAllocator, db.mFilename);
+            db.mState    = s_once_pending;
+            db.mFilename = nullptr;
+            db.mSize     = 0;
+            db.mData     = nullptr;
+        }
+
+        fdb_t const* archivefile_t::fdb() const
+        {
+#if !defined(_SUBMISSION)
+            return (fdb_t const*)loadDb(mFDB);
+#else
+            return nullptr;
+#endif
+        }
+
+        hdb_t const* archivefile_t::hdb() const { return (hdb_t const*)loadDb(mHDB); }
+
+        s32 archivefile_t::open(alloc_t* allocator, archive_t::EBackend backend, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename)
+        {
+            close(allocator);
+
+            // The FDB and HDB are opened when first used
+            mAllocator = allocator;
+            mBackend   = backend;
+#if !defined(_SUBMISSION)
+            setupDb(mFDB, filenameDbFilename);
+#endif
+            setupDb(mHDB, hashDbFilename);
+
+            // Stamped before anything is read, a rebuild that overlaps with opening shows up as a change
+            mFilename    = s_copy_string(allocator, archiveFilename);
+            mTocFilename = s_copy_string(allocator, tocFilename);
+            mStamp       = stamp();
+
+            mGDA        = g_allocate<gda_t>(allocator);
+            mGDA->mBase = 0;
+            if (backend == archive_t::BackendMemoryMapped)
+            {
+                if (nplatform::filemap_open(archiveFilename, mGDA->map))
+                {
+                    // A TOC that can not be mapped is read instead, as loadDb does for the databases
+                    mGDA->mSize = mGDA->map.size();
+                    mTOC        = (toc_t*)s_map_file(tocFilename, mTocMap);
+                    if (mTOC == nullptr)
+                        mTOC = (toc_t*)s_read_file(tocFilename, allocator, nullptr);
+                    return mTOC != nullptr ? 0 : -1;
+                }
+                // Mapping is not available, fall through to the read backend
+                mBackend = archive_t::BackendFileRead;
+            }
+
+            if (nplatform::fileio_open(archiveFilename, mGDA->io))
+            {
+                mGDA->mSize = mGDA->io.size();
+                mTOC        = (toc_t*)s_read_file(tocFilename, allocator, nullptr);
+                return mTOC != nullptr ? 0 : -1;
+            }
+            return -1;
         }
 
-        s32 archivefile_t::open(alloc_t* allocator, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename)
+        // The regions of a packed archive must lie within the file and start on a page, the TOC is required
+        static bool s_valid_pack(archive_t::packheader_t const& header, u64 fileSize)
+        {
+            if (header.mMagic != archive_t::packheader_t::Magic || header.mVersion != archive_t::packheader_t::Version || header.mToc.mSize == 0)
+                return false;
+            archive_t::packheader_t::region_t const* regions[] = {&header.mData, &header.mToc, &header.mFdb, &header.mHdb};
+            for (s32 i = 0; i < 4; ++i)
+            {
+                archive_t::packheader_t::region_t const& r = *regions[i];
+                if ((r.mOffset % archive_t::packheader_t::Alignment) != 0 || r.mOffset > fileSize || r.mSize > (fileSize - r.mOffset))
+                    return false;
+            }
+            return true;
+        }
+
+        // One file holds everything. Mapped, the TOC, FDB and HDB are used in-place in the mapping of the
+        // file, otherwise they are read from the one open file.
+        s32 archivefile_t::openPacked(alloc_t* allocator, archive_t::EBackend backend, const char* packFilename)
         {
             close(allocator);
 
-            mGDA     = g_allocate<gda_t>(allocator);
-            mGDA->fd = file_open(archiveFilename, nfile::file_mode_t::FILE_MODE_READ);
-            if (mGDA->isValid())
+            mAllocator = allocator;
+            mBackend   = backend;
+#if !defined(_SUBMISSION)
+            setupDb(mFDB, nullptr);
+#endif
+            setupDb(mHDB, nullptr);
+            mFilename = s_copy_string(allocator, packFilename);
+            mStamp    = stamp();
+
+            mGDA        = g_allocate<gda_t>(allocator);
+            mGDA->mBase = 0;
+            mGDA->mSize = 0;
+
+            archive_t::packheader_t header;
+            if (backend == archive_t::BackendMemoryMapped && nplatform::filemap_open(packFilename, mGDA->map))
             {
-                mTOC = (toc_t*)s_read_file(tocFilename, allocator, nullptr);
+                if (mGDA->map.size() < sizeof(header))
+                    return -1;
+                nmem::memcpy(&header, mGDA->map.data(), sizeof(header));
+                if (!s_valid_pack(header, mGDA->map.size()))
+                    return -1;
+
+                byte const* base = mGDA->map.data();
+                mTOC             = (toc_t*)(base + header.mToc.mOffset);
 #if !defined(_SUBMISSION)
-                mFDB = (fdb_t*)s_read_file(filenameDbFilename, allocator, nullptr);
-                mHDB = (hdb_t*)s_read_file(hashDbFilename, allocator, nullptr);
+                mFDB.mData  = header.mFdb.mSize > 0 ? (void*)(base + header.mFdb.mOffset) : nullptr;
+                mFDB.mState = s_once_done;
 #endif
+                mHDB.mData  = header.mHdb.mSize > 0 ? (void*)(base + header.mHdb.mOffset) : nullptr;
+                mHDB.mState = s_once_done;
+                mGDA->mBase = header.mData.mOffset;
+                mGDA->mSize = header.mData.mSize;
                 return 0;
             }
-            return -1;
+
+            if (!nplatform::fileio_open(packFilename, mGDA->io))
+                return -1;
+            if (nplatform::fileio_pread(mGDA->io, 0, &header, sizeof(header)) != (s64)sizeof(header) || !s_valid_pack(header, mGDA->io.size()))
+                return -1;
+
+            mBackend = archive_t::BackendFileRead;
+            mTOC     = (toc_t*)s_read_region(mGDA->io, header.mToc.mOffset, header.mToc.mSize, allocator);
+#if !defined(_SUBMISSION)
+            mFDB.mOffset = header.mFdb.mOffset;
+            mFDB.mSize   = header.mFdb.mSize;
+#endif
+            mHDB.mOffset = header.mHdb.mOffset;
+            mHDB.mSize   = header.mHdb.mSize;
+            mGDA->mBase  = header.mData.mOffset;
+            mGDA->mSize = header.mData.mSize;
+            return mTOC != nullptr ? 0 : -1;
         }
 
         void archivefile_t::close(alloc_t* allocator)
         {
-            if (mGDA->isValid())
+            // The tables of a mapped packed archive are part of its mapping
+            if (mGDA == nullptr || !isMapped(mTOC))
+                s_release_file(allocator, mTOC, mTocMap);
+            if (mAllocator != nullptr)
             {
-                nfile::file_close(mGDA->fd);
+                closeDb(mFDB);
+                closeDb(mHDB);
             }
+            mHashIndex.teardown(allocator);
+            mIndexState = s_once_pending;
 
-            g_deallocate(allocator, mGDA);
-            g_deallocate(allocator, mTOC);
-            g_deallocate(allocator, mFDB);
-            g_deallocate(allocator, mHDB);
+            if (mGDA != nullptr)
+            {
+                if (mGDA->isMapped())
+                    nplatform::filemap_close(mGDA->map);
+                else if (mGDA->isValid())
+                    nplatform::fileio_close(mGDA->io);
+                g_deallocate(allocator, mGDA);
+            }
+
+            g_deallocate(allocator, mFilename);
+            g_deallocate(allocator, mTocFilename);
+            mFilename    = nullptr;
+            mTocFilename = nullptr;
+
+            mGDA = nullptr;
+            mTOC = nullptr;
         }
 
+        archive_t::section_t const* archivefile_t::section(u32 archiveIndex) const { return mTOC->getSection(archiveIndex); }
+
         bool archivefile_t::exists(fileid_t id) const
         {
             archive_t::file_t const* f = mTOC->getFileItem(id);
@@ -468,7 +3376,11 @@ namespace ncore
         }
 
         archive_t::file_t const* archivefile_t::file(fileid_t id) const { return mTOC->getFileItem(id); }
-        string_t                 archivefile_t::filename(fileid_t id) const { return mFDB != nullptr ? mFDB->getFilename(id) : string_t(); }
+        string_t                 archivefile_t::filename(fileid_t id) const
+        {
+            fdb_t const* names = fdb();
+            return names != nullptr ? names->getFilename(id) : string_t();
+        }
 
         s64 archivefile_t::fileRead(fileid_t id, s32 offset, s32 size, void* destination) const
         {
@@ -477,8 +3389,97 @@ namespace ncore
                 return -1;
 
             const s64 seekpos = f->getFileOffset() + offset;
-            nfile::file_seek(mGDA->fd, seekpos, nfile::seek_mode_t::SEEK_MODE_BEG);
-            return nfile::file_read(mGDA->fd, (u8*)destination, size);
+            return read(seekpos, size, destination);
+        }
+
+        s64 archivefile_t::read(u64 offset, u64 size, void* destination) const
+        {
+            if ((offset + size) > mGDA->mSize)
+                return -1;
+            if (mGDA->isMapped())
+            {
+                nmem::memcpy(destination, mGDA->data() + offset, size);
+                return (s64)size;
+            }
+            return nplatform::fileio_pread(mGDA->io, mGDA->mBase + offset, destination, size);
+        }
+
+        byte const* archivefile_t::mapped(u64 offset, u64 size) const
+        {
+            if (!mGDA->isMapped() || (offset + size) > mGDA->mSize)
+                return nullptr;
+            return mGDA->data() + offset;
+        }
+
+        void archivefile_t::willneed(u64 offset, u64 size) const
+        {
+            if (mGDA->isMapped())
+                nplatform::filemap_willneed(mGDA->map, mGDA->mBase + offset, size);
+        }
+
+        void const* archivefile_t::fileData(fileid_t id) const
+        {
+            if (!mGDA->isMapped())
+                return nullptr;
+
+            archive_t::file_t const* f = mTOC->getFileItem(id);
+            if (!f->isValid() || f->isCompressed())
+                return nullptr;
+            if ((f->getFileOffset() + f->getFileSize()) > mGDA->mSize)
+                return nullptr;
+            return mGDA->data() + f->getFileOffset();
+        }
+
+        bool archivefile_t::isMapped() const { return mGDA->isMapped(); }
+        bool archivefile_t::isMapped(void const* ptr) const { return mGDA->isMapped() && mGDA->map.contains(ptr); }
+
+        // A hash of 0 means the file has none, for equal hashes the lowest file index is found
+        hashindex_t const& archivefile_t::index() const
+        {
+            if (s_once_begin(&mIndexState))
+            {
+                hdb_t const* hashes = hdb();
+                if (hashes != nullptr)
+                {
+                    archive_t::section_t const* section = hashes->getSection((u32)mIndex);
+                    mHashIndex.setup(mAllocator, section->m_ItemArrayCount);
+                    for (u32 i = 0; i < section->m_ItemArrayCount; ++i)
+                    {
+                        u64 const hash = hashes->getHash(fileid_t((u32)mIndex, i));
+                        if (hash != 0)
+                            mHashIndex.insert(hash, i);
+                    }
+                }
+                s_once_end(&mIndexState);
+            }
+            return mHashIndex;
+        }
+
+        bool archivefile_t::find(u64 hash, fileid_t& id) const
+        {
+            u32 fileIndex;
+            if (!index().find(hash, fileIndex))
+                return false;
+            id = fileid_t((u32)mIndex, fileIndex);
+            return true;
+        }
+
+        u64 archivefile_t::hash(fileid_t id) const
+        {
+            hdb_t const* hashes = hdb();
+            return hashes != nullptr ? hashes->getHash(id) : 0;
+        }
+
+        u64 archivefile_t::stamp() const
+        {
+            char const* filenames[] = {mFilename, mTocFilename, mFDB.mFilename, mHDB.mFilename};
+            u64         result      = 0;
+            for (s32 i = 0; i < 4; ++i)
+            {
+                if (filenames[i] != nullptr)
+                    result = (result * 0x100000001B3ull) ^ nplatform::file_stamp(filenames[i]);
+            }
+            return result;
         }
 
         // ------------------------------------------------------------------------------------------------
@@ -491,16 +3492,44 @@ namespace ncore
         bool                     archive_t::exists(fileid_t const& id) const { return s_imp->exists(id); }
         archive_t::file_t const* archive_t::fileitem(fileid_t const& id) const { return s_imp->fileitem(id); }
         string_t                 archive_t::filename(fileid_t const& id) const { return s_imp->filename(id); }
+        fileid_t                 archive_t::find(u64 hash) const { return s_imp->find(hash); }
+        s32                      archive_t::verify(s32 archiveIndex, fileid_t* outCorrupt, s32 maxCorrupt, s32 numThreads) { return s_imp->verify(archiveIndex, outCorrupt, maxCorrupt, numThreads); }
+        bool                     archive_t::changed(s32 archiveIndex) const { return s_imp->changed(archiveIndex); }
+        s32                      archive_t::reload(s32 archiveIndex, reload_fn callback, void* context) { return s_imp->reload(archiveIndex, callback, context); }
+        s32                      archive_t::find(u64 const* hashes, s32 count, fileid_t* outIds) const { return s_imp->find(hashes, count, outIds); }
         archive_loader_t*        archive_t::loader() const { return s_imp; }
-
-        void archive_t::s_setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataArchives)
+        archive_loader_t*        archive_t::loader(arena_t* arena) const { return arena; }
+
+        s32  archive_t::mount(s32 archiveIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename) { return s_imp->mount(archiveIndex, archiveFilename, tocFilename, filenameDbFilename, hashDbFilename); }
+        void archive_t::unmount(s32 archiveIndex) { s_imp->unmount(archiveIndex); }
+        s32  archive_t::mount(s32 archiveIndex, const char* packFilename) { return s_imp->mount(archiveIndex, packFilename, nullptr, nullptr, nullptr); }
+        s32  archive_t::mount_overlay(s32 archiveIndex, s32 baseIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename) { return s_imp->mountOverlay(archiveIndex, baseIndex, archiveFilename, tocFilename, filenameDbFilename, hashDbFilename); }
+        s32  archive_t::mount_overlay(s32 archiveIndex, s32 baseIndex, const char* packFilename) { return s_imp->mountOverlay(archiveIndex, baseIndex, packFilename, nullptr, nullptr, nullptr); }
+
+        void archive_t::set_residency_budget(u64 bytes) { s_imp->setResidencyBudget(bytes); }
+        u64  archive_t::resident_bytes() const { return s_imp->residentBytes(); }
+
+        u64  archive_t::resident_bytes(s32 archiveIndex) const { return s_imp->residentBytes(archiveIndex); }
+        void archive_t::stats(telemetry_t::stats_t& out) const { s_imp->mTelemetry.stats(out); }
+        void archive_t::reset_stats() { s_imp->mTelemetry.reset(); }
+        bool archive_t::start_trace(u32 maxEvents) { return s_imp->mTelemetry.start_trace(maxEvents); }
+        void archive_t::stop_trace() { s_imp->mTelemetry.stop_trace(); }
+        bool archive_t::dump_trace(const char* filename) const { return s_imp->mTelemetry.dump_trace(filename); }
+        bool archive_t::start_access_log(u32 maxEntries) { return s_imp->mTelemetry.start_access_log(maxEntries); }
+        void archive_t::stop_access_log() { s_imp->mTelemetry.stop_access_log(); }
+        bool archive_t::dump_access_log(const char* filename) const { return s_imp->mTelemetry.dump_access_log(filename); }
+
+        archive_t::arena_t* archive_t::create_arena(u64 blockSize) { return s_imp->createArena(blockSize); }
+        void                archive_t::release_arena(arena_t* arena) { s_imp->releaseArena(arena); }
+
+        void archive_t::s_setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataArchives, config_t const& config)
         {
             if (s_instance == nullptr)
             {
                 s_instance = g_allocate<archive_t>(allocator);
 
                 s_imp = g_allocate<archive_imp_t>(allocator);
-                s_imp->setup(allocator, maxNumDataUnits, maxNumDataArchives);
+                s_imp->setup(allocator, maxNumDataUnits, maxNumDataArchives, config);
 
                 g_loader = s_imp;
             }
@@ -1,5 +1,6 @@
 #include "ccore/c_target.h"
 #include "cbase/c_hash.h"
+#include "cbase/c_memory.h"
 #include "cbase/c_log.h"
 #include "cbase/c_va_list.h"
 
@@ -14,5 +15,126 @@ namespace ncore
         {
 
         }  // namespace ngamedata
+
+        u32 strtable_t::s_index_size(u32 numStrings)
+        {
+            u32 size = 1;
+            while ((size * 3) < (numStrings * 4))
+                size *= 2;
+            return size;
+        }
+
+        bool strtable_t::s_build_index(u32 const* hashes, u32 numStrings, u32* index, u32 indexSize)
+        {
+            bool unique = true;
+            for (u32 b = 0; b < indexSize; ++b)
+                index[b] = 0;
+            for (u32 i = 0; i < numStrings; ++i)
+            {
+                u32 b = s_bucket(hashes[i], indexSize);
+                while (index[b] != 0 && hashes[index[b] - 1] != hashes[i])
+                    b = (b + 1) & (indexSize - 1);
+                if (index[b] != 0)
+                    unique = false;
+                else
+                    index[b] = i + 1;
+            }
+            return unique;
+        }
+
+        u32 strtable_t::s_table_bound(u32 numStrings, u32 textBytes) { return (u32)sizeof(strtable_t) + numStrings * 4 * 4 + s_index_size(numStrings) * 4 + textBytes + numStrings; }
+
+        s32 strtable_t::s_write_table(u32 const* hashes, char const* const* strings, u32 const* byteLengths, u32 const* charLengths, u32 numStrings, byte* dst, u32 dstCapacity)
+        {
+            u32 textBytes = 0;
+            for (u32 i = 0; i < numStrings; ++i)
+                textBytes += byteLengths[i];
+            if (dstCapacity < s_table_bound(numStrings, textBytes))
+                return -1;
+
+            strtable_t* table         = (strtable_t*)dst;
+            table->mMagic             = Magic;
+            table->mNumStrings        = numStrings;
+            table->mHashesOffset      = (u32)sizeof(strtable_t);
+            table->mOffsetsOffset     = table->mHashesOffset + numStrings * 4;
+            table->mCharLengthsOffset = table->mOffsetsOffset + numStrings * 4;
+            table->mByteLengthsOffset = table->mCharLengthsOffset + numStrings * 4;
+            table->mIndexSize         = s_index_size(numStrings);
+            table->mIndexOffset       = table->mByteLengthsOffset + numStrings * 4;
+            table->mStringsOffset     = table->mIndexOffset + table->mIndexSize * 4;
+
+            u32* const offsets = (u32*)(dst + table->mOffsetsOffset);
+            char*      text    = (char*)(dst + table->mStringsOffset);
+            u32        offset  = 0;
+            for (u32 i = 0; i < numStrings; ++i)
+            {
+                offsets[i] = offset;
+                nmem::memcpy(text + offset, strings[i], byteLengths[i]);
+                offset += byteLengths[i];
+                text[offset++] = '\0';
+            }
+            if (numStrings > 0)
+            {
+                nmem::memcpy(dst + table->mHashesOffset, hashes, numStrings * 4);
+                nmem::memcpy(dst + table->mCharLengthsOffset, charLengths, numStrings * 4);
+                nmem::memcpy(dst + table->mByteLengthsOffset, byteLengths, numStrings * 4);
+            }
+            s_build_index(hashes, numStrings, (u32*)(dst + table->mIndexOffset), table->mIndexSize);
+            return (s32)(table->mStringsOffset + offset);
+        }
+
+        s32 strtable_t::find(u32 hash) const { return s_find(array(mHashesOffset), array(mIndexOffset), mIndexSize, hash); }
+
+        // The index is never full, a probe ends at an empty bucket at the latest
+        s32 strtable_t::s_find(u32 const* hashes, u32 const* index, u32 indexSize, u32 hash)
+        {
+            if (indexSize == 0)
+                return -1;
+            u32 b = s_bucket(hash, indexSize);
+            while (index[b] != 0)
+            {
+                if (hashes[index[b] - 1] == hash)
+                    return (s32)(index[b] - 1);
+                b = (b + 1) & (indexSize - 1);
+            }
+            return -1;
+        }
+
+        // Tools lay the strings out after the arrays, but nothing requires that
+        u32 strtable_t::bytes() const
+        {
+            u32       end      = sizeof(strtable_t);
+            u32 const arrays[] = {mHashesOffset, mOffsetsOffset, mCharLengthsOffset, mByteLengthsOffset};
+            for (s32 a = 0; a < 4; ++a)
+                end = (arrays[a] + mNumStrings * 4) > end ? (arrays[a] + mNumStrings * 4) : end;
+            if (mIndexSize > 0 && (mIndexOffset + mIndexSize * 4) > end)
+                end = mIndexOffset + mIndexSize * 4;
+
+            u32 const* offsets     = array(mOffsetsOffset);
+            u32 const* byteLengths = array(mByteLengthsOffset);
+            for (u32 i = 0; i < mNumStrings; ++i)
+            {
+                u32 const stringEnd = mStringsOffset + offsets[i] + byteLengths[i] + 1;
+                end                 = stringEnd > end ? stringEnd : end;
+            }
+            return end;
+        }
+
+        void modeldatafile_t::load() const
+        {
+            // Batch in chunks, a model with more textures than this is still only a handful of reads
+            s32 const numFiles = (s32)m_Textures.size() + 1;
+            fileid_t  fileids[32];
+            s32       count = 0;
+            for (s32 i = 0; i < numFiles; ++i)
+            {
+                fileids[count++] = (i < (s32)m_Textures.size()) ? m_Textures[i].m_fileid : m_StaticMesh.m_fileid;
+                if (count == 32 || i == (numFiles - 1))
+                {
+                    g_loader->load_datafiles(fileids, count);
+                    count = 0;
+                }
+            }
+        }
     }  // namespace charon
 }  // namespace ncore
@@ -0,0 +1,165 @@
+#include "ccore/c_target.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_hash.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nhash
+        {
+            static const u64 c_prime1 = 0x9E3779B185EBCA87ull;
+            static const u64 c_prime2 = 0xC2B2AE3D27D4EB4Full;
+            static const u64 c_prime3 = 0x165667B19E3779F9ull;
+            static const u64 c_prime4 = 0x85EBCA77C2B2AE63ull;
+            static const u64 c_prime5 = 0x27D4EB2F165667C5ull;
+
+            // Little endian reads, unaligned
+            static inline u64 s_read64(u8 const* p)
+            {
+                u64 v;
+                nmem::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+
+            static inline u32 s_read32(u8 const* p)
+            {
+                u32 v;
+                nmem::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+
+            static inline u64 s_rotl(u64 x, s32 r) { return (x << r) | (x >> (64 - r)); }
+
+            static inline u64 s_round(u64 lane, u64 input)
+            {
+                lane += input * c_prime2;
+                lane = s_rotl(lane, 31);
+                return lane * c_prime1;
+            }
+
+            static inline u64 s_merge(u64 hash, u64 lane)
+            {
+                hash ^= s_round(0, lane);
+                return hash * c_prime1 + c_prime4;
+            }
+
+            static inline void s_init(u64* lanes, u64 seed)
+            {
+                lanes[0] = seed + c_prime1 + c_prime2;
+                lanes[1] = seed + c_prime2;
+                lanes[2] = seed;
+                lanes[3] = seed - c_prime1;
+            }
+
+            // The lanes do not depend on each other, so the four multiplies of a stripe overlap
+            static inline u8 const* s_stripes(u64* lanes, u8 const* p, u8 const* end)
+            {
+                u64 v0 = lanes[0], v1 = lanes[1], v2 = lanes[2], v3 = lanes[3];
+                while ((end - p) >= 32)
+                {
+                    v0 = s_round(v0, s_read64(p + 0));
+                    v1 = s_round(v1, s_read64(p + 8));
+                    v2 = s_round(v2, s_read64(p + 16));
+                    v3 = s_round(v3, s_read64(p + 24));
+                    p += 32;
+                }
+                lanes[0] = v0;
+                lanes[1] = v1;
+                lanes[2] = v2;
+                lanes[3] = v3;
+                return p;
+            }
+
+            static u64 s_finish(u64 const* lanes, u64 seed, u64 total, u8 const* p, u8 const* end)
+            {
+                u64 h;
+                if (total >= 32)
+                {
+                    h = s_rotl(lanes[0], 1) + s_rotl(lanes[1], 7) + s_rotl(lanes[2], 12) + s_rotl(lanes[3], 18);
+                    for (s32 i = 0; i < 4; ++i)
+                        h = s_merge(h, lanes[i]);
+                }
+                else
+                {
+                    h = seed + c_prime5;
+                }
+                h += total;
+
+                while ((end - p) >= 8)
+                {
+                    h ^= s_round(0, s_read64(p));
+                    h = s_rotl(h, 27) * c_prime1 + c_prime4;
+                    p += 8;
+                }
+                if ((end - p) >= 4)
+                {
+                    h ^= (u64)s_read32(p) * c_prime1;
+                    h = s_rotl(h, 23) * c_prime2 + c_prime3;
+                    p += 4;
+                }
+                while (p < end)
+                {
+                    h ^= (u64)(*p++) * c_prime5;
+                    h = s_rotl(h, 11) * c_prime1;
+                }
+
+                h ^= h >> 33;
+                h *= c_prime2;
+                h ^= h >> 29;
+                h *= c_prime3;
+                h ^= h >> 32;
+                return h;
+            }
+
+            u64 hash64(void const* data, u64 size, u64 seed)
+            {
+                u8 const* p   = (u8 const*)data;
+                u8 const* end = p + size;
+                u64       lanes[4];
+                s_init(lanes, seed);
+                p = s_stripes(lanes, p, end);
+                return s_finish(lanes, seed, size, p, end);
+            }
+
+            void state_t::reset(u64 seed)
+            {
+                s_init(mLanes, seed);
+                mSeed     = seed;
+                mTotal    = 0;
+                mBuffered = 0;
+            }
+
+            void state_t::update(void const* data, u64 size)
+            {
+                u8 const* p   = (u8 const*)data;
+                u8 const* end = p + size;
+                mTotal += size;
+
+                // Complete a buffered stripe first
+                if (mBuffered > 0)
+                {
+                    u32 const fill = (u32)((32 - mBuffered) < size ? (32 - mBuffered) : size);
+                    nmem::memcpy(mBuffer + mBuffered, p, fill);
+                    mBuffered += fill;
+                    p += fill;
+                    if (mBuffered < 32)
+                        return;
+                    s_stripes(mLanes, mBuffer, mBuffer + 32);
+                    mBuffered = 0;
+                }
+
+                p = s_stripes(mLanes, p, end);
+                if (p < end)
+                {
+                    nmem::memcpy(mBuffer, p, (u32)(end - p));
+                    mBuffered = (u32)(end - p);
+                }
+            }
+
+            u64 state_t::digest() const { return s_finish(mLanes, mSeed, mTotal, mBuffer, mBuffer + mBuffered); }
+
+        }  // namespace nhash
+    }  // namespace charon
+}  // namespace ncore
@@ -0,0 +1,154 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_hashindex.h"
+#include "charon/c_platform.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define CHARON_HASHINDEX_SSE2
+#endif
+
+namespace ncore
+{
+    namespace charon
+    {
+        static const u32 s_group_size = 16;
+        static const u8  s_empty      = 0x80;
+
+        // The HDB hashes are good hashes already, the multiply spreads any structure that is left (e.g.
+        // sequential ids) over the high bits, which select the group and the 7-bit tag.
+        static inline u64 s_mix(u64 hash) { return hash * 0x9E3779B97F4A7C15ull; }
+        static inline u8  s_tag(u64 h) { return (u8)(h >> 57); }
+        static inline u32 s_group(u64 h) { return (u32)(h >> 25); }
+
+        // Bit i is set when control byte i of the group equals value
+        static inline u32 s_match(u8 const* control, u8 value)
+        {
+#if defined(CHARON_HASHINDEX_SSE2)
+            __m128i const group = _mm_load_si128((__m128i const*)control);
+            return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)value)));
+#else
+            u32 mask = 0;
+            for (u32 i = 0; i < s_group_size; ++i)
+                mask |= (control[i] == value ? 1u : 0u) << i;
+            return mask;
+#endif
+        }
+
+        hashindex_t::hashindex_t()
+            : mControl(nullptr)
+            , mEntries(nullptr)
+            , mGroupMask(0)
+            , mCount(0)
+            , mMaxItems(0)
+        {
+        }
+
+        void hashindex_t::setup(alloc_t* allocator, u32 maxItems)
+        {
+            u32 const minSlots  = maxItems + (maxItems / 7) + 1;
+            u32       numGroups = 1;
+            while ((numGroups * s_group_size) < minSlots)
+                numGroups *= 2;
+
+            u32 const numSlots = numGroups * s_group_size;
+            mControl           = (u8*)allocator->allocate(numSlots, s_group_size);
+            mEntries           = g_allocate_array<entry_t>(allocator, numSlots);
+            mGroupMask         = numGroups - 1;
+            mCount             = 0;
+            mMaxItems          = numSlots - (numSlots / 8);
+            nmem::memset(mControl, s_empty, numSlots);
+        }
+
+        void hashindex_t::teardown(alloc_t* allocator)
+        {
+            allocator->deallocate(mControl);
+            g_deallocate(allocator, mEntries);
+            mControl   = nullptr;
+            mEntries   = nullptr;
+            mGroupMask = 0;
+            mCount     = 0;
+            mMaxItems  = 0;
+        }
+
+        // Groups are visited at triangular offsets, with a power of two number of groups that visits each
+        // group once. The table always has an empty slot, a probe ends at the first group that has one.
+        bool hashindex_t::insert(u64 hash, u32 value)
+        {
+            if (mCount >= mMaxItems)
+                return false;
+
+            u64 const h   = s_mix(hash);
+            u8 const  tag = s_tag(h);
+            u32       g   = s_group(h) & mGroupMask;
+            for (u32 step = 1;; ++step)
+            {
+                u8* control = mControl + g * s_group_size;
+                u32 match   = s_match(control, tag);
+                while (match != 0)
+                {
+                    u32 const slot = g * s_group_size + nplatform::lowest_bit(match);
+                    if (mEntries[slot].mHash == hash)
+                        return false;
+                    match &= match - 1;
+                }
+
+                u32 const empty = s_match(control, s_empty);
+                if (empty != 0)
+                {
+                    u32 const slot = g * s_group_size + nplatform::lowest_bit(empty);
+                    mControl[slot]        = tag;
+                    mEntries[slot].mHash  = hash;
+                    mEntries[slot].mValue = value;
+                    mCount += 1;
+                    return true;
+                }
+                g = (g + step) & mGroupMask;
+            }
+        }
+
+        bool hashindex_t::find(u64 hash, u32& value) const
+        {
+            if (mControl == nullptr)
+                return false;
+
+            u64 const h   = s_mix(hash);
+            u8 const  tag = s_tag(h);
+            u32       g   = s_group(h) & mGroupMask;
+            for (u32 step = 1; step <= (mGroupMask + 1); ++step)
+            {
+                u8 const* control = mControl + g * s_group_size;
+                u32       match   = s_match(control, tag);
+                while (match != 0)
+                {
+                    u32 const slot = g * s_group_size + nplatform::lowest_bit(match);
+                    if (mEntries[slot].mHash == hash)
+                    {
+                        value = mEntries[slot].mValue;
+                        return true;
+                    }
+                    match &= match - 1;
+                }
+                if (s_match(control, s_empty) != 0)
+                    return false;
+                g = (g + step) & mGroupMask;
+            }
+            return false;
+        }
+
+        // Most lookups end in their first group, its entries span 4 cache lines
+        void hashindex_t::prefetch(u64 hash) const
+        {
+            if (mControl == nullptr)
+                return;
+            u32 const      g       = s_group(s_mix(hash)) & mGroupMask;
+            entry_t const* entries = mEntries + g * s_group_size;
+            nplatform::prefetch(mControl + g * s_group_size);
+            for (u32 i = 0; i < s_group_size; i += 4)
+                nplatform::prefetch(entries + i);
+        }
+
+    }  // namespace charon
+}  // namespace ncore
@@ -0,0 +1,215 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+
+#include "charon/c_jobs.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        jobs_t::jobs_t()
+            : mAllocator(nullptr)
+            , mJobs(nullptr)
+            , mMaxJobs(0)
+            , mFreeHead(-1)
+            , mPendingHead(-1)
+            , mPendingTail(-1)
+            , mThreads(nullptr)
+            , mNumThreads(0)
+            , mQuit(false)
+        {
+        }
+
+        void jobs_t::setup(alloc_t* allocator, s32 numThreads, s32 maxJobs)
+        {
+            mAllocator   = allocator;
+            mMaxJobs     = maxJobs;
+            mJobs        = g_allocate_array_and_clear<job_t>(allocator, maxJobs);
+            mFreeHead    = -1;
+            mPendingHead = -1;
+            mPendingTail = -1;
+            for (s32 i = maxJobs - 1; i >= 0; --i)
+            {
+                mJobs[i].mNext = mFreeHead;
+                mFreeHead      = i;
+            }
+
+            nplatform::mutex_init(mMutex);
+            nplatform::cond_init(mWork);
+            nplatform::cond_init(mDone);
+
+            mQuit       = false;
+            mNumThreads = 0;
+            mThreads    = numThreads > 0 ? g_allocate_array_and_clear<nplatform::thread_t>(allocator, numThreads) : nullptr;
+            for (s32 i = 0; i < numThreads; ++i)
+            {
+                if (!nplatform::thread_create(mThreads[mNumThreads], s_worker, this))
+                    break;
+                mNumThreads += 1;
+            }
+        }
+
+        void jobs_t::teardown()
+        {
+            nplatform::mutex_lock(mMutex);
+            mQuit = true;
+            nplatform::cond_broadcast(mWork);
+            nplatform::mutex_unlock(mMutex);
+
+            for (s32 i = 0; i < mNumThreads; ++i)
+                nplatform::thread_join(mThreads[i]);
+
+            // Without threads nothing can be pending, jobs were executed inline
+            while (help())
+            {
+            }
+
+            nplatform::cond_destroy(mDone);
+            nplatform::cond_destroy(mWork);
+            nplatform::mutex_destroy(mMutex);
+
+            g_deallocate(mAllocator, mThreads);
+            g_deallocate(mAllocator, mJobs);
+            mThreads    = nullptr;
+            mJobs       = nullptr;
+            mNumThreads = 0;
+        }
+
+        jobhandle_t jobs_t::submit(job_fn func, void* context, u64 arg)
+        {
+            jobhandle_t handle;
+            if (mNumThreads > 0)
+            {
+                nplatform::mutex_lock(mMutex);
+                if (mFreeHead >= 0 && !mQuit)
+                {
+                    s32 const index = mFreeHead;
+                    job_t&    job   = mJobs[index];
+                    mFreeHead       = job.mNext;
+
+                    job.mFunc    = func;
+                    job.mContext = context;
+                    job.mArg     = arg;
+                    job.mNext    = -1;
+                    if (mPendingTail >= 0)
+                        mJobs[mPendingTail].mNext = index;
+                    else
+                        mPendingHead = index;
+                    mPendingTail = index;
+
+                    handle.m_index      = index;
+                    handle.m_generation = job.mGeneration;
+                    nplatform::cond_signal(mWork);
+                    nplatform::mutex_unlock(mMutex);
+                    return handle;
+                }
+                nplatform::mutex_unlock(mMutex);
+            }
+
+            // No workers or no free job slot, do the work now
+            func(context, arg);
+            return handle;
+        }
+
+        bool jobs_t::is_done(jobhandle_t const& handle) const
+        {
+            if (!handle.isValid())
+                return true;
+            return nplatform::atomic_load(&mJobs[handle.m_index].mGeneration) != handle.m_generation;
+        }
+
+        // The waiting thread can hold something (e.g. a claimed slot) that a job of another kind needs, it
+        // only helps with jobs of the kind that it waits for
+        void jobs_t::wait(jobhandle_t const& handle)
+        {
+            if (is_done(handle))
+                return;
+
+            nplatform::mutex_lock(mMutex);
+            job_fn const func = is_done(handle) ? nullptr : mJobs[handle.m_index].mFunc;
+            nplatform::mutex_unlock(mMutex);
+
+            while (!is_done(handle))
+            {
+                if (help(func))
+                    continue;
+
+                nplatform::mutex_lock(mMutex);
+                if (!is_done(handle))
+                    nplatform::cond_wait(mDone, mMutex);
+                nplatform::mutex_unlock(mMutex);
+            }
+        }
+
+        bool jobs_t::help(job_fn func)
+        {
+            nplatform::mutex_lock(mMutex);
+            s32 const index = pop(func);
+            nplatform::mutex_unlock(mMutex);
+            if (index < 0)
+                return false;
+
+            job_t& job = mJobs[index];
+            job.mFunc(job.mContext, job.mArg);
+            finish(index);
+            return true;
+        }
+
+        // Mutex must be held, takes the oldest pending job (of func when given) out of the list
+        s32 jobs_t::pop(job_fn func)
+        {
+            s32 prev  = -1;
+            s32 index = mPendingHead;
+            while (index >= 0 && func != nullptr && mJobs[index].mFunc != func)
+            {
+                prev  = index;
+                index = mJobs[index].mNext;
+            }
+            if (index >= 0)
+            {
+                s32 const next = mJobs[index].mNext;
+                if (prev >= 0)
+                    mJobs[prev].mNext = next;
+                else
+                    mPendingHead = next;
+                if (next < 0)
+                    mPendingTail = prev;
+            }
+            return index;
+        }
+
+        void jobs_t::finish(s32 index)
+        {
+            nplatform::mutex_lock(mMutex);
+            job_t& job = mJobs[index];
+            nplatform::atomic_store(&job.mGeneration, job.mGeneration + 1);
+            job.mNext = mFreeHead;
+            mFreeHead = index;
+            nplatform::cond_broadcast(mDone);
+            nplatform::mutex_unlock(mMutex);
+        }
+
+        void jobs_t::s_worker(void* arg)
+        {
+            jobs_t* jobs = (jobs_t*)arg;
+            nplatform::mutex_lock(jobs->mMutex);
+            while (true)
+            {
+                while (!jobs->mQuit && jobs->mPendingHead < 0)
+                    nplatform::cond_wait(jobs->mWork, jobs->mMutex);
+
+                s32 const index = jobs->pop(nullptr);
+                if (index < 0)
+                    break;  // Quit and nothing left to do
+
+                nplatform::mutex_unlock(jobs->mMutex);
+                job_t& job = jobs->mJobs[index];
+                job.mFunc(job.mContext, job.mArg);
+                jobs->finish(index);
+                nplatform::mutex_lock(jobs->mMutex);
+            }
+            nplatform::mutex_unlock(jobs->mMutex);
+        }
+
+    }  // namespace charon
+}  // namespace ncore
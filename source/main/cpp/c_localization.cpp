@@ -5,13 +5,19 @@
 
 #include "charon/c_localization.h"
 #include "charon/c_archive.h"
+#include "charon/c_platform.h"
 
 namespace ncore
 {
     localization_t::localization_t(alloc_t* allocator)
         : mAllocator(allocator)
-        , mCurrentLanguage(charon::enums::LanguageInvalid)
         , mLanguages(nullptr)
+        , mCurrent(nullptr)
+        , mCurrentLanguage(charon::enums::LanguageInvalid)
+        , mRequested(charon::enums::LanguageInvalid)
+        , mBudget(0)
+        , mResidentBytes(0)
+        , mUpdates(0)
     {
     }
 
@@ -21,61 +27,327 @@ namespace ncore
         for (s32 i = 0; i < charon::enums::LanguageCount; ++i)
         {
             mLanguageStrTables[i] = nullptr;
+            mPools[i]             = nullptr;
+            mTexts[i].mTable      = nullptr;
+            mTexts[i].mStrings    = nullptr;
+            mTexts[i].mPool       = nullptr;
+            mPrefetching[i]       = false;
+            mPoolLoading[i]       = false;
+            mBytes[i]             = 0;
+            mLastUsed[i]          = 0;
+            mRetired[i]           = 0;
         }
+        mCache.setup(mAllocator, s_cache_blocks, s_grace_updates);
     }
 
-    void localization_t::teardown(charon::archive_t* ar) { unloadLanguages(ar); }
+    void localization_t::teardown(charon::archive_t* ar)
+    {
+        unloadLanguages(ar);
+        mCache.teardown();
+    }
 
-    charon::enums::ELanguage localization_t::getCurrentLanguage() const { return mCurrentLanguage; }
+    charon::enums::ELanguage localization_t::getCurrentLanguage() const { return (charon::enums::ELanguage)charon::nplatform::atomic_load(&mCurrentLanguage); }
 
     void localization_t::setupLanguage(charon::enums::ELanguage language, charon::archive_t* ar)
     {
         s32 const i = language;
+        if (mPrefetching[i])
+        {
+            mPrefetching[i] = false;
+            adoptLanguage(language, charon::g_loader->wait(mPrefetches[i]), true);
+        }
+        if (mPoolLoading[i])
+        {
+            mPoolLoading[i] = false;
+            adoptPool(language, charon::g_loader->wait(mPoolLoads[i]));
+        }
         if (mLanguageStrTables[i] == nullptr)
         {
-            loadLanguage(mLanguageStrTables[i], mCurrentLanguage, ar);
+            loadLanguage(language);
+        }
+        if (isResident(language))
+        {
+            switchLanguage(language);
         }
-        mCurrentLanguage = language;
     }
 
     void localization_t::teardownLanguage(charon::enums::ELanguage language, charon::archive_t* ar)
     {
         s32 const i = language;
+        if (mPrefetching[i])
+        {
+            mPrefetching[i] = false;
+            if (!charon::g_loader->cancel(mPrefetches[i]))
+                adoptLanguage(language, charon::g_loader->wait(mPrefetches[i]), false);
+        }
+        if (mRequested == language)
+        {
+            mRequested = charon::enums::LanguageInvalid;
+        }
         if (mLanguageStrTables[i] != nullptr)
         {
-            charon::datafile_t<charon::strtable_t> const& lan = mLanguages->getLanguageArray()[language];
-            lan.unload(mLanguageStrTables[i]);
-            mCurrentLanguage = charon::enums::LanguageEnglish;
+            // Without a current language getText returns empty text
+            if (getCurrentLanguage() == language)
+            {
+                charon::nplatform::atomic_store(&mCurrent, (void*)nullptr);
+                charon::nplatform::atomic_store(&mCurrentLanguage, (s32)charon::enums::LanguageInvalid);
+            }
+            unloadLanguage(language);
         }
     }
 
-    void localization_t::loadLanguage(charon::strtable_t*& language, charon::enums::ELanguage language_id, charon::archive_t* bf)
+    void localization_t::prefetchLanguage(charon::enums::ELanguage language, charon::EPriority priority)
     {
-        charon::array_t<charon::datafile_t<charon::strtable_t>> const& languages    = mLanguages->getLanguageArray();
-        void*                                                          language_mem = languages[language_id].load();
-        language                                                                    = new (language_mem) charon::strtable_t();
+        s32 const i  = language;
+        mLastUsed[i] = mUpdates;
+        if (mLanguageStrTables[i] == nullptr && !mPrefetching[i])
+        {
+            mPrefetches[i]  = mLanguages->getLanguageArray()[i].load_async(priority);
+            mPrefetching[i] = true;
+        }
     }
 
-    void localization_t::unloadLanguages(charon::archive_t* ar)
+    void localization_t::requestLanguage(charon::enums::ELanguage language)
+    {
+        s32 const i = language;
+        if (isResident(language))
+        {
+            mRequested = charon::enums::LanguageInvalid;
+            switchLanguage(language);
+            return;
+        }
+
+        // Now needed, a prefetch that has not started yet moves to the front
+        if (mPrefetching[i])
+            charon::g_loader->reprioritize(mPrefetches[i], charon::PriorityHigh);
+        else if (mPoolLoading[i])
+            charon::g_loader->reprioritize(mPoolLoads[i], charon::PriorityHigh);
+        else
+            prefetchLanguage(language, charon::PriorityHigh);
+        mRequested = language;
+    }
+
+    void localization_t::update()
+    {
+        mUpdates += 1;
+        mCache.update();
+        for (s32 i = 0; i < charon::enums::LanguageCount; ++i)
+        {
+            if (mPrefetching[i] && charon::g_loader->is_done(mPrefetches[i]))
+            {
+                mPrefetching[i] = false;
+                adoptLanguage((charon::enums::ELanguage)i, charon::g_loader->wait(mPrefetches[i]), false);
+            }
+            if (mPoolLoading[i] && charon::g_loader->is_done(mPoolLoads[i]))
+            {
+                mPoolLoading[i] = false;
+                adoptPool((charon::enums::ELanguage)i, charon::g_loader->wait(mPoolLoads[i]));
+            }
+        }
+
+        if (mRequested != charon::enums::LanguageInvalid)
+        {
+            if (isResident(mRequested))
+            {
+                switchLanguage(mRequested);
+                mRequested = charon::enums::LanguageInvalid;
+            }
+            else if (mLanguageStrTables[mRequested] == nullptr && !mPrefetching[mRequested])
+            {
+                mRequested = charon::enums::LanguageInvalid;  // The load failed
+            }
+        }
+        evict();
+    }
+
+    void localization_t::setBudget(u64 bytes)
+    {
+        mBudget = bytes;
+        evict();
+    }
+
+    void localization_t::loadLanguage(charon::enums::ELanguage language)
     {
-        // For every language that was loaded, unload it
         charon::array_t<charon::datafile_t<charon::strtable_t>> const& languages = mLanguages->getLanguageArray();
+        adoptLanguage(language, languages[language].load(), true);
+    }
+
+    // A failed load or an unknown format leaves the language unloaded. The pool of a strlang_t is loaded right
+    // away when another language already has it or when the caller blocks anyway, otherwise update() adopts it.
+    void localization_t::adoptLanguage(charon::enums::ELanguage language, void* data, bool block)
+    {
+        s32 const i = language;
+        if (data == nullptr)
+            return;
+        mLanguageStrTables[i] = (charon::strtable_t*)data;
+        if (mLanguageStrTables[i]->isValid())
+        {
+            mBytes[i]        = mLanguageStrTables[i]->bytes();
+            mTexts[i].mTable = mLanguageStrTables[i];
+            mResidentBytes += mBytes[i];
+            return;
+        }
+
+        charon::strlang_t const* strings = (charon::strlang_t const*)data;
+        if (!strings->isValid())
+        {
+            mLanguages->getLanguageArray()[i].unload(mLanguageStrTables[i]);
+            mLanguageStrTables[i] = nullptr;
+            return;
+        }
+        mBytes[i] = strings->bytes();
+        mResidentBytes += mBytes[i];
+        if (block || sharesPool(language))
+        {
+            adoptPool(language, strings->pool().load());
+        }
+        else
+        {
+            mPoolLoads[i]   = strings->pool().load_async(mRequested == language ? charon::PriorityHigh : charon::PriorityNormal);
+            mPoolLoading[i] = true;
+        }
+    }
+
+    // Without its pool the language is of no use
+    void localization_t::adoptPool(charon::enums::ELanguage language, void* data)
+    {
+        s32 const i = language;
+        if (data == nullptr)
+        {
+            unloadLanguage(language);
+            return;
+        }
+        mPools[i] = (charon::strpool_t*)data;
+        if (!sharesPool(language))
+            mResidentBytes += mPools[i]->bytes();
+        mTexts[i].mStrings = (charon::strlang_t const*)mLanguageStrTables[i];
+        mTexts[i].mPool    = mPools[i];
+    }
+
+    bool localization_t::sharesPool(charon::enums::ELanguage language) const
+    {
+        charon::fileid_t const pool = ((charon::strlang_t const*)mLanguageStrTables[language])->pool().m_fileid;
+        for (s32 j = 0; j < charon::enums::LanguageCount; ++j)
+        {
+            if (j != language && mPools[j] != nullptr)
+            {
+                charon::fileid_t const other = ((charon::strlang_t const*)mLanguageStrTables[j])->pool().m_fileid;
+                if (other.getArchiveIndex() == pool.getArchiveIndex() && other.getFileIndex() == pool.getFileIndex())
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    // The language is completely loaded before it is published, a thread that reads mCurrent sees all of it
+    void localization_t::switchLanguage(charon::enums::ELanguage language)
+    {
+        s32 const previous = charon::nplatform::atomic_load(&mCurrentLanguage);
+        if (previous != charon::enums::LanguageInvalid && previous != language)
+            mRetired[previous] = mUpdates;
+        mLastUsed[language] = mUpdates;
+        charon::nplatform::atomic_store(&mCurrent, (void*)&mTexts[language]);
+        charon::nplatform::atomic_store(&mCurrentLanguage, (s32)language);
+    }
+
+    void localization_t::unloadLanguage(charon::enums::ELanguage language)
+    {
+        s32 const i = language;
+        if (!mLanguageStrTables[i]->isValid())
+        {
+            charon::strlang_t const* strings = (charon::strlang_t const*)mLanguageStrTables[i];
+            if (mPoolLoading[i])
+            {
+                mPoolLoading[i] = false;
+                if (!charon::g_loader->cancel(mPoolLoads[i]))
+                    mPools[i] = (charon::strpool_t*)charon::g_loader->wait(mPoolLoads[i]);
+                else
+                    mPools[i] = nullptr;
+            }
+            else if (mPools[i] != nullptr && !sharesPool(language))
+            {
+                mResidentBytes -= mPools[i]->bytes();
+                mCache.forget(mPools[i]);
+            }
+            if (mPools[i] != nullptr)
+                strings->pool().unload(mPools[i]);
+            mPools[i] = nullptr;
+        }
+
+        mLanguages->getLanguageArray()[i].unload(mLanguageStrTables[i]);
+        mLanguageStrTables[i] = nullptr;
+        mTexts[i].mTable      = nullptr;
+        mTexts[i].mStrings    = nullptr;
+        mTexts[i].mPool       = nullptr;
+        mResidentBytes -= mBytes[i];
+        mBytes[i] = 0;
+    }
+
+    // Least recently used first, a language that was current lately may still be read by another thread
+    void localization_t::evict()
+    {
+        s32 const current = charon::nplatform::atomic_load(&mCurrentLanguage);
+        while (mBudget > 0 && mResidentBytes > mBudget)
+        {
+            s32 victim = -1;
+            for (s32 i = 0; i < charon::enums::LanguageCount; ++i)
+            {
+                if (mLanguageStrTables[i] == nullptr || i == current || i == mRequested || (mUpdates - mRetired[i]) < s_grace_updates)
+                    continue;
+                if (victim < 0 || mLastUsed[i] < mLastUsed[victim])
+                    victim = i;
+            }
+            if (victim < 0)
+                break;
+            unloadLanguage((charon::enums::ELanguage)victim);
+        }
+    }
+
+    void localization_t::unloadLanguages(charon::archive_t* ar)
+    {
+        // For every language that was loaded or is being loaded, unload it
+        charon::nplatform::atomic_store(&mCurrent, (void*)nullptr);
+        charon::nplatform::atomic_store(&mCurrentLanguage, (s32)charon::enums::LanguageInvalid);
+        mRequested = charon::enums::LanguageInvalid;
         for (s32 i = 0; i < charon::enums::LanguageCount; ++i)
         {
+            if (mPrefetching[i])
+            {
+                mPrefetching[i] = false;
+                if (!charon::g_loader->cancel(mPrefetches[i]))
+                    adoptLanguage((charon::enums::ELanguage)i, charon::g_loader->wait(mPrefetches[i]), false);
+            }
             if (mLanguageStrTables[i] != nullptr)
             {
-                languages[i].unload(mLanguageStrTables[i]);
+                unloadLanguage((charon::enums::ELanguage)i);
             }
         }
     }
 
     charon::string_t localization_t::getText(charon::locstr_t lstr) const
     {
-        if (lstr.id == charon::INVALID_LOCSTR.id)
+        text_t const* language = (text_t const*)charon::nplatform::atomic_load(&mCurrent);
+        if (lstr.id == charon::INVALID_LOCSTR.id || language == nullptr)
             return charon::string_t();
+        if (language->mTable != nullptr)
+            return language->mTable->str(lstr);
+        if (lstr.id < 0 || lstr.id >= language->mStrings->size())
+            return charon::string_t();
+        return mCache.str(language->mPool, language->mStrings->id((u32)lstr.id));
+    }
 
-        charon::strtable_t const* language = mLanguageStrTables[mCurrentLanguage];
-        return language->str(lstr);
+    charon::string_t localization_t::getText(u32 hash) const
+    {
+        text_t const* language = (text_t const*)charon::nplatform::atomic_load(&mCurrent);
+        if (language == nullptr)
+            return charon::string_t();
+        if (language->mTable != nullptr)
+        {
+            s32 const index = language->mTable->find(hash);
+            return index >= 0 ? language->mTable->str((u32)index) : charon::string_t();
+        }
+        s32 const index = language->mStrings->find(hash);
+        return index >= 0 ? mCache.str(language->mPool, language->mStrings->id((u32)index)) : charon::string_t();
     }
 
 }  // namespace ncore
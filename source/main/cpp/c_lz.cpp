@@ -0,0 +1,263 @@
+#include "ccore/c_target.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_lz.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nlz
+        {
+            // Sequence:
+            //   u8:     Token, high nibble literal length, low nibble match length - 4 (15 means more length bytes follow)
+            //   u8[]:   Literal length continuation (each 255 means another byte follows)
+            //   byte[]: Literals
+            //   u16:    Match offset (little endian, 1 to 65535), absent for the last sequence of a block
+            //   u8[]:   Match length continuation
+            //
+            // The last 5 bytes of a block are always literals.
+
+            static const u32 c_min_match  = 4;
+            static const u32 c_last_lits  = 5;
+            static const u32 c_mf_limit   = 12;
+            static const u32 c_max_offset = 65535;
+            static const u32 c_hash_log   = 12;
+            static const u32 c_hash_size  = 1 << c_hash_log;
+
+            static inline u32 s_read32(byte const* p)
+            {
+                u32 v;
+                nmem::memcpy(&v, p, sizeof(v));
+                return v;
+            }
+
+            static inline u32 s_hash(u32 sequence) { return (sequence * 2654435761U) >> (32 - c_hash_log); }
+
+            static inline byte* s_write_length(byte* op, u32 length)
+            {
+                while (length >= 255)
+                {
+                    *op++ = 255;
+                    length -= 255;
+                }
+                *op++ = (byte)length;
+                return op;
+            }
+
+            u32 compress_bound(u32 srcSize) { return srcSize + (srcSize / 255) + 16; }
+
+            s32 compress_block(byte const* src, u32 srcSize, byte* dst, u32 dstCapacity)
+            {
+                if (dstCapacity < compress_bound(srcSize))
+                    return -1;
+
+                u32 table[c_hash_size];
+                nmem::memset(table, 0, sizeof(table));
+
+                byte*     op     = dst;
+                u32       ip     = 0;
+                u32       anchor = 0;
+                u32 const limit  = srcSize > c_mf_limit ? srcSize - c_mf_limit : 0;
+
+                while (ip < limit)
+                {
+                    u32 const sequence = s_read32(src + ip);
+                    u32 const h        = s_hash(sequence);
+                    u32 const ref      = table[h];
+                    table[h]           = ip;
+
+                    if (ref >= ip || (ip - ref) > c_max_offset || s_read32(src + ref) != sequence)
+                    {
+                        // Step faster through data that does not compress
+                        ip += 1 + ((ip - anchor) >> 6);
+                        continue;
+                    }
+
+                    u32 matchLength = c_min_match;
+                    while ((ip + matchLength) < (srcSize - c_last_lits) && src[ref + matchLength] == src[ip + matchLength])
+                        matchLength += 1;
+
+                    u32 const literalLength = ip - anchor;
+                    byte*     token         = op++;
+                    *token                  = (byte)(((literalLength >= 15 ? 15 : literalLength) << 4) | ((matchLength - c_min_match) >= 15 ? 15 : (matchLength - c_min_match)));
+                    if (literalLength >= 15)
+                        op = s_write_length(op, literalLength - 15);
+                    nmem::memcpy(op, src + anchor, literalLength);
+                    op += literalLength;
+
+                    u32 const offset = ip - ref;
+                    *op++            = (byte)(offset & 0xFF);
+                    *op++            = (byte)(offset >> 8);
+                    if ((matchLength - c_min_match) >= 15)
+                        op = s_write_length(op, matchLength - c_min_match - 15);
+
+                    ip += matchLength;
+                    anchor = ip;
+                }
+
+                // Last literals
+                u32 const literalLength = srcSize - anchor;
+                *op++                   = (byte)((literalLength >= 15 ? 15 : literalLength) << 4);
+                if (literalLength >= 15)
+                    op = s_write_length(op, literalLength - 15);
+                nmem::memcpy(op, src + anchor, literalLength);
+                op += literalLength;
+
+                return (s32)(op - dst);
+            }
+
+            s32 decompress_block(byte const* src, u32 srcSize, byte* dst, u32 dstSize)
+            {
+                byte const*       ip   = src;
+                byte const* const iend = src + srcSize;
+                byte*             op   = dst;
+                byte* const       oend = dst + dstSize;
+
+                while (ip < iend)
+                {
+                    u32 const token = *ip++;
+
+                    u32 literalLength = token >> 4;
+                    if (literalLength == 15)
+                    {
+                        u32 b;
+                        do
+                        {
+                            if (ip >= iend)
+                                return -1;
+                            b = *ip++;
+                            literalLength += b;
+                        } while (b == 255);
+                    }
+
+                    if (literalLength > (u32)(iend - ip) || literalLength > (u32)(oend - op))
+                        return -1;
+                    nmem::memcpy(op, ip, literalLength);
+                    ip += literalLength;
+                    op += literalLength;
+
+                    if (ip == iend)
+                        break;  // The last sequence has no match
+
+                    if ((iend - ip) < 2)
+                        return -1;
+                    u32 const offset = (u32)ip[0] | ((u32)ip[1] << 8);
+                    ip += 2;
+                    if (offset == 0 || offset > (u32)(op - dst))
+                        return -1;
+
+                    u32 matchLength = (token & 15);
+                    if (matchLength == 15)
+                    {
+                        u32 b;
+                        do
+                        {
+                            if (ip >= iend)
+                                return -1;
+                            b = *ip++;
+                            matchLength += b;
+                        } while (b == 255);
+                    }
+                    matchLength += c_min_match;
+                    if (matchLength > (u32)(oend - op))
+                        return -1;
+
+                    byte const* match = op - offset;
+                    if (offset >= 8)
+                    {
+                        // Non-overlapping in steps of 8 bytes
+                        byte* const mend = op + matchLength;
+                        while ((op + 8) <= mend)
+                        {
+                            nmem::memcpy(op, match, 8);
+                            op += 8;
+                            match += 8;
+                        }
+                        while (op < mend)
+                            *op++ = *match++;
+                    }
+                    else
+                    {
+                        for (u32 i = 0; i < matchLength; ++i)
+                            *op++ = *match++;
+                    }
+                }
+
+                return (s32)(op - dst);
+            }
+
+            u32 compress_file_bound(u32 srcSize, u32 blockSize)
+            {
+                u32 const numBlocks = (srcSize + blockSize - 1) / blockSize;
+                return sizeof(header_t) + numBlocks * sizeof(u32) + numBlocks * compress_bound(blockSize);
+            }
+
+            s32 compress_file(byte const* src, u32 srcSize, byte* dst, u32 dstCapacity, u32 blockSize)
+            {
+                if (blockSize == 0 || dstCapacity < compress_file_bound(srcSize, blockSize))
+                    return -1;
+
+                header_t* header          = (header_t*)dst;
+                header->mMagic            = c_magic;
+                header->mUncompressedSize = srcSize;
+                header->mBlockSize        = blockSize;
+                header->mNumBlocks        = (srcSize + blockSize - 1) / blockSize;
+
+                u32*  blockSizes = (u32*)(header + 1);
+                byte* op         = dst + header->headerSize();
+                for (u32 b = 0; b < header->mNumBlocks; ++b)
+                {
+                    u32 const   size  = header->blockUncompressedSize(b);
+                    byte const* block = src + b * blockSize;
+                    s32 const   n     = compress_block(block, size, op, (u32)((dst + dstCapacity) - op));
+                    if (n < 0 || (u32)n >= size)
+                    {
+                        // Incompressible, store it
+                        nmem::memcpy(op, block, size);
+                        blockSizes[b] = size | c_block_stored_bit;
+                        op += size;
+                    }
+                    else
+                    {
+                        blockSizes[b] = (u32)n;
+                        op += n;
+                    }
+                }
+                return (s32)(op - dst);
+            }
+
+            s32 decompress_file(byte const* src, u32 srcSize, byte* dst, u32 dstSize)
+            {
+                header_t const* header = (header_t const*)src;
+                if (srcSize < sizeof(header_t) || !header->isValid() || srcSize < header->headerSize() || dstSize < header->mUncompressedSize)
+                    return -1;
+
+                byte const* ip   = src + header->headerSize();
+                byte const* iend = src + srcSize;
+                for (u32 b = 0; b < header->mNumBlocks; ++b)
+                {
+                    u32 const size       = header->blockCompressedSize(b);
+                    u32 const outputSize = header->blockUncompressedSize(b);
+                    if (size > (u32)(iend - ip))
+                        return -1;
+
+                    byte* out = dst + b * header->mBlockSize;
+                    if (header->blockIsStored(b))
+                    {
+                        if (size != outputSize)
+                            return -1;
+                        nmem::memcpy(out, ip, size);
+                    }
+                    else if (decompress_block(ip, size, out, outputSize) != (s32)outputSize)
+                    {
+                        return -1;
+                    }
+                    ip += size;
+                }
+                return (s32)header->mUncompressedSize;
+            }
+
+        }  // namespace nlz
+    }  // namespace charon
+}  // namespace ncore
@@ -0,0 +1,524 @@
+#include "ccore/c_target.h"
+
+#if defined(TARGET_PC)
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#elif defined(TARGET_MAC) || defined(TARGET_LINUX)
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <pthread.h>
+#    include <sched.h>
+#    include <stdlib.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <time.h>
+#    include <unistd.h>
+#else
+#    include <time.h>
+#    include "cfile/c_file.h"
+#endif
+
+#include "charon/c_platform.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nplatform
+        {
+#if defined(TARGET_PC)
+
+            bool filemap_open(const char* filename, filemap_t& map)
+            {
+                HANDLE file = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, nullptr);
+                if (file == INVALID_HANDLE_VALUE)
+                    return false;
+
+                LARGE_INTEGER size;
+                if (!::GetFileSizeEx(file, &size) || size.QuadPart == 0)
+                {
+                    ::CloseHandle(file);
+                    return false;
+                }
+
+                HANDLE mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping == nullptr)
+                {
+                    ::CloseHandle(file);
+                    return false;
+                }
+
+                void* data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                if (data == nullptr)
+                {
+                    ::CloseHandle(mapping);
+                    ::CloseHandle(file);
+                    return false;
+                }
+
+                map.mFile    = file;
+                map.mMapping = mapping;
+                map.mData    = (byte*)data;
+                map.mSize    = (u64)size.QuadPart;
+                return true;
+            }
+
+            void filemap_close(filemap_t& map)
+            {
+                if (map.mData != nullptr)
+                    ::UnmapViewOfFile(map.mData);
+                if (map.mMapping != nullptr)
+                    ::CloseHandle((HANDLE)map.mMapping);
+                if (map.mFile != nullptr)
+                    ::CloseHandle((HANDLE)map.mFile);
+                map = filemap_t();
+            }
+
+            void filemap_willneed(filemap_t const& map, u64 offset, u64 size)
+            {
+                if (!map.isValid() || offset >= map.mSize)
+                    return;
+                if (size > (map.mSize - offset))
+                    size = map.mSize - offset;
+
+                WIN32_MEMORY_RANGE_ENTRY range;
+                range.VirtualAddress = map.mData + offset;
+                range.NumberOfBytes  = (SIZE_T)size;
+                ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+            }
+
+            bool fileio_open(const char* filename, fileio_t& file)
+            {
+                HANDLE handle = ::CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (handle == INVALID_HANDLE_VALUE)
+                    return false;
+
+                LARGE_INTEGER size;
+                if (!::GetFileSizeEx(handle, &size))
+                {
+                    ::CloseHandle(handle);
+                    return false;
+                }
+
+                file.mHandle = handle;
+                file.mSize   = (u64)size.QuadPart;
+                return true;
+            }
+
+            void fileio_close(fileio_t& file)
+            {
+                if (file.mHandle != nullptr)
+                    ::CloseHandle((HANDLE)file.mHandle);
+                file = fileio_t();
+            }
+
+            u64 file_stamp(const char* filename)
+            {
+                // No access rights needed for the attributes, a file that is open elsewhere can still be asked
+                HANDLE handle = ::CreateFileA(filename, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                if (handle == INVALID_HANDLE_VALUE)
+                    return 0;
+                BY_HANDLE_FILE_INFORMATION info;
+                BOOL const                 ok = ::GetFileInformationByHandle(handle, &info);
+                ::CloseHandle(handle);
+                if (!ok)
+                    return 0;
+                u64 const time     = ((u64)info.ftLastWriteTime.dwHighDateTime << 32) | (u64)info.ftLastWriteTime.dwLowDateTime;
+                u64 const size     = ((u64)info.nFileSizeHigh << 32) | (u64)info.nFileSizeLow;
+                u64 const identity = (((u64)info.nFileIndexHigh << 32) | (u64)info.nFileIndexLow) ^ ((u64)info.dwVolumeSerialNumber << 48);
+                return ((time * 0x9E3779B97F4A7C15ull) ^ size ^ (identity * 0xC2B2AE3D27D4EB4Full)) | 1;
+            }
+
+            s64 fileio_pread(fileio_t const& file, u64 offset, void* destination, u64 size)
+            {
+                // An OVERLAPPED with an offset on a synchronous handle is a positional read
+                u64 total = 0;
+                while (total < size)
+                {
+                    u64 const   remaining = size - total;
+                    DWORD const request  = remaining > 0x40000000 ? 0x40000000 : (DWORD)remaining;
+
+                    OVERLAPPED ov;
+                    ::ZeroMemory(&ov, sizeof(ov));
+                    ov.Offset     = (DWORD)((offset + total) & 0xFFFFFFFF);
+                    ov.OffsetHigh = (DWORD)((offset + total) >> 32);
+
+                    DWORD read = 0;
+                    if (!::ReadFile((HANDLE)file.mHandle, (byte*)destination + total, request, &read, &ov))
+                        return total > 0 ? (s64)total : -1;
+                    if (read == 0)
+                        break;
+                    total += read;
+                }
+                return (s64)total;
+            }
+
+            struct thread_start_t
+            {
+                thread_fn mFunc;
+                void*     mArg;
+            };
+
+            static DWORD WINAPI s_thread_main(LPVOID param)
+            {
+                thread_start_t start = *(thread_start_t*)param;
+                ::HeapFree(::GetProcessHeap(), 0, param);
+                start.mFunc(start.mArg);
+                return 0;
+            }
+
+            bool thread_create(thread_t& thread, thread_fn func, void* arg)
+            {
+                thread_start_t* start = (thread_start_t*)::HeapAlloc(::GetProcessHeap(), 0, sizeof(thread_start_t));
+                start->mFunc          = func;
+                start->mArg           = arg;
+                HANDLE handle         = ::CreateThread(nullptr, 0, s_thread_main, start, 0, nullptr);
+                if (handle == nullptr)
+                {
+                    ::HeapFree(::GetProcessHeap(), 0, start);
+                    return false;
+                }
+                thread.mHandle = handle;
+                return true;
+            }
+
+            void thread_join(thread_t& thread)
+            {
+                if (thread.mHandle != nullptr)
+                {
+                    ::WaitForSingleObject((HANDLE)thread.mHandle, INFINITE);
+                    ::CloseHandle((HANDLE)thread.mHandle);
+                    thread.mHandle = nullptr;
+                }
+            }
+
+            void thread_yield() { ::SwitchToThread(); }
+
+            s32 thread_hardware_concurrency()
+            {
+                SYSTEM_INFO info;
+                ::GetSystemInfo(&info);
+                return (s32)info.dwNumberOfProcessors;
+            }
+
+            u64 clock_ns()
+            {
+                static LARGE_INTEGER s_frequency = {};
+                if (s_frequency.QuadPart == 0)
+                    ::QueryPerformanceFrequency(&s_frequency);
+                LARGE_INTEGER counter;
+                ::QueryPerformanceCounter(&counter);
+                u64 const seconds = (u64)counter.QuadPart / (u64)s_frequency.QuadPart;
+                u64 const rest    = (u64)counter.QuadPart % (u64)s_frequency.QuadPart;
+                return seconds * 1000000000ull + (rest * 1000000000ull) / (u64)s_frequency.QuadPart;
+            }
+
+            static_assert(sizeof(SRWLOCK) <= sizeof(mutex_t), "mutex_t storage is too small");
+            static_assert(sizeof(CONDITION_VARIABLE) <= sizeof(cond_t), "cond_t storage is too small");
+
+            void mutex_init(mutex_t& mutex) { ::InitializeSRWLock((SRWLOCK*)mutex.mStorage); }
+            void mutex_destroy(mutex_t& mutex) {}
+            void mutex_lock(mutex_t& mutex) { ::AcquireSRWLockExclusive((SRWLOCK*)mutex.mStorage); }
+            void mutex_unlock(mutex_t& mutex) { ::ReleaseSRWLockExclusive((SRWLOCK*)mutex.mStorage); }
+
+            void cond_init(cond_t& cond) { ::InitializeConditionVariable((CONDITION_VARIABLE*)cond.mStorage); }
+            void cond_destroy(cond_t& cond) {}
+            void cond_wait(cond_t& cond, mutex_t& mutex) { ::SleepConditionVariableSRW((CONDITION_VARIABLE*)cond.mStorage, (SRWLOCK*)mutex.mStorage, INFINITE, 0); }
+            void cond_signal(cond_t& cond) { ::WakeConditionVariable((CONDITION_VARIABLE*)cond.mStorage); }
+            void cond_broadcast(cond_t& cond) { ::WakeAllConditionVariable((CONDITION_VARIABLE*)cond.mStorage); }
+
+#elif defined(TARGET_MAC) || defined(TARGET_LINUX)
+
+            bool filemap_open(const char* filename, filemap_t& map)
+            {
+                int const fd = ::open(filename, O_RDONLY);
+                if (fd < 0)
+                    return false;
+
+                struct stat st;
+                if (::fstat(fd, &st) != 0 || st.st_size == 0)
+                {
+                    ::close(fd);
+                    return false;
+                }
+
+                void* data = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+                ::close(fd);  // The mapping keeps its own reference to the file
+                if (data == MAP_FAILED)
+                    return false;
+
+                ::madvise(data, (size_t)st.st_size, MADV_RANDOM);
+
+                map.mFile    = nullptr;
+                map.mMapping = nullptr;
+                map.mData    = (byte*)data;
+                map.mSize    = (u64)st.st_size;
+                return true;
+            }
+
+            void filemap_close(filemap_t& map)
+            {
+                if (map.mData != nullptr)
+                    ::munmap(map.mData, (size_t)map.mSize);
+                map = filemap_t();
+            }
+
+            void filemap_willneed(filemap_t const& map, u64 offset, u64 size)
+            {
+                if (!map.isValid() || offset >= map.mSize)
+                    return;
+                if (size > (map.mSize - offset))
+                    size = map.mSize - offset;
+
+                // madvise wants a page aligned address
+                uptr_t const page  = (uptr_t)::sysconf(_SC_PAGESIZE);
+                uptr_t const begin = ((uptr_t)map.mData + offset) & ~(page - 1);
+                uptr_t const end   = (uptr_t)map.mData + offset + size;
+                ::madvise((void*)begin, (size_t)(end - begin), MADV_WILLNEED);
+            }
+
+            bool fileio_open(const char* filename, fileio_t& file)
+            {
+                int const fd = ::open(filename, O_RDONLY);
+                if (fd < 0)
+                    return false;
+
+                struct stat st;
+                if (::fstat(fd, &st) != 0)
+                {
+                    ::close(fd);
+                    return false;
+                }
+
+                // Store fd + 1 so that a valid descriptor of 0 is not mistaken for 'no handle'
+                file.mHandle = (void*)(uptr_t)(fd + 1);
+                file.mSize   = (u64)st.st_size;
+                return true;
+            }
+
+            void fileio_close(fileio_t& file)
+            {
+                if (file.mHandle != nullptr)
+                    ::close((int)((uptr_t)file.mHandle - 1));
+                file = fileio_t();
+            }
+
+            u64 file_stamp(const char* filename)
+            {
+                struct stat st;
+                if (::stat(filename, &st) != 0)
+                    return 0;
+#    if defined(TARGET_MAC)
+                u64 const time = (u64)st.st_mtimespec.tv_sec * 1000000000ull + (u64)st.st_mtimespec.tv_nsec;
+#    else
+                u64 const time = (u64)st.st_mtim.tv_sec * 1000000000ull + (u64)st.st_mtim.tv_nsec;
+#    endif
+                u64 const identity = (u64)st.st_ino ^ ((u64)st.st_dev << 48);
+                return ((time * 0x9E3779B97F4A7C15ull) ^ (u64)st.st_size ^ (identity * 0xC2B2AE3D27D4EB4Full)) | 1;
+            }
+
+            s64 fileio_pread(fileio_t const& file, u64 offset, void* destination, u64 size)
+            {
+                int const fd    = (int)((uptr_t)file.mHandle - 1);
+                u64       total = 0;
+                while (total < size)
+                {
+                    ssize_t const read = ::pread(fd, (byte*)destination + total, (size_t)(size - total), (off_t)(offset + total));
+                    if (read < 0)
+                    {
+                        if (errno == EINTR)
+                            continue;
+                        return total > 0 ? (s64)total : -1;
+                    }
+                    if (read == 0)
+                        break;
+                    total += (u64)read;
+                }
+                return (s64)total;
+            }
+
+            struct thread_start_t
+            {
+                thread_fn mFunc;
+                void*     mArg;
+            };
+
+            static void* s_thread_main(void* param)
+            {
+                thread_start_t start = *(thread_start_t*)param;
+                ::free(param);
+                start.mFunc(start.mArg);
+                return nullptr;
+            }
+
+            bool thread_create(thread_t& thread, thread_fn func, void* arg)
+            {
+                thread_start_t* start = (thread_start_t*)::malloc(sizeof(thread_start_t));
+                start->mFunc          = func;
+                start->mArg           = arg;
+
+                pthread_t handle;
+                if (::pthread_create(&handle, nullptr, s_thread_main, start) != 0)
+                {
+                    ::free(start);
+                    return false;
+                }
+                thread.mHandle = (void*)handle;
+                return true;
+            }
+
+            void thread_join(thread_t& thread)
+            {
+                if (thread.mHandle != nullptr)
+                {
+                    ::pthread_join((pthread_t)thread.mHandle, nullptr);
+                    thread.mHandle = nullptr;
+                }
+            }
+
+            void thread_yield() { ::sched_yield(); }
+
+            s32 thread_hardware_concurrency()
+            {
+                long const n = ::sysconf(_SC_NPROCESSORS_ONLN);
+                return n > 0 ? (s32)n : 1;
+            }
+
+            u64 clock_ns()
+            {
+                struct timespec ts;
+                ::clock_gettime(CLOCK_MONOTONIC, &ts);
+                return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+            }
+
+            static_assert(sizeof(pthread_mutex_t) <= sizeof(mutex_t), "mutex_t storage is too small");
+            static_assert(sizeof(pthread_cond_t) <= sizeof(cond_t), "cond_t storage is too small");
+
+            void mutex_init(mutex_t& mutex) { ::pthread_mutex_init((pthread_mutex_t*)mutex.mStorage, nullptr); }
+            void mutex_destroy(mutex_t& mutex) { ::pthread_mutex_destroy((pthread_mutex_t*)mutex.mStorage); }
+            void mutex_lock(mutex_t& mutex) { ::pthread_mutex_lock((pthread_mutex_t*)mutex.mStorage); }
+            void mutex_unlock(mutex_t& mutex) { ::pthread_mutex_unlock((pthread_mutex_t*)mutex.mStorage); }
+
+            void cond_init(cond_t& cond) { ::pthread_cond_init((pthread_cond_t*)cond.mStorage, nullptr); }
+            void cond_destroy(cond_t& cond) { ::pthread_cond_destroy((pthread_cond_t*)cond.mStorage); }
+            void cond_wait(cond_t& cond, mutex_t& mutex) { ::pthread_cond_wait((pthread_cond_t*)cond.mStorage, (pthread_mutex_t*)mutex.mStorage); }
+            void cond_signal(cond_t& cond) { ::pthread_cond_signal((pthread_cond_t*)cond.mStorage); }
+            void cond_broadcast(cond_t& cond) { ::pthread_cond_broadcast((pthread_cond_t*)cond.mStorage); }
+
+#else
+
+            // No memory mapping on this platform, the archive falls back to reading
+            bool filemap_open(const char* filename, filemap_t& map) { return false; }
+            void filemap_close(filemap_t& map) { map = filemap_t(); }
+            void filemap_willneed(filemap_t const& map, u64 offset, u64 size) {}
+
+            // Threads can not be created here but the loader still has to be safe for concurrent callers, the
+            // locks spin on an atomic and a condition wait is a spurious wakeup (every caller waits in a loop)
+            static inline s32 volatile* s_lock_word(mutex_t& mutex) { return (s32 volatile*)mutex.mStorage; }
+            static inline void          s_spin_lock(s32 volatile* lock)
+            {
+                while (!atomic_cas(lock, 0, 1))
+                {
+                }
+            }
+            static inline void s_spin_unlock(s32 volatile* lock) { atomic_store(lock, 0); }
+
+            // Positional reads through nfile, which has a file position, so every read seeks under the lock of
+            // its file. The files live in a fixed table since there is no allocator at this level, an archive
+            // only keeps its GDA open.
+            struct fallbackfile_t
+            {
+                nfile::file_handle_t mFile;
+                s32 volatile         mLock;
+                s32 volatile         mUsed;
+            };
+
+            static const s32      c_max_files = 64;
+            static fallbackfile_t s_files[c_max_files];
+
+            bool fileio_open(const char* filename, fileio_t& file)
+            {
+                file = fileio_t();
+                for (s32 i = 0; i < c_max_files; ++i)
+                {
+                    fallbackfile_t& slot = s_files[i];
+                    if (!atomic_cas(&slot.mUsed, 0, 1))
+                        continue;
+
+                    slot.mFile = nfile::file_open(filename, nfile::file_mode_t::FILE_MODE_READ);
+                    if (!slot.mFile.isValid())
+                    {
+                        atomic_store(&slot.mUsed, 0);
+                        return false;
+                    }
+                    s64 const size = nfile::file_size(slot.mFile);
+                    slot.mLock     = 0;
+                    file.mHandle   = &slot;
+                    file.mSize     = size > 0 ? (u64)size : 0;
+                    return true;
+                }
+                return false;
+            }
+
+            void fileio_close(fileio_t& file)
+            {
+                if (file.mHandle != nullptr)
+                {
+                    fallbackfile_t* slot = (fallbackfile_t*)file.mHandle;
+                    nfile::file_close(slot->mFile);
+                    atomic_store(&slot->mUsed, 0);
+                }
+                file = fileio_t();
+            }
+
+            s64 fileio_pread(fileio_t const& file, u64 offset, void* destination, u64 size)
+            {
+                fallbackfile_t* slot = (fallbackfile_t*)file.mHandle;
+                if (slot == nullptr)
+                    return -1;
+
+                s_spin_lock(&slot->mLock);
+                s64 total = -1;
+                if (nfile::file_seek(slot->mFile, (s64)offset, nfile::seek_mode_t::SEEK_MODE_BEG) >= 0)
+                {
+                    total = 0;
+                    while ((u64)total < size)
+                    {
+                        u64 const chunk = (size - (u64)total) > 0x40000000 ? 0x40000000 : (size - (u64)total);
+                        s64 const n     = nfile::file_read(slot->mFile, (u8*)destination + total, (u32)chunk);
+                        if (n <= 0)
+                            break;
+                        total += n;
+                    }
+                }
+                s_spin_unlock(&slot->mLock);
+                return total;
+            }
+
+            u64 file_stamp(const char* filename) { return 0; }  // Hot reload sees no changes here
+
+            // Single threaded platform, thread creation fails and the archive runs async work inline
+            bool thread_create(thread_t& thread, thread_fn func, void* arg) { return false; }
+            void thread_join(thread_t& thread) {}
+            void thread_yield() {}
+            s32  thread_hardware_concurrency() { return 1; }
+            u64  clock_ns() { return (u64)::clock() * (1000000000ull / CLOCKS_PER_SEC); }  // Processor time, the only clock standard C has
+            void mutex_init(mutex_t& mutex) { *s_lock_word(mutex) = 0; }
+            void mutex_destroy(mutex_t& mutex) {}
+            void mutex_lock(mutex_t& mutex) { s_spin_lock(s_lock_word(mutex)); }
+            void mutex_unlock(mutex_t& mutex) { s_spin_unlock(s_lock_word(mutex)); }
+            void cond_init(cond_t& cond) {}
+            void cond_destroy(cond_t& cond) {}
+            void cond_wait(cond_t& cond, mutex_t& mutex)
+            {
+                mutex_unlock(mutex);
+                mutex_lock(mutex);
+            }
+            void cond_signal(cond_t& cond) {}
+            void cond_broadcast(cond_t& cond) {}
+
+#endif
+
+        }  // namespace nplatform
+    }  // namespace charon
+}  // namespace ncore
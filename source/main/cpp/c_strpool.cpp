@@ -0,0 +1,430 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_memory.h"
+
+#include "charon/c_strpool.h"
+#include "charon/c_hash.h"
+#include "charon/c_lz.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        static const u32 s_max_block_size = 64 * 1024;  // The offset of a group in its block is 16 bits
+        static const u32 s_max_blocks     = 64 * 1024;  // And so is the block index
+
+        static inline u32 s_read_varint(byte const*& p)
+        {
+            u32 value = 0;
+            u32 shift = 0;
+            while ((*p & 0x80) != 0)
+            {
+                value |= (u32)(*p++ & 0x7F) << shift;
+                shift += 7;
+            }
+            return value | ((u32)(*p++) << shift);
+        }
+
+        static inline byte* s_write_varint(byte* p, u32 value)
+        {
+            while (value >= 0x80)
+            {
+                *p++ = (byte)(value | 0x80);
+                value >>= 7;
+            }
+            *p++ = (byte)value;
+            return p;
+        }
+
+        static inline u32 s_varint_size(u32 value)
+        {
+            u32 size = 1;
+            while (value >= 0x80)
+            {
+                value >>= 7;
+                size += 1;
+            }
+            return size;
+        }
+
+        static inline u32 s_zigzag(s32 value) { return ((u32)value << 1) ^ (u32)(value >> 31); }
+        static inline s32 s_unzigzag(u32 value) { return (s32)(value >> 1) ^ -(s32)(value & 1); }
+
+        // ------- strpool_t ---
+
+        string_t strpool_t::str(u32 id, byte const* blockData) const
+        {
+            u32 const   group = ((u32 const*)((byte const*)this + mGroupsOffset))[id / GroupSize];
+            byte const* p     = blockData + (group & 0xFFFF);
+            for (u32 skip = id % GroupSize; skip > 0; --skip)
+            {
+                u32 const byteLength = s_read_varint(p);
+                s_read_varint(p);
+                p += byteLength + 1;
+            }
+            u32 const byteLength = s_read_varint(p);
+            u32 const charLength = s_read_varint(p);
+            return string_t(byteLength, charLength, (const char*)p);
+        }
+
+        u32 strpool_t::bytes() const
+        {
+            u32 const numGroups = (mNumStrings + GroupSize - 1) / GroupSize;
+            u32       end       = mGroupsOffset + numGroups * 4;
+            end                 = (mBlocksOffset + mNumBlocks * (u32)sizeof(block_t)) > end ? (mBlocksOffset + mNumBlocks * (u32)sizeof(block_t)) : end;
+            for (u32 b = 0; b < mNumBlocks; ++b)
+            {
+                u32 const blockEnd = block(b).mOffset + (block(b).mSize & ~nlz::c_block_stored_bit);
+                end                = blockEnd > end ? blockEnd : end;
+            }
+            return end;
+        }
+
+        // ------- strlang_t ---
+
+        u32 strlang_t::id(u32 index) const
+        {
+            u32 const*  checkpoint = array(mCheckpointsOffset) + (index / strpool_t::GroupSize) * 2;
+            u32         id         = checkpoint[0];
+            byte const* p          = (byte const*)this + mIdsOffset + checkpoint[1];
+            for (u32 i = index % strpool_t::GroupSize; i != ~0u; --i)
+                id += (u32)s_unzigzag(s_read_varint(p));
+            return id;
+        }
+
+        u32 strlang_t::bytes() const { return mIdsOffset + mIdsSize; }
+
+        // ------- strcache_t ---
+
+        strcache_t::strcache_t()
+            : mAllocator(nullptr)
+            , mEntries(nullptr)
+            , mMaxBlocks(0)
+            , mGrace(0)
+            , mUpdates(0)
+            , mUses(0)
+            , mDecodes(0)
+            , mBytes(0)
+            , mEvicted(nullptr)
+        {
+        }
+
+        void strcache_t::setup(alloc_t* allocator, u32 maxBlocks, u64 grace)
+        {
+            mAllocator = allocator;
+            mMaxBlocks = maxBlocks > 0 ? maxBlocks : 1;
+            mEntries   = g_allocate_array_and_clear<entry_t>(allocator, mMaxBlocks);
+            mGrace     = grace;
+            nplatform::mutex_init(mMutex);
+        }
+
+        void strcache_t::teardown()
+        {
+            if (mEntries == nullptr)
+                return;
+            for (u32 i = 0; i < mMaxBlocks; ++i)
+            {
+                if (mEntries[i].mPool != nullptr)
+                    evict(mEntries[i]);
+            }
+            while (mEvicted != nullptr)
+            {
+                decoded_t* next = mEvicted->mNext;
+                mAllocator->deallocate(mEvicted);
+                mEvicted = next;
+            }
+            g_deallocate_array(mAllocator, mEntries);
+            mEntries = nullptr;
+            mBytes   = 0;
+            nplatform::mutex_destroy(mMutex);
+        }
+
+        // Stored blocks are used in-place, the lock is only taken for compressed ones. Decoding happens under the
+        // lock, two threads that miss on the same block decode it once.
+        string_t strcache_t::str(strpool_t const* pool, u32 id)
+        {
+            if (id >= pool->size())
+                return string_t();
+            u32 const b = pool->blockOf(id);
+            if (pool->isStored(b))
+                return pool->str(id, pool->stored(b));
+
+            nplatform::scoped_lock_t lock(mMutex);
+
+            entry_t* hit    = nullptr;
+            entry_t* victim = &mEntries[0];
+            for (u32 i = 0; i < mMaxBlocks && hit == nullptr; ++i)
+            {
+                entry_t& entry = mEntries[i];
+                if (entry.mPool == pool && entry.mBlock == b)
+                    hit = &entry;
+                else if (victim->mPool != nullptr && (entry.mPool == nullptr || entry.mLastUse < victim->mLastUse))
+                    victim = &entry;
+            }
+
+            if (hit == nullptr)
+            {
+                strpool_t::block_t const& block   = pool->block(b);
+                decoded_t*                decoded = (decoded_t*)mAllocator->allocate((u32)sizeof(decoded_t) + block.mUncompressedSize, sizeof(void*));
+                if (decoded == nullptr)
+                    return string_t();
+                if (nlz::decompress_block(pool->stored(b), block.mSize, (byte*)(decoded + 1), block.mUncompressedSize) != (s32)block.mUncompressedSize)
+                {
+                    mAllocator->deallocate(decoded);
+                    return string_t();
+                }
+                decoded->mNext = nullptr;
+                decoded->mSize = block.mUncompressedSize;
+
+                if (victim->mPool != nullptr)
+                    evict(*victim);
+                victim->mPool    = pool;
+                victim->mBlock   = b;
+                victim->mDecoded = decoded;
+                mDecodes += 1;
+                mBytes += decoded->mSize;
+                hit = victim;
+            }
+
+            hit->mLastUse = ++mUses;
+            return pool->str(id, (byte const*)(hit->mDecoded + 1));
+        }
+
+        // The list is newest first, once a block is old enough so are all that follow it
+        void strcache_t::update()
+        {
+            nplatform::scoped_lock_t lock(mMutex);
+            mUpdates += 1;
+
+            decoded_t** link = &mEvicted;
+            while (*link != nullptr && (mUpdates - (*link)->mEvicted) < mGrace)
+                link = &(*link)->mNext;
+            decoded_t* old = *link;
+            *link          = nullptr;
+            while (old != nullptr)
+            {
+                decoded_t* next = old->mNext;
+                mBytes -= old->mSize;
+                mAllocator->deallocate(old);
+                old = next;
+            }
+        }
+
+        void strcache_t::forget(strpool_t const* pool)
+        {
+            nplatform::scoped_lock_t lock(mMutex);
+            for (u32 i = 0; i < mMaxBlocks; ++i)
+            {
+                if (mEntries[i].mPool == pool)
+                    evict(mEntries[i]);
+            }
+        }
+
+        void strcache_t::evict(entry_t& entry)
+        {
+            entry.mDecoded->mEvicted = mUpdates;
+            entry.mDecoded->mNext    = mEvicted;
+            mEvicted                 = entry.mDecoded;
+            entry.mPool              = nullptr;
+            entry.mDecoded           = nullptr;
+        }
+
+        // ------- strpoolbuilder_t ---
+
+        strpoolbuilder_t::strpoolbuilder_t()
+            : mAllocator(nullptr)
+            , mStrings(nullptr)
+            , mByteLengths(nullptr)
+            , mCharLengths(nullptr)
+            , mNumStrings(0)
+            , mMaxStrings(0)
+        {
+        }
+
+        void strpoolbuilder_t::setup(alloc_t* allocator, u32 maxStrings)
+        {
+            mAllocator   = allocator;
+            mStrings     = g_allocate_array<char const*>(allocator, maxStrings);
+            mByteLengths = g_allocate_array<u32>(allocator, maxStrings);
+            mCharLengths = g_allocate_array<u32>(allocator, maxStrings);
+            mNumStrings  = 0;
+            mMaxStrings  = maxStrings;
+            mIndex.setup(allocator, maxStrings);
+        }
+
+        void strpoolbuilder_t::teardown()
+        {
+            mIndex.teardown(mAllocator);
+            g_deallocate_array(mAllocator, mStrings);
+            g_deallocate_array(mAllocator, mByteLengths);
+            g_deallocate_array(mAllocator, mCharLengths);
+            mStrings     = nullptr;
+            mByteLengths = nullptr;
+            mCharLengths = nullptr;
+            mNumStrings  = 0;
+            mMaxStrings  = 0;
+        }
+
+        // Two different strings with the same hash both get added, only the first one is in the index
+        u32 strpoolbuilder_t::add(char const* str, u32 byteLength, u32 charLength)
+        {
+            u64 const hash = nhash::hash64(str, byteLength);
+            u32       id;
+            if (mIndex.find(hash, id) && mByteLengths[id] == byteLength && nmem::memcmp(mStrings[id], str, byteLength) == 0)
+                return id;
+            if (mNumStrings == mMaxStrings)
+                return ~0u;
+
+            id               = mNumStrings++;
+            mStrings[id]     = str;
+            mByteLengths[id] = byteLength;
+            mCharLengths[id] = charLength;
+            mIndex.insert(hash, id);
+            return id;
+        }
+
+        // A group always starts in the block where the previous one ended unless that block has reached
+        // blockSize, so a group starts below blockSize and a block is only larger when its last group is
+        u32 strpoolbuilder_t::layout(u32 blockSize, u32* groups, u32* blockSizes, u32& total) const
+        {
+            u32 numBlocks = 0;
+            u32 current   = 0;
+            total         = 0;
+            for (u32 first = 0; first < mNumStrings; first += strpool_t::GroupSize)
+            {
+                if (numBlocks == 0 || current >= blockSize)
+                {
+                    numBlocks += 1;
+                    current = 0;
+                }
+                if (groups != nullptr)
+                    groups[first / strpool_t::GroupSize] = ((numBlocks - 1) << 16) | current;
+
+                u32 const last = (first + strpool_t::GroupSize) < mNumStrings ? (first + strpool_t::GroupSize) : mNumStrings;
+                for (u32 i = first; i < last; ++i)
+                {
+                    u32 const size = s_varint_size(mByteLengths[i]) + s_varint_size(mCharLengths[i]) + mByteLengths[i] + 1;
+                    current += size;
+                    total += size;
+                }
+                if (blockSizes != nullptr)
+                    blockSizes[numBlocks - 1] = current;
+            }
+            return numBlocks;
+        }
+
+        u32 strpoolbuilder_t::pool_bound(u32 blockSize) const
+        {
+            blockSize           = (blockSize == 0 || blockSize > s_max_block_size) ? s_max_block_size : blockSize;
+            u32       total     = 0;
+            u32 const numBlocks = layout(blockSize, nullptr, nullptr, total);
+            u32 const numGroups = (mNumStrings + strpool_t::GroupSize - 1) / strpool_t::GroupSize;
+            return (u32)sizeof(strpool_t) + numGroups * 4 + numBlocks * (u32)sizeof(strpool_t::block_t) + total + (total / 255) + numBlocks * 16;
+        }
+
+        s32 strpoolbuilder_t::write_pool(byte* dst, u32 dstCapacity, u32 blockSize, bool compress) const
+        {
+            blockSize           = (blockSize == 0 || blockSize > s_max_block_size) ? s_max_block_size : blockSize;
+            u32       total     = 0;
+            u32 const numBlocks = layout(blockSize, nullptr, nullptr, total);
+            if (numBlocks > s_max_blocks || dstCapacity < pool_bound(blockSize))
+                return -1;
+
+            u32 const  numGroups = (mNumStrings + strpool_t::GroupSize - 1) / strpool_t::GroupSize;
+            strpool_t* pool      = (strpool_t*)dst;
+            pool->mMagic         = strpool_t::Magic;
+            pool->mNumStrings    = mNumStrings;
+            pool->mNumBlocks     = numBlocks;
+            pool->mBlockSize     = blockSize;
+            pool->mGroupsOffset  = (u32)sizeof(strpool_t);
+            pool->mBlocksOffset  = pool->mGroupsOffset + numGroups * 4;
+
+            u32* const                blockSizes = numBlocks > 0 ? g_allocate_array<u32>(mAllocator, numBlocks) : nullptr;
+            strpool_t::block_t* const blocks     = (strpool_t::block_t*)(dst + pool->mBlocksOffset);
+            layout(blockSize, (u32*)(dst + pool->mGroupsOffset), blockSizes, total);
+
+            u32 largest = 0;
+            for (u32 b = 0; b < numBlocks; ++b)
+                largest = blockSizes[b] > largest ? blockSizes[b] : largest;
+            byte* const buffer = largest > 0 ? g_allocate_array<byte>(mAllocator, largest) : nullptr;
+
+            u32 offset = pool->mBlocksOffset + numBlocks * (u32)sizeof(strpool_t::block_t);
+            u32 s      = 0;
+            for (u32 b = 0; b < numBlocks; ++b)
+            {
+                byte* p = buffer;
+                while ((u32)(p - buffer) < blockSizes[b])
+                {
+                    p = s_write_varint(p, mByteLengths[s]);
+                    p = s_write_varint(p, mCharLengths[s]);
+                    nmem::memcpy(p, mStrings[s], mByteLengths[s]);
+                    p += mByteLengths[s];
+                    *p++ = 0;
+                    s += 1;
+                }
+
+                blocks[b].mOffset           = offset;
+                blocks[b].mUncompressedSize = blockSizes[b];
+                s32 const compressed        = compress ? nlz::compress_block(buffer, blockSizes[b], dst + offset, dstCapacity - offset) : -1;
+                if (compressed > 0 && (u32)compressed < blockSizes[b])
+                {
+                    blocks[b].mSize = (u32)compressed;
+                }
+                else
+                {
+                    nmem::memcpy(dst + offset, buffer, blockSizes[b]);
+                    blocks[b].mSize = blockSizes[b] | nlz::c_block_stored_bit;
+                }
+                offset += blocks[b].mSize & ~nlz::c_block_stored_bit;
+            }
+
+            g_deallocate_array(mAllocator, buffer);
+            g_deallocate_array(mAllocator, blockSizes);
+            return (s32)offset;
+        }
+
+        u32 strpoolbuilder_t::s_language_bound(u32 numStrings)
+        {
+            u32 const numGroups = (numStrings + strpool_t::GroupSize - 1) / strpool_t::GroupSize;
+            return (u32)sizeof(strlang_t) + numStrings * 4 + strtable_t::s_index_size(numStrings) * 4 + numGroups * 8 + numStrings * 5;
+        }
+
+        s32 strpoolbuilder_t::s_write_language(u32 const* hashes, u32 const* ids, u32 numStrings, fileid_t pool, byte* dst, u32 dstCapacity)
+        {
+            if (dstCapacity < s_language_bound(numStrings))
+                return -1;
+
+            u32 const  numGroups     = (numStrings + strpool_t::GroupSize - 1) / strpool_t::GroupSize;
+            strlang_t* lang          = (strlang_t*)dst;
+            lang->mMagic             = strlang_t::Magic;
+            lang->mNumStrings        = numStrings;
+            lang->mPool.m_fileid     = pool;
+            lang->mHashesOffset      = (u32)sizeof(strlang_t);
+            lang->mIndexSize         = strtable_t::s_index_size(numStrings);
+            lang->mIndexOffset       = lang->mHashesOffset + numStrings * 4;
+            lang->mCheckpointsOffset = lang->mIndexOffset + lang->mIndexSize * 4;
+            lang->mIdsOffset         = lang->mCheckpointsOffset + numGroups * 8;
+
+            nmem::memcpy(dst + lang->mHashesOffset, hashes, numStrings * 4);
+            strtable_t::s_build_index(hashes, numStrings, (u32*)(dst + lang->mIndexOffset), lang->mIndexSize);
+
+            u32* const  checkpoints = (u32*)(dst + lang->mCheckpointsOffset);
+            byte* const deltas      = dst + lang->mIdsOffset;
+            byte*       p           = deltas;
+            u32         previous    = 0;
+            for (u32 i = 0; i < numStrings; ++i)
+            {
+                if ((i % strpool_t::GroupSize) == 0)
+                {
+                    checkpoints[(i / strpool_t::GroupSize) * 2 + 0] = previous;
+                    checkpoints[(i / strpool_t::GroupSize) * 2 + 1] = (u32)(p - deltas);
+                }
+                p        = s_write_varint(p, s_zigzag((s32)(ids[i] - previous)));
+                previous = ids[i];
+            }
+            lang->mIdsSize = (u32)(p - deltas);
+            return (s32)(lang->mIdsOffset + lang->mIdsSize);
+        }
+
+    }  // namespace charon
+}  // namespace ncore
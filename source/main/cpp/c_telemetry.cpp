@@ -0,0 +1,288 @@
+#include "ccore/c_target.h"
+#include "cbase/c_allocator.h"
+#include "cbase/c_memory.h"
+#include "cfile/c_file.h"
+
+#include "charon/c_telemetry.h"
+#include "charon/c_platform.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        // Threads get a small id on their first event, a trace viewer shows one track per id
+        static s32 volatile      s_num_threads = 0;
+        static thread_local u32  s_thread      = 0;
+        static const char* const s_phase_names[telemetry_t::PhaseCount] = {"queue", "io", "decompress", "patch"};
+
+        static u32 s_thread_id()
+        {
+            if (s_thread == 0)
+                s_thread = (u32)nplatform::atomic_add(&s_num_threads, 1);
+            return s_thread;
+        }
+
+        telemetry_t::telemetry_t()
+            : mAllocator(nullptr)
+            , mEvents(nullptr)
+            , mCapacity(0)
+            , mTracing(0)
+            , mNextEvent(0)
+            , mTraceStart(0)
+            , mLog(nullptr)
+            , mLogCapacity(0)
+            , mLogging(0)
+            , mLogNext(0)
+        {
+            reset();
+        }
+
+        void telemetry_t::setup(alloc_t* allocator)
+        {
+            mAllocator = allocator;
+            reset();
+        }
+
+        void telemetry_t::teardown()
+        {
+            stop_trace();
+            stop_access_log();
+            g_deallocate(mAllocator, mEvents);
+            g_deallocate(mAllocator, mLog);
+            mEvents      = nullptr;
+            mCapacity    = 0;
+            mLog         = nullptr;
+            mLogCapacity = 0;
+        }
+
+        void telemetry_t::record(EPhase phase, u64 begin, u64 end, u32 archiveIndex, u32 fileIndex)
+        {
+            u64 const duration = end - begin;
+            nplatform::atomic_add(&mPhaseCount[phase], 1);
+            nplatform::atomic_add(&mPhaseNs[phase], duration);
+            u64 longest = nplatform::atomic_load(&mPhaseMaxNs[phase]);
+            while (duration > longest && !nplatform::atomic_cas(&mPhaseMaxNs[phase], longest, duration))
+                longest = nplatform::atomic_load(&mPhaseMaxNs[phase]);
+
+            if (nplatform::atomic_load(&mTracing) == 0)
+                return;
+
+            u64 const index = nplatform::atomic_add(&mNextEvent, 1) - 1;
+            event_t&  event = mEvents[index & (mCapacity - 1)];
+            event.mBegin    = begin;
+            event.mDuration = duration;
+            event.mThread   = s_thread_id();
+            event.mPhase    = (u32)phase;
+            event.mArchive  = archiveIndex;
+            event.mFile     = fileIndex;
+        }
+
+        void telemetry_t::stats(stats_t& out) const
+        {
+            for (s32 i = 0; i < CounterCount; ++i)
+                out.mCounters[i] = nplatform::atomic_load(&mCounters[i]);
+            for (s32 i = 0; i < PhaseCount; ++i)
+            {
+                out.mPhaseCount[i] = nplatform::atomic_load(&mPhaseCount[i]);
+                out.mPhaseNs[i]    = nplatform::atomic_load(&mPhaseNs[i]);
+                out.mPhaseMaxNs[i] = nplatform::atomic_load(&mPhaseMaxNs[i]);
+            }
+        }
+
+        // Counters that change while resetting may keep part of their old value
+        void telemetry_t::reset()
+        {
+            for (s32 i = 0; i < CounterCount; ++i)
+                mCounters[i] = 0;
+            for (s32 i = 0; i < PhaseCount; ++i)
+            {
+                mPhaseCount[i] = 0;
+                mPhaseNs[i]    = 0;
+                mPhaseMaxNs[i] = 0;
+            }
+        }
+
+        bool telemetry_t::start_trace(u32 maxEvents)
+        {
+            if (maxEvents == 0)
+                return false;
+
+            u32 capacity = 1;
+            while (capacity < maxEvents)
+                capacity *= 2;
+
+            stop_trace();
+            if (capacity != mCapacity)
+            {
+                g_deallocate(mAllocator, mEvents);
+                mEvents   = g_allocate_array<event_t>(mAllocator, capacity);
+                mCapacity = capacity;
+            }
+            mNextEvent  = 0;
+            mTraceStart = nplatform::clock_ns();
+            nplatform::atomic_store(&mTracing, 1);
+            return mEvents != nullptr;
+        }
+
+        void telemetry_t::stop_trace() { nplatform::atomic_store(&mTracing, 0); }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Access Log -----------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // Every miss claims its own entry, the log does not wrap so entries are never written twice
+        void telemetry_t::log(u32 archiveIndex, u32 fileIndex)
+        {
+            u64 const index = nplatform::atomic_add(&mLogNext, 1) - 1;
+            if (index >= mLogCapacity)
+                return;
+            mLog[index * 2 + 0] = archiveIndex;
+            mLog[index * 2 + 1] = fileIndex;
+        }
+
+        bool telemetry_t::start_access_log(u32 maxEntries)
+        {
+            if (maxEntries == 0)
+                return false;
+
+            stop_access_log();
+            if (maxEntries != mLogCapacity)
+            {
+                g_deallocate(mAllocator, mLog);
+                mLog         = g_allocate_array<u32>(mAllocator, (s64)maxEntries * 2);
+                mLogCapacity = maxEntries;
+            }
+            mLogNext = 0;
+            nplatform::atomic_store(&mLogging, 1);
+            return mLog != nullptr;
+        }
+
+        void telemetry_t::stop_access_log() { nplatform::atomic_store(&mLogging, 0); }
+
+        bool telemetry_t::dump_access_log(const char* filename) const
+        {
+            if (mLog == nullptr)
+                return false;
+
+            u64 const   total  = nplatform::atomic_load(&mLogNext);
+            u32 const   count  = total < mLogCapacity ? (u32)total : mLogCapacity;
+            accesslog_t header = {accesslog_t::Magic, accesslog_t::Version, count, (u32)(total - count)};
+
+            nfile::file_handle_t file = nfile::file_open(filename, nfile::file_mode_t::FILE_MODE_WRITE);
+            if (!file.isValid())
+                return false;
+            bool written = nfile::file_write(file, (u8 const*)&header, sizeof(header)) == (s64)sizeof(header);
+            if (written && count > 0)
+                written = nfile::file_write(file, (u8 const*)mLog, (s64)count * 2 * sizeof(u32)) == (s64)(count * 2 * sizeof(u32));
+            nfile::file_close(file);
+            return written;
+        }
+
+        // ------------------------------------------------------------------------------------------------
+        // ------- Chrome Trace ---------------------------------------------------------------------------
+        // ------------------------------------------------------------------------------------------------
+        // A JSON array of complete ("X") events, timestamps in microseconds since the start of the trace
+        struct jsonwriter_t
+        {
+            nfile::file_handle_t mFile;
+            u32                  mUsed;
+            bool                 mFailed;
+            char                 mBuffer[16 * 1024];
+
+            void flush()
+            {
+                if (mUsed > 0 && nfile::file_write(mFile, (u8 const*)mBuffer, mUsed) != (s64)mUsed)
+                    mFailed = true;
+                mUsed = 0;
+            }
+
+            void text(const char* str)
+            {
+                while (*str != '\0')
+                {
+                    if (mUsed == sizeof(mBuffer))
+                        flush();
+                    mBuffer[mUsed++] = *str++;
+                }
+            }
+
+            void number(u64 value)
+            {
+                char digits[24];
+                s32  count = 0;
+                do
+                {
+                    digits[count++] = (char)('0' + (value % 10));
+                    value /= 10;
+                } while (value != 0);
+
+                char str[24];
+                for (s32 i = 0; i < count; ++i)
+                    str[i] = digits[count - 1 - i];
+                str[count] = '\0';
+                text(str);
+            }
+
+            // Nanoseconds as microseconds with 3 decimals
+            void micros(u64 ns)
+            {
+                number(ns / 1000);
+                char str[5] = {'.', (char)('0' + (ns / 100) % 10), (char)('0' + (ns / 10) % 10), (char)('0' + ns % 10), '\0'};
+                text(str);
+            }
+        };
+
+        bool telemetry_t::dump_trace(const char* filename) const
+        {
+            if (mEvents == nullptr)
+                return false;
+
+            jsonwriter_t* writer = g_allocate<jsonwriter_t>(mAllocator);
+            writer->mFile        = nfile::file_open(filename, nfile::file_mode_t::FILE_MODE_WRITE);
+            writer->mUsed        = 0;
+            writer->mFailed      = !writer->mFile.isValid();
+            if (writer->mFailed)
+            {
+                g_deallocate(mAllocator, writer);
+                return false;
+            }
+
+            u64 const end   = nplatform::atomic_load(&mNextEvent);
+            u64 const begin = end > mCapacity ? end - mCapacity : 0;
+            bool      first = true;
+            writer->text("{\"traceEvents\":[\n");
+            for (u64 i = begin; i < end; ++i)
+            {
+                // Events of a previous trace that were recorded while this one started
+                event_t const& event = mEvents[i & (mCapacity - 1)];
+                if (event.mBegin < mTraceStart)
+                    continue;
+                writer->text(first ? "{\"name\":\"" : ",\n{\"name\":\"");
+                first = false;
+                writer->text(s_phase_names[event.mPhase < PhaseCount ? event.mPhase : 0]);
+                writer->text("\",\"cat\":\"charon\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+                writer->number(event.mThread);
+                writer->text(",\"ts\":");
+                writer->micros(event.mBegin - mTraceStart);
+                writer->text(",\"dur\":");
+                writer->micros(event.mDuration);
+                if (event.mArchive != ~0u)
+                {
+                    writer->text(",\"args\":{\"archive\":");
+                    writer->number(event.mArchive);
+                    writer->text(",\"file\":");
+                    writer->number(event.mFile);
+                    writer->text("}");
+                }
+                writer->text("}");
+            }
+            writer->text("\n],\"displayTimeUnit\":\"ns\"}\n");
+            writer->flush();
+            nfile::file_close(writer->mFile);
+
+            bool const written = !writer->mFailed;
+            g_deallocate(mAllocator, writer);
+            return written;
+        }
+
+    }  // namespace charon
+}  // namespace ncore
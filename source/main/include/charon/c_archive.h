@@ -6,6 +6,7 @@
 #endif
 
 #include "charon/c_gamedata.h"
+#include "charon/c_telemetry.h"
 
 namespace ncore
 {
@@ -13,13 +14,42 @@ namespace ncore
 
     namespace charon
     {
-        u8* g_patch(dataunit_header_t* data);
+        class jobs_t;
+
+        // Resolve the pointers of a loaded dataunit, returns the data that follows the header. Large flat
+        // patch tables are split across the threads of jobs when given.
+        u8* g_patch(dataunit_header_t* data, jobs_t* jobs = nullptr);
 
         class archive_t
         {
         public:
+            enum EBackend
+            {
+                BackendFileRead     = 0,  // Every load reads into a heap allocation
+                BackendMemoryMapped = 1,  // Archives are mapped, uncompressed datafiles are returned in-place (read-only)
+            };
+
+            struct config_t
+            {
+                inline config_t()
+                    : mBackend(BackendFileRead)
+                    , mNumIoThreads(0)
+                    , mMaxAsyncLoads(256)
+                    , mResidencyBudget(0)
+                    , mDeduplicate(false)
+                    , mVerify(false)
+                {
+                }
+                EBackend mBackend;
+                s32      mNumIoThreads;     // Background threads serving async loads, 0 means async loads complete inline
+                s32      mMaxAsyncLoads;    // Maximum number of async loads in flight, beyond that they complete inline
+                u64      mResidencyBudget;  // Bytes that may stay resident, unloaded data is cached until this is exceeded (0 = no caching)
+                bool     mDeduplicate;      // Datafiles with the same HDB hash and size share one copy, the HDB must hold content hashes
+                bool     mVerify;           // Files read from an archive must match their HDB hash (nhash::hash64 of the stored bytes), a corrupt file fails to load
+            };
+
             static archive_t* s_instance;
-            static void       s_setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataArchives);
+            static void       s_setup(alloc_t* allocator, s32 maxNumDataUnits, s32 maxNumDataArchives, config_t const& config = config_t());
             static void       s_teardown();
 
             struct file_t
@@ -48,10 +78,109 @@ namespace ncore
                 }
             };
 
+            // A packed archive is one file that holds the data, TOC, FDB and HDB of an archive. Every region starts
+            // at a multiple of Alignment (a page) so that the file can be mapped once and the TOC, FDB and HDB are
+            // used in-place. The tables have the same layout as the separate files, file offsets in the TOC are
+            // relative to the data region. An FDB or HDB region of size 0 means that it is absent.
+            struct packheader_t
+            {
+                enum
+                {
+                    Magic     = 0x4B504843,  // 'CHPK'
+                    Version   = 1,
+                    Alignment = 4096,
+                };
+
+                struct region_t
+                {
+                    u64 mOffset;  // From the start of the file
+                    u64 mSize;
+                };
+
+                u32      mMagic;
+                u32      mVersion;
+                region_t mData;
+                region_t mToc;
+                region_t mFdb;
+                region_t mHdb;
+            };
+
+            // Mounting must not overlap with loads from that archive, loading and unloading itself
+            // is safe to call from any number of threads. With deduplication, data that other archives
+            // share from an archive is also released when that archive is unmounted.
+            s32  mount(s32 archiveIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            s32  mount(s32 archiveIndex, const char* packFilename);  // Mount a packed archive, see packheader_t
+            void unmount(s32 archiveIndex);
+
+            // Mount an archive as a layer on top of a base archive, files that the layer has (a valid TOC entry
+            // at the same file index) shadow those of the base: a file id of the base archive then loads the
+            // file from the newest layer. Layers can be unmounted in any order, the base can be remounted.
+            // Data that was loaded before the layers changed stays valid until it is unloaded or the archive
+            // that it came from is unmounted, cached dataunits (archive 0) are not reloaded. At most 255
+            // layers per base.
+            s32 mount_overlay(s32 archiveIndex, s32 baseIndex, const char* archiveFilename, const char* tocFilename, const char* filenameDbFilename, const char* hashDbFilename);
+            s32 mount_overlay(s32 archiveIndex, s32 baseIndex, const char* packFilename);
+
+            // Hot reload of an archive that was rebuilt on disk, changed() compares the size and write time of
+            // its files with those at mount. reload() opens the files again and moves the resident data of every
+            // file whose TOC entry or HDB hash changed to the new data; data that has owners is read right away
+            // and the owners are told through the callback, with dataunitIndex -1 for a datafile and the pointers
+            // as load returned them. Owners must switch to newData, oldData is released when reload returns and
+            // the owners keep their ownership. Return the number of files whose owners were called, or -1 when
+            // the archive is not mounted or the new files can not be opened or loaded, the archive then stays
+            // as it was. Like mount, reload must not overlap with loads. Build tools must write new files and
+            // rename them over the old ones, a mapped file that is rewritten in-place changes under the loader.
+            // Content changes that keep every offset and size are only seen when the HDB was loaded before the
+            // rebuild (find, deduplication and verification load it) or is part of a packed archive.
+            typedef void (*reload_fn)(void* context, fileid_t fileid, s32 dataunitIndex, void* oldData, void* newData);
+            bool changed(s32 archiveIndex) const;
+            s32  reload(s32 archiveIndex, reload_fn callback = nullptr, void* context = nullptr);
+
+            // Loads are reference counted, data that is no longer referenced is kept (LRU) as long as the
+            // resident bytes stay within the residency budget.
+            void set_residency_budget(u64 bytes);
+            u64  resident_bytes() const;
+            u64  resident_bytes(s32 archiveIndex) const;  // Of one archive (walks its slots), dataunits count for archive 0
+
+            // Loader telemetry, see telemetry_t. Counters and per-phase timing are always collected, the timed
+            // phases are traced between start_trace and stop_trace. dump_trace writes a Chrome trace JSON file.
+            void stats(telemetry_t::stats_t& out) const;
+            void reset_stats();
+            bool start_trace(u32 maxEvents);
+            void stop_trace();
+            bool dump_trace(const char* filename) const;
+
+            // Access log of a session, the file ids that were read from the archives in load order (see
+            // telemetry_t::accesslog_t). charon_layout uses these logs to lay out an archive in load order.
+            bool start_access_log(u32 maxEntries);
+            void stop_access_log();
+            bool dump_access_log(const char* filename) const;
+
+            // An arena holds the data of everything that is loaded through its loader, allocated linearly from
+            // blocks of blockSize bytes, releasing the arena frees all of it at once. Release it once its loads
+            // are unloaded and its async loads are done or cancelled, data that still has owners keeps the arena
+            // alive until it is unloaded. A file that is already resident is not loaded again, whichever arena
+            // holds it. Mapped (uncompressed) datafiles are used in-place and never take arena memory.
+            class arena_t;
+            arena_t*          create_arena(u64 blockSize = 4 * 1024 * 1024);
+            void              release_arena(arena_t* arena);
+            archive_loader_t* loader(arena_t* arena) const;  // Get the loader interface that loads into an arena
+
             bool              exists(fileid_t const& id) const;    // Return True if file-id exists
             file_t const*     fileitem(fileid_t const& id) const;  // Return Item associated with file id
             string_t          filename(fileid_t const& id) const;  // Return Filename associated with file id
             archive_loader_t* loader() const;                      // Get the loader interface
+
+            // Hash every file of an archive on numThreads threads (0 uses every core) and compare it with its HDB
+            // hash, files without a hash (0) are skipped. Return the number of corrupt files, of which up to
+            // maxCorrupt are written to outCorrupt, or -1 when the archive is not mounted or has no HDB. Loads
+            // from the archive can continue meanwhile.
+            s32 verify(s32 archiveIndex, fileid_t* outCorrupt = nullptr, s32 maxCorrupt = 0, s32 numThreads = 0);
+
+            // Look up files by their HDB hash, archives are searched in mount index order. Return INVALID_FILEID
+            // when no mounted archive has the hash, the batched find returns the number of hashes found.
+            fileid_t find(u64 hash) const;
+            s32      find(u64 const* hashes, s32 count, fileid_t* outIds) const;
         };
 
     }  // namespace charon
@@ -77,6 +77,11 @@ namespace ncore
 
         struct fileid_t
         {
+            inline fileid_t()
+                : archiveIndex((u32)-1)
+                , fileIndex((u32)-1)
+            {
+            }
             explicit fileid_t(u32 archiveIndex, u32 fileIndex)
                 : archiveIndex(archiveIndex)
                 , fileIndex(fileIndex)
@@ -92,12 +97,76 @@ namespace ncore
 
         const fileid_t INVALID_FILEID((u32)-1, (u32)-1);
 
+        // Async loads are served by priority, within a priority the earliest deadline goes first
+        enum EPriority
+        {
+            PriorityImmediate = 0,  // Needed now, e.g. the sound that has to play this frame
+            PriorityHigh      = 1,  // Needed soon, e.g. the textures of the next track segment
+            PriorityNormal    = 2,  //
+            PriorityLow       = 3,  //
+            PriorityIdle      = 4,  // Prefetching, only when nothing else is waiting
+        };
+
+        // Returned by the async load functions, an invalid job (-1) means the load already completed
+        struct loadhandle_t
+        {
+            inline loadhandle_t()
+                : m_job(-1)
+                , m_generation(0)
+                , m_dataunit_index(-1)
+                , m_fileid(INVALID_FILEID)
+            {
+            }
+
+            s32      m_job;  // Streaming request
+            s32      m_generation;
+            s32      m_dataunit_index;  // -1 when this is a datafile load
+            fileid_t m_fileid;
+        };
+
+        // Returned by load_dataunit_group, holds the loads of a dataunit and of everything it references
+        struct loadgroup_t
+        {
+            inline loadgroup_t()
+                : m_group(nullptr)
+            {
+            }
+
+            loadhandle_t m_handle;  // Of the root dataunit
+            void*        m_group;
+        };
+
         class archive_loader_t
         {
         public:
             void* load_datafile(fileid_t fileid) { return v_load_datafile(fileid); }
             void* load_dataunit(u32 dataunit_index) { return v_load_dataunit(dataunit_index); }
 
+            // Load many datafiles at once, the reads are sorted by offset and merged where files are close
+            // together. outData (optional) receives the loaded data of each file id.
+            void load_datafiles(fileid_t const* fileids, s32 count, void** outData = nullptr) { v_load_datafiles(fileids, count, outData); }
+
+            // Non-blocking loads, poll with is_done() or block with wait() which returns the loaded data.
+            // The deadline is in nplatform::clock_ns() time, 0 means no deadline. Waiting on a load that has
+            // not started yet performs it on the calling thread.
+            loadhandle_t load_datafile_async(fileid_t fileid, EPriority priority = PriorityNormal, u64 deadline = 0) { return v_load_datafile_async(fileid, priority, deadline); }
+            loadhandle_t load_dataunit_async(u32 dataunit_index, EPriority priority = PriorityNormal, u64 deadline = 0) { return v_load_dataunit_async(dataunit_index, priority, deadline); }
+            bool         is_done(loadhandle_t const& handle) { return v_is_done(handle); }
+            void*        wait(loadhandle_t const& handle) { return v_wait(handle); }
+
+            // Load a dataunit together with everything that its reference table lists, following referenced
+            // dataunits. The datafiles of each level are loaded as one batch with merged reads, wait() returns
+            // the root dataunit. unload_group() drops every load of the group, or cancels it when not started.
+            loadgroup_t load_dataunit_group(u32 dataunit_index, EPriority priority = PriorityNormal, u64 deadline = 0) { return v_load_dataunit_group(dataunit_index, priority, deadline); }
+            bool        is_done(loadgroup_t const& group) { return v_is_done(group.m_handle); }
+            void*       wait(loadgroup_t const& group) { return v_wait(group.m_handle); }
+            void        unload_group(loadgroup_t& group) { v_unload_group(group); }
+
+            // Only affect loads that have not started yet, return false otherwise. A cancelled load holds no
+            // data, it must not be waited on or unloaded.
+            bool reprioritize(loadhandle_t const& handle, EPriority priority, u64 deadline = 0) { return v_reprioritize(handle, priority, deadline); }
+            bool cancel(loadhandle_t const& handle) { return v_cancel(handle); }
+
             template <typename T>
             void* get_datafile_ptr(fileid_t fileid)
             {
@@ -123,16 +192,90 @@ namespace ncore
             }
 
         protected:
-            virtual void* v_get_datafile_ptr(fileid_t fileid)                = 0;
-            virtual void* v_get_dataunit_ptr(u32 dataunit_index)             = 0;
-            virtual void* v_load_datafile(fileid_t fileid)                   = 0;
-            virtual void* v_load_dataunit(u32 dataunit_index)                = 0;
-            virtual void  v_unload_datafile(fileid_t fileid, void*& data)    = 0;
-            virtual void  v_unload_dataunit(u32 dataunit_index, void*& data) = 0;
+            virtual void* v_get_datafile_ptr(fileid_t fileid)                                  = 0;
+            virtual void* v_get_dataunit_ptr(u32 dataunit_index)                               = 0;
+            virtual void* v_load_datafile(fileid_t fileid)                                     = 0;
+            virtual void* v_load_dataunit(u32 dataunit_index)                                  = 0;
+            virtual void  v_load_datafiles(fileid_t const* fileids, s32 count, void** outData) = 0;
+            virtual void  v_unload_datafile(fileid_t fileid, void*& data)                      = 0;
+            virtual void  v_unload_dataunit(u32 dataunit_index, void*& data)                   = 0;
+
+            virtual loadhandle_t v_load_datafile_async(fileid_t fileid, EPriority priority, u64 deadline)    = 0;
+            virtual loadhandle_t v_load_dataunit_async(u32 dataunit_index, EPriority priority, u64 deadline) = 0;
+            virtual bool         v_is_done(loadhandle_t const& handle)                                        = 0;
+            virtual void*        v_wait(loadhandle_t const& handle)                                           = 0;
+            virtual bool         v_reprioritize(loadhandle_t const& handle, EPriority priority, u64 deadline) = 0;
+            virtual bool         v_cancel(loadhandle_t const& handle)                                         = 0;
+            virtual loadgroup_t  v_load_dataunit_group(u32 dataunit_index, EPriority priority, u64 deadline)  = 0;
+            virtual void         v_unload_group(loadgroup_t& group)                                           = 0;
         };
 
         extern archive_loader_t* g_loader;
 
+        // Pointers inside a dataunit. By default they are absolute pointers that g_patch fixes up after
+        // loading. With CHARON_RELATIVE_POINTERS defined they are self-relative and resolved on access,
+        // a dataunit then needs no patching and can be used straight from a read-only mapping.
+        //
+        // A relative pointer has the layout of an (unpatched) pointer record of the patch table:
+        //   s32: Offset to the next record, unused here
+        //   s32: Offset of the target relative to the start of the field, 0 means nullptr
+        // so the same dataunit works in both modes. The record is 8 bytes on every target, a patched pointer
+        // only fills it on 64-bit targets, 32-bit targets need CHARON_RELATIVE_POINTERS.
+        template <typename T>
+        struct relptr_t
+        {
+            inline relptr_t()
+                : m_link(0)
+                , m_offset(0)
+            {
+            }
+            inline relptr_t(T* ptr)
+                : m_link(0)
+            {
+                set(ptr);
+            }
+            inline relptr_t(relptr_t const& other)
+                : m_link(0)
+            {
+                set(other.get());
+            }
+            inline relptr_t& operator=(relptr_t const& other)
+            {
+                set(other.get());
+                return *this;
+            }
+            inline relptr_t& operator=(T* ptr)
+            {
+                set(ptr);
+                return *this;
+            }
+
+            inline T* get() const { return m_offset != 0 ? (T*)((byte*)this + m_offset) : nullptr; }
+            inline    operator T*() const { return get(); }
+            inline T* operator->() const { return get(); }
+
+        private:
+            inline void set(T* ptr)
+            {
+                // A copy must stay close to its target, e.g. within the same dataunit
+                s64 const offset = (ptr != nullptr) ? (s64)((byte const*)ptr - (byte const*)this) : 0;
+                ASSERT(offset == (s64)(s32)offset);
+                m_offset = (s32)offset;
+            }
+
+            s32 m_link;
+            s32 m_offset;
+        };
+
+#if defined(CHARON_RELATIVE_POINTERS)
+        template <typename T>
+        using dataptr_t = relptr_t<T>;
+#else
+        template <typename T>
+        using dataptr_t = T*;
+#endif
+        static_assert(sizeof(dataptr_t<void>) == sizeof(relptr_t<void>), "a dataunit pointer must fill its patch record");
+
         template <class T>
         struct array_t
         {
@@ -168,26 +311,44 @@ namespace ncore
             }
 
         private:
-            T*  m_array;
-            u32 m_bytes;
-            u32 m_count;
+            dataptr_t<T> m_array;
+            u32          m_bytes;
+            u32          m_count;
         };
 
         template <typename T>
         struct dataunit_t
         {
-            T*    get() { return g_loader->get_dataunit_ptr<T>(m_dataunit_index); }
-            void* load() { return g_loader->load_dataunit(m_dataunit_index); }
-            void  unload(void*& data) { g_loader->unload_dataunit(m_dataunit_index, data); }
-            u32   m_dataunit_index;
+            T*           get() { return g_loader->get_dataunit_ptr<T>(m_dataunit_index); }
+            void*        load() { return g_loader->load_dataunit(m_dataunit_index); }
+            loadhandle_t load_async(EPriority priority = PriorityNormal, u64 deadline = 0) const { return g_loader->load_dataunit_async(m_dataunit_index, priority, deadline); }
+            loadgroup_t  load_group(EPriority priority = PriorityNormal, u64 deadline = 0) const { return g_loader->load_dataunit_group(m_dataunit_index, priority, deadline); }
+            void         unload(void*& data) { g_loader->unload_dataunit(m_dataunit_index, data); }
+            u32          m_dataunit_index;
         };
 
+        // Patch table, at m_patch_offset, in one of two formats:
+        //   Chain (default): s32 offset of the first pointer record, each record holds the offset to the next one
+        //   Flat (FlagFlatPatchTable): u32[m_patch_count] offsets of the pointer records, sorted ascending
+        // A pointer record is {s32 next, s32 target relative to the record}, next is unused by the flat format.
+        //
+        // Reference table, at m_refs_offset (0 = none), what the dataunit references so that it can be loaded
+        // together with its dependencies (see archive_loader_t::load_dataunit_group):
+        //   u32:        Number of datafiles
+        //   u32:        Number of dataunits
+        //   fileid_t[]: Datafiles, also the ones referenced through other datafiles (e.g. the textures of a modeldatafile_t)
+        //   u32[]:      Dataunits, their own reference tables are followed
         struct dataunit_header_t
         {
+            enum
+            {
+                FlagFlatPatchTable = 0x1,
+            };
+
             u32 m_patch_offset;
             s32 m_patch_count;
-            u32 m_dummy0;
-            u32 m_dummy1;
+            u32 m_flags;
+            u32 m_refs_offset;
         };
 
         struct locstr_t
@@ -221,38 +382,83 @@ namespace ncore
             char const* m_array;
         };
 
+        // A string_t record of a dataunit read through a relative pointer. string_t itself always holds an
+        // absolute pointer since it is passed around by value at runtime.
+        struct relstring_t
+        {
+            inline string_t str() const { return string_t(m_bytes, m_count, m_array.get()); }
+            inline          operator string_t() const { return str(); }
+
+        private:
+            u32                  m_bytes;
+            u32                  m_count;
+            relptr_t<char const> m_array;
+        };
+
+        // A string inside a dataunit
+#if defined(CHARON_RELATIVE_POINTERS)
+        typedef relstring_t datastring_t;
+#else
+        typedef string_t datastring_t;
+#endif
+
+        // A string table datafile, the arrays follow the header and are found by their offset from the start of
+        // the table so that it is used in-place wherever it is loaded or mapped. Every string has a u32 key hash
+        // (the UI and scripts refer to text by it), find() looks a key up in the open addressing index that the
+        // tools store with the table: mIndexSize buckets, a power of two and at most 3/4 full, that hold the
+        // string index + 1 or 0 when empty. Probing is linear from the bucket of the mixed key hash.
         struct strtable_t
         {
-            inline strtable_t() {}
-            inline strtable_t(u32 numStrings, u32 const* byteLengths, u32 const* charLengths, u32 const* offsets, const char* strings)
-                : mMagic(0x36DF5DE5)
-                , mNumStrings(numStrings)
-                , mByteLengths(byteLengths)
-                , mCharLengths(charLengths)
-                , mOffsets(offsets)
-                , mStrings(strings)
+            enum
             {
-            }
+                Magic = 0x36DF5DE5,  // 'STRT'
+            };
+
+            inline strtable_t() {}
+            inline bool     isValid() const { return mMagic == Magic; }
             inline s32      size() const { return mNumStrings; }
-            inline string_t str(locstr_t l) const { return string_t(mByteLengths[l.id], mCharLengths[l.id], mStrings + mOffsets[l.id]); }
+            inline string_t str(locstr_t l) const { return str((u32)l.id); }
+            inline string_t str(u32 index) const { return string_t(array(mByteLengthsOffset)[index], array(mCharLengthsOffset)[index], (const char*)this + mStringsOffset + array(mOffsetsOffset)[index]); }
+            inline u32      hash(u32 index) const { return array(mHashesOffset)[index]; }
+            s32             find(u32 hash) const;  // Return the index of the string with this key hash, -1 when there is none
+            u32             bytes() const;         // Return the size of the table including its arrays and strings
+
+            // For the tools that write string tables, build the index over the key hashes. Return false when two
+            // strings have the same hash, the first of them is found.
+            static u32  s_index_size(u32 numStrings);
+            static bool s_build_index(u32 const* hashes, u32 numStrings, u32* index, u32 indexSize);
+            static s32  s_find(u32 const* hashes, u32 const* index, u32 indexSize, u32 hash);  // Also used by strlang_t
+            static u32  s_bucket(u32 hash, u32 indexSize) { return (u32)(((u64)(hash * 0x9E3779B1u) * indexSize) >> 32); }
+
+            // For the tools, write a whole table with its index: the arrays in the order of the members and then
+            // the text, every string terminated. textBytes is the sum of the byte lengths. Return the size written
+            // or -1 when dstCapacity is too small.
+            static u32 s_table_bound(u32 numStrings, u32 textBytes);
+            static s32 s_write_table(u32 const* hashes, char const* const* strings, u32 const* byteLengths, u32 const* charLengths, u32 numStrings, byte* dst, u32 dstCapacity);
+
             DCORE_CLASS_PLACEMENT_NEW_DELETE
         protected:
-            u32         mMagic;  // 'STRT'
-            u32         mNumStrings;
-            u32 const*  mHashes;
-            u32 const*  mOffsets;
-            u32 const*  mCharLengths;
-            u32 const*  mByteLengths;
-            const char* mStrings;
+            inline u32 const* array(u32 offset) const { return (u32 const*)((byte const*)this + offset); }
+
+            u32 mMagic;              // 'STRT'
+            u32 mNumStrings;         //
+            u32 mHashesOffset;       // u32[mNumStrings], key hash of every string
+            u32 mOffsetsOffset;      // u32[mNumStrings], of every string from the start of the strings
+            u32 mCharLengthsOffset;  // u32[mNumStrings]
+            u32 mByteLengthsOffset;  // u32[mNumStrings]
+            u32 mStringsOffset;      // UTF-8 text
+            u32 mIndexSize;          // Buckets of the index, 0 when the table has no index
+            u32 mIndexOffset;        // u32[mIndexSize]
         };
 
         template <typename T>
         struct datafile_t
         {
-            T*       get() const { return g_loader->get_datafile_ptr<T>(m_fileid); }
-            void*    load() const { return g_loader->load_datafile(m_fileid); }
-            void     unload(T*& data) const { g_loader->unload_datafile(m_fileid, data); }
-            fileid_t m_fileid;
+            T*           get() const { return g_loader->get_datafile_ptr<T>(m_fileid); }
+            void*        load() const { return g_loader->load_datafile(m_fileid); }
+            loadhandle_t load_async(EPriority priority = PriorityNormal, u64 deadline = 0) const { return g_loader->load_datafile_async(m_fileid, priority, deadline); }
+            void         unload(T*& data) const { g_loader->unload_datafile(m_fileid, data); }
+            fileid_t     m_fileid;
         };
 
         struct modeldatafile_t
@@ -260,6 +466,8 @@ namespace ncore
             inline array_t<datafile_t<texture_t>> const& getTextures() const { return m_Textures; }
             inline datafile_t<staticmesh_t> const&       getStaticMesh() const { return m_StaticMesh; }
 
+            void load() const;  // Load the textures and the static mesh as one batch
+
         private:
             array_t<datafile_t<texture_t>> m_Textures;
             datafile_t<staticmesh_t>       m_StaticMesh;
@@ -267,24 +475,24 @@ namespace ncore
 
         struct carconfiguration_t
         {
-            inline string_t const& getName() const { return m_Name; }
-            inline f32             getWeight() const { return m_Weight; }
-            inline f32             getMaxSpeed() const { return m_MaxSpeed; }
-            inline f32             getAcceleration() const { return m_Acceleration; }
-            inline f32             getBraking() const { return m_Braking; }
-            inline f32             getCornering() const { return m_Cornering; }
-            inline f32             getStability() const { return m_Stability; }
-            inline f32             getTraction() const { return m_Traction; }
+            inline string_t getName() const { return m_Name; }
+            inline f32      getWeight() const { return m_Weight; }
+            inline f32      getMaxSpeed() const { return m_MaxSpeed; }
+            inline f32      getAcceleration() const { return m_Acceleration; }
+            inline f32      getBraking() const { return m_Braking; }
+            inline f32      getCornering() const { return m_Cornering; }
+            inline f32      getStability() const { return m_Stability; }
+            inline f32      getTraction() const { return m_Traction; }
 
         private:
-            string_t m_Name;
-            f32      m_Weight;
-            f32      m_MaxSpeed;
-            f32      m_Acceleration;
-            f32      m_Braking;
-            f32      m_Cornering;
-            f32      m_Stability;
-            f32      m_Traction;
+            datastring_t m_Name;
+            f32          m_Weight;
+            f32          m_MaxSpeed;
+            f32          m_Acceleration;
+            f32          m_Braking;
+            f32          m_Cornering;
+            f32          m_Stability;
+            f32          m_Traction;
         };
 
         struct track_t
@@ -293,8 +501,8 @@ namespace ncore
             inline modeldatafile_t const*       getModel() const { return m_Model; }
 
         private:
-            datafile_t<texture_t> m_Road;
-            modeldatafile_t*      m_Model;
+            datafile_t<texture_t>      m_Road;
+            dataptr_t<modeldatafile_t> m_Model;
         };
 
         struct car_t
@@ -303,8 +511,8 @@ namespace ncore
             inline modeldatafile_t const*    getModelPath() const { return m_ModelPath; }
 
         private:
-            carconfiguration_t* m_Configuration;
-            modeldatafile_t*    m_ModelPath;
+            dataptr_t<carconfiguration_t> m_Configuration;
+            dataptr_t<modeldatafile_t>    m_ModelPath;
         };
 
         struct enemy_t
@@ -337,10 +545,10 @@ namespace ncore
 
         struct cars_t
         {
-            inline array_t<car_t*> const& getcars() const { return m_cars; }
+            inline array_t<dataptr_t<car_t>> const& getcars() const { return m_cars; }
 
         private:
-            array_t<car_t*> m_cars;
+            array_t<dataptr_t<car_t>> m_cars;
         };
 
         struct localization_t
@@ -348,39 +556,39 @@ namespace ncore
             inline languages_t const* getLanguages() const { return m_Languages; }
 
         private:
-            languages_t* m_Languages;
+            dataptr_t<languages_t> m_Languages;
         };
 
         struct menu_t
         {
-            inline string_t const& getdescr() const { return m_descr; }
+            inline string_t getdescr() const { return m_descr; }
 
         private:
-            string_t m_descr;
+            datastring_t m_descr;
         };
 
         struct fonts_t
         {
-            inline string_t const&           getDescription() const { return m_Description; }
+            inline string_t                  getDescription() const { return m_Description; }
             inline datafile_t<font_t> const& getFont() const { return m_Font; }
 
         private:
-            string_t           m_Description;
+            datastring_t       m_Description;
             datafile_t<font_t> m_Font;
         };
 
         struct ai_t
         {
-            inline string_t const&            getDescription() const { return m_Description; }
-            inline array_t<enemy_t*> const&   getBlueprintsAsArray() const { return m_BlueprintsAsArray; }
-            inline array_t<enemy_t*> const&   getBlueprintsAsList() const { return m_BlueprintsAsList; }
-            inline datafile_t<curve_t> const& getReactionCurve() const { return m_ReactionCurve; }
+            inline string_t                           getDescription() const { return m_Description; }
+            inline array_t<dataptr_t<enemy_t>> const& getBlueprintsAsArray() const { return m_BlueprintsAsArray; }
+            inline array_t<dataptr_t<enemy_t>> const& getBlueprintsAsList() const { return m_BlueprintsAsList; }
+            inline datafile_t<curve_t> const&         getReactionCurve() const { return m_ReactionCurve; }
 
         private:
-            string_t            m_Description;
-            array_t<enemy_t*>   m_BlueprintsAsArray;
-            array_t<enemy_t*>   m_BlueprintsAsList;
-            datafile_t<curve_t> m_ReactionCurve;
+            datastring_t                m_Description;
+            array_t<dataptr_t<enemy_t>> m_BlueprintsAsArray;
+            array_t<dataptr_t<enemy_t>> m_BlueprintsAsList;
+            datafile_t<curve_t>         m_ReactionCurve;
         };
 
         struct tracks_t
@@ -393,24 +601,24 @@ namespace ncore
 
         struct gameroot_t
         {
-            inline array_t<archive_info_t*> const&   getArchiveInfo() const { return m_ArchiveInfo; }
-            inline datafile_t<audio_t> const&        getBootSound() const { return m_BootSound; }
-            inline tracks_t const*                   getTracks() const { return m_Tracks; }
-            inline dataunit_t<ai_t> const&           getAI() const { return m_AI; }
-            inline dataunit_t<fonts_t> const&        getFonts() const { return m_Fonts; }
-            inline dataunit_t<menu_t> const&         getMenu() const { return m_Menu; }
-            inline dataunit_t<localization_t> const& getLocalization() const { return m_Localization; }
-            inline dataunit_t<cars_t> const&         getCars() const { return m_Cars; }
+            inline array_t<dataptr_t<archive_info_t>> const& getArchiveInfo() const { return m_ArchiveInfo; }
+            inline datafile_t<audio_t> const&                getBootSound() const { return m_BootSound; }
+            inline tracks_t const*                           getTracks() const { return m_Tracks; }
+            inline dataunit_t<ai_t> const&                   getAI() const { return m_AI; }
+            inline dataunit_t<fonts_t> const&                getFonts() const { return m_Fonts; }
+            inline dataunit_t<menu_t> const&                 getMenu() const { return m_Menu; }
+            inline dataunit_t<localization_t> const&         getLocalization() const { return m_Localization; }
+            inline dataunit_t<cars_t> const&                 getCars() const { return m_Cars; }
 
         private:
-            array_t<archive_info_t*>   m_ArchiveInfo;
-            datafile_t<audio_t>        m_BootSound;
-            tracks_t*                  m_Tracks;
-            dataunit_t<ai_t>           m_AI;
-            dataunit_t<fonts_t>        m_Fonts;
-            dataunit_t<menu_t>         m_Menu;
-            dataunit_t<localization_t> m_Localization;
-            dataunit_t<cars_t>         m_Cars;
+            array_t<dataptr_t<archive_info_t>> m_ArchiveInfo;
+            datafile_t<audio_t>                m_BootSound;
+            dataptr_t<tracks_t>                m_Tracks;
+            dataunit_t<ai_t>                   m_AI;
+            dataunit_t<fonts_t>                m_Fonts;
+            dataunit_t<menu_t>                 m_Menu;
+            dataunit_t<localization_t>         m_Localization;
+            dataunit_t<cars_t>                 m_Cars;
         };
 
     }  // namespace charon
@@ -0,0 +1,37 @@
+#ifndef __CHARON_HASH_H__
+#define __CHARON_HASH_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+namespace ncore
+{
+    namespace charon
+    {
+        // XXH64, the content hash that the HDB holds when archives are verified (see archive_t::verify). Four
+        // independent lanes of 64-bit multiply-rotate over 32 byte stripes, it runs at memory bandwidth on one
+        // core. Tools that build archives can use any XXH64 implementation with the same seed.
+        namespace nhash
+        {
+            u64 hash64(void const* data, u64 size, u64 seed = 0);
+
+            // For data that arrives in pieces, the digest equals hash64 over the concatenated pieces
+            struct state_t
+            {
+                void reset(u64 seed = 0);
+                void update(void const* data, u64 size);
+                u64  digest() const;
+
+                u64 mLanes[4];
+                u64 mSeed;
+                u64 mTotal;       // Bytes passed to update
+                u8  mBuffer[32];  // Tail of the data that does not fill a stripe yet
+                u32 mBuffered;
+            };
+
+        }  // namespace nhash
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_HASH_H__
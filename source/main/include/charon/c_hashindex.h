@@ -0,0 +1,49 @@
+#ifndef __CHARON_HASHINDEX_H__
+#define __CHARON_HASHINDEX_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace charon
+    {
+        // Maps 64-bit hashes to u32 values, laid out like a Swiss table. Slots are in groups of 16 with
+        // one control byte each, holding 7 bits of the hash or s_empty, a lookup compares the 16 control
+        // bytes of a group at once and only touches the entries of the slots that match. Groups are probed
+        // quadratically, the table is at most 7/8 full. Items can not be removed.
+        class hashindex_t
+        {
+        public:
+            hashindex_t();
+
+            void setup(alloc_t* allocator, u32 maxItems);
+            void teardown(alloc_t* allocator);
+
+            bool insert(u64 hash, u32 value);       // Return false when the hash is already in the index (the first value is kept) or the index is full
+            bool find(u64 hash, u32& value) const;  // Return false when the hash is not in the index
+            void prefetch(u64 hash) const;          // Start loading the first group that a find of hash reads
+            u32  size() const { return mCount; }
+
+        private:
+            struct entry_t  // Hash and value share a cache line, a hit costs the control group and one entry
+            {
+                u64 mHash;
+                u32 mValue;
+                u32 mPadding;
+            };
+
+            u8*      mControl;    // 16 per group
+            entry_t* mEntries;
+            u32      mGroupMask;  // Number of groups - 1, a power of two
+            u32      mCount;
+            u32      mMaxItems;
+        };
+
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_HASHINDEX_H__
@@ -0,0 +1,79 @@
+#ifndef __CHARON_JOBS_H__
+#define __CHARON_JOBS_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#include "charon/c_platform.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace charon
+    {
+        typedef void (*job_fn)(void* context, u64 arg);
+
+        struct jobhandle_t
+        {
+            inline jobhandle_t()
+                : m_index(-1)
+                , m_generation(0)
+            {
+            }
+            inline bool isValid() const { return m_index >= 0; }
+
+            s32 m_index;
+            s32 m_generation;
+        };
+
+        // A pool of worker threads executing jobs in submission order.
+        // With zero threads, or when all job slots are in use, a job is executed inline by
+        // submit() and the returned handle is invalid, which counts as done.
+        class jobs_t
+        {
+        public:
+            jobs_t();
+
+            void setup(alloc_t* allocator, s32 numThreads, s32 maxJobs);
+            void teardown();  // Runs all pending jobs before the threads exit
+
+            jobhandle_t submit(job_fn func, void* context, u64 arg);
+            bool        is_done(jobhandle_t const& handle) const;
+            void        wait(jobhandle_t const& handle);  // Helps with pending jobs of the same function while waiting
+            bool        help(job_fn func = nullptr);      // Execute one pending job (of func when given) on the calling thread, false if there was none
+            s32         num_threads() const { return mNumThreads; }
+
+        private:
+            struct job_t
+            {
+                job_fn       mFunc;
+                void*        mContext;
+                u64          mArg;
+                s32 volatile mGeneration;
+                s32          mNext;
+            };
+
+            static void s_worker(void* arg);
+            s32         pop(job_fn func);
+            void        finish(s32 index);
+
+            alloc_t*             mAllocator;
+            job_t*               mJobs;
+            s32                  mMaxJobs;
+            s32                  mFreeHead;
+            s32                  mPendingHead;
+            s32                  mPendingTail;
+            nplatform::thread_t* mThreads;
+            s32                  mNumThreads;
+            bool                 mQuit;
+            nplatform::mutex_t   mMutex;
+            nplatform::cond_t    mWork;  // Signalled when a job is queued
+            nplatform::cond_t    mDone;  // Broadcast when a job finished
+        };
+
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_JOBS_H__
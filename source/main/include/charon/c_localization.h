@@ -7,11 +7,21 @@
 
 #include "charon/c_archive.h"
 #include "charon/c_gamedata.h"
+#include "charon/c_strpool.h"
 
 namespace ncore
 {
     class alloc_t;
 
+    // The string tables of the languages and the current language. Setting up, prefetching, switching and
+    // update() belong to one (main) thread, getText can be called from any thread: the current table is
+    // swapped atomically once it is completely loaded. Text stays valid while its language is resident,
+    // the current language is never evicted and a language that was switched away from stays resident
+    // for at least s_grace_updates calls of update().
+    //
+    // The datafile of a language holds either a strtable_t or a strlang_t (see charon/c_strpool.h), told apart
+    // by the magic. A strlang_t is resident once the strpool_t that it refers to is loaded too, languages that
+    // share a pool share it in memory, and the text of compressed blocks is decoded through a small cache.
     class localization_t
     {
     public:
@@ -21,20 +31,65 @@ namespace ncore
         void teardown(charon::archive_t* ar);
 
         charon::enums::ELanguage getCurrentLanguage() const;
-        void                     setupLanguage(charon::enums::ELanguage language, charon::archive_t* ar);
+        void                     setupLanguage(charon::enums::ELanguage language, charon::archive_t* ar); // Load (or finish the prefetch) and switch, blocks
         void                     teardownLanguage(charon::enums::ELanguage language, charon::archive_t* ar);
 
-        // UTF-8
+        // Switching without a hitch: prefetch the languages that a menu offers, requestLanguage switches
+        // right away when the language is resident and otherwise once update() finds it loaded.
+        void prefetchLanguage(charon::enums::ELanguage language, charon::EPriority priority = charon::PriorityIdle);
+        void requestLanguage(charon::enums::ELanguage language);
+        void update();  // Once per frame, adopts finished prefetches, switches and evicts
+
+        // Languages other than the current and the requested one are unloaded, least recently used first,
+        // while the resident tables take more than this (0 = no limit)
+        void setBudget(u64 bytes);
+        u64  residentBytes() const { return mResidentBytes; }  // Tables, and every pool once
+        u64  cacheBytes() const { return mCache.bytes(); }     // Decoded blocks of compressed pools
+
+        // UTF-8, empty while there is no current language
         charon::string_t getText(charon::locstr_t lstr) const;
+        charon::string_t getText(u32 hash) const; // By the key hash of the string, empty when the language has no such string
+
+        static const u64 s_grace_updates = 2;
+        static const u32 s_cache_blocks  = 8;
 
     private:
-        void loadLanguage(charon::strtable_t*& language, charon::enums::ELanguage language_id, charon::archive_t* ar);
+        struct text_t  // What getText reads, either mTable or mStrings with mPool
+        {
+            charon::strtable_t const* mTable;
+            charon::strlang_t const*  mStrings;
+            charon::strpool_t const*  mPool;
+        };
+
+        bool isResident(charon::enums::ELanguage language) const { return mTexts[language].mTable != nullptr || mTexts[language].mPool != nullptr; }
+        void loadLanguage(charon::enums::ELanguage language);
+        void adoptLanguage(charon::enums::ELanguage language, void* data, bool block);
+        void adoptPool(charon::enums::ELanguage language, void* data);
+        bool sharesPool(charon::enums::ELanguage language) const;
+        void switchLanguage(charon::enums::ELanguage language);
+        void unloadLanguage(charon::enums::ELanguage language);
         void unloadLanguages(charon::archive_t* ar);
+        void evict();
 
         alloc_t*                   mAllocator;
         charon::languages_t const* mLanguages;
-        charon::strtable_t*        mLanguageStrTables[charon::enums::LanguageCount];
-        charon::enums::ELanguage   mCurrentLanguage;
+        charon::strtable_t*        mLanguageStrTables[charon::enums::LanguageCount];  // Loaded datafiles, a strtable_t or a strlang_t
+        charon::strpool_t*         mPools[charon::enums::LanguageCount];              // Of a strlang_t, loaded by every language that uses it
+        text_t                     mTexts[charon::enums::LanguageCount];              // Of the resident languages
+        charon::loadhandle_t       mPrefetches[charon::enums::LanguageCount];         // Async loads, valid while mPrefetching
+        bool                       mPrefetching[charon::enums::LanguageCount];        //
+        charon::loadhandle_t       mPoolLoads[charon::enums::LanguageCount];          // Async loads of pools, valid while mPoolLoading
+        bool                       mPoolLoading[charon::enums::LanguageCount];        //
+        u32                        mBytes[charon::enums::LanguageCount];              // Of each loaded table
+        u64                        mLastUsed[charon::enums::LanguageCount];           // update() count when last current, requested or prefetched
+        u64                        mRetired[charon::enums::LanguageCount];            // update() count when it stopped being the current language
+        void* volatile             mCurrent;                                          // The text_t of the current language, read by getText on any thread
+        s32 volatile               mCurrentLanguage;                                  // ELanguage of mCurrent
+        charon::enums::ELanguage   mRequested;                                        // Switch when loaded, LanguageInvalid when none
+        u64                        mBudget;                                           //
+        u64                        mResidentBytes;                                    //
+        u64                        mUpdates;                                          // Calls of update()
+        mutable charon::strcache_t mCache;                                            // getText decodes through it
     };
 
 }  // namespace ncore
@@ -0,0 +1,58 @@
+#ifndef __CHARON_LZ_H__
+#define __CHARON_LZ_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+namespace ncore
+{
+    namespace charon
+    {
+        // A byte oriented LZ77 block codec (LZ4 style sequences) that favours decode speed.
+        //
+        // Compressed datafile layout, this is what an archive entry flagged with file_t::isCompressed holds:
+        //   u32:             Magic 'CLZ1'
+        //   u32:             Uncompressed size
+        //   u32:             Block size (uncompressed bytes per block, the last block can be smaller)
+        //   u32:             Number of blocks
+        //   u32[NumBlocks]:  Compressed size of each block, bit 31 set means the block is stored as-is
+        //   byte[]:          Block data
+        // End
+        namespace nlz
+        {
+            static const u32 c_magic            = 0x315A4C43;  // 'CLZ1'
+            static const u32 c_default_block    = 64 * 1024;
+            static const u32 c_block_stored_bit = 0x80000000;
+
+            struct header_t
+            {
+                u32 mMagic;
+                u32 mUncompressedSize;
+                u32 mBlockSize;
+                u32 mNumBlocks;
+
+                // In u64, a corrupt header must not wrap around to a small size
+                inline bool       isValid() const { return mMagic == c_magic && mBlockSize > 0 && (u64)mNumBlocks == (((u64)mUncompressedSize + mBlockSize - 1) / mBlockSize); }
+                inline u64        headerSize() const { return (u64)sizeof(header_t) + (u64)mNumBlocks * sizeof(u32); }
+                inline u32 const* blockSizes() const { return (u32 const*)(this + 1); }
+                inline u32        blockCompressedSize(u32 block) const { return blockSizes()[block] & ~c_block_stored_bit; }
+                inline bool       blockIsStored(u32 block) const { return (blockSizes()[block] & c_block_stored_bit) != 0; }
+                inline u32        blockUncompressedSize(u32 block) const { return (block + 1) < mNumBlocks ? mBlockSize : (mUncompressedSize - block * mBlockSize); }
+            };
+
+            // Single block, returns the number of bytes written or -1 when dst is too small / the input is corrupt
+            u32 compress_bound(u32 srcSize);
+            s32 compress_block(byte const* src, u32 srcSize, byte* dst, u32 dstCapacity);
+            s32 decompress_block(byte const* src, u32 srcSize, byte* dst, u32 dstSize);
+
+            // Whole datafile in the blocked layout above, used by tools that build archives
+            u32 compress_file_bound(u32 srcSize, u32 blockSize = c_default_block);
+            s32 compress_file(byte const* src, u32 srcSize, byte* dst, u32 dstCapacity, u32 blockSize = c_default_block);
+            s32 decompress_file(byte const* src, u32 srcSize, byte* dst, u32 dstSize);
+
+        }  // namespace nlz
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_LZ_H__
@@ -0,0 +1,197 @@
+#ifndef __CHARON_PLATFORM_H__
+#define __CHARON_PLATFORM_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#if defined(_MSC_VER)
+#    include <intrin.h>
+#endif
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace nplatform
+        {
+            // A read-only view of a whole file mapped into the address space.
+            // The OS page cache backs the memory, nothing is copied on open.
+            struct filemap_t
+            {
+                inline filemap_t()
+                    : mFile(nullptr)
+                    , mMapping(nullptr)
+                    , mData(nullptr)
+                    , mSize(0)
+                {
+                }
+
+                inline bool        isValid() const { return mData != nullptr; }
+                inline bool        contains(void const* ptr) const { return (byte const*)ptr >= mData && (byte const*)ptr < (mData + mSize); }
+                inline byte const* data() const { return mData; }
+                inline u64         size() const { return mSize; }
+
+                void* mFile;     // OS file handle (Windows only)
+                void* mMapping;  // OS mapping handle (Windows only)
+                byte* mData;
+                u64   mSize;
+            };
+
+            bool filemap_open(const char* filename, filemap_t& map);
+            void filemap_close(filemap_t& map);
+            void filemap_willneed(filemap_t const& map, u64 offset, u64 size);  // Hint the OS to start paging in a range
+
+            // A file opened for positional reads, there is no shared file position so
+            // any number of threads can read from the same handle at the same time.
+            struct fileio_t
+            {
+                inline fileio_t()
+                    : mHandle(nullptr)
+                    , mSize(0)
+                {
+                }
+
+                inline bool isValid() const { return mHandle != nullptr; }
+                inline u64  size() const { return mSize; }
+
+                void* mHandle;
+                u64   mSize;
+            };
+
+            bool fileio_open(const char* filename, fileio_t& file);
+            void fileio_close(fileio_t& file);
+            s64  fileio_pread(fileio_t const& file, u64 offset, void* destination, u64 size);  // Returns number of bytes read, -1 on error
+
+            // Size, last write time and identity (inode, file index) of a file folded into one value that changes
+            // when the file is rewritten in place or replaced by a rename, 0 when the file does not exist
+            u64 file_stamp(const char* filename);
+
+            // Threads and blocking synchronization, the storage is opaque and big enough for every platform
+            typedef void (*thread_fn)(void* arg);
+
+            struct thread_t
+            {
+                inline thread_t()
+                    : mHandle(nullptr)
+                {
+                }
+                void* mHandle;
+            };
+
+            struct mutex_t
+            {
+                u64 mStorage[8];
+            };
+
+            struct cond_t
+            {
+                u64 mStorage[8];
+            };
+
+            bool thread_create(thread_t& thread, thread_fn func, void* arg);
+            void thread_join(thread_t& thread);
+            void thread_yield();
+            s32  thread_hardware_concurrency();
+
+            u64 clock_ns();  // Monotonic clock in nanoseconds, for measuring intervals
+
+            void mutex_init(mutex_t& mutex);
+            void mutex_destroy(mutex_t& mutex);
+            void mutex_lock(mutex_t& mutex);
+            void mutex_unlock(mutex_t& mutex);
+
+            void cond_init(cond_t& cond);
+            void cond_destroy(cond_t& cond);
+            void cond_wait(cond_t& cond, mutex_t& mutex);
+            void cond_signal(cond_t& cond);
+            void cond_broadcast(cond_t& cond);
+
+            class scoped_lock_t
+            {
+            public:
+                inline scoped_lock_t(mutex_t& mutex)
+                    : mMutex(mutex)
+                {
+                    mutex_lock(mMutex);
+                }
+                inline ~scoped_lock_t() { mutex_unlock(mMutex); }
+
+            private:
+                mutex_t& mMutex;
+            };
+
+            // Atomics, loads have acquire and stores have release semantics
+#if defined(_MSC_VER)
+            inline void* atomic_load(void* volatile const* ptr)
+            {
+                void* value = *ptr;
+                _ReadWriteBarrier();
+                return value;
+            }
+            inline void atomic_store(void* volatile* ptr, void* value)
+            {
+                _ReadWriteBarrier();
+                *ptr = value;
+            }
+            inline bool atomic_cas(void* volatile* ptr, void* expected, void* desired) { return _InterlockedCompareExchangePointer(ptr, desired, expected) == expected; }
+            inline s32  atomic_load(s32 volatile const* ptr)
+            {
+                s32 value = *ptr;
+                _ReadWriteBarrier();
+                return value;
+            }
+            inline void atomic_store(s32 volatile* ptr, s32 value)
+            {
+                _ReadWriteBarrier();
+                *ptr = value;
+            }
+            inline bool atomic_cas(s32 volatile* ptr, s32 expected, s32 desired) { return _InterlockedCompareExchange((long volatile*)ptr, desired, expected) == expected; }
+            inline s32  atomic_add(s32 volatile* ptr, s32 value) { return _InterlockedExchangeAdd((long volatile*)ptr, value) + value; }
+            inline u64  atomic_load(u64 volatile const* ptr)
+            {
+                u64 value = *ptr;
+                _ReadWriteBarrier();
+                return value;
+            }
+            inline bool atomic_cas(u64 volatile* ptr, u64 expected, u64 desired) { return (u64)_InterlockedCompareExchange64((__int64 volatile*)ptr, (__int64)desired, (__int64)expected) == expected; }
+            inline u64  atomic_add(u64 volatile* ptr, u64 value) { return (u64)_InterlockedExchangeAdd64((__int64 volatile*)ptr, (__int64)value) + value; }
+#else
+            inline void* atomic_load(void* volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+            inline void  atomic_store(void* volatile* ptr, void* value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+            inline bool  atomic_cas(void* volatile* ptr, void* expected, void* desired) { return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+            inline s32   atomic_load(s32 volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+            inline void  atomic_store(s32 volatile* ptr, s32 value) { __atomic_store_n(ptr, value, __ATOMIC_RELEASE); }
+            inline bool  atomic_cas(s32 volatile* ptr, s32 expected, s32 desired) { return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+            inline s32   atomic_add(s32 volatile* ptr, s32 value) { return __atomic_add_fetch(ptr, value, __ATOMIC_ACQ_REL); }
+            inline u64   atomic_load(u64 volatile const* ptr) { return __atomic_load_n(ptr, __ATOMIC_ACQUIRE); }
+            inline bool  atomic_cas(u64 volatile* ptr, u64 expected, u64 desired) { return __atomic_compare_exchange_n(ptr, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE); }
+            inline u64   atomic_add(u64 volatile* ptr, u64 value) { return __atomic_add_fetch(ptr, value, __ATOMIC_ACQ_REL); }
+#endif
+
+            // Hint the CPU to bring the cache line holding ptr in, for reads and writes that follow soon
+#if defined(_MSC_VER) && (defined(_M_ARM64) || defined(_M_ARM))
+            inline void prefetch(void const* ptr) { __prefetch(ptr); }
+#elif defined(_MSC_VER)
+            inline void prefetch(void const* ptr) { _mm_prefetch((char const*)ptr, _MM_HINT_T0); }
+#else
+            inline void prefetch(void const* ptr) { __builtin_prefetch(ptr, 1, 3); }
+#endif
+
+            // Index of the lowest set bit, value must not be 0
+#if defined(_MSC_VER)
+            inline u32 lowest_bit(u32 value)
+            {
+                unsigned long index;
+                _BitScanForward(&index, value);
+                return (u32)index;
+            }
+#else
+            inline u32 lowest_bit(u32 value) { return (u32)__builtin_ctz(value); }
+#endif
+
+        }  // namespace nplatform
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_PLATFORM_H__
@@ -0,0 +1,196 @@
+#ifndef __CHARON_STRPOOL_H__
+#define __CHARON_STRPOOL_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#include "charon/c_gamedata.h"
+#include "charon/c_hashindex.h"
+#include "charon/c_lz.h"
+#include "charon/c_platform.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace charon
+    {
+        // The compact localization format, an alternative to strtable_t when many languages are resident.
+        //
+        // A string pool datafile holds the unique strings of a set of languages: a string that is the same in
+        // several languages (names, numbers, text that is not translated) or that repeats within a language
+        // is stored once. Every string is a varint byte length, a varint character length, the UTF-8 bytes
+        // and a terminating 0. Strings are in groups of GroupSize, a sparse index holds the block and the
+        // offset in the block where every group starts, so a string is found by skipping at most
+        // GroupSize - 1 strings. Groups are packed into blocks of about mBlockSize bytes (at most 64 KB),
+        // a block is either stored as-is and used in-place or nlz compressed and decoded through a strcache_t.
+        struct strpool_t
+        {
+            enum
+            {
+                Magic     = 0x50525453,  // 'STRP'
+                GroupSize = 16,
+            };
+
+            struct block_t
+            {
+                u32 mOffset;            // From the start of the pool
+                u32 mSize;              // Stored size, nlz::c_block_stored_bit is set when the block is not compressed
+                u32 mUncompressedSize;  //
+            };
+
+            inline strpool_t() {}
+            inline bool           isValid() const { return mMagic == Magic; }
+            inline u32            size() const { return mNumStrings; }
+            inline u32            numBlocks() const { return mNumBlocks; }
+            inline block_t const& block(u32 b) const { return ((block_t const*)((byte const*)this + mBlocksOffset))[b]; }
+            inline u32            blockOf(u32 id) const { return ((u32 const*)((byte const*)this + mGroupsOffset))[id / GroupSize] >> 16; }
+            inline byte const*    stored(u32 b) const { return (byte const*)this + block(b).mOffset; }  // Data of the block as it is in the pool
+            inline bool           isStored(u32 b) const { return (block(b).mSize & nlz::c_block_stored_bit) != 0; }
+            u32                   bytes() const;  // Return the size of the pool including its blocks
+
+            // The string with this id from the uncompressed data of its block
+            string_t str(u32 id, byte const* blockData) const;
+
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+        protected:
+            friend class strpoolbuilder_t;
+
+            u32 mMagic;         // 'STRP'
+            u32 mNumStrings;    //
+            u32 mNumBlocks;     //
+            u32 mBlockSize;     // Uncompressed size that a block grows to before the next one starts
+            u32 mGroupsOffset;  // u32[(mNumStrings + GroupSize - 1) / GroupSize], block << 16 | offset in the block
+            u32 mBlocksOffset;  // block_t[mNumBlocks]
+        };
+
+        // The strings of one language in the compact format, a datafile that refers to its strpool_t. Key hashes
+        // and the index are those of strtable_t, the pool id of every string is a zigzag varint delta to the id
+        // of the previous string, which is mostly 1 when the pool is built in the order of the strings. For
+        // every group of GroupSize strings a checkpoint holds the id before the group and the offset of its
+        // first delta.
+        struct strlang_t
+        {
+            enum
+            {
+                Magic = 0x4C525453,  // 'STRL'
+            };
+
+            inline strlang_t() {}
+            inline bool                         isValid() const { return mMagic == Magic; }
+            inline s32                          size() const { return mNumStrings; }
+            inline datafile_t<strpool_t> const& pool() const { return mPool; }
+            inline u32                          hash(u32 index) const { return array(mHashesOffset)[index]; }
+            inline s32                          find(u32 hash) const { return strtable_t::s_find(array(mHashesOffset), array(mIndexOffset), mIndexSize, hash); }
+            u32                                 id(u32 index) const;  // Return the pool id of the string
+            u32                                 bytes() const;        // Return the size of the datafile
+
+            DCORE_CLASS_PLACEMENT_NEW_DELETE
+        protected:
+            friend class strpoolbuilder_t;
+
+            inline u32 const* array(u32 offset) const { return (u32 const*)((byte const*)this + offset); }
+
+            u32                   mMagic;              // 'STRL'
+            u32                   mNumStrings;         //
+            datafile_t<strpool_t> mPool;               //
+            u32                   mHashesOffset;       // u32[mNumStrings]
+            u32                   mIndexSize;          // As strtable_t
+            u32                   mIndexOffset;        // u32[mIndexSize]
+            u32                   mCheckpointsOffset;  // u32[2 * number of groups], id before the group and offset of its first delta
+            u32                   mIdsOffset;          // Varint deltas
+            u32                   mIdsSize;            // Bytes
+        };
+
+        // A small LRU of decoded blocks of compressed pools, shared by the threads that read text. An evicted
+        // block is freed only after `grace` more calls of update(), so text from the cache lives as long as the
+        // text of a language that was switched away from. update() belongs to one thread, str() can be called
+        // from any thread.
+        class strcache_t
+        {
+        public:
+            strcache_t();
+
+            void setup(alloc_t* allocator, u32 maxBlocks, u64 grace);
+            void teardown();
+
+            string_t str(strpool_t const* pool, u32 id);  // Empty when the block can not be decoded
+            void     update();                            // Free evicted blocks that have been out of the cache long enough
+            void     forget(strpool_t const* pool);       // Before a pool is unloaded, evict its blocks
+
+            u64 decodes() const { return mDecodes; }  // Number of blocks decoded, the misses of the cache
+            u64 bytes() const { return mBytes; }      // Decoded blocks in the cache and waiting to be freed
+
+        private:
+            struct decoded_t
+            {
+                decoded_t* mNext;     // Evicted blocks that are waiting to be freed
+                u64        mEvicted;  // Update of the eviction
+                u32        mSize;     // Of the data that follows
+                u32        mPadding;  //
+            };
+
+            struct entry_t
+            {
+                strpool_t const* mPool;
+                u32              mBlock;
+                u32              mPadding;
+                u64              mLastUse;
+                decoded_t*       mDecoded;
+            };
+
+            void evict(entry_t& entry);
+
+            alloc_t*           mAllocator;
+            entry_t*           mEntries;    // mMaxBlocks, mPool is nullptr when the entry is free
+            u32                mMaxBlocks;  //
+            u64                mGrace;      // Updates that an evicted block is kept
+            u64                mUpdates;    // Calls of update()
+            u64                mUses;       // Clock of the LRU
+            u64                mDecodes;    //
+            u64                mBytes;      //
+            decoded_t*         mEvicted;    // Newest first
+            nplatform::mutex_t mMutex;      //
+        };
+
+        // For the tools that write localization, the unique strings of all languages. add() every string of
+        // every language (in the order of the strings of a language, the ids of a language then are mostly
+        // consecutive), keep the text alive until the pool is written.
+        class strpoolbuilder_t
+        {
+        public:
+            strpoolbuilder_t();
+
+            void setup(alloc_t* allocator, u32 maxStrings);
+            void teardown();
+
+            u32 add(char const* str, u32 byteLength, u32 charLength);  // Return the pool id, identical strings get the same id, ~0 when full
+            u32 size() const { return mNumStrings; }
+
+            // Write the pool, blocks (blockSize is at most 64 KB) are compressed when that makes them smaller.
+            // Return the size written or -1 when dstCapacity is too small or the pool has more than 64K blocks.
+            u32 pool_bound(u32 blockSize) const;
+            s32 write_pool(byte* dst, u32 dstCapacity, u32 blockSize, bool compress) const;
+
+            // Write the strlang_t of a language, ids as returned by add(). Of two strings with the same key hash the
+            // first is found. Return the size written or -1 when dstCapacity is too small.
+            static u32 s_language_bound(u32 numStrings);
+            static s32 s_write_language(u32 const* hashes, u32 const* ids, u32 numStrings, fileid_t pool, byte* dst, u32 dstCapacity);
+
+        private:
+            u32 layout(u32 blockSize, u32* groups, u32* blockSizes, u32& total) const;  // Return the number of blocks
+
+            alloc_t*     mAllocator;
+            char const** mStrings;
+            u32*         mByteLengths;
+            u32*         mCharLengths;
+            u32          mNumStrings;
+            u32          mMaxStrings;
+            hashindex_t  mIndex;  // Hash of the text to pool id
+        };
+
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_STRPOOL_H__
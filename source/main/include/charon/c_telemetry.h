@@ -0,0 +1,129 @@
+#ifndef __CHARON_TELEMETRY_H__
+#define __CHARON_TELEMETRY_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#include "charon/c_platform.h"
+
+namespace ncore
+{
+    class alloc_t;
+
+    namespace charon
+    {
+        // Counters and per-phase timing of the archive loader, plus an optional trace of every timed phase.
+        // Counters and timing are always collected, they are a few atomic adds per load. The trace is a ring
+        // buffer that keeps the most recent events, it is only written between start_trace and stop_trace
+        // and can be dumped as a Chrome trace (chrome://tracing, Perfetto).
+        class telemetry_t
+        {
+        public:
+            enum EPhase
+            {
+                PhaseQueue      = 0,  // An async load waiting in the queue
+                PhaseIo         = 1,  // Reading from an archive
+                PhaseDecompress = 2,  // Decoding a chunk of a compressed datafile
+                PhasePatch      = 3,  // Resolving the pointers of a dataunit
+                PhaseCount      = 4,
+            };
+
+            enum ECounter
+            {
+                CounterLoads     = 0,  // Datafile and dataunit loads, every one is either a hit or a miss
+                CounterHits      = 1,  // Served by data that was resident or being loaded by another thread
+                CounterMisses    = 2,  // Loaded from an archive, in-place from a mapping or shared with a duplicate
+                CounterReads     = 3,  // Reads from archives
+                CounterBytesRead = 4,  // As stored in the archive, compressed data counts compressed
+                CounterEvictions = 5,  // Resident data released to stay within the residency budget
+                CounterCorrupt   = 6,  // Loads that failed verification against the HDB hash
+                CounterCount     = 7,
+            };
+
+            struct stats_t
+            {
+                u64 mCounters[CounterCount];
+                u64 mPhaseCount[PhaseCount];  // Number of timed intervals
+                u64 mPhaseNs[PhaseCount];     // Total time
+                u64 mPhaseMaxNs[PhaseCount];  // Longest single interval, where load hitches show up
+            };
+
+            struct event_t
+            {
+                u64 mBegin;     // nplatform::clock_ns()
+                u64 mDuration;  //
+                u32 mThread;    // Small id per thread, in order of first use
+                u32 mPhase;     // EPhase
+                u32 mArchive;   // File of the load that the event is part of, ~0 when unknown
+                u32 mFile;      //
+            };
+
+            // An access log file, the file id of every load that read a file from an archive (a miss) in the
+            // order of the loads, mCount {u32 archive index, u32 file index} pairs follow the header. This is
+            // the input of charon_layout, which orders the data of an archive by first access.
+            struct accesslog_t
+            {
+                enum
+                {
+                    Magic   = 0x4C414843,  // 'CHAL'
+                    Version = 1,
+                };
+
+                u32 mMagic;
+                u32 mVersion;
+                u32 mCount;
+                u32 mDropped;  // Misses that did not fit in the log
+            };
+
+            telemetry_t();
+
+            void setup(alloc_t* allocator);
+            void teardown();
+
+            inline void count(ECounter counter, u64 n = 1) { nplatform::atomic_add(&mCounters[counter], n); }
+            void        record(EPhase phase, u64 begin, u64 end, u32 archiveIndex = ~0u, u32 fileIndex = ~0u);
+            void        stats(stats_t& out) const;
+            void        reset();
+
+            // A trace keeps the last maxEvents events (rounded up to a power of two), size it well above the
+            // number of events of a frame: when the ring wraps around while an event is being written another
+            // thread can overwrite it halfway. Starting a trace of another size than the previous one must not
+            // overlap with loads, stop the trace before dumping it.
+            bool start_trace(u32 maxEvents);
+            void stop_trace();
+            bool dump_trace(const char* filename) const;
+
+            // The access log keeps the first maxEntries misses after start_access_log, stop it before dumping
+            inline void access(u32 archiveIndex, u32 fileIndex)
+            {
+                if (nplatform::atomic_load(&mLogging) != 0)
+                    log(archiveIndex, fileIndex);
+            }
+            bool start_access_log(u32 maxEntries);
+            void stop_access_log();
+            bool dump_access_log(const char* filename) const;
+
+        private:
+            void log(u32 archiveIndex, u32 fileIndex);
+
+            alloc_t*     mAllocator;
+            u64 volatile mCounters[CounterCount];
+            u64 volatile mPhaseCount[PhaseCount];
+            u64 volatile mPhaseNs[PhaseCount];
+            u64 volatile mPhaseMaxNs[PhaseCount];
+            event_t*     mEvents;       // Ring buffer, nullptr until the first trace
+            u32          mCapacity;     // Power of two
+            s32 volatile mTracing;      // Events are recorded while 1
+            u64 volatile mNextEvent;    // Total number of events recorded, the ring holds the last mCapacity
+            u64          mTraceStart;   // clock_ns() of start_trace, the time origin of the dump
+            u32*         mLog;          // Pairs of archive and file index, nullptr until the first access log
+            u32          mLogCapacity;  // Entries
+            s32 volatile mLogging;      // Misses are logged while 1
+            u64 volatile mLogNext;      // Misses since start_access_log, entries beyond mLogCapacity are dropped
+        };
+
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_TELEMETRY_H__
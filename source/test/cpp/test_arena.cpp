@@ -0,0 +1,248 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_platform.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(arena)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_arena";
+        static const u32   s_numFiles = 8;
+        static const u32   s_fileSize = 1000;
+
+        // Counts the allocations that are alive, so that a test can see everything of an arena go back. With a
+        // limit set, allocations larger than the limit fail.
+        class countalloc_t : public alloc_t
+        {
+        public:
+            countalloc_t(alloc_t* allocator)
+                : mAllocator(allocator)
+                , mLive(0)
+                , mLimit(0)
+            {
+            }
+
+            s32  live() const { return charon::nplatform::atomic_load(&mLive); }
+            void limit(u32 size) { mLimit = size; }
+
+        protected:
+            virtual void* v_allocate(u32 size, u32 alignment)
+            {
+                if (mLimit != 0 && size > mLimit)
+                    return nullptr;
+                charon::nplatform::atomic_add(&mLive, 1);
+                return mAllocator->allocate(size, alignment);
+            }
+
+            virtual void v_deallocate(void* ptr)
+            {
+                if (ptr == nullptr)
+                    return;
+                charon::nplatform::atomic_add(&mLive, -1);
+                mAllocator->deallocate(ptr);
+            }
+
+            alloc_t*     mAllocator;
+            s32 volatile mLive;
+            u32          mLimit;
+        };
+
+        struct build_t
+        {
+            byte                      mData[s_numFiles][s_fileSize];
+            charon::ntest::testfile_t mFiles[s_numFiles];
+        };
+
+        // The odd files are compressed, every file is loaded and unloaded once so that the slot pages exist
+        static charon::archive_t* setup(alloc_t* allocator, build_t* build, charon::archive_t::EBackend backend)
+        {
+            charon::archive_t::config_t config;
+            config.mBackend         = backend;
+            config.mResidencyBudget = 1 << 20;
+            charon::archive_t::s_setup(allocator, 4, 2, config);
+
+            for (u32 f = 0; f < s_numFiles; ++f)
+            {
+                charon::ntest::fill(build->mData[f], s_fileSize, f);
+                build->mFiles[f].mData     = build->mData[f];
+                build->mFiles[f].mSize     = s_fileSize;
+                build->mFiles[f].mCompress = (f & 1) != 0;
+            }
+            CHECK_TRUE(charon::ntest::mount_files(allocator, s_path, 1, build->mFiles, s_numFiles));
+
+            charon::archive_t* ar = charon::archive_t::s_instance;
+
+            for (u32 f = 0; f < s_numFiles; ++f)
+            {
+                void* data = ar->loader()->load_datafile(charon::fileid_t(1, f));
+                ar->loader()->unload_datafile(charon::fileid_t(1, f), data);
+            }
+            ar->set_residency_budget(0);
+            ar->set_residency_budget(1 << 20);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            return ar;
+        }
+
+        static void teardown()
+        {
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+        }
+
+        UNITTEST_TEST(release)
+        {
+            countalloc_t       counter(Allocator);
+            build_t*           build    = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar       = setup(&counter, build, charon::archive_t::BackendFileRead);
+            s32 const          baseline = counter.live();
+
+            charon::archive_t::arena_t* arena  = ar->create_arena(4096);
+            charon::archive_loader_t*   loader = ar->loader(arena);
+            void*                       data[s_numFiles];
+            for (u32 f = 0; f < s_numFiles; ++f)
+            {
+                data[f] = loader->load_datafile(charon::fileid_t(1, f));
+                CHECK_NOT_NULL(data[f]);
+                CHECK_EQUAL(0, memcmp(data[f], build->mData[f], s_fileSize));
+            }
+            CHECK_TRUE(counter.live() > baseline);
+
+            // Arena data does not count against the residency budget and stays until the arena is released
+            CHECK_EQUAL(0, ar->resident_bytes());
+            for (u32 f = 0; f < s_numFiles; ++f)
+                loader->unload_datafile(charon::fileid_t(1, f), data[f]);
+            ar->set_residency_budget(0);
+            CHECK_NOT_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 0)));
+
+            // A file that is resident in an arena is not loaded again by another loader
+            void* again = ar->loader()->load_datafile(charon::fileid_t(1, 3));
+            CHECK_TRUE(again == ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 3)));
+            ar->loader()->unload_datafile(charon::fileid_t(1, 3), again);
+
+            ar->release_arena(arena);
+            for (u32 f = 0; f < s_numFiles; ++f)
+                CHECK_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, f)));
+            CHECK_EQUAL(baseline, counter.live());
+
+            teardown();
+            CHECK_EQUAL(0, counter.live());
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(owners)
+        {
+            countalloc_t       counter(Allocator);
+            build_t*           build    = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar       = setup(&counter, build, charon::archive_t::BackendFileRead);
+            s32 const          baseline = counter.live();
+
+            // Data that still has owners keeps a released arena alive until it is unloaded
+            charon::archive_t::arena_t* arena  = ar->create_arena(4096);
+            charon::archive_loader_t*   loader = ar->loader(arena);
+            void*                       held   = loader->load_datafile(charon::fileid_t(1, 1));
+            void*                       loose  = loader->load_datafile(charon::fileid_t(1, 2));
+            loader->unload_datafile(charon::fileid_t(1, 2), loose);
+            ar->release_arena(arena);
+            CHECK_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 2)));
+            CHECK_TRUE(held == ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 1)));
+            CHECK_EQUAL(0, memcmp(held, build->mData[1], s_fileSize));
+            CHECK_TRUE(counter.live() > baseline);
+
+            ar->loader()->unload_datafile(charon::fileid_t(1, 1), held);
+            CHECK_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 1)));
+            CHECK_EQUAL(baseline, counter.live());
+
+            teardown();
+            CHECK_EQUAL(0, counter.live());
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(exhausted)
+        {
+            countalloc_t       counter(Allocator);
+            build_t*           build = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar    = setup(&counter, build, charon::archive_t::BackendFileRead);
+
+            // A block the allocator can not provide fails the load, stored, compressed and batched alike
+            charon::archive_t::arena_t* arena    = ar->create_arena(4096);
+            charon::archive_loader_t*   loader   = ar->loader(arena);
+            s32 const                   baseline = counter.live();
+            counter.limit(4096);
+            CHECK_NULL(loader->load_datafile(charon::fileid_t(1, 0)));
+            CHECK_NULL(loader->load_datafile(charon::fileid_t(1, 1)));
+            charon::fileid_t const batch[] = {charon::fileid_t(1, 2), charon::fileid_t(1, 4), charon::fileid_t(1, 6)};
+            void*                  data[s_numFiles];
+            loader->load_datafiles(batch, 3, data);
+            for (u32 i = 0; i < 3; ++i)
+                CHECK_NULL(data[i]);
+            for (u32 f = 0; f < s_numFiles; ++f)
+                CHECK_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, f)));
+            CHECK_EQUAL(baseline, counter.live());
+
+            // The failed loads leave nothing behind, the same files load once there is memory
+            counter.limit(0);
+            for (u32 f = 0; f < 3; ++f)
+            {
+                data[f] = loader->load_datafile(charon::fileid_t(1, f));
+                CHECK_NOT_NULL(data[f]);
+                CHECK_EQUAL(0, memcmp(data[f], build->mData[f], s_fileSize));
+                loader->unload_datafile(charon::fileid_t(1, f), data[f]);
+            }
+            ar->release_arena(arena);
+            CHECK_EQUAL(baseline - 1, counter.live());
+
+            teardown();
+            CHECK_EQUAL(0, counter.live());
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(mapped)
+        {
+            countalloc_t       counter(Allocator);
+            build_t*           build = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar    = setup(&counter, build, charon::archive_t::BackendMemoryMapped);
+
+            // Uncompressed files are used in-place and take no arena memory, compressed files are decoded into it
+            charon::archive_t::arena_t* arena    = ar->create_arena(4096);
+            charon::archive_loader_t*   loader   = ar->loader(arena);
+            s32 const                   baseline = counter.live();
+            void*                       data[s_numFiles];
+            for (u32 f = 0; f < s_numFiles; f += 2)
+            {
+                data[f] = loader->load_datafile(charon::fileid_t(1, f));
+                CHECK_EQUAL(0, memcmp(data[f], build->mData[f], s_fileSize));
+            }
+            CHECK_EQUAL(baseline, counter.live());
+            for (u32 f = 1; f < s_numFiles; f += 2)
+            {
+                data[f] = loader->load_datafile(charon::fileid_t(1, f));
+                CHECK_EQUAL(0, memcmp(data[f], build->mData[f], s_fileSize));
+            }
+            CHECK_TRUE(counter.live() > baseline);
+
+            for (u32 f = 0; f < s_numFiles; ++f)
+                loader->unload_datafile(charon::fileid_t(1, f), data[f]);
+            ar->release_arena(arena);
+            CHECK_EQUAL(baseline - 1, counter.live());
+
+            teardown();
+            CHECK_EQUAL(0, counter.live());
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
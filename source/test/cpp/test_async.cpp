@@ -0,0 +1,227 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_platform.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(async)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_async";
+        static const u32   s_numFiles = 4;
+        static const u32   s_fileSize = 1000;
+        static const u32   s_gateSize = 3000;  // File 0, the only allocation of this size
+
+        struct build_t
+        {
+            byte mGate[s_gateSize];
+            byte mData[s_numFiles][s_fileSize];
+        };
+
+        // File 0 is the gate file, file 3 is compressed
+        static charon::archive_t* setup(charon::ntest::gatealloc_t* gate, build_t* build, s32 numIoThreads, s32 maxAsyncLoads)
+        {
+            charon::archive_t::config_t config;
+            config.mResidencyBudget = 1 << 20;
+            config.mNumIoThreads    = numIoThreads;
+            config.mMaxAsyncLoads   = maxAsyncLoads;
+            charon::archive_t::s_setup(gate, 4, 2, config);
+
+            charon::ntest::fill(build->mGate, s_gateSize, 100);
+            charon::ntest::testfile_t files[s_numFiles];
+            files[0].mData     = build->mGate;
+            files[0].mSize     = s_gateSize;
+            files[0].mCompress = false;
+            for (u32 f = 1; f < s_numFiles; ++f)
+            {
+                charon::ntest::fill(build->mData[f], s_fileSize, f);
+                files[f].mData     = build->mData[f];
+                files[f].mSize     = s_fileSize;
+                files[f].mCompress = f == 3;
+            }
+            CHECK_TRUE(charon::ntest::mount_files(gate, s_path, 1, files, s_numFiles));
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown(charon::archive_t* ar)
+        {
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+        }
+
+        static bool finish(charon::archive_loader_t* loader, charon::loadhandle_t const& handle)
+        {
+            u64 const until = charon::nplatform::clock_ns() + 5000000000ull;
+            while (!loader->is_done(handle))
+            {
+                if (charon::nplatform::clock_ns() > until)
+                    return false;
+                charon::nplatform::thread_yield();
+            }
+            return true;
+        }
+
+        static void unload(charon::archive_loader_t* loader, charon::fileid_t fileid)
+        {
+            void* data = loader->get_datafile_ptr<void>(fileid);
+            CHECK_NOT_NULL(data);
+            loader->unload_datafile(fileid, data);
+        }
+
+        // Opens the gate a moment after it started, by then the test thread is waiting on the held load
+        static void s_open_later(void* arg)
+        {
+            u64 const until = charon::nplatform::clock_ns() + 50000000ull;
+            while (charon::nplatform::clock_ns() < until)
+                charon::nplatform::thread_yield();
+            ((charon::ntest::gatealloc_t*)arg)->open();
+        }
+
+        UNITTEST_TEST(inline_load)
+        {
+            // Without I/O threads a load completes before load_datafile_async returns
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 0, 4);
+            charon::archive_loader_t*  loader = ar->loader();
+
+            charon::loadhandle_t const handle = loader->load_datafile_async(charon::fileid_t(1, 3));
+            CHECK_EQUAL(-1, handle.m_job);
+            CHECK_TRUE(loader->is_done(handle));
+            CHECK_FALSE(loader->cancel(handle));
+            void* data = loader->wait(handle);
+            CHECK_NOT_NULL(data);
+            CHECK_EQUAL(0, memcmp(data, build->mData[3], s_fileSize));
+            unload(loader, charon::fileid_t(1, 3));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(queue_full)
+        {
+            // With every request in use a load completes inline, also while the I/O thread is busy
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 1, 1);
+            charon::archive_loader_t*  loader = ar->loader();
+
+            gate.arm(s_gateSize);
+            charon::loadhandle_t const held = loader->load_datafile_async(charon::fileid_t(1, 0));
+            CHECK_TRUE(gate.held());
+            charon::loadhandle_t const full = loader->load_datafile_async(charon::fileid_t(1, 1));
+            CHECK_EQUAL(-1, full.m_job);
+            CHECK_TRUE(loader->is_done(full));
+            CHECK_EQUAL(0, memcmp(loader->get_datafile_ptr<void>(charon::fileid_t(1, 1)), build->mData[1], s_fileSize));
+            CHECK_FALSE(loader->is_done(held));
+
+            gate.open();
+            CHECK_TRUE(finish(loader, held));
+            unload(loader, charon::fileid_t(1, 0));
+            unload(loader, charon::fileid_t(1, 1));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(wait_queued)
+        {
+            // Waiting on a load that is still queued loads it on the waiting thread, the I/O thread stays held
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 1, 4);
+            charon::archive_loader_t*  loader = ar->loader();
+
+            gate.arm(s_gateSize);
+            charon::loadhandle_t const held = loader->load_datafile_async(charon::fileid_t(1, 0));
+            CHECK_TRUE(gate.held());
+            charon::loadhandle_t const queued = loader->load_datafile_async(charon::fileid_t(1, 3));
+            CHECK_FALSE(loader->is_done(queued));
+
+            void* data = loader->wait(queued);
+            CHECK_NOT_NULL(data);
+            CHECK_EQUAL(0, memcmp(data, build->mData[3], s_fileSize));
+            CHECK_TRUE(loader->is_done(queued));
+            CHECK_FALSE(loader->is_done(held));
+            CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, 0)));
+
+            gate.open();
+            CHECK_TRUE(finish(loader, held));
+            unload(loader, charon::fileid_t(1, 0));
+            unload(loader, charon::fileid_t(1, 3));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(wait_started)
+        {
+            // Waiting on a load that the I/O thread is serving blocks until it is done
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 1, 4);
+            charon::archive_loader_t*  loader = ar->loader();
+
+            gate.arm(s_gateSize);
+            charon::loadhandle_t const held = loader->load_datafile_async(charon::fileid_t(1, 0));
+            CHECK_TRUE(gate.held());
+
+            charon::nplatform::thread_t opener;
+            CHECK_TRUE(charon::nplatform::thread_create(opener, s_open_later, &gate));
+            void* data = loader->wait(held);
+            CHECK_TRUE(loader->is_done(held));
+            CHECK_NOT_NULL(data);
+            CHECK_EQUAL(0, memcmp(data, build->mGate, s_gateSize));
+            charon::nplatform::thread_join(opener);
+            unload(loader, charon::fileid_t(1, 0));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(generation)
+        {
+            // A finished handle stays done when its request is reused by a later load
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 1, 1);
+            charon::archive_loader_t*  loader = ar->loader();
+
+            charon::loadhandle_t const first = loader->load_datafile_async(charon::fileid_t(1, 1));
+            CHECK_TRUE(finish(loader, first));
+
+            gate.arm(s_gateSize);
+            charon::loadhandle_t const second = loader->load_datafile_async(charon::fileid_t(1, 0));
+            CHECK_TRUE(gate.held());
+            CHECK_EQUAL(first.m_job, second.m_job);
+            CHECK_TRUE(loader->is_done(first));
+            CHECK_FALSE(loader->is_done(second));
+            CHECK_TRUE(loader->wait(first) == loader->get_datafile_ptr<void>(charon::fileid_t(1, 1)));
+
+            gate.open();
+            CHECK_TRUE(finish(loader, second));
+            CHECK_TRUE(loader->is_done(first));
+            unload(loader, charon::fileid_t(1, 0));
+            unload(loader, charon::fileid_t(1, 1));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,316 @@
+#include "ccore/c_target.h"
+#include "ccore/c_allocator.h"
+
+#include "charon/c_archive.h"
+#include "charon/c_hash.h"
+#include "charon/c_lz.h"
+#include "charon/c_platform.h"
+
+#include "test_bigfile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace ntest
+        {
+            // Every table file (.toc/.fdb/.hdb) has a single section:
+            //   u32:       NumSections (1)
+            //   section_t: {ArchiveIndex, ArchiveOffset, ItemArrayCount, ItemArrayOffset (relative to the section)}
+            //   u32:       Padding, so that the item array is 8 byte aligned
+            //   Items
+            static const u32 s_section_offset = sizeof(u32);
+            static const u32 s_items_offset   = 24;
+
+            static void s_put(FILE* f, void const* data, u32 size, bool& failed)
+            {
+                if (size > 0 && fwrite(data, 1, size, f) != size)
+                    failed = true;
+            }
+
+            static void s_put_header(FILE* f, u32 archiveIndex, u32 count, bool& failed)
+            {
+                u32 const header[6] = {1, archiveIndex, 0, count, s_items_offset - s_section_offset, 0};
+                s_put(f, header, sizeof(header), failed);
+            }
+
+            static FILE* s_create(const char* path, const char* suffix)
+            {
+                char filename[512];
+                snprintf(filename, sizeof(filename), "%s.tmp.%s", path, suffix);
+                return fopen(filename, "wb");
+            }
+
+            static void s_close(FILE* f, bool& failed)
+            {
+                if (f == nullptr)
+                    failed = true;
+                else if (fclose(f) != 0)
+                    failed = true;
+            }
+
+            static const char* const s_suffixes[] = {"gda", "toc", "fdb", "hdb"};
+
+            bool write_archive(alloc_t* allocator, const char* path, u32 archiveIndex, testfile_t const* files, u32 numFiles)
+            {
+                bool  failed = false;
+                FILE* gda    = s_create(path, "gda");
+                FILE* toc    = s_create(path, "toc");
+                FILE* fdb    = s_create(path, "fdb");
+                FILE* hdb    = s_create(path, "hdb");
+                if (gda == nullptr || toc == nullptr || fdb == nullptr || hdb == nullptr)
+                    failed = true;
+
+                if (!failed)
+                {
+                    s_put_header(toc, archiveIndex, numFiles, failed);
+                    s_put_header(fdb, archiveIndex, numFiles, failed);
+                    s_put_header(hdb, archiveIndex, numFiles, failed);
+
+                    // Data and TOC, every file starts at a multiple of 64
+                    static byte const s_zero[64] = {0};
+                    u64               gdaSize    = 0;
+                    for (u32 i = 0; i < numFiles; ++i)
+                    {
+                        testfile_t const& file   = files[i];
+                        byte const*       stored = file.mData;
+                        u32               size   = file.mSize;
+                        byte*             packed = nullptr;
+                        if (file.mCompress && size > 0)
+                        {
+                            u32 const bound = nlz::compress_file_bound(size);
+                            packed          = g_allocate_array<byte>(allocator, bound);
+                            s32 const n     = nlz::compress_file(file.mData, size, packed, bound);
+                            if (n < 0)
+                                failed = true;
+                            stored = packed;
+                            size   = n < 0 ? 0 : (u32)n;
+                        }
+
+                        u32 const padding = (u32)((64 - (gdaSize & 63)) & 63);
+                        s_put(gda, s_zero, padding, failed);
+                        gdaSize += padding;
+
+                        u32 const item[2] = {size > 0 ? ((u32)(gdaSize >> 6) | (file.mCompress ? 0x80000000 : 0)) : 0, size};
+                        u64 const hash    = size > 0 ? nhash::hash64(stored, size) : 0;
+                        s_put(toc, item, sizeof(item), failed);
+                        s_put(hdb, &hash, sizeof(hash), failed);
+                        s_put(gda, stored, size, failed);
+                        gdaSize += size;
+
+                        if (packed != nullptr)
+                            g_deallocate_array(allocator, packed);
+                    }
+                    // An archive that holds only empty files still has data
+                    if (gdaSize == 0)
+                        s_put(gda, s_zero, sizeof(s_zero), failed);
+
+                    // FDB, the offset array is followed by {u32 bytes, u32 chars, char[] with terminator} entries
+                    char name[64];
+                    u32  offset = s_items_offset + numFiles * sizeof(u32);
+                    for (u32 i = 0; i < numFiles; ++i)
+                    {
+                        snprintf(name, sizeof(name), "test/%u/file_%04u.bin", archiveIndex, i);
+                        s_put(fdb, &offset, sizeof(offset), failed);
+                        offset += (2 * sizeof(u32) + (u32)strlen(name) + 1 + 3) & ~3;
+                    }
+                    for (u32 i = 0; i < numFiles; ++i)
+                    {
+                        memset(name, 0, sizeof(name));
+                        snprintf(name, sizeof(name), "test/%u/file_%04u.bin", archiveIndex, i);
+                        u32 const length  = (u32)strlen(name);
+                        u32 const head[2] = {length, length};
+                        s_put(fdb, head, sizeof(head), failed);
+                        s_put(fdb, name, ((2 * sizeof(u32) + length + 1 + 3) & ~3) - sizeof(head), failed);
+                    }
+                }
+
+                s_close(gda, failed);
+                s_close(toc, failed);
+                s_close(fdb, failed);
+                s_close(hdb, failed);
+
+                for (s32 i = 0; i < 4 && !failed; ++i)
+                {
+                    char from[512];
+                    char to[512];
+                    snprintf(from, sizeof(from), "%s.tmp.%s", path, s_suffixes[i]);
+                    snprintf(to, sizeof(to), "%s.%s", path, s_suffixes[i]);
+                    if (rename(from, to) != 0)
+                        failed = true;
+                }
+                return !failed;
+            }
+
+            void remove_archive(const char* path)
+            {
+                for (s32 i = 0; i < 4; ++i)
+                {
+                    char filename[512];
+                    snprintf(filename, sizeof(filename), "%s.%s", path, s_suffixes[i]);
+                    remove(filename);
+                    snprintf(filename, sizeof(filename), "%s.tmp.%s", path, s_suffixes[i]);
+                    remove(filename);
+                }
+                char filename[512];
+                snprintf(filename, sizeof(filename), "%s.gpk", path);
+                remove(filename);
+            }
+
+            // Append a file at the next aligned offset of the pack
+            static void s_append(FILE* pack, const char* filename, archive_t::packheader_t::region_t& region, bool& failed)
+            {
+                static byte const s_zero[archive_t::packheader_t::Alignment] = {0};
+
+                u64 const end     = (u64)ftell(pack);
+                u64 const aligned = (end + archive_t::packheader_t::Alignment - 1) & ~(u64)(archive_t::packheader_t::Alignment - 1);
+                s_put(pack, s_zero, (u32)(aligned - end), failed);
+                region.mOffset = aligned;
+                region.mSize   = 0;
+
+                FILE* f = fopen(filename, "rb");
+                if (f == nullptr)
+                {
+                    failed = true;
+                    return;
+                }
+                byte   buffer[4096];
+                size_t n;
+                while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+                {
+                    s_put(pack, buffer, (u32)n, failed);
+                    region.mSize += n;
+                }
+                fclose(f);
+            }
+
+            bool write_pack(alloc_t* allocator, const char* path, u32 archiveIndex, testfile_t const* files, u32 numFiles)
+            {
+                if (!write_archive(allocator, path, archiveIndex, files, numFiles))
+                    return false;
+
+                char filename[512];
+                snprintf(filename, sizeof(filename), "%s.gpk", path);
+                FILE* pack = fopen(filename, "wb");
+                if (pack == nullptr)
+                    return false;
+
+                archive_t::packheader_t header;
+                memset(&header, 0, sizeof(header));
+                header.mMagic   = archive_t::packheader_t::Magic;
+                header.mVersion = archive_t::packheader_t::Version;
+
+                bool                               failed    = false;
+                archive_t::packheader_t::region_t* regions[] = {&header.mData, &header.mToc, &header.mFdb, &header.mHdb};
+                s_put(pack, &header, sizeof(header), failed);
+                for (s32 i = 0; i < 4; ++i)
+                {
+                    snprintf(filename, sizeof(filename), "%s.%s", path, s_suffixes[i]);
+                    s_append(pack, filename, *regions[i], failed);
+                    remove(filename);
+                }
+                if (fseek(pack, 0, SEEK_SET) != 0)
+                    failed = true;
+                s_put(pack, &header, sizeof(header), failed);
+                s_close(pack, failed);
+                return !failed;
+            }
+
+            s32 mount_archive(const char* path, s32 archiveIndex)
+            {
+                char filenames[4][512];
+                for (s32 i = 0; i < 4; ++i)
+                    snprintf(filenames[i], sizeof(filenames[i]), "%s.%s", path, s_suffixes[i]);
+                return archive_t::s_instance->mount(archiveIndex, filenames[0], filenames[1], filenames[2], filenames[3]);
+            }
+
+            s32 mount_layer(const char* path, s32 archiveIndex, s32 baseIndex)
+            {
+                char filenames[4][512];
+                for (s32 i = 0; i < 4; ++i)
+                    snprintf(filenames[i], sizeof(filenames[i]), "%s.%s", path, s_suffixes[i]);
+                return archive_t::s_instance->mount_overlay(archiveIndex, baseIndex, filenames[0], filenames[1], filenames[2], filenames[3]);
+            }
+
+            bool mount_files(alloc_t* allocator, const char* path, s32 archiveIndex, testfile_t const* files, u32 numFiles)
+            {
+                if (!write_archive(allocator, path, (u32)archiveIndex, files, numFiles))
+                    return false;
+                return mount_archive(path, archiveIndex) == 0;
+            }
+
+            u64 counter(telemetry_t::ECounter counter)
+            {
+                telemetry_t::stats_t stats;
+                archive_t::s_instance->stats(stats);
+                return stats.mCounters[counter];
+            }
+
+            void fill(byte* data, u32 size, u32 seed)
+            {
+                u32 state = seed * 2654435761u + 1;
+                u32 i     = 0;
+                while (i < size)
+                {
+                    state          = state * 1664525 + 1013904223;
+                    u32 const  run = 1 + ((state >> 8) & 15);
+                    byte const b   = (byte)((state >> 24) & 0x1F);
+                    for (u32 j = 0; j < run && i < size; ++j)
+                        data[i++] = b;
+                }
+            }
+
+            enum
+            {
+                GateOpen    = 0,
+                GateArmed   = 1,
+                GateHolding = 2,
+            };
+
+            static const u64 s_gate_timeout_ns = 5000000000ull;
+
+            gatealloc_t::gatealloc_t(alloc_t* allocator)
+                : mAllocator(allocator)
+                , mSize(0)
+                , mState(GateOpen)
+            {
+            }
+
+            void gatealloc_t::arm(u32 size)
+            {
+                mSize = size;
+                nplatform::atomic_store(&mState, (s32)GateArmed);
+            }
+
+            bool gatealloc_t::held()
+            {
+                u64 const until = nplatform::clock_ns() + s_gate_timeout_ns;
+                while (nplatform::atomic_load(&mState) != GateHolding)
+                {
+                    if (nplatform::clock_ns() > until)
+                        return false;
+                    nplatform::thread_yield();
+                }
+                return true;
+            }
+
+            void gatealloc_t::open() { nplatform::atomic_store(&mState, (s32)GateOpen); }
+
+            void* gatealloc_t::v_allocate(u32 size, u32 alignment)
+            {
+                if (size == mSize && nplatform::atomic_cas(&mState, (s32)GateArmed, (s32)GateHolding))
+                {
+                    while (nplatform::atomic_load(&mState) == GateHolding)
+                        nplatform::thread_yield();
+                }
+                return mAllocator->allocate(size, alignment);
+            }
+
+            void gatealloc_t::v_deallocate(void* ptr) { mAllocator->deallocate(ptr); }
+
+        }  // namespace ntest
+    }  // namespace charon
+}  // namespace ncore
@@ -0,0 +1,77 @@
+#ifndef __CHARON_TEST_BIGFILE_H__
+#define __CHARON_TEST_BIGFILE_H__
+#include "ccore/c_target.h"
+#ifdef USE_PRAGMA_ONCE
+#    pragma once
+#endif
+
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+
+namespace ncore
+{
+    namespace charon
+    {
+        namespace ntest
+        {
+            // A file of a test archive, stored nlz compressed when mCompress is set. An empty file has no TOC
+            // entry (an overlay layer then does not shadow the base file).
+            struct testfile_t
+            {
+                byte const* mData;
+                u32         mSize;
+                bool        mCompress;
+            };
+
+            // Write <path>.gda/.toc/.fdb/.hdb in the layout that archive_t::mount reads, the HDB holds content
+            // hashes (nhash::hash64 of the stored bytes). The files are written next to the old ones and renamed
+            // over them, the way build tools replace an archive for hot reload. Return false when a file could not
+            // be written.
+            bool write_archive(alloc_t* allocator, const char* path, u32 archiveIndex, testfile_t const* files, u32 numFiles);
+            void remove_archive(const char* path);
+
+            // Write the same archive as one packed file <path>.gpk (see archive_t::packheader_t), every region
+            // starts on a page. The separate files are only written on the way and are removed again.
+            bool write_pack(alloc_t* allocator, const char* path, u32 archiveIndex, testfile_t const* files, u32 numFiles);
+
+            // Mount the files of a test archive on archive_t::s_instance, return what mount returns
+            s32 mount_archive(const char* path, s32 archiveIndex);
+            s32 mount_layer(const char* path, s32 archiveIndex, s32 baseIndex);
+
+            // Write a test archive and mount it, return false when either failed
+            bool mount_files(alloc_t* allocator, const char* path, s32 archiveIndex, testfile_t const* files, u32 numFiles);
+
+            // A load counter of archive_t::s_instance
+            u64 counter(telemetry_t::ECounter counter);
+
+            // Content that compresses roughly like asset data, different for every seed
+            void fill(byte* data, u32 size, u32 seed);
+
+            // The key hash of string i of the test string tables
+            inline u32 key_hash(u32 i) { return (i + 1) * 2654435761u; }
+
+            // Holds the thread that makes the first allocation of a given size after arm() until open(), so that
+            // a test can keep the I/O thread busy with one load while it queues others
+            class gatealloc_t : public alloc_t
+            {
+            public:
+                gatealloc_t(alloc_t* allocator);
+
+                void arm(u32 size);
+                bool held();  // Wait for a thread to be held, false when none is after a few seconds
+                void open();
+
+            protected:
+                virtual void* v_allocate(u32 size, u32 alignment);
+                virtual void  v_deallocate(void* ptr);
+
+                alloc_t*     mAllocator;
+                u32          mSize;
+                s32 volatile mState;
+            };
+
+        }  // namespace ntest
+    }  // namespace charon
+}  // namespace ncore
+
+#endif  // __CHARON_TEST_BIGFILE_H__
@@ -0,0 +1,151 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(dedup)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const u32 s_fileSize = 2000;
+
+        struct build_t
+        {
+            byte mData[4][s_fileSize];
+        };
+
+        // Archive 1: {A, B, A, C compressed}, archive 2: {A, D, C compressed, C stored}
+        static charon::archive_t* setup(alloc_t* allocator, build_t* build, bool deduplicate)
+        {
+            charon::archive_t::config_t config;
+            config.mResidencyBudget = 1 << 20;
+            config.mDeduplicate     = deduplicate;
+            charon::archive_t::s_setup(allocator, 4, 4, config);
+
+            for (u32 i = 0; i < 4; ++i)
+                charon::ntest::fill(build->mData[i], s_fileSize, i);
+            charon::ntest::testfile_t const first[]  = {{build->mData[0], s_fileSize, false}, {build->mData[1], s_fileSize, false}, {build->mData[0], s_fileSize, false}, {build->mData[2], s_fileSize, true}};
+            charon::ntest::testfile_t const second[] = {{build->mData[0], s_fileSize, false}, {build->mData[3], s_fileSize, false}, {build->mData[2], s_fileSize, true}, {build->mData[2], s_fileSize, false}};
+            CHECK_TRUE(charon::ntest::mount_files(allocator, "test_dedup_1", 1, first, 4));
+            CHECK_TRUE(charon::ntest::mount_files(allocator, "test_dedup_2", 2, second, 4));
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown(charon::archive_t* ar)
+        {
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive("test_dedup_1");
+            charon::ntest::remove_archive("test_dedup_2");
+        }
+
+        UNITTEST_TEST(shared)
+        {
+            build_t*                  build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*        ar     = setup(Allocator, build, true);
+            charon::archive_loader_t* loader = ar->loader();
+
+            // Identical files, within an archive and across archives, get the data of the first one in mount order
+            void* a1 = loader->load_datafile(charon::fileid_t(1, 0));
+            void* a2 = loader->load_datafile(charon::fileid_t(1, 2));
+            void* a3 = loader->load_datafile(charon::fileid_t(2, 0));
+            CHECK_NOT_NULL(a1);
+            CHECK_TRUE(a1 == a2);
+            CHECK_TRUE(a1 == a3);
+            CHECK_EQUAL(0, memcmp(a1, build->mData[0], s_fileSize));
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterReads));
+            CHECK_EQUAL((u64)s_fileSize, ar->resident_bytes());
+
+            void* b = loader->load_datafile(charon::fileid_t(1, 1));
+            void* d = loader->load_datafile(charon::fileid_t(2, 1));
+            CHECK_TRUE(b != a1 && d != a1 && b != d);
+            CHECK_EQUAL(3 * (u64)s_fileSize, ar->resident_bytes());
+
+            // Compressed files share when the compression matches, the decoded data is resident once
+            void* c1 = loader->load_datafile(charon::fileid_t(1, 3));
+            void* c2 = loader->load_datafile(charon::fileid_t(2, 2));
+            void* c3 = loader->load_datafile(charon::fileid_t(2, 3));
+            CHECK_TRUE(c1 == c2);
+            CHECK_TRUE(c1 != c3);
+            CHECK_EQUAL(0, memcmp(c1, build->mData[2], s_fileSize));
+            CHECK_EQUAL(0, memcmp(c3, build->mData[2], s_fileSize));
+            CHECK_EQUAL(5 * (u64)s_fileSize, ar->resident_bytes());
+
+            loader->unload_datafile(charon::fileid_t(1, 0), a1);
+            loader->unload_datafile(charon::fileid_t(1, 2), a2);
+            loader->unload_datafile(charon::fileid_t(2, 0), a3);
+            loader->unload_datafile(charon::fileid_t(1, 1), b);
+            loader->unload_datafile(charon::fileid_t(2, 1), d);
+            loader->unload_datafile(charon::fileid_t(1, 3), c1);
+            loader->unload_datafile(charon::fileid_t(2, 2), c2);
+            loader->unload_datafile(charon::fileid_t(2, 3), c3);
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(ownership)
+        {
+            build_t*                  build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*        ar     = setup(Allocator, build, true);
+            charon::archive_loader_t* loader = ar->loader();
+
+            // A duplicate holds an ownership of the data it shares, which stays resident until the duplicate lets go
+            void* a = loader->load_datafile(charon::fileid_t(2, 0));
+            CHECK_TRUE(a == loader->get_datafile_ptr<void>(charon::fileid_t(1, 0)));
+            ar->set_residency_budget(0);
+            CHECK_EQUAL((u64)s_fileSize, ar->resident_bytes());
+            CHECK_TRUE(a == loader->get_datafile_ptr<void>(charon::fileid_t(1, 0)));
+            loader->unload_datafile(charon::fileid_t(2, 0), a);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, 0)));
+
+            // Unmounting the archive with the data takes it from the duplicates, that load again from their own archive
+            ar->set_residency_budget(1 << 20);
+            a = loader->load_datafile(charon::fileid_t(2, 0));
+            loader->unload_datafile(charon::fileid_t(2, 0), a);
+            ar->unmount(1);
+            CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(2, 0)));
+            a = loader->load_datafile(charon::fileid_t(2, 0));
+            CHECK_NOT_NULL(a);
+            CHECK_EQUAL(0, memcmp(a, build->mData[0], s_fileSize));
+            CHECK_EQUAL((u64)s_fileSize, ar->resident_bytes());
+            loader->unload_datafile(charon::fileid_t(2, 0), a);
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(disabled)
+        {
+            build_t*                  build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*        ar     = setup(Allocator, build, false);
+            charon::archive_loader_t* loader = ar->loader();
+
+            void* a1 = loader->load_datafile(charon::fileid_t(1, 0));
+            void* a2 = loader->load_datafile(charon::fileid_t(2, 0));
+            CHECK_TRUE(a1 != a2);
+            CHECK_EQUAL(0, memcmp(a1, a2, s_fileSize));
+            CHECK_EQUAL(2, charon::ntest::counter(charon::telemetry_t::CounterReads));
+            CHECK_EQUAL(2 * (u64)s_fileSize, ar->resident_bytes());
+            loader->unload_datafile(charon::fileid_t(1, 0), a1);
+            loader->unload_datafile(charon::fileid_t(2, 0), a2);
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
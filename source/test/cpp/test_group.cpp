@@ -0,0 +1,172 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_gamedata.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(group)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_units    = "test_group_units";
+        static const char* s_files    = "test_group_files";
+        static const u32   s_numUnits = 2;
+        static const u32   s_numFiles = 4;
+        static const u32   s_fileSize = 1000;
+        static const u32   s_gateSize = 3000;  // File 3, the only allocation of this size
+        static const u32   s_unitSize = 64;
+
+        struct build_t
+        {
+            byte mUnits[s_numUnits][s_unitSize];
+            u32  mUnitSize[s_numUnits];
+            byte mGate[s_gateSize];
+            byte mData[s_numFiles][s_fileSize];
+        };
+
+        // A dataunit without pointers, the header is followed by the reference table and an empty patch chain
+        static u32 unit(byte* data, charon::fileid_t const* files, u32 numFiles, u32 const* units, u32 numUnits)
+        {
+            charon::dataunit_header_t* header = (charon::dataunit_header_t*)data;
+            u32*                       table  = (u32*)(header + 1);
+            table[0]                          = numFiles;
+            table[1]                          = numUnits;
+            memcpy(table + 2, files, numFiles * sizeof(charon::fileid_t));
+            memcpy((byte*)(table + 2) + numFiles * sizeof(charon::fileid_t), units, numUnits * sizeof(u32));
+
+            header->m_refs_offset  = sizeof(charon::dataunit_header_t);
+            header->m_patch_offset = header->m_refs_offset + 2 * sizeof(u32) + numFiles * sizeof(charon::fileid_t) + numUnits * sizeof(u32);
+            header->m_patch_count  = 0;
+            header->m_flags        = 0;
+            *(s32*)(data + header->m_patch_offset) = 0;
+            return header->m_patch_offset + sizeof(s32);
+        }
+
+        // Dataunits 0 and 1 reference each other and both reference datafile 0, each also has a datafile of its
+        // own (1 and 2, 2 is compressed). Datafile 3 is not referenced, it holds the I/O thread for a test.
+        static charon::archive_t* setup(charon::ntest::gatealloc_t* gate, build_t* build, s32 numIoThreads)
+        {
+            charon::archive_t::config_t config;
+            config.mNumIoThreads = numIoThreads;
+            charon::archive_t::s_setup(gate, 4, 2, config);
+
+            charon::fileid_t const first[]  = {charon::fileid_t(1, 0), charon::fileid_t(1, 1)};
+            charon::fileid_t const second[] = {charon::fileid_t(1, 2), charon::fileid_t(1, 0)};
+            u32 const              other[]  = {1, 0};
+            build->mUnitSize[0]             = unit(build->mUnits[0], first, 2, &other[0], 1);
+            build->mUnitSize[1]             = unit(build->mUnits[1], second, 2, &other[1], 1);
+
+            charon::ntest::testfile_t units[s_numUnits];
+            for (u32 u = 0; u < s_numUnits; ++u)
+            {
+                units[u].mData     = build->mUnits[u];
+                units[u].mSize     = build->mUnitSize[u];
+                units[u].mCompress = false;
+            }
+            charon::ntest::testfile_t files[s_numFiles];
+            for (u32 f = 0; f < s_numFiles; ++f)
+            {
+                charon::ntest::fill(build->mData[f], s_fileSize, f);
+                files[f].mData     = build->mData[f];
+                files[f].mSize     = s_fileSize;
+                files[f].mCompress = f == 2;
+            }
+            charon::ntest::fill(build->mGate, s_gateSize, 100);
+            files[3].mData = build->mGate;
+            files[3].mSize = s_gateSize;
+            CHECK_TRUE(charon::ntest::mount_files(gate, s_units, 0, units, s_numUnits));
+            CHECK_TRUE(charon::ntest::mount_files(gate, s_files, 1, files, s_numFiles));
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown()
+        {
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_units);
+            charon::ntest::remove_archive(s_files);
+        }
+
+        UNITTEST_TEST(cycle)
+        {
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 0);
+            charon::archive_loader_t*  loader = ar->loader();
+            u64 const                  total  = build->mUnitSize[0] + build->mUnitSize[1] + 3 * s_fileSize;
+
+            // Every dataunit and datafile is loaded once, the cycle and the shared datafile included
+            charon::loadgroup_t group = loader->load_dataunit_group(0);
+            CHECK_TRUE(loader->is_done(group));
+            CHECK_TRUE(loader->wait(group) == loader->get_dataunit_ptr<void>(0));
+            CHECK_EQUAL(5, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(5, charon::ntest::counter(charon::telemetry_t::CounterMisses));
+            CHECK_EQUAL(total, ar->resident_bytes());
+            CHECK_NOT_NULL(loader->get_dataunit_ptr<void>(1));
+            for (u32 f = 0; f < 3; ++f)
+                CHECK_EQUAL(0, memcmp(loader->get_datafile_ptr<void>(charon::fileid_t(1, f)), build->mData[f], s_fileSize));
+            CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, 3)));
+
+            // A second group holds loads of its own, that are hits
+            charon::loadgroup_t again = loader->load_dataunit_group(1);
+            CHECK_TRUE(loader->wait(again) == loader->get_dataunit_ptr<void>(1));
+            CHECK_EQUAL(10, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(5, charon::ntest::counter(charon::telemetry_t::CounterHits));
+
+            // Without a residency budget everything goes once the last group lets go
+            loader->unload_group(group);
+            CHECK_NULL(group.m_group);
+            CHECK_EQUAL(total, ar->resident_bytes());
+            loader->unload_group(again);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            CHECK_NULL(loader->get_dataunit_ptr<void>(0));
+            CHECK_NULL(loader->get_dataunit_ptr<void>(1));
+            for (u32 f = 0; f < 3; ++f)
+                CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, f)));
+
+            teardown();
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(cancel)
+        {
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build, 1);
+            charon::archive_loader_t*  loader = ar->loader();
+
+            gate.arm(s_gateSize);
+            charon::loadhandle_t const held = loader->load_datafile_async(charon::fileid_t(1, 3));
+            CHECK_TRUE(gate.held());
+
+            // A group that did not start is cancelled by unloading it, it made no loads
+            charon::loadgroup_t group = loader->load_dataunit_group(0);
+            CHECK_FALSE(loader->is_done(group));
+            loader->unload_group(group);
+            CHECK_NULL(group.m_group);
+
+            gate.open();
+            CHECK_TRUE(loader->wait(held) != nullptr);
+            void* data = loader->get_datafile_ptr<void>(charon::fileid_t(1, 3));
+            loader->unload_datafile(charon::fileid_t(1, 3), data);
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(0, ar->resident_bytes());
+            CHECK_NULL(loader->get_dataunit_ptr<void>(0));
+
+            teardown();
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
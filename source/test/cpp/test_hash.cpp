@@ -0,0 +1,81 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_hash.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(hash)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static void fill(byte* data, u32 size)
+        {
+            u32 seed = 0x12345678;
+            for (u32 i = 0; i < size; ++i)
+            {
+                seed    = seed * 1664525 + 1013904223;
+                data[i] = (byte)(seed >> 24);
+            }
+        }
+
+        // Reference values of XXH64
+        UNITTEST_TEST(known)
+        {
+            CHECK_EQUAL(0xEF46DB3751D8E999ull, charon::nhash::hash64("", 0));
+            CHECK_EQUAL(0xD24EC4F1A98C6E5Bull, charon::nhash::hash64("a", 1));
+            CHECK_EQUAL(0x44BC2CF5AD770999ull, charon::nhash::hash64("abc", 3));
+        }
+
+        UNITTEST_TEST(seed)
+        {
+            byte data[100];
+            fill(data, sizeof(data));
+            CHECK_NOT_EQUAL(charon::nhash::hash64(data, sizeof(data), 0), charon::nhash::hash64(data, sizeof(data), 1));
+        }
+
+        // Every split of the data gives the one-shot hash, sizes cover the tail paths and whole stripes
+        UNITTEST_TEST(streaming)
+        {
+            u32 const size = 4099;
+            byte*     data = (byte*)Allocator->allocate(size);
+            fill(data, size);
+
+            u32 const pieces[] = {1, 3, 8, 31, 32, 33, 100, 4099};
+            for (u32 p = 0; p < sizeof(pieces) / sizeof(pieces[0]); ++p)
+            {
+                for (u32 length = 0; length <= size; length += 97)
+                {
+                    charon::nhash::state_t state;
+                    state.reset(7);
+                    for (u32 offset = 0; offset < length; offset += pieces[p])
+                        state.update(data + offset, (offset + pieces[p]) <= length ? pieces[p] : (length - offset));
+                    CHECK_EQUAL(charon::nhash::hash64(data, length, 7), state.digest());
+                }
+            }
+
+            Allocator->deallocate(data);
+        }
+
+        // A single flipped bit changes the hash
+        UNITTEST_TEST(corrupt)
+        {
+            byte data[256];
+            fill(data, sizeof(data));
+            u64 const hash = charon::nhash::hash64(data, sizeof(data));
+            for (u32 i = 0; i < sizeof(data); i += 13)
+            {
+                data[i] ^= 0x10;
+                CHECK_NOT_EQUAL(hash, charon::nhash::hash64(data, sizeof(data)));
+                data[i] ^= 0x10;
+            }
+        }
+    }
+}
+UNITTEST_SUITE_END
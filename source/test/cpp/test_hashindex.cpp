@@ -0,0 +1,102 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_hashindex.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(hashindex)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static u64 s_hash(u32 i)
+        {
+            u64 h = (u64)i + 0x9E3779B97F4A7C15ull;
+            h     = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+            h     = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+            return h ^ (h >> 31);
+        }
+
+        UNITTEST_TEST(empty)
+        {
+            charon::hashindex_t index;
+            u32                 value = 0;
+            CHECK_FALSE(index.find(1, value));
+
+            index.setup(Allocator, 0);
+            CHECK_FALSE(index.find(1, value));
+            CHECK_EQUAL(0, index.size());
+            index.teardown(Allocator);
+        }
+
+        UNITTEST_TEST(insert_find)
+        {
+            u32 const           count = 50000;
+            charon::hashindex_t index;
+            index.setup(Allocator, count);
+            for (u32 i = 0; i < count; ++i)
+                CHECK_TRUE(index.insert(s_hash(i), i));
+            CHECK_EQUAL(count, index.size());
+
+            u32 value = 0;
+            for (u32 i = 0; i < count; ++i)
+            {
+                index.prefetch(s_hash(i + 1));
+                CHECK_TRUE(index.find(s_hash(i), value));
+                CHECK_EQUAL(i, value);
+            }
+            for (u32 i = count; i < 2 * count; ++i)
+                CHECK_FALSE(index.find(s_hash(i), value));
+            index.teardown(Allocator);
+        }
+
+        // Sequential hashes and hashes that only differ in their high bits must still spread
+        UNITTEST_TEST(structured_hashes)
+        {
+            charon::hashindex_t index;
+            index.setup(Allocator, 2000);
+            for (u32 i = 0; i < 1000; ++i)
+            {
+                CHECK_TRUE(index.insert(i + 1, i));
+                CHECK_TRUE(index.insert((u64)(i + 1) << 40, 1000 + i));
+            }
+
+            u32 value = 0;
+            for (u32 i = 0; i < 1000; ++i)
+            {
+                CHECK_TRUE(index.find(i + 1, value));
+                CHECK_EQUAL(i, value);
+                CHECK_TRUE(index.find((u64)(i + 1) << 40, value));
+                CHECK_EQUAL(1000 + i, value);
+            }
+            index.teardown(Allocator);
+        }
+
+        UNITTEST_TEST(duplicates_and_full)
+        {
+            charon::hashindex_t index;
+            index.setup(Allocator, 10);
+            CHECK_TRUE(index.insert(42, 1));
+            CHECK_FALSE(index.insert(42, 2));
+
+            u32 value = 0;
+            CHECK_TRUE(index.find(42, value));
+            CHECK_EQUAL(1, value);
+
+            // 10 items fit in one group of 16 slots, which holds at most 14
+            u32 inserted = 1;
+            for (u32 i = 0; i < 100; ++i)
+                inserted += index.insert(s_hash(i), i) ? 1 : 0;
+            CHECK_EQUAL(14, inserted);
+            CHECK_FALSE(index.find(s_hash(99), value));
+            index.teardown(Allocator);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,259 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_localization.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(localization)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path       = "test_localization";
+        static const u32   s_numStrings = 40;
+        static const u32   s_tableSize  = 2048;
+
+        // A dataunit holding a languages_t, the array pointer is the one record of the patch chain
+        struct languages_image_t
+        {
+            charon::dataunit_header_t mHeader;
+            u64                       mRecord;  // array_t: {record, bytes, count}
+            u32                       mBytes;
+            u32                       mCount;
+            s16                       mDefault;
+            s32                       mPatchTable;
+        };
+
+        // String i of language l is "<'a' + l><i as two digits>", every table has the same size
+        static u32 table(byte* data, u32 l)
+        {
+            char        text[s_numStrings][4];
+            char const* strings[s_numStrings];
+            u32         hashes[s_numStrings];
+            u32         lengths[s_numStrings];
+            for (u32 i = 0; i < s_numStrings; ++i)
+            {
+                text[i][0] = (char)('a' + l);
+                text[i][1] = (char)('0' + i / 10);
+                text[i][2] = (char)('0' + i % 10);
+                strings[i] = text[i];
+                hashes[i]  = charon::ntest::key_hash(i);
+                lengths[i] = 3;
+            }
+            s32 const size = charon::strtable_t::s_write_table(hashes, strings, lengths, lengths, s_numStrings, data, s_tableSize);
+            CHECK_TRUE(size > 0);
+            return size > 0 ? (u32)size : 0;
+        }
+
+        struct fixture_t
+        {
+            byte                                   mTables[charon::enums::LanguageCount][s_tableSize];
+            charon::ntest::testfile_t              mFiles[charon::enums::LanguageCount];
+            charon::datafile_t<charon::strtable_t> mDatafiles[charon::enums::LanguageCount];
+            languages_image_t                      mImage;
+            u32                                    mTableBytes;
+        };
+
+        // Every language is file l of archive 1, the archive keeps nothing that is unloaded
+        static fixture_t* setup(alloc_t* allocator, s32 numIoThreads)
+        {
+            fixture_t* f = (fixture_t*)allocator->allocate(sizeof(fixture_t));
+            for (u32 l = 0; l < charon::enums::LanguageCount; ++l)
+            {
+                f->mFiles[l].mData        = f->mTables[l];
+                f->mFiles[l].mSize        = table(f->mTables[l], l);
+                f->mFiles[l].mCompress    = false;
+                f->mDatafiles[l].m_fileid = charon::fileid_t(1, l);
+            }
+            f->mTableBytes       = f->mFiles[0].mSize;
+            CHECK_TRUE(f->mTableBytes <= s_tableSize);
+
+            // Patched or resolved on access, the image reads the same in either pointer mode
+            languages_image_t& image     = f->mImage;
+            s32*               record    = (s32*)&image.mRecord;
+            image.mHeader.m_patch_offset = (u32)((byte*)&image.mPatchTable - (byte*)&image);
+            image.mHeader.m_patch_count  = 1;
+            image.mHeader.m_flags        = 0;
+            image.mHeader.m_refs_offset  = 0;
+            record[0]                    = 0;
+            record[1]                    = (s32)((byte*)f->mDatafiles - (byte*)record);
+            image.mBytes                 = sizeof(f->mDatafiles);
+            image.mCount                 = charon::enums::LanguageCount;
+            image.mDefault               = charon::enums::LanguageEnglish;
+            image.mPatchTable            = sizeof(charon::dataunit_header_t);
+            charon::g_patch(&image.mHeader);
+
+            charon::archive_t::config_t config;
+            config.mNumIoThreads = numIoThreads;
+            charon::archive_t::s_setup(allocator, 4, 2, config);
+            CHECK_TRUE(charon::ntest::mount_files(allocator, s_path, 1, f->mFiles, charon::enums::LanguageCount));
+            return f;
+        }
+
+        static void teardown(alloc_t* allocator, fixture_t* f)
+        {
+            CHECK_EQUAL(0, charon::archive_t::s_instance->resident_bytes());
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+            allocator->deallocate(f);
+        }
+
+        static charon::languages_t* languages(fixture_t* f) { return (charon::languages_t*)&f->mImage.mRecord; }
+
+        static bool loaded(charon::enums::ELanguage language) { return charon::archive_t::s_instance->loader()->get_datafile_ptr<charon::strtable_t>(charon::fileid_t(1, language)) != nullptr; }
+
+        static bool text(localization_t const& loc, u32 l, u32 i)
+        {
+            charon::string_t const s = loc.getText(charon::ntest::key_hash(i));
+            return s.bytes() == 3 && s.c_str()[0] == (char)('a' + l) && s.c_str()[1] == (char)('0' + i / 10) && s.c_str()[2] == (char)('0' + i % 10);
+        }
+
+        // Runs update() until the language is current, the prefetch completes on an I/O thread
+        static bool switched(localization_t& loc, charon::enums::ELanguage language)
+        {
+            for (s32 i = 0; i < 1000000 && loc.getCurrentLanguage() != language; ++i)
+                loc.update();
+            return loc.getCurrentLanguage() == language;
+        }
+
+        UNITTEST_TEST(request_and_update)
+        {
+            fixture_t*         f  = setup(Allocator, 1);
+            charon::archive_t* ar = charon::archive_t::s_instance;
+
+            localization_t loc(Allocator);
+            loc.setup(languages(f), ar);
+            CHECK_EQUAL(charon::enums::LanguageInvalid, loc.getCurrentLanguage());
+            CHECK_EQUAL(0, loc.getText(charon::ntest::key_hash(7)).bytes());
+
+            loc.setupLanguage(charon::enums::LanguageGerman, ar);
+            CHECK_EQUAL(charon::enums::LanguageGerman, loc.getCurrentLanguage());
+            CHECK_TRUE(text(loc, charon::enums::LanguageGerman, 7));
+
+            // A language that is not resident is switched to by update(), the current one serves until then
+            loc.requestLanguage(charon::enums::LanguageDutch);
+            CHECK_EQUAL(charon::enums::LanguageGerman, loc.getCurrentLanguage());
+            CHECK_TRUE(text(loc, charon::enums::LanguageGerman, 7));
+            CHECK_TRUE(switched(loc, charon::enums::LanguageDutch));
+            CHECK_TRUE(text(loc, charon::enums::LanguageDutch, 7));
+            CHECK_TRUE(text(loc, charon::enums::LanguageDutch, 39));
+            CHECK_EQUAL(2 * (u64)f->mTableBytes, loc.residentBytes());
+
+            // A resident language is switched to right away
+            loc.requestLanguage(charon::enums::LanguageGerman);
+            CHECK_EQUAL(charon::enums::LanguageGerman, loc.getCurrentLanguage());
+            CHECK_TRUE(text(loc, charon::enums::LanguageGerman, 0));
+
+            loc.teardown(ar);
+            CHECK_EQUAL(0, loc.residentBytes());
+            teardown(Allocator, f);
+        }
+
+        UNITTEST_TEST(budget)
+        {
+            fixture_t*         f  = setup(Allocator, 1);
+            charon::archive_t* ar = charon::archive_t::s_instance;
+
+            localization_t loc(Allocator);
+            loc.setup(languages(f), ar);
+
+            // Used in the order English, Italian, German, Dutch, Dutch is current
+            charon::enums::ELanguage const order[] = {charon::enums::LanguageEnglish, charon::enums::LanguageItalian, charon::enums::LanguageGerman, charon::enums::LanguageDutch};
+            for (u32 i = 0; i < 4; ++i)
+            {
+                loc.setupLanguage(order[i], ar);
+                loc.update();
+            }
+            for (u64 i = 0; i < localization_t::s_grace_updates; ++i)
+                loc.update();
+            CHECK_EQUAL(4 * (u64)f->mTableBytes, loc.residentBytes());
+
+            // Least recently used first
+            loc.setBudget(3 * (u64)f->mTableBytes);
+            CHECK_FALSE(loaded(charon::enums::LanguageEnglish));
+            CHECK_TRUE(loaded(charon::enums::LanguageItalian));
+            loc.setBudget(2 * (u64)f->mTableBytes);
+            CHECK_FALSE(loaded(charon::enums::LanguageItalian));
+            CHECK_TRUE(loaded(charon::enums::LanguageGerman));
+            CHECK_EQUAL(2 * (u64)f->mTableBytes, loc.residentBytes());
+
+            // Neither the current nor the requested language goes, whatever the budget
+            loc.requestLanguage(charon::enums::LanguageKorean);
+            loc.setBudget(1);
+            CHECK_FALSE(loaded(charon::enums::LanguageGerman));
+            CHECK_TRUE(loaded(charon::enums::LanguageDutch));
+            CHECK_TRUE(text(loc, charon::enums::LanguageDutch, 3));
+            CHECK_TRUE(switched(loc, charon::enums::LanguageKorean));
+            CHECK_TRUE(loaded(charon::enums::LanguageKorean));
+            CHECK_TRUE(text(loc, charon::enums::LanguageKorean, 3));
+
+            loc.teardown(ar);
+            teardown(Allocator, f);
+        }
+
+        UNITTEST_TEST(grace)
+        {
+            fixture_t*         f  = setup(Allocator, 0);
+            charon::archive_t* ar = charon::archive_t::s_instance;
+
+            localization_t loc(Allocator);
+            loc.setup(languages(f), ar);
+            loc.setupLanguage(charon::enums::LanguageEnglish, ar);
+            loc.setupLanguage(charon::enums::LanguageGerman, ar);
+
+            // Text of the language that was switched away from may still be read elsewhere
+            loc.setBudget(f->mTableBytes);
+            for (u64 i = 1; i < localization_t::s_grace_updates; ++i)
+            {
+                loc.update();
+                CHECK_TRUE(loaded(charon::enums::LanguageEnglish));
+            }
+            CHECK_TRUE(loaded(charon::enums::LanguageEnglish));
+            CHECK_EQUAL(2 * (u64)f->mTableBytes, loc.residentBytes());
+            loc.update();
+            CHECK_FALSE(loaded(charon::enums::LanguageEnglish));
+            CHECK_EQUAL((u64)f->mTableBytes, loc.residentBytes());
+            CHECK_TRUE(text(loc, charon::enums::LanguageGerman, 11));
+
+            loc.teardown(ar);
+            teardown(Allocator, f);
+        }
+
+        // Prefetches that are still queued or loading when their language or the whole localization goes
+        UNITTEST_TEST(teardown_prefetch)
+        {
+            fixture_t*         f  = setup(Allocator, 1);
+            charon::archive_t* ar = charon::archive_t::s_instance;
+
+            localization_t loc(Allocator);
+            loc.setup(languages(f), ar);
+            loc.setupLanguage(charon::enums::LanguageEnglish, ar);
+            for (u32 l = 1; l < charon::enums::LanguageCount; ++l)
+                loc.prefetchLanguage((charon::enums::ELanguage)l, charon::PriorityIdle);
+            loc.teardownLanguage(charon::enums::LanguageKorean, ar);
+            CHECK_FALSE(loaded(charon::enums::LanguageKorean));
+            loc.requestLanguage(charon::enums::LanguagePolish);
+            loc.teardownLanguage(charon::enums::LanguagePolish, ar);
+            loc.update();
+            CHECK_EQUAL(charon::enums::LanguageEnglish, loc.getCurrentLanguage());
+
+            loc.teardown(ar);
+            CHECK_EQUAL(charon::enums::LanguageInvalid, loc.getCurrentLanguage());
+            CHECK_EQUAL(0, loc.residentBytes());
+            CHECK_EQUAL(0, loc.getText(charon::ntest::key_hash(1)).bytes());
+            teardown(Allocator, f);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,121 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_lz.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(lz)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static void fill(byte* data, u32 size, u32 mode)
+        {
+            u32 seed = 0x12345678;
+            for (u32 i = 0; i < size; ++i)
+            {
+                seed = seed * 1664525 + 1013904223;
+                switch (mode)
+                {
+                    case 0: data[i] = (byte)(seed >> 24); break;         // Noise, stored blocks
+                    case 1: data[i] = (byte)((i / 7) & 0xFF); break;     // Long runs
+                    default: data[i] = (byte)((seed >> 24) & 3); break;  // Small alphabet
+                }
+            }
+        }
+
+        static bool roundtrip(alloc_t* allocator, u32 size, u32 mode, u32 blockSize)
+        {
+            byte* src        = (byte*)allocator->allocate(size + 1);
+            u32   bound      = charon::nlz::compress_file_bound(size, blockSize);
+            byte* compressed = (byte*)allocator->allocate(bound);
+            byte* dst        = (byte*)allocator->allocate(size + 1);
+            fill(src, size, mode);
+
+            s32 const n  = charon::nlz::compress_file(src, size, compressed, bound, blockSize);
+            s32 const d  = charon::nlz::decompress_file(compressed, (u32)n, dst, size);
+            bool      ok = n > 0 && d == (s32)size;
+            for (u32 i = 0; ok && i < size; ++i)
+                ok = src[i] == dst[i];
+
+            allocator->deallocate(dst);
+            allocator->deallocate(compressed);
+            allocator->deallocate(src);
+            return ok;
+        }
+
+        UNITTEST_TEST(empty)
+        {
+            CHECK_TRUE(roundtrip(Allocator, 0, 1, charon::nlz::c_default_block));
+        }
+
+        UNITTEST_TEST(small)
+        {
+            for (u32 size = 1; size < 40; ++size)
+            {
+                CHECK_TRUE(roundtrip(Allocator, size, 1, charon::nlz::c_default_block));
+                CHECK_TRUE(roundtrip(Allocator, size, 2, charon::nlz::c_default_block));
+            }
+        }
+
+        UNITTEST_TEST(blocks)
+        {
+            CHECK_TRUE(roundtrip(Allocator, 300000, 0, charon::nlz::c_default_block));
+            CHECK_TRUE(roundtrip(Allocator, 300000, 1, charon::nlz::c_default_block));
+            CHECK_TRUE(roundtrip(Allocator, 300000, 2, 4096));
+        }
+
+        UNITTEST_TEST(compresses)
+        {
+            u32 const size  = 100000;
+            byte*     src   = (byte*)Allocator->allocate(size);
+            u32 const bound = charon::nlz::compress_file_bound(size);
+            byte*     dst   = (byte*)Allocator->allocate(bound);
+            fill(src, size, 1);
+            s32 const n = charon::nlz::compress_file(src, size, dst, bound);
+            CHECK_TRUE(n > 0 && n < (s32)(size / 4));
+            Allocator->deallocate(dst);
+            Allocator->deallocate(src);
+        }
+
+        UNITTEST_TEST(corrupt)
+        {
+            // Offsets pointing before the start of the output must be rejected
+            byte const block[] = {0x10, 'a', 0x40, 0x00};
+            byte       out[32];
+            CHECK_EQUAL(-1, charon::nlz::decompress_block(block, sizeof(block), out, sizeof(out)));
+
+            // Output larger than the destination must be rejected
+            byte const literals[] = {0x50, 'a', 'b', 'c', 'd', 'e'};
+            CHECK_EQUAL(-1, charon::nlz::decompress_block(literals, sizeof(literals), out, 4));
+            CHECK_EQUAL(5, charon::nlz::decompress_block(literals, sizeof(literals), out, 5));
+        }
+
+        // A block table that is larger than 4 GB must not wrap around to a small header
+        UNITTEST_TEST(corrupt_header)
+        {
+            charon::nlz::header_t header;
+            header.mMagic            = charon::nlz::c_magic;
+            header.mUncompressedSize = 0x40000000;
+            header.mBlockSize        = 1;
+            header.mNumBlocks        = 0x40000000;
+            CHECK_TRUE(header.isValid());
+            CHECK_EQUAL(16ull + 4ull * 0x40000000ull, header.headerSize());
+
+            byte out[16];
+            CHECK_EQUAL(-1, charon::nlz::decompress_file((byte const*)&header, sizeof(header), out, sizeof(out)));
+
+            header.mUncompressedSize = 0xFFFFFFFF;
+            header.mBlockSize        = 0x10;
+            header.mNumBlocks        = 0x10000000;
+            CHECK_TRUE(header.isValid());
+        }
+    }
+}
+UNITTEST_SUITE_END
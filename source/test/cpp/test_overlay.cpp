@@ -0,0 +1,187 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(overlay)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const u32 s_numBase  = 8;
+        static const u32 s_numLayer = 10;  // Files 8 and 9 are added by the first layer
+        static const u32 s_fileSize = 700;
+
+        // Content of file f of an archive, base files differ in size from those of the layers
+        struct build_t
+        {
+            byte                      mBase[s_numBase][s_fileSize];
+            byte                      mLayer[s_numLayer][s_fileSize];
+            byte                      mTop[s_fileSize];
+            charon::ntest::testfile_t mFiles[s_numLayer];
+        };
+
+        static u32 s_base_size(u32 f) { return 500 + f * 10; }
+
+        // Base archive 1, layer 2 has files 0, 3, 8 and 9 and layer 3 has file 3 (the others are empty and do not shadow)
+        static charon::archive_t* setup(alloc_t* allocator, build_t* build)
+        {
+            for (u32 f = 0; f < s_numBase; ++f)
+            {
+                charon::ntest::fill(build->mBase[f], s_base_size(f), f);
+                build->mFiles[f].mData     = build->mBase[f];
+                build->mFiles[f].mSize     = s_base_size(f);
+                build->mFiles[f].mCompress = (f & 1) != 0;
+            }
+            CHECK_TRUE(charon::ntest::write_archive(allocator, "test_overlay_base", 1, build->mFiles, s_numBase));
+
+            for (u32 f = 0; f < s_numLayer; ++f)
+            {
+                bool const has = f == 0 || f == 3 || f >= s_numBase;
+                charon::ntest::fill(build->mLayer[f], s_fileSize, 100 + f);
+                build->mFiles[f].mData     = build->mLayer[f];
+                build->mFiles[f].mSize     = has ? s_fileSize : 0;
+                build->mFiles[f].mCompress = f == 3;
+            }
+            CHECK_TRUE(charon::ntest::write_archive(allocator, "test_overlay_layer", 2, build->mFiles, s_numLayer));
+
+            charon::ntest::fill(build->mTop, s_fileSize, 300);
+            for (u32 f = 0; f < s_numBase; ++f)
+            {
+                build->mFiles[f].mData     = build->mTop;
+                build->mFiles[f].mSize     = f == 3 ? s_fileSize : 0;
+                build->mFiles[f].mCompress = false;
+            }
+            CHECK_TRUE(charon::ntest::write_archive(allocator, "test_overlay_top", 3, build->mFiles, s_numBase));
+
+            charon::archive_t::config_t config;
+            config.mResidencyBudget = 1 << 20;
+            charon::archive_t::s_setup(allocator, 4, 4, config);
+            CHECK_EQUAL(0, charon::ntest::mount_archive("test_overlay_base", 1));
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown(charon::archive_t* ar)
+        {
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive("test_overlay_base");
+            charon::ntest::remove_archive("test_overlay_layer");
+            charon::ntest::remove_archive("test_overlay_top");
+        }
+
+        // Load file f through the base archive and compare it with the expected content
+        static bool same(charon::archive_t* ar, u32 f, byte const* expected, u32 size)
+        {
+            charon::fileid_t const id   = charon::fileid_t(1, f);
+            void*                  data = ar->loader()->load_datafile(id);
+            if (data == nullptr)
+                return false;
+            bool const same = memcmp(data, expected, size) == 0;
+            ar->loader()->unload_datafile(id, data);
+            return same;
+        }
+
+        UNITTEST_TEST(shadow)
+        {
+            build_t*           build = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar    = setup(Allocator, build);
+
+            // Data loaded before a layer is mounted stays valid until it is unloaded
+            void* before = ar->loader()->load_datafile(charon::fileid_t(1, 0));
+            CHECK_EQUAL(0, memcmp(before, build->mBase[0], s_base_size(0)));
+
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_layer", 2, 1));
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+            CHECK_TRUE(same(ar, 3, build->mLayer[3], s_fileSize));
+            for (u32 f = 0; f < s_numBase; ++f)
+            {
+                if (f != 0 && f != 3)
+                    CHECK_TRUE(same(ar, f, build->mBase[f], s_base_size(f)));
+            }
+            CHECK_EQUAL(0, memcmp(before, build->mBase[0], s_base_size(0)));
+            ar->loader()->unload_datafile(charon::fileid_t(1, 0), before);
+
+            // Files that a layer adds beyond the end of the base are found through the base as well
+            CHECK_FALSE(ar->exists(charon::fileid_t(2, 1)));
+            CHECK_TRUE(ar->exists(charon::fileid_t(1, 8)));
+            CHECK_TRUE(same(ar, 9, build->mLayer[9], s_fileSize));
+
+            // The newest layer wins
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_top", 3, 1));
+            CHECK_TRUE(same(ar, 3, build->mTop, s_fileSize));
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+            CHECK_TRUE(same(ar, 1, build->mBase[1], s_base_size(1)));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(unmount)
+        {
+            build_t*           build = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar    = setup(Allocator, build);
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_layer", 2, 1));
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_top", 3, 1));
+
+            // Unmounting a layer in the middle rebuilds the redirect from the layers that are left
+            ar->unmount(2);
+            CHECK_TRUE(same(ar, 3, build->mTop, s_fileSize));
+            CHECK_TRUE(same(ar, 0, build->mBase[0], s_base_size(0)));
+            CHECK_FALSE(ar->exists(charon::fileid_t(1, 8)));
+
+            ar->unmount(3);
+            CHECK_TRUE(same(ar, 3, build->mBase[3], s_base_size(3)));
+            CHECK_TRUE(same(ar, 0, build->mBase[0], s_base_size(0)));
+
+            // A layer can be mounted again after its base lost every layer
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_layer", 2, 1));
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+
+            // Layers stay on top of an unmounted base and serve the files that they have
+            ar->unmount(1);
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+            CHECK_FALSE(ar->exists(charon::fileid_t(1, 1)));
+            CHECK_EQUAL(0, charon::ntest::mount_archive("test_overlay_base", 1));
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+            CHECK_TRUE(same(ar, 1, build->mBase[1], s_base_size(1)));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(failed_mount)
+        {
+            build_t*           build = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar    = setup(Allocator, build);
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_layer", 2, 1));
+
+            // A replacement layer that can not be opened leaves the mounted layer in place
+            CHECK_EQUAL(-1, charon::ntest::mount_layer("test_overlay_missing", 2, 1));
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+            CHECK_TRUE(ar->exists(charon::fileid_t(1, 8)));
+
+            // A base can not be a layer of its own, and a layer of a layer stacks on the bottom archive
+            CHECK_EQUAL(-1, charon::ntest::mount_layer("test_overlay_top", 1, 1));
+            CHECK_EQUAL(0, charon::ntest::mount_layer("test_overlay_top", 3, 2));
+            CHECK_TRUE(same(ar, 3, build->mTop, s_fileSize));
+            CHECK_TRUE(same(ar, 0, build->mLayer[0], s_fileSize));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,120 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_hash.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(pack)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_pack";
+        static const char* s_pack     = "test_pack.gpk";
+        static const u32   s_numFiles = 6;
+        static const u32   s_fileSize = 5000;
+
+        struct build_t
+        {
+            byte mData[s_numFiles][s_fileSize];
+        };
+
+        // The odd files are compressed, the data region is larger than a page
+        static charon::archive_t* setup(alloc_t* allocator, build_t* build, charon::archive_t::EBackend backend)
+        {
+            charon::archive_t::config_t config;
+            config.mBackend = backend;
+            config.mVerify  = true;
+            charon::archive_t::s_setup(allocator, 4, 2, config);
+
+            charon::ntest::testfile_t files[s_numFiles];
+            for (u32 f = 0; f < s_numFiles; ++f)
+            {
+                charon::ntest::fill(build->mData[f], s_fileSize, f);
+                files[f].mData     = build->mData[f];
+                files[f].mSize     = s_fileSize;
+                files[f].mCompress = (f & 1) != 0;
+            }
+            CHECK_TRUE(charon::ntest::write_pack(allocator, s_path, 1, files, s_numFiles));
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown()
+        {
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+        }
+
+        UNITTEST_TEST(mount)
+        {
+            build_t* build = (build_t*)Allocator->allocate(sizeof(build_t));
+            for (s32 backend = 0; backend < 2; ++backend)
+            {
+                charon::archive_t*        ar     = setup(Allocator, build, (charon::archive_t::EBackend)backend);
+                charon::archive_loader_t* loader = ar->loader();
+                CHECK_EQUAL(0, ar->mount(1, s_pack));
+
+                // The TOC, FDB and HDB regions of the pack are the tables of the archive
+                CHECK_TRUE(ar->exists(charon::fileid_t(1, s_numFiles - 1)));
+                CHECK_FALSE(ar->exists(charon::fileid_t(1, s_numFiles)));
+                CHECK_EQUAL(0, strcmp(ar->filename(charon::fileid_t(1, 2)).c_str(), "test/1/file_0002.bin"));
+                u64 const hash = charon::nhash::hash64(build->mData[2], s_fileSize);
+                CHECK_EQUAL(1, ar->find(hash).getArchiveIndex());
+                CHECK_EQUAL(2, ar->find(hash).getFileIndex());
+                CHECK_EQUAL(0, ar->verify(1));
+
+                // File offsets are relative to the data region, loads are verified against the HDB region
+                void* data[s_numFiles];
+                for (u32 f = 0; f < s_numFiles; ++f)
+                {
+                    data[f] = loader->load_datafile(charon::fileid_t(1, f));
+                    CHECK_NOT_NULL(data[f]);
+                    CHECK_EQUAL(0, memcmp(data[f], build->mData[f], s_fileSize));
+                }
+                CHECK_EQUAL(0, charon::ntest::counter(charon::telemetry_t::CounterCorrupt));
+
+                // Mapped, the stored files are used in-place and only the compressed ones take memory
+                u64 const resident = backend == charon::archive_t::BackendMemoryMapped ? (s_numFiles / 2) * s_fileSize : s_numFiles * s_fileSize;
+                CHECK_EQUAL(resident, ar->resident_bytes());
+
+                for (u32 f = 0; f < s_numFiles; ++f)
+                    loader->unload_datafile(charon::fileid_t(1, f), data[f]);
+                CHECK_EQUAL(0, ar->resident_bytes());
+                ar->unmount(1);
+                CHECK_FALSE(ar->exists(charon::fileid_t(1, 0)));
+
+                teardown();
+            }
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(invalid)
+        {
+            build_t*           build = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t* ar    = setup(Allocator, build, charon::archive_t::BackendFileRead);
+
+            // Separate files are not a pack
+            charon::ntest::testfile_t const file = {build->mData[0], s_fileSize, false};
+            CHECK_TRUE(charon::ntest::write_archive(Allocator, "test_pack_loose", 1, &file, 1));
+            CHECK_EQUAL(-1, ar->mount(1, "test_pack_loose.gda"));
+            CHECK_EQUAL(-1, ar->mount(1, "test_pack_missing.gpk"));
+            CHECK_FALSE(ar->exists(charon::fileid_t(1, 0)));
+            charon::ntest::remove_archive("test_pack_loose");
+
+            teardown();
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
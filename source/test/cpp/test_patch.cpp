@@ -0,0 +1,169 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_gamedata.h"
+#include "charon/c_jobs.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(patch)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        // A dataunit with numPointers pointer records, record i points at the u32 value i in the value block
+        //   header | records (8 bytes each) | values (u32 each) | patch table
+        static charon::dataunit_header_t* build(alloc_t* allocator, s32 numPointers, bool flat)
+        {
+            u32 const recordsOffset = sizeof(charon::dataunit_header_t);
+            u32 const valuesOffset  = recordsOffset + numPointers * 8;
+            u32 const tableOffset   = valuesOffset + numPointers * sizeof(u32);
+            u32 const tableSize     = flat ? numPointers * sizeof(u32) : sizeof(s32);
+            byte*     data          = (byte*)allocator->allocate(tableOffset + tableSize, 8);
+
+            charon::dataunit_header_t* header = (charon::dataunit_header_t*)data;
+            header->m_patch_offset            = tableOffset;
+            header->m_patch_count             = numPointers;
+            header->m_flags                   = flat ? charon::dataunit_header_t::FlagFlatPatchTable : 0;
+            header->m_refs_offset             = 0;
+
+            for (s32 i = 0; i < numPointers; ++i)
+            {
+                u32 const record = recordsOffset + i * 8;
+                u32 const value  = valuesOffset + i * sizeof(u32);
+                s32*      fields = (s32*)(data + record);
+                fields[0]        = (i + 1) < numPointers ? 8 : 0;
+                fields[1]        = (s32)(value - record);
+
+                *(u32*)(data + value) = (u32)i;
+                if (flat)
+                    ((u32*)(data + tableOffset))[i] = record;
+            }
+            if (!flat)
+                *(s32*)(data + tableOffset) = numPointers > 0 ? (s32)recordsOffset : 0;
+            return header;
+        }
+
+        // Also holds with CHARON_RELATIVE_POINTERS, where patching is a no-op and the records resolve on access,
+        // see the relative test
+        static bool verify(charon::dataunit_header_t* header, s32 numPointers)
+        {
+            charon::dataptr_t<u32> const* pointers = (charon::dataptr_t<u32> const*)(header + 1);
+            for (s32 i = 0; i < numPointers; ++i)
+            {
+                if (*pointers[i] != (u32)i)
+                    return false;
+            }
+            return true;
+        }
+
+        static const u32   s_numValues = 5;
+        static const char* s_text      = "relative";
+
+        // A dataunit with an array_t and a string_t, their pointers are the two records of the patch chain
+        //   header | array_t | string_t | values (u32 each) | text | patch table
+        static charon::dataunit_header_t* build_records(alloc_t* allocator)
+        {
+            u32 const textLength   = (u32)strlen(s_text);
+            u32 const arrayOffset  = sizeof(charon::dataunit_header_t);
+            u32 const stringOffset = arrayOffset + 16;
+            u32 const valuesOffset = stringOffset + 16;
+            u32 const textOffset   = valuesOffset + s_numValues * sizeof(u32);
+            u32 const tableOffset  = (textOffset + textLength + 1 + 3) & ~3;
+            byte*     data         = (byte*)allocator->allocate(tableOffset + sizeof(s32), 8);
+
+            charon::dataunit_header_t* header = (charon::dataunit_header_t*)data;
+            header->m_patch_offset            = tableOffset;
+            header->m_patch_count             = 2;
+            header->m_flags                   = 0;
+            header->m_refs_offset             = 0;
+
+            // array_t: {record, bytes, count}, string_t: {bytes, count, record}
+            u32 const arrayRecord  = arrayOffset;
+            u32 const stringRecord = stringOffset + 2 * sizeof(u32);
+            u32*      array        = (u32*)(data + arrayOffset);
+            array[0]               = stringRecord - arrayRecord;
+            array[1]               = (u32)(valuesOffset - arrayRecord);
+            array[2]               = s_numValues * sizeof(u32);
+            array[3]               = s_numValues;
+            u32* string            = (u32*)(data + stringOffset);
+            string[0]              = textLength;
+            string[1]              = textLength;
+            string[2]              = 0;
+            string[3]              = (u32)(textOffset - stringRecord);
+
+            for (u32 i = 0; i < s_numValues; ++i)
+                ((u32*)(data + valuesOffset))[i] = 100 + i;
+            memcpy(data + textOffset, s_text, textLength + 1);
+            *(s32*)(data + tableOffset) = (s32)arrayRecord;
+            return header;
+        }
+
+        UNITTEST_TEST(relative)
+        {
+            // Without patching, the records resolve through relptr_t and relstring_t
+            charon::dataunit_header_t*   header  = build_records(Allocator);
+            byte const*                  base    = (byte const*)(header + 1);
+            charon::relptr_t<u32> const* values  = (charon::relptr_t<u32> const*)base;
+            charon::string_t const       relText = *(charon::relstring_t const*)(base + 16);
+            CHECK_TRUE(values->get() == (u32 const*)(base + 32));
+            for (u32 i = 0; i < s_numValues; ++i)
+                CHECK_EQUAL(100 + i, values->get()[i]);
+            CHECK_EQUAL((u32)strlen(s_text), relText.bytes());
+            CHECK_EQUAL((u32)strlen(s_text), relText.size());
+            CHECK_EQUAL(0, strcmp(relText.c_str(), s_text));
+
+            // After g_patch the same records are read through array_t and datastring_t, in either mode
+            charon::g_patch(header);
+            charon::array_t<u32> const* array = (charon::array_t<u32> const*)base;
+            charon::string_t const      text  = *(charon::datastring_t const*)(base + 16);
+            CHECK_EQUAL(s_numValues, array->size());
+            CHECK_EQUAL(s_numValues * sizeof(u32), array->bytes());
+            for (u32 i = 0; i < s_numValues; ++i)
+                CHECK_EQUAL(100 + i, (*array)[i]);
+            CHECK_EQUAL((u32)strlen(s_text), text.bytes());
+            CHECK_EQUAL(0, strcmp(text.c_str(), s_text));
+            Allocator->deallocate(header);
+        }
+
+        UNITTEST_TEST(chain)
+        {
+            charon::dataunit_header_t* header = build(Allocator, 1000, false);
+            CHECK_TRUE(charon::g_patch(header) == (u8*)(header + 1));
+            CHECK_TRUE(verify(header, 1000));
+            Allocator->deallocate(header);
+        }
+
+        UNITTEST_TEST(flat)
+        {
+            for (s32 n = 0; n < 40; ++n)
+            {
+                charon::dataunit_header_t* header = build(Allocator, n, true);
+                charon::g_patch(header);
+                CHECK_TRUE(verify(header, n));
+                Allocator->deallocate(header);
+            }
+        }
+
+        UNITTEST_TEST(flat_parallel)
+        {
+            charon::jobs_t jobs;
+            jobs.setup(Allocator, 3, 16);
+            s32 const                  n      = 200000;
+            charon::dataunit_header_t* header = build(Allocator, n, true);
+            charon::g_patch(header, &jobs);
+            CHECK_TRUE(verify(header, n));
+            Allocator->deallocate(header);
+            jobs.teardown();
+        }
+    }
+}
+UNITTEST_SUITE_END
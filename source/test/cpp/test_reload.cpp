@@ -0,0 +1,144 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_hash.h"
+
+#include "test_bigfile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(reload)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_reload";
+        static const u32   s_numFiles = 16;
+        static const u32   s_numOwned = 8;  // Files 0..7 are loaded and kept
+
+        struct build_t
+        {
+            byte                      mData[s_numFiles][1024];
+            charon::ntest::testfile_t mFiles[s_numFiles];
+        };
+
+        // File i has (i + 1) * 50 bytes, the seeded file gets other content and the grown file 100 more bytes
+        static bool write(build_t& build, u32 seeded, u32 seed, u32 grown)
+        {
+            for (u32 i = 0; i < s_numFiles; ++i)
+            {
+                build.mFiles[i].mData     = build.mData[i];
+                build.mFiles[i].mSize     = (i + 1) * 50 + (i == grown ? 100 : 0);
+                build.mFiles[i].mCompress = false;
+                charon::ntest::fill(build.mData[i], build.mFiles[i].mSize, i == seeded ? seed : i);
+            }
+            return charon::ntest::write_archive(Allocator, s_path, 1, build.mFiles, s_numFiles);
+        }
+
+        struct owners_t
+        {
+            void* mData[s_numOwned];
+            s32   mCalls;
+            s32   mBad;
+        };
+
+        static void s_on_reload(void* context, charon::fileid_t fileid, s32 dataunitIndex, void* oldData, void* newData)
+        {
+            owners_t* owners = (owners_t*)context;
+            u32 const f      = fileid.getFileIndex();
+            owners->mCalls += 1;
+            if (dataunitIndex != -1 || fileid.getArchiveIndex() != 1 || f >= s_numOwned || owners->mData[f] != oldData || newData == nullptr)
+                owners->mBad += 1;
+            else
+                owners->mData[f] = newData;
+        }
+
+        static bool s_same(owners_t const& owners, build_t const& build)
+        {
+            for (u32 f = 0; f < s_numOwned; ++f)
+            {
+                if (memcmp(owners.mData[f], build.mFiles[f].mData, build.mFiles[f].mSize) != 0)
+                    return false;
+            }
+            return true;
+        }
+
+        static void check(alloc_t* allocator, charon::archive_t::EBackend backend)
+        {
+            build_t* build = (build_t*)allocator->allocate(sizeof(build_t));
+            CHECK_TRUE(write(*build, ~0u, 0, ~0u));
+
+            charon::archive_t::config_t config;
+            config.mBackend         = backend;
+            config.mResidencyBudget = 1 << 20;
+            charon::archive_t::s_setup(allocator, 4, 4, config);
+            charon::archive_t*        ar     = charon::archive_t::s_instance;
+            charon::archive_loader_t* loader = ar->loader();
+            CHECK_EQUAL(0, charon::ntest::mount_archive(s_path, 1));
+            CHECK_FALSE(ar->changed(1));
+
+            owners_t owners;
+            memset(&owners, 0, sizeof(owners));
+            for (u32 f = 0; f < s_numOwned; ++f)
+                owners.mData[f] = loader->load_datafile(charon::fileid_t(1, f));
+            CHECK_TRUE(s_same(owners, *build));
+
+            // A content change that keeps every offset and size is seen through the HDB, which find loaded
+            CHECK_EQUAL(0u, ar->find(charon::nhash::hash64(build->mData[0], build->mFiles[0].mSize)).getFileIndex());
+            CHECK_TRUE(write(*build, 3, 99, ~0u));
+            CHECK_TRUE(ar->changed(1));
+            s32 const content = ar->reload(1, s_on_reload, &owners);
+            CHECK_EQUAL(backend == charon::archive_t::BackendMemoryMapped ? (s32)s_numOwned : 1, content);
+            CHECK_EQUAL(content, owners.mCalls);
+            CHECK_EQUAL(0, owners.mBad);
+            CHECK_TRUE(s_same(owners, *build));
+            CHECK_FALSE(ar->changed(1));
+
+            // A file that grows moves every file after it
+            owners.mCalls = 0;
+            CHECK_TRUE(write(*build, 3, 99, 5));
+            CHECK_TRUE(ar->changed(1));
+            s32 const layout = ar->reload(1, s_on_reload, &owners);
+            CHECK_EQUAL(backend == charon::archive_t::BackendMemoryMapped ? (s32)s_numOwned : 3, layout);
+            CHECK_EQUAL(layout, owners.mCalls);
+            CHECK_EQUAL(0, owners.mBad);
+            CHECK_TRUE(s_same(owners, *build));
+            CHECK_EQUAL(build->mFiles[5].mSize, (u32)ar->fileitem(charon::fileid_t(1, 5))->getFileSize());
+
+            // A rebuild that can not be opened leaves the archive as it was
+            owners.mCalls = 0;
+            CHECK_TRUE(write(*build, 3, 7, ~0u));
+            CHECK_EQUAL(0, rename("test_reload.toc", "test_reload.toc.keep"));
+            CHECK_EQUAL(-1, ar->reload(1, s_on_reload, &owners));
+            CHECK_EQUAL(0, owners.mCalls);
+            CHECK_EQUAL(build->mFiles[5].mSize + 100, (u32)ar->fileitem(charon::fileid_t(1, 5))->getFileSize());
+            CHECK_EQUAL(0, rename("test_reload.toc.keep", "test_reload.toc"));
+            CHECK_TRUE(ar->changed(1));
+            CHECK_TRUE(ar->reload(1, s_on_reload, &owners) > 0);
+            CHECK_EQUAL(0, owners.mBad);
+            CHECK_TRUE(s_same(owners, *build));
+
+            for (u32 f = 0; f < s_numOwned; ++f)
+                loader->unload_datafile(charon::fileid_t(1, f), owners.mData[f]);
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+            allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(file_read) { check(Allocator, charon::archive_t::BackendFileRead); }
+        UNITTEST_TEST(memory_mapped) { check(Allocator, charon::archive_t::BackendMemoryMapped); }
+    }
+}
+UNITTEST_SUITE_END
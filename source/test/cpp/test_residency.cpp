@@ -0,0 +1,142 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+
+#include "test_bigfile.h"
+
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(residency)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_residency";
+        static const u32   s_numFiles = 16;
+        static const u32   s_fileSize = 1000;
+
+        // Every file has s_fileSize bytes, the archive is mounted at index 1
+        static charon::archive_t* setup(alloc_t* allocator, u64 budget)
+        {
+            charon::archive_t::config_t config;
+            config.mResidencyBudget = budget;
+            charon::archive_t::s_setup(allocator, 4, 2, config);
+
+            byte*                     data = (byte*)allocator->allocate(s_numFiles * s_fileSize);
+            charon::ntest::testfile_t files[s_numFiles];
+            for (u32 i = 0; i < s_numFiles; ++i)
+            {
+                files[i].mData     = data + i * s_fileSize;
+                files[i].mSize     = s_fileSize;
+                files[i].mCompress = false;
+                charon::ntest::fill(data + i * s_fileSize, s_fileSize, i);
+            }
+            CHECK_TRUE(charon::ntest::mount_files(allocator, s_path, 1, files, s_numFiles));
+            allocator->deallocate(data);
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown()
+        {
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+        }
+
+        static void touch(charon::archive_t* ar, u32 f)
+        {
+            void* data = ar->loader()->load_datafile(charon::fileid_t(1, f));
+            CHECK_NOT_NULL(data);
+            ar->loader()->unload_datafile(charon::fileid_t(1, f), data);
+        }
+
+        UNITTEST_TEST(counters)
+        {
+            charon::archive_t* ar = setup(Allocator, 4 * s_fileSize);
+
+            touch(ar, 0);
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(0, charon::ntest::counter(charon::telemetry_t::CounterHits));
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterMisses));
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterReads));
+            CHECK_EQUAL(s_fileSize, charon::ntest::counter(charon::telemetry_t::CounterBytesRead));
+
+            // Unloaded data stays within the budget, loading it again is a hit without a read
+            touch(ar, 0);
+            CHECK_EQUAL(2, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterHits));
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterMisses));
+            CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterReads));
+
+            // A batch counts every file, those that are resident as hits
+            charon::fileid_t ids[4];
+            void*            data[4];
+            for (u32 i = 0; i < 4; ++i)
+                ids[i] = charon::fileid_t(1, i);
+            ar->loader()->load_datafiles(ids, 4, data);
+            CHECK_EQUAL(6, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(2, charon::ntest::counter(charon::telemetry_t::CounterHits));
+            CHECK_EQUAL(4, charon::ntest::counter(charon::telemetry_t::CounterMisses));
+            for (u32 i = 0; i < 4; ++i)
+            {
+                CHECK_NOT_NULL(data[i]);
+                ar->loader()->unload_datafile(ids[i], data[i]);
+            }
+
+            // Evictions are counted as the budget is kept
+            for (u32 f = 4; f < 8; ++f)
+                touch(ar, f);
+            CHECK_EQUAL(4, charon::ntest::counter(charon::telemetry_t::CounterEvictions));
+            CHECK_EQUAL(4 * (u64)s_fileSize, ar->resident_bytes(1));
+
+            ar->reset_stats();
+            CHECK_EQUAL(0, charon::ntest::counter(charon::telemetry_t::CounterLoads));
+            CHECK_EQUAL(0, charon::ntest::counter(charon::telemetry_t::CounterMisses));
+            teardown();
+        }
+
+        UNITTEST_TEST(budget)
+        {
+            charon::archive_t* ar = setup(Allocator, 4 * s_fileSize);
+
+            // Unloaded data is evicted least recently used first, as soon as the budget is exceeded
+            for (u32 f = 0; f < 8; ++f)
+            {
+                touch(ar, f);
+                CHECK_TRUE(ar->resident_bytes() <= 4 * s_fileSize);
+            }
+            CHECK_EQUAL(4 * (u64)s_fileSize, ar->resident_bytes());
+            for (u32 f = 0; f < 8; ++f)
+                CHECK_EQUAL(f >= 4, ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, f)) != nullptr);
+
+            // A hit makes a file the most recently used
+            touch(ar, 4);
+            touch(ar, 8);
+            CHECK_NOT_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 4)));
+            CHECK_NULL(ar->loader()->get_datafile_ptr<void>(charon::fileid_t(1, 5)));
+
+            // Data that has owners is never evicted, whatever the budget
+            void* held[6];
+            for (u32 i = 0; i < 6; ++i)
+                held[i] = ar->loader()->load_datafile(charon::fileid_t(1, 10 + i));
+            CHECK_EQUAL(6 * (u64)s_fileSize, ar->resident_bytes());
+            ar->set_residency_budget(s_fileSize);
+            CHECK_EQUAL(6 * (u64)s_fileSize, ar->resident_bytes());
+            for (u32 i = 0; i < 6; ++i)
+                ar->loader()->unload_datafile(charon::fileid_t(1, 10 + i), held[i]);
+            CHECK_EQUAL((u64)s_fileSize, ar->resident_bytes());
+
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            teardown();
+        }
+    }
+}
+UNITTEST_SUITE_END
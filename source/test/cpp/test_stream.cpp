@@ -0,0 +1,234 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+#include "charon/c_platform.h"
+
+#include "test_bigfile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(stream)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_stream";
+        static const char* s_other    = "test_stream_other";
+        static const char* s_trace    = "test_stream.json";
+        static const u32   s_numFiles = 12;
+        static const u32   s_fileSize = 1000;
+        static const u32   s_gateSize = 3000;  // File 0, the only allocation of this size
+
+        struct build_t
+        {
+            byte mGate[s_gateSize];
+            byte mData[s_numFiles][s_fileSize];
+        };
+
+        // Archive 1: the gate file, files 1-8 compressed, files 9-11 stored. Archive 2: one stored file.
+        // A single I/O thread serves the loads, a test holds it on the gate file while it queues the others.
+        static charon::archive_t* setup(charon::ntest::gatealloc_t* gate, build_t* build)
+        {
+            charon::archive_t::config_t config;
+            config.mResidencyBudget = 1 << 20;
+            config.mNumIoThreads    = 1;
+            charon::archive_t::s_setup(gate, 4, 4, config);
+
+            charon::ntest::fill(build->mGate, s_gateSize, 100);
+            charon::ntest::testfile_t files[s_numFiles];
+            files[0].mData     = build->mGate;
+            files[0].mSize     = s_gateSize;
+            files[0].mCompress = false;
+            for (u32 f = 1; f < s_numFiles; ++f)
+            {
+                charon::ntest::fill(build->mData[f], s_fileSize, f);
+                files[f].mData     = build->mData[f];
+                files[f].mSize     = s_fileSize;
+                files[f].mCompress = f < 9;
+            }
+            charon::ntest::fill(build->mData[0], s_fileSize, 0);
+            charon::ntest::testfile_t const other = {build->mData[0], s_fileSize, false};
+            CHECK_TRUE(charon::ntest::mount_files(gate, s_path, 1, files, s_numFiles));
+            CHECK_TRUE(charon::ntest::mount_files(gate, s_other, 2, &other, 1));
+            return charon::archive_t::s_instance;
+        }
+
+        static void teardown(charon::archive_t* ar)
+        {
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+            charon::ntest::remove_archive(s_other);
+            remove(s_trace);
+        }
+
+        // Poll rather than wait, waiting on a queued load serves it on the calling thread
+        static bool finish(charon::archive_loader_t* loader, charon::loadhandle_t const* handles, u32 count)
+        {
+            u64 const until = charon::nplatform::clock_ns() + 5000000000ull;
+            for (u32 i = 0; i < count; ++i)
+            {
+                while (!loader->is_done(handles[i]))
+                {
+                    if (charon::nplatform::clock_ns() > until)
+                        return false;
+                    charon::nplatform::thread_yield();
+                }
+            }
+            return true;
+        }
+
+        // The archive and file of the queue events of the trace in the order they were served, the index of a
+        // file in the second archive is returned as 100 + index
+        static u32 served(alloc_t* allocator, charon::archive_t* ar, u32* files, u32 maxFiles)
+        {
+            ar->stop_trace();
+            CHECK_TRUE(ar->dump_trace(s_trace));
+
+            FILE* f = fopen(s_trace, "rb");
+            if (f == nullptr)
+                return 0;
+            fseek(f, 0, SEEK_END);
+            long const size = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            char*        text = (char*)allocator->allocate((u32)size + 1);
+            size_t const read = fread(text, 1, (size_t)size, f);
+            text[read]        = 0;
+            fclose(f);
+
+            u32         count  = 0;
+            char const* cursor = text;
+            while (count < maxFiles && (cursor = strstr(cursor, "{\"name\":\"queue\"")) != nullptr)
+            {
+                char const* archive = strstr(cursor, "\"archive\":");
+                char const* file    = strstr(cursor, "\"file\":");
+                if (archive == nullptr || file == nullptr)
+                    break;
+                u32 const archiveIndex = (u32)strtoul(archive + 10, nullptr, 10);
+                u32 const fileIndex    = (u32)strtoul(file + 7, nullptr, 10);
+                files[count++]         = (archiveIndex == 2 ? 100 : 0) + fileIndex;
+                cursor                 = file;
+            }
+            allocator->deallocate(text);
+            return count;
+        }
+
+        static void unload(charon::archive_loader_t* loader, charon::fileid_t fileid)
+        {
+            void* data = loader->get_datafile_ptr<void>(fileid);
+            CHECK_NOT_NULL(data);
+            loader->unload_datafile(fileid, data);
+        }
+
+        UNITTEST_TEST(order)
+        {
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build);
+            charon::archive_loader_t*  loader = ar->loader();
+            CHECK_TRUE(ar->start_trace(1024));
+
+            // A load that has started can not be reprioritized or cancelled
+            charon::loadhandle_t handles[9];
+            gate.arm(s_gateSize);
+            handles[0] = loader->load_datafile_async(charon::fileid_t(1, 0), charon::PriorityIdle);
+            CHECK_TRUE(gate.held());
+            CHECK_FALSE(loader->is_done(handles[0]));
+            CHECK_FALSE(loader->reprioritize(handles[0], charon::PriorityImmediate));
+            CHECK_FALSE(loader->cancel(handles[0]));
+
+            // Priority first, then the earliest deadline where no deadline (0) comes last, then request order
+            u64 const now = charon::nplatform::clock_ns();
+            handles[1]    = loader->load_datafile_async(charon::fileid_t(1, 1), charon::PriorityLow);
+            handles[2]    = loader->load_datafile_async(charon::fileid_t(1, 2), charon::PriorityHigh);
+            handles[3]    = loader->load_datafile_async(charon::fileid_t(1, 3), charon::PriorityHigh, now + 2000000000ull);
+            handles[4]    = loader->load_datafile_async(charon::fileid_t(1, 4), charon::PriorityNormal);
+            handles[5]    = loader->load_datafile_async(charon::fileid_t(1, 5), charon::PriorityHigh, now + 1000000000ull);
+            handles[6]    = loader->load_datafile_async(charon::fileid_t(1, 6), charon::PriorityNormal);
+            handles[7]    = loader->load_datafile_async(charon::fileid_t(1, 7), charon::PriorityIdle);
+            handles[8]    = loader->load_datafile_async(charon::fileid_t(1, 8), charon::PriorityNormal);
+            CHECK_TRUE(loader->reprioritize(handles[7], charon::PriorityImmediate));
+            CHECK_TRUE(loader->cancel(handles[8]));
+            CHECK_TRUE(loader->is_done(handles[8]));
+            CHECK_FALSE(loader->cancel(handles[8]));
+            for (u32 i = 1; i < 8; ++i)
+                CHECK_FALSE(loader->is_done(handles[i]));
+
+            gate.open();
+            CHECK_TRUE(finish(loader, handles, 9));
+            CHECK_FALSE(loader->reprioritize(handles[7], charon::PriorityLow));
+            CHECK_FALSE(loader->cancel(handles[1]));
+
+            u32 const expected[] = {0, 7, 5, 3, 2, 4, 6, 1};
+            u32       order[16];
+            CHECK_EQUAL(8, served(Allocator, ar, order, 16));
+            for (u32 i = 0; i < 8; ++i)
+                CHECK_EQUAL(expected[i], order[i]);
+
+            CHECK_EQUAL(0, memcmp(loader->get_datafile_ptr<void>(charon::fileid_t(1, 0)), build->mGate, s_gateSize));
+            for (u32 f = 1; f < 8; ++f)
+                CHECK_EQUAL(0, memcmp(loader->get_datafile_ptr<void>(charon::fileid_t(1, f)), build->mData[f], s_fileSize));
+            CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, 8)));
+            for (u32 f = 0; f < 8; ++f)
+                unload(loader, charon::fileid_t(1, f));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(merge)
+        {
+            charon::ntest::gatealloc_t gate(Allocator);
+            build_t*                   build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*         ar     = setup(&gate, build);
+            charon::archive_loader_t*  loader = ar->loader();
+            CHECK_TRUE(ar->start_trace(1024));
+
+            charon::loadhandle_t handles[5];
+            gate.arm(s_gateSize);
+            handles[0] = loader->load_datafile_async(charon::fileid_t(1, 0), charon::PriorityNormal);
+            CHECK_TRUE(gate.held());
+
+            // Stored files that are close together in an archive are served with the most urgent of them as
+            // one read, whatever their own priority. A file of another archive is never part of it.
+            handles[1] = loader->load_datafile_async(charon::fileid_t(1, 9), charon::PriorityIdle);
+            handles[2] = loader->load_datafile_async(charon::fileid_t(1, 11), charon::PriorityLow);
+            handles[3] = loader->load_datafile_async(charon::fileid_t(2, 0), charon::PriorityHigh);
+            handles[4] = loader->load_datafile_async(charon::fileid_t(1, 10), charon::PriorityIdle);
+
+            gate.open();
+            CHECK_TRUE(finish(loader, handles, 5));
+            CHECK_EQUAL(3, charon::ntest::counter(charon::telemetry_t::CounterReads));
+
+            u32 order[16];
+            CHECK_EQUAL(5, served(Allocator, ar, order, 16));
+            CHECK_EQUAL(0, order[0]);
+            CHECK_EQUAL(100, order[1]);
+            CHECK_EQUAL(11, order[2]);
+            CHECK_TRUE((order[3] == 9 && order[4] == 10) || (order[3] == 10 && order[4] == 9));
+
+            CHECK_EQUAL(0, memcmp(loader->get_datafile_ptr<void>(charon::fileid_t(2, 0)), build->mData[0], s_fileSize));
+            for (u32 f = 9; f < s_numFiles; ++f)
+                CHECK_EQUAL(0, memcmp(loader->get_datafile_ptr<void>(charon::fileid_t(1, f)), build->mData[f], s_fileSize));
+            unload(loader, charon::fileid_t(1, 0));
+            unload(loader, charon::fileid_t(2, 0));
+            for (u32 f = 9; f < s_numFiles; ++f)
+                unload(loader, charon::fileid_t(1, f));
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END
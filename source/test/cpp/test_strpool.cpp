@@ -0,0 +1,157 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_strpool.h"
+
+#include "test_bigfile.h"
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(strpool)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const u32 s_languages = 3;
+        static const u32 s_strings   = 500;
+
+        // Text of string i in language l, strings repeat within a language every 100 and every third of
+        // those is the same in all languages
+        static u32 text(u32 l, u32 i, char* buffer)
+        {
+            u32 const   key    = i % 100;
+            u32 const   lang   = (key % 3) == 0 ? 9 : l;
+            char const* phrase = "the quick brown fox jumps over the lazy dog ";
+            u32         length = 0;
+            buffer[length++]   = (char)('a' + lang);
+            for (u32 r = 0; r < 1 + key % 4; ++r)
+                for (char const* c = phrase; *c != 0; ++c)
+                    buffer[length++] = *c;
+            buffer[length++] = (char)('0' + key / 10);
+            buffer[length++] = (char)('0' + key % 10);
+            buffer[length]   = 0;
+            return length;
+        }
+
+        static bool equal(charon::string_t const& s, char const* expected, u32 length)
+        {
+            if (s.bytes() != length || s.size() != length || s.c_str()[length] != 0)
+                return false;
+            for (u32 i = 0; i < length; ++i)
+                if (s.c_str()[i] != expected[i])
+                    return false;
+            return true;
+        }
+
+        static void check(alloc_t* allocator, u32 blockSize, bool compress)
+        {
+            char* texts = (char*)allocator->allocate(s_languages * s_strings * 256);
+            u32*  ids   = (u32*)allocator->allocate(s_languages * s_strings * 4);
+            u32   hashes[s_strings];
+            for (u32 i = 0; i < s_strings; ++i)
+                hashes[i] = charon::ntest::key_hash(i);
+
+            charon::strpoolbuilder_t builder;
+            builder.setup(allocator, s_languages * s_strings);
+            for (u32 l = 0; l < s_languages; ++l)
+            {
+                for (u32 i = 0; i < s_strings; ++i)
+                {
+                    char* t                = texts + (l * s_strings + i) * 256;
+                    u32   length           = text(l, i, t);
+                    ids[l * s_strings + i] = builder.add(t, length, length);
+                }
+            }
+            // 100 keys, one shared third and the rest per language
+            CHECK_EQUAL(34u + 66u * s_languages, builder.size());
+
+            u32 const poolBound = builder.pool_bound(blockSize);
+            byte*     poolData  = (byte*)allocator->allocate(poolBound);
+            s32 const poolSize  = builder.write_pool(poolData, poolBound, blockSize, compress);
+            CHECK_TRUE(poolSize > 0);
+            charon::strpool_t const* pool = (charon::strpool_t const*)poolData;
+            CHECK_TRUE(pool->isValid());
+            CHECK_EQUAL((u32)poolSize, pool->bytes());
+            CHECK_EQUAL(builder.size(), pool->size());
+
+            charon::strcache_t cache;
+            cache.setup(allocator, 2, 2);
+
+            u32 const langBound = charon::strpoolbuilder_t::s_language_bound(s_strings);
+            byte*     langData  = (byte*)allocator->allocate(langBound);
+            for (u32 l = 0; l < s_languages; ++l)
+            {
+                s32 const langSize = charon::strpoolbuilder_t::s_write_language(hashes, ids + l * s_strings, s_strings, charon::fileid_t(1, 7), langData, langBound);
+                CHECK_TRUE(langSize > 0);
+                charon::strlang_t const* lang = (charon::strlang_t const*)langData;
+                CHECK_TRUE(lang->isValid());
+                CHECK_EQUAL((u32)langSize, lang->bytes());
+                CHECK_EQUAL(7u, lang->pool().m_fileid.getFileIndex());
+
+                for (u32 i = 0; i < s_strings; ++i)
+                {
+                    s32 const index = lang->find(hashes[i]);
+                    CHECK_EQUAL((s32)i, index);
+                    CHECK_EQUAL(ids[l * s_strings + i], lang->id((u32)index));
+                    char      expected[256];
+                    u32 const length = text(l, i, expected);
+                    CHECK_TRUE(equal(cache.str(pool, lang->id((u32)index)), expected, length));
+                }
+                CHECK_EQUAL(-1, lang->find(charon::ntest::key_hash(s_strings)));
+            }
+            CHECK_EQUAL(charon::string_t().bytes(), cache.str(pool, pool->size()).bytes());
+
+            if (compress)
+            {
+                // Shared text compresses well, and the cache only decodes on a miss
+                CHECK_TRUE((u32)poolSize < builder.size() * 40);
+                CHECK_TRUE(cache.decodes() > 0);
+                u64 const decodes = cache.decodes();
+                cache.str(pool, 0);
+                cache.str(pool, 0);
+                CHECK_TRUE(cache.decodes() <= decodes + 1);
+
+                // Evicted blocks are kept for the grace updates
+                cache.forget(pool);
+                CHECK_TRUE(cache.bytes() > 0);
+                cache.update();
+                CHECK_TRUE(cache.bytes() > 0);
+                cache.update();
+                CHECK_EQUAL(0, cache.bytes());
+            }
+            else
+            {
+                CHECK_EQUAL(0, cache.decodes());
+            }
+
+            cache.teardown();
+            builder.teardown();
+            allocator->deallocate(langData);
+            allocator->deallocate(poolData);
+            allocator->deallocate(ids);
+            allocator->deallocate(texts);
+        }
+
+        UNITTEST_TEST(stored) { check(Allocator, 4096, false); }
+        UNITTEST_TEST(compressed) { check(Allocator, 4096, true); }
+        UNITTEST_TEST(one_block) { check(Allocator, 64 * 1024, true); }
+
+        UNITTEST_TEST(empty)
+        {
+            charon::strpoolbuilder_t builder;
+            builder.setup(Allocator, 4);
+            byte      data[256];
+            s32 const size = builder.write_pool(data, sizeof(data), 1024, true);
+            CHECK_TRUE(size > 0);
+            CHECK_EQUAL(0u, ((charon::strpool_t const*)data)->size());
+            CHECK_EQUAL(0u, ((charon::strpool_t const*)data)->numBlocks());
+            builder.teardown();
+        }
+    }
+}
+UNITTEST_SUITE_END
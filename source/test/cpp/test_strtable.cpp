@@ -0,0 +1,123 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_gamedata.h"
+
+#include "test_bigfile.h"
+
+#include <stdio.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(strtable)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        // Strings "0", "1", ... keyed by the given hashes
+        static charon::strtable_t const* build(alloc_t* allocator, u32 const* hashes, u32 numStrings)
+        {
+            char*        text      = (char*)allocator->allocate(numStrings * 12 + 1);
+            char const** strs      = (char const**)allocator->allocate((numStrings + 1) * sizeof(char const*));
+            u32*         lengths   = (u32*)allocator->allocate((numStrings + 1) * 4);
+            u32          textBytes = 0;
+            for (u32 i = 0; i < numStrings; ++i)
+            {
+                char* digits = text + i * 12;
+                lengths[i]   = (u32)snprintf(digits, 12, "%u", i);
+                strs[i]      = digits;
+                textBytes += lengths[i];
+            }
+
+            u32 const size  = charon::strtable_t::s_table_bound(numStrings, textBytes);
+            byte*     data  = (byte*)allocator->allocate(size);
+            CHECK_EQUAL(-1, charon::strtable_t::s_write_table(hashes, strs, lengths, lengths, numStrings, data, size - 1));
+            s32 const bytes = charon::strtable_t::s_write_table(hashes, strs, lengths, lengths, numStrings, data, size);
+            CHECK_TRUE(bytes > 0 && (u32)bytes <= size);
+            CHECK_EQUAL((u32)bytes, ((charon::strtable_t const*)data)->bytes());
+
+            allocator->deallocate(lengths);
+            allocator->deallocate(strs);
+            allocator->deallocate(text);
+            return (charon::strtable_t const*)data;
+        }
+
+        UNITTEST_TEST(find)
+        {
+            u32 const numStrings = 1000;
+            u32*      hashes     = (u32*)Allocator->allocate(numStrings * 4);
+            for (u32 i = 0; i < numStrings; ++i)
+                hashes[i] = charon::ntest::key_hash(i);
+
+            charon::strtable_t const* table = build(Allocator, hashes, numStrings);
+            CHECK_TRUE(table->isValid());
+            CHECK_EQUAL(1000, table->size());
+            for (u32 i = 0; i < numStrings; ++i)
+            {
+                CHECK_EQUAL((s32)i, table->find(hashes[i]));
+                CHECK_EQUAL(hashes[i], table->hash(i));
+            }
+            CHECK_EQUAL(-1, table->find(charon::ntest::key_hash(numStrings)));
+            CHECK_EQUAL(-1, table->find(0));
+
+            charon::string_t const text = table->str((u32)table->find(hashes[123]));
+            CHECK_EQUAL(3u, text.bytes());
+            CHECK_EQUAL('1', text.c_str()[0]);
+            CHECK_EQUAL('3', text.c_str()[2]);
+
+            Allocator->deallocate((void*)table);
+            Allocator->deallocate(hashes);
+        }
+
+        // Hashes that all start probing in the same bucket still find their own string
+        UNITTEST_TEST(collide)
+        {
+            u32 const numStrings = 12;
+            u32 const indexSize  = charon::strtable_t::s_index_size(numStrings);
+            u32       hashes[numStrings];
+            u32       count = 0;
+            for (u32 h = 1; count < numStrings; ++h)
+            {
+                if (charon::strtable_t::s_bucket(h, indexSize) == indexSize - 1)
+                    hashes[count++] = h;
+            }
+
+            u32 index[16];
+            CHECK_EQUAL(16u, indexSize);
+            CHECK_TRUE(charon::strtable_t::s_build_index(hashes, numStrings, index, indexSize));
+
+            charon::strtable_t const* table = build(Allocator, hashes, numStrings);
+            for (u32 i = 0; i < numStrings; ++i)
+                CHECK_EQUAL((s32)i, table->find(hashes[i]));
+            Allocator->deallocate((void*)table);
+        }
+
+        UNITTEST_TEST(duplicate)
+        {
+            // The index reports the duplicate, the first of the two strings is found
+            u32 const hashes[] = {5, 7, 5, 9};
+            u32       index[8];
+            CHECK_EQUAL(8u, charon::strtable_t::s_index_size(4));
+            CHECK_FALSE(charon::strtable_t::s_build_index(hashes, 4, index, 8));
+
+            charon::strtable_t const* table = build(Allocator, hashes, 4);
+            CHECK_EQUAL(0, table->find(5));
+            CHECK_EQUAL(3, table->find(9));
+            Allocator->deallocate((void*)table);
+        }
+
+        UNITTEST_TEST(empty)
+        {
+            charon::strtable_t const* table = build(Allocator, nullptr, 0);
+            CHECK_EQUAL(0, table->size());
+            CHECK_EQUAL(-1, table->find(1));
+            Allocator->deallocate((void*)table);
+        }
+    }
+}
+UNITTEST_SUITE_END
@@ -0,0 +1,154 @@
+#include "ccore/c_target.h"
+
+#include "cunittest/cunittest.h"
+#include "ccore/c_allocator.h"
+#include "charon/c_archive.h"
+
+#include "test_bigfile.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace ncore;
+
+UNITTEST_SUITE_BEGIN(verify)
+{
+    UNITTEST_FIXTURE(main)
+    {
+        UNITTEST_ALLOCATOR;
+
+        UNITTEST_FIXTURE_SETUP() {}
+        UNITTEST_FIXTURE_TEARDOWN() {}
+
+        static const char* s_path     = "test_verify";
+        static const u32   s_numFiles = 4;
+        static const u32   s_fileSize = 2000;
+
+        struct build_t
+        {
+            byte mData[s_numFiles][s_fileSize];
+        };
+
+        static bool flip(u64 offset)
+        {
+            char filename[64];
+            snprintf(filename, sizeof(filename), "%s.gda", s_path);
+            FILE* f = fopen(filename, "r+b");
+            if (f == nullptr)
+                return false;
+            bool ok = fseek(f, (long)offset, SEEK_SET) == 0;
+            s32  c  = ok ? fgetc(f) : EOF;
+            ok      = ok && c != EOF && fseek(f, (long)offset, SEEK_SET) == 0 && fputc(c ^ 0x5A, f) != EOF;
+            return fclose(f) == 0 && ok;
+        }
+
+        // Files 1 (stored) and 2 (compressed) have a byte changed in the archive, 0 (stored) and 3 (compressed)
+        // are intact. The last byte of a compressed file is a literal, so its blocks still decode.
+        static charon::archive_t* setup(alloc_t* allocator, build_t* build, charon::archive_t::EBackend backend, bool verify)
+        {
+            charon::archive_t::config_t config;
+            config.mBackend         = backend;
+            config.mResidencyBudget = 1 << 20;
+            config.mVerify          = verify;
+            charon::archive_t::s_setup(allocator, 4, 2, config);
+
+            charon::ntest::testfile_t files[s_numFiles];
+            for (u32 f = 0; f < s_numFiles; ++f)
+            {
+                charon::ntest::fill(build->mData[f], s_fileSize, f);
+                files[f].mData     = build->mData[f];
+                files[f].mSize     = s_fileSize;
+                files[f].mCompress = f >= 2;
+            }
+            CHECK_TRUE(charon::ntest::mount_files(allocator, s_path, 1, files, s_numFiles));
+
+            charon::archive_t*              ar     = charon::archive_t::s_instance;
+            charon::archive_t::file_t const stored = *ar->fileitem(charon::fileid_t(1, 1));
+            charon::archive_t::file_t const packed = *ar->fileitem(charon::fileid_t(1, 2));
+            CHECK_TRUE(packed.isCompressed());
+            ar->unmount(1);
+            CHECK_TRUE(flip(stored.getFileOffset() + 100));
+            CHECK_TRUE(flip(packed.getFileOffset() + packed.getFileSize() - 1));
+            CHECK_EQUAL(0, charon::ntest::mount_archive(s_path, 1));
+            return ar;
+        }
+
+        static void teardown(charon::archive_t* ar)
+        {
+            ar->set_residency_budget(0);
+            CHECK_EQUAL(0, ar->resident_bytes());
+            charon::archive_t::s_teardown();
+            charon::ntest::remove_archive(s_path);
+        }
+
+        UNITTEST_TEST(scan)
+        {
+            build_t* build = (build_t*)Allocator->allocate(sizeof(build_t));
+            for (s32 backend = 0; backend < 2; ++backend)
+            {
+                charon::archive_t* ar = setup(Allocator, build, (charon::archive_t::EBackend)backend, false);
+
+                charon::fileid_t corrupt[s_numFiles];
+                CHECK_EQUAL(2, ar->verify(1, corrupt, s_numFiles, 2));
+                CHECK_EQUAL(1, corrupt[0].getArchiveIndex());
+                CHECK_EQUAL(1, corrupt[1].getArchiveIndex());
+                CHECK_TRUE((corrupt[0].getFileIndex() == 1 && corrupt[1].getFileIndex() == 2) || (corrupt[0].getFileIndex() == 2 && corrupt[1].getFileIndex() == 1));
+
+                // Without an array the corrupt files are only counted, an archive that is not mounted is an error
+                CHECK_EQUAL(2, ar->verify(1));
+                CHECK_EQUAL(-1, ar->verify(2));
+
+                teardown(ar);
+            }
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(load)
+        {
+            build_t* build = (build_t*)Allocator->allocate(sizeof(build_t));
+            for (s32 backend = 0; backend < 2; ++backend)
+            {
+                charon::archive_t*        ar     = setup(Allocator, build, (charon::archive_t::EBackend)backend, true);
+                charon::archive_loader_t* loader = ar->loader();
+
+                // A corrupt file fails to load, also when it is compressed and hashed as it streams in
+                CHECK_NULL(loader->load_datafile(charon::fileid_t(1, 1)));
+                CHECK_EQUAL(1, charon::ntest::counter(charon::telemetry_t::CounterCorrupt));
+                CHECK_NULL(loader->load_datafile(charon::fileid_t(1, 2)));
+                CHECK_EQUAL(2, charon::ntest::counter(charon::telemetry_t::CounterCorrupt));
+                CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, 1)));
+                CHECK_NULL(loader->get_datafile_ptr<void>(charon::fileid_t(1, 2)));
+
+                for (u32 f = 0; f < s_numFiles; f += 3)
+                {
+                    void* data = loader->load_datafile(charon::fileid_t(1, f));
+                    CHECK_NOT_NULL(data);
+                    CHECK_EQUAL(0, memcmp(data, build->mData[f], s_fileSize));
+                    loader->unload_datafile(charon::fileid_t(1, f), data);
+                }
+                CHECK_EQUAL(2, charon::ntest::counter(charon::telemetry_t::CounterCorrupt));
+
+                teardown(ar);
+            }
+            Allocator->deallocate(build);
+        }
+
+        UNITTEST_TEST(unverified)
+        {
+            build_t*                  build  = (build_t*)Allocator->allocate(sizeof(build_t));
+            charon::archive_t*        ar     = setup(Allocator, build, charon::archive_t::BackendFileRead, false);
+            charon::archive_loader_t* loader = ar->loader();
+
+            // Without mVerify the changed byte goes unnoticed
+            void* data = loader->load_datafile(charon::fileid_t(1, 1));
+            CHECK_NOT_NULL(data);
+            CHECK_TRUE(memcmp(data, build->mData[1], s_fileSize) != 0);
+            CHECK_EQUAL(0, charon::ntest::counter(charon::telemetry_t::CounterCorrupt));
+            loader->unload_datafile(charon::fileid_t(1, 1), data);
+
+            teardown(ar);
+            Allocator->deallocate(build);
+        }
+    }
+}
+UNITTEST_SUITE_END